@@ -0,0 +1,97 @@
+#ifndef IMP_BENCH_H
+#define IMP_BENCH_H
+
+
+/**
+ * @file bench.h
+ * @brief Timing and hardware counters shared by the benchmarks.
+ *
+ * On Linux, cache misses, branch misses and instructions of the calling
+ * thread are counted with perf_event_open. Counters that are unavailable
+ * (other systems, containers, perf_event_paranoid) are reported as n/a.
+ *
+ * @author Flavian Kaufmann
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+
+#define BENCH_EVENTS 3
+
+/** Counters of a measured run. */
+typedef struct BenchCounters {
+  int fds[BENCH_EVENTS];
+  long long counts[BENCH_EVENTS]; /**< Event counts, or -1 if unavailable. */
+  double start;
+  double seconds;                 /**< Elapsed wall-clock time. */
+} BenchCounters;
+
+static const char *const bench_event_names[BENCH_EVENTS] = { "cache-misses", "branch-misses", "instructions" };
+
+static inline double bench_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static inline void bench_start(BenchCounters *counters) {
+  for (int i = 0; i < BENCH_EVENTS; ++i) {
+    counters->fds[i] = -1;
+    counters->counts[i] = -1;
+  }
+#ifdef __linux__
+  const unsigned long long configs[BENCH_EVENTS] = {
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_INSTRUCTIONS
+  };
+  for (int i = 0; i < BENCH_EVENTS; ++i) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = configs[i];
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    counters->fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (counters->fds[i] >= 0) {
+      ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+#endif
+  counters->start = bench_now();
+}
+
+static inline void bench_stop(BenchCounters *counters) {
+  counters->seconds = bench_now() - counters->start;
+#ifdef __linux__
+  for (int i = 0; i < BENCH_EVENTS; ++i) {
+    if (counters->fds[i] < 0) continue;
+    ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    if (read(counters->fds[i], &counters->counts[i], sizeof(long long)) != sizeof(long long)) counters->counts[i] = -1;
+    close(counters->fds[i]);
+  }
+#endif
+}
+
+static inline void bench_print(const char *label, const BenchCounters *counters) {
+  printf("%-10s %8.3fs", label, counters->seconds);
+  for (int i = 0; i < BENCH_EVENTS; ++i) {
+    if (counters->counts[i] < 0) printf("  %s %12s", bench_event_names[i], "n/a");
+    else printf("  %s %12lld", bench_event_names[i], counters->counts[i]);
+  }
+  printf("\n");
+}
+
+
+#endif /* IMP_BENCH_H */
@@ -0,0 +1,119 @@
+/**
+ * @file dispatch.c
+ * @brief Benchmark of the tree walker against the closure compiler, the bytecode VM and JIT.
+ *
+ * Scales up the given programs by running their statements (all but the
+ * procedure declarations) in a loop, skipping programs that only declare
+ * procedures, and executes them with the recursive tree walker (tracing
+ * disabled), with the closure compiler, with the VM, whose dispatch
+ * (threaded or switch) is fixed at build time, and with the template JIT
+ * (if the host supports it). Reports time, loop iterations per
+ * second and hardware counters of each run (see bench.h).
+ *
+ * @author Flavian Kaufmann
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "ast.h"
+#include "symbol.h"
+#include "resolver.h"
+#include "interpreter.h"
+#include "interpreter_context.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "jit.h"
+#include "closure.h"
+#include "driver.h"
+#include "bench.h"
+
+
+/** Wraps the statements of a program into a loop running iterations times, NULL if it has none. */
+static IMP_ASTNode *scale(IMP_ASTArena *arena, IMP_ASTNode *program, int iterations) {
+  IMP_ASTNode **stmts = program->type == IMP_AST_NT_BLOCK ? program->data.block.stmts : &program;
+  int len = program->type == IMP_AST_NT_BLOCK ? program->data.block.len : 1;
+  IMP_ASTNode **decls = malloc(sizeof(IMP_ASTNode *) * (len + 2));
+  IMP_ASTNode **body = malloc(sizeof(IMP_ASTNode *) * (len + 1));
+  int decls_len = 0, body_len = 0;
+  for (int i = 0; i < len; ++i) {
+    if (stmts[i]->type == IMP_AST_NT_PROCDECL) decls[decls_len++] = stmts[i];
+    else body[body_len++] = stmts[i];
+  }
+  if (!body_len) {
+    free(decls);
+    free(body);
+    return NULL;
+  }
+  const IMP_Symbol *counter = imp_symbol_intern("benchiterations");
+  body[body_len++] = imp_ast_assign(arena, imp_ast_var(arena, counter),
+    imp_ast_aop(arena, IMP_AST_AOP_SUB, imp_ast_var(arena, counter), imp_ast_int(arena, 1)));
+  decls[decls_len++] = imp_ast_assign(arena, imp_ast_var(arena, counter), imp_ast_int(arena, iterations));
+  decls[decls_len++] = imp_ast_while(arena,
+    imp_ast_rop(arena, IMP_AST_ROP_GT, imp_ast_var(arena, counter), imp_ast_int(arena, 0)),
+    imp_ast_block(arena, body, body_len));
+  IMP_ASTNode *scaled = imp_ast_block(arena, decls, decls_len);
+  free(decls);
+  free(body);
+  return scaled;
+}
+
+static void run(const char *label, IMP_ASTNode *program, int iterations, IMP_DriverEngine engine) {
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  imp_tracer_set_threshold(imp_interpreter_context_tracer(context), 0);
+  imp_resolver_resolve(context, program);
+  int bytecode = engine == IMP_DRIVER_ENGINE_VM || engine == IMP_DRIVER_ENGINE_JIT;
+  IMP_BytecodeChunk *chunk = bytecode ? imp_bytecode_compile(context, program) : NULL;
+  IMP_JitCode *code = engine == IMP_DRIVER_ENGINE_JIT ? imp_jit_compile(chunk) : NULL;
+  IMP_ClosureProgram *closures = engine == IMP_DRIVER_ENGINE_CLOSURE ? imp_closure_compile(program) : NULL;
+  BenchCounters counters;
+  bench_start(&counters);
+  int ret;
+  if (closures) ret = imp_closure_run(context, closures);
+  else if (code) ret = imp_jit_run(context, chunk, code);
+  else if (chunk) ret = imp_vm_run(context, chunk);
+  else ret = imp_interpreter_interpret_ast(context, program);
+  bench_stop(&counters);
+  bench_print(label, &counters);
+  printf("%-10s %8.0f iterations/s%s\n", "", iterations / counters.seconds, ret ? " (failed)" : "");
+  imp_closure_destroy(closures);
+  imp_jit_destroy(code);
+  imp_bytecode_destroy(chunk);
+  imp_interpreter_context_destroy(context);
+}
+
+int main(int argc, char **argv) {
+  int iterations = 1000000;
+  int first = 1;
+  if (argc > 2 && argv[1][0] == '-' && argv[1][1] == 'n') {
+    iterations = atoi(argv[2]);
+    first = 3;
+  }
+  if (iterations < 1 || first >= argc) {
+    fprintf(stderr, "Usage: %s [-n iterations] file...\n", argv[0]);
+    return 1;
+  }
+  printf("vm dispatch: %s, %d iterations\n", imp_vm_dispatch(), iterations);
+  for (int i = first; i < argc; ++i) {
+    IMP_ASTArena *arena = imp_ast_arena_create();
+    IMP_ASTNode *program = imp_driver_parse_file(argv[i], arena);
+    if (!program) {
+      fprintf(stderr, "Error: cannot parse %s\n", argv[i]);
+      imp_ast_arena_destroy(arena);
+      return 1;
+    }
+    printf("%s\n", argv[i]);
+    IMP_ASTNode *scaled = scale(arena, program, iterations);
+    if (!scaled) {
+      printf("skipped: no statements besides procedure declarations\n");
+      imp_ast_arena_destroy(arena);
+      continue;
+    }
+    run("ast", scaled, iterations, IMP_DRIVER_ENGINE_AST);
+    run("closure", scaled, iterations, IMP_DRIVER_ENGINE_CLOSURE);
+    run("vm", scaled, iterations, IMP_DRIVER_ENGINE_VM);
+    if (imp_jit_supported()) run("jit", scaled, iterations, IMP_DRIVER_ENGINE_JIT);
+    imp_ast_arena_destroy(arena);
+  }
+  return 0;
+}
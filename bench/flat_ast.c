@@ -0,0 +1,110 @@
+/**
+ * @file flat_ast.c
+ * @brief Benchmark of the pointer-based AST against the flat AST.
+ *
+ * Builds a large program whose loop body does not fit into the cache and
+ * evaluates it as a heap-scattered pointer tree, as an arena-allocated
+ * pointer tree and as a flat AST. Reports time and hardware counters of each
+ * run (see bench.h).
+ *
+ * @author Flavian Kaufmann
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "ast.h"
+#include "symbol.h"
+#include "resolver.h"
+#include "interpreter.h"
+#include "interpreter_context.h"
+#include "flat_ast.h"
+#include "bench.h"
+
+
+#define BENCH_VARS 64
+
+static IMP_ASTNode *var(IMP_ASTArena *arena, int i) {
+  char name[16];
+  snprintf(name, sizeof(name), "v%d", i % BENCH_VARS);
+  return imp_ast_var(arena, imp_symbol_intern(name));
+}
+
+/** Builds a balanced sequence of statements v_k := v_k + v_k+1 * 3 - i. */
+static IMP_ASTNode *body(IMP_ASTArena *arena, int from, int to, void ***garbage) {
+  if (to - from == 1) {
+    if (garbage) {
+      /* scatter the nodes of heap trees like a long running parse would */
+      void *junk = malloc(16 + (size_t)(rand() % 256));
+      **garbage = junk;
+      (*garbage)++;
+    }
+    return imp_ast_assign(arena, var(arena, from),
+      imp_ast_aop(arena, IMP_AST_AOP_SUB,
+        imp_ast_aop(arena, IMP_AST_AOP_ADD, var(arena, from),
+          imp_ast_aop(arena, IMP_AST_AOP_MUL, var(arena, from + 1), imp_ast_int(arena, 3))),
+        imp_ast_var(arena, imp_symbol_intern("i"))));
+  }
+  int mid = from + (to - from) / 2;
+  IMP_ASTNode *fst = body(arena, from, mid, garbage);
+  IMP_ASTNode *snd = body(arena, mid, to, garbage);
+  return imp_ast_seq(arena, fst, snd);
+}
+
+static IMP_ASTNode *program(IMP_ASTArena *arena, int statements, int iterations, void ***garbage) {
+  return imp_ast_seq(arena,
+    imp_ast_assign(arena, imp_ast_var(arena, imp_symbol_intern("i")), imp_ast_int(arena, iterations)),
+    imp_ast_while(arena,
+      imp_ast_rop(arena, IMP_AST_ROP_GT, imp_ast_var(arena, imp_symbol_intern("i")), imp_ast_int(arena, 0)),
+      imp_ast_seq(arena,
+        body(arena, 0, statements, garbage),
+        imp_ast_assign(arena, imp_ast_var(arena, imp_symbol_intern("i")),
+          imp_ast_aop(arena, IMP_AST_AOP_SUB, imp_ast_var(arena, imp_symbol_intern("i")), imp_ast_int(arena, 1))))));
+}
+
+static void run(const char *label, IMP_InterpreterContext *context, IMP_ASTNode *node, const IMP_FlatAST *flat) {
+  BenchCounters counters;
+  bench_start(&counters);
+  if (flat) imp_flat_ast_interpret(context, flat);
+  else imp_interpreter_interpret_ast(context, node);
+  bench_stop(&counters);
+  bench_print(label, &counters);
+}
+
+int main(int argc, char **argv) {
+  int statements = argc > 1 ? atoi(argv[1]) : 200000;
+  int iterations = argc > 2 ? atoi(argv[2]) : 20;
+  if (statements < 1 || iterations < 1) {
+    fprintf(stderr, "Usage: %s [statements] [iterations]\n", argv[0]);
+    return 1;
+  }
+  printf("%d statements, %d iterations\n", statements, iterations);
+
+  void **garbage = malloc(sizeof(void *) * (size_t)statements);
+  void **garbage_end = garbage;
+  IMP_InterpreterContext *heap_context = imp_interpreter_context_create();
+  IMP_ASTNode *heap = program(NULL, statements, iterations, &garbage_end);
+  imp_resolver_resolve(heap_context, heap);
+  run("heap", heap_context, heap, NULL);
+
+  IMP_ASTArena *arena = imp_ast_arena_create();
+  IMP_InterpreterContext *arena_context = imp_interpreter_context_create();
+  IMP_ASTNode *arena_tree = program(arena, statements, iterations, NULL);
+  imp_resolver_resolve(arena_context, arena_tree);
+  run("arena", arena_context, arena_tree, NULL);
+
+  IMP_InterpreterContext *flat_context = imp_interpreter_context_create();
+  imp_resolver_resolve(flat_context, arena_tree);
+  IMP_FlatAST *flat = imp_flat_ast_from_ast(arena_tree, flat_context);
+  run("flat", flat_context, NULL, flat);
+
+  imp_flat_ast_destroy(flat);
+  imp_interpreter_context_destroy(flat_context);
+  imp_interpreter_context_destroy(arena_context);
+  imp_ast_arena_destroy(arena);
+  imp_interpreter_context_destroy(heap_context);
+  imp_ast_destroy(heap);
+  while (garbage_end > garbage) free(*--garbage_end);
+  free(garbage);
+  return 0;
+}
@@ -7,6 +7,9 @@
  *
  * Provides data structures, enums, and functions for creating, managing, cloning, and freeing AST nodes.
  *
+ * Nodes are either allocated individually on the heap (arena NULL), and freed with imp_ast_destroy,
+ * or bump-allocated in an arena, and freed all at once with imp_ast_arena_destroy.
+ *
  * @author Flavian Kaufmann
  */
 
@@ -16,6 +19,7 @@ typedef enum {
   IMP_AST_NT_SKIP,        /**< No-operation (skip) */
   IMP_AST_NT_ASSIGN,      /**< Assignment statement */
   IMP_AST_NT_SEQ,         /**< Sequential composition of statements */
+  IMP_AST_NT_BLOCK,       /**< Block of statements executed in order */
   IMP_AST_NT_IF,          /**< Conditional (if-then-else) statement */
   IMP_AST_NT_WHILE,       /**< While loop statement */
   IMP_AST_NT_INT,         /**< Integer literal */
@@ -52,6 +56,22 @@ typedef enum {
   IMP_AST_ROP_GE  /**< Greater or equal (>=) */
 } IMP_ASTRelationalOperator;
 
+/** Operand kinds of an arithmetic or relational operation, recorded in place by the tree walker on its first execution. */
+typedef enum {
+  IMP_AST_QUICK_NONE,    /**< Not executed yet */
+  IMP_AST_QUICK_GENERIC, /**< Operands evaluated recursively */
+  IMP_AST_QUICK_VAR_VAR, /**< Variable and variable */
+  IMP_AST_QUICK_VAR_INT, /**< Variable and integer literal */
+  IMP_AST_QUICK_INT_VAR  /**< Integer literal and variable */
+} IMP_ASTQuickening;
+
+#include <stddef.h>
+
+#include "symbol.h"
+
+/** Opaque type representing an arena owning AST nodes and lists. */
+typedef struct IMP_ASTArena IMP_ASTArena;
+
 /** Forward declaration for linked-list structure. */
 struct IMP_ASTNodeList;
 
@@ -62,17 +82,18 @@ typedef struct IMP_ASTNode {
   union {
     struct { struct IMP_ASTNode *var, *aexpr; } assign;
     struct { struct IMP_ASTNode *fst_stmt, *snd_stmt; } seq;
+    struct { struct IMP_ASTNode **stmts; int len; } block;
     struct { struct IMP_ASTNode *cond_bexpr, *then_stmt, *else_stmt; } if_stmt;
     struct { struct IMP_ASTNode *cond_bexpr, *body_stmt; } while_stmt;
     struct { int val; } integer;
-    struct { char *name; } variable;
-    struct { IMP_ASTArithmeticOperator aopr; struct IMP_ASTNode *l_aexpr, *r_aexpr; } arith_op;
+    struct { const IMP_Symbol *symbol; int slot; } variable;
+    struct { IMP_ASTArithmeticOperator aopr; struct IMP_ASTNode *l_aexpr, *r_aexpr; IMP_ASTQuickening quick; } arith_op;
     struct { IMP_ASTBooleanOperator bopr; struct IMP_ASTNode *l_bexpr, *r_bexpr; } bool_op;
     struct { struct IMP_ASTNode *bexpr; } bool_not;
-    struct { IMP_ASTRelationalOperator ropr; struct IMP_ASTNode *l_aexpr, *r_aexpr; } rel_op;
+    struct { IMP_ASTRelationalOperator ropr; struct IMP_ASTNode *l_aexpr, *r_aexpr; IMP_ASTQuickening quick; } rel_op;
     struct { struct IMP_ASTNode *var, *aexpr, *body_stmt; } let_stmt;
-    struct { char *name; struct IMP_ASTNodeList *val_args, *var_args; struct IMP_ASTNode *body_stmt; } proc_decl;
-    struct { char *name; struct IMP_ASTNodeList *val_args, *var_args; } proc_call;
+    struct { const IMP_Symbol *symbol; struct IMP_ASTNodeList *val_args, *var_args; struct IMP_ASTNode *body_stmt; int frame_size; } proc_decl;
+    struct { const IMP_Symbol *symbol; struct IMP_ASTNodeList *val_args, *var_args; const struct IMP_ASTNode *procdecl; unsigned long proc_epoch; } proc_call;
   } data;
 } IMP_ASTNode;
 
@@ -82,49 +103,78 @@ typedef struct IMP_ASTNodeList {
   struct IMP_ASTNodeList *next;       /**< Pointer to the next node in the list. */
 } IMP_ASTNodeList;
 
+/* === AST Arena Functions === */
+
+/**
+ * Creates an empty arena.
+ *
+ * @return Pointer to the arena; must be freed by the caller.
+ */
+IMP_ASTArena *imp_ast_arena_create(void);
+
+/**
+ * Frees an arena together with all nodes and lists allocated in it.
+ *
+ * @param arena Arena to free.
+ */
+void imp_ast_arena_destroy(IMP_ASTArena *arena);
+
+/**
+ * Retrieves the number of bytes allocated in an arena.
+ *
+ * @param arena The arena.
+ * @return Number of bytes handed out by the arena.
+ */
+size_t imp_ast_arena_bytes(const IMP_ASTArena *arena);
+
 /* === AST Node Creation Functions === */
 
+/* All creation functions allocate in the given arena, or on the heap if arena is NULL. */
+
 /** Creates a 'skip' node (no-operation). */
-IMP_ASTNode *imp_ast_skip(void);
+IMP_ASTNode *imp_ast_skip(IMP_ASTArena *arena);
 
 /** Creates an assignment node. */
-IMP_ASTNode *imp_ast_assign(IMP_ASTNode *var, IMP_ASTNode *aexpr);
+IMP_ASTNode *imp_ast_assign(IMP_ASTArena *arena, IMP_ASTNode *var, IMP_ASTNode *aexpr);
 
 /** Creates a sequence node (statement sequencing). */
-IMP_ASTNode *imp_ast_seq(IMP_ASTNode *fst_stmt, IMP_ASTNode *snd_stmt);
+IMP_ASTNode *imp_ast_seq(IMP_ASTArena *arena, IMP_ASTNode *fst_stmt, IMP_ASTNode *snd_stmt);
+
+/** Creates a block node of len statements. (Statement array is copied internally.) */
+IMP_ASTNode *imp_ast_block(IMP_ASTArena *arena, IMP_ASTNode **stmts, int len);
 
 /** Creates an if-then-else node. */
-IMP_ASTNode *imp_ast_if(IMP_ASTNode *cond_bexpr, IMP_ASTNode *then_stmt, IMP_ASTNode *else_stmt);
+IMP_ASTNode *imp_ast_if(IMP_ASTArena *arena, IMP_ASTNode *cond_bexpr, IMP_ASTNode *then_stmt, IMP_ASTNode *else_stmt);
 
 /** Creates a while loop node. */
-IMP_ASTNode *imp_ast_while(IMP_ASTNode *cond_bexpr, IMP_ASTNode *body_stmt);
+IMP_ASTNode *imp_ast_while(IMP_ASTArena *arena, IMP_ASTNode *cond_bexpr, IMP_ASTNode *body_stmt);
 
 /** Creates an integer literal node. */
-IMP_ASTNode *imp_ast_int(int val);
+IMP_ASTNode *imp_ast_int(IMP_ASTArena *arena, int val);
 
-/** Creates a variable reference node. (Name is copied internally.) */
-IMP_ASTNode *imp_ast_var(const char *name);
+/** Creates a variable reference node. (Slot is unresolved.) */
+IMP_ASTNode *imp_ast_var(IMP_ASTArena *arena, const IMP_Symbol *symbol);
 
 /** Creates an arithmetic operation node. */
-IMP_ASTNode *imp_ast_aop(IMP_ASTArithmeticOperator aopr, IMP_ASTNode *l_aexpr, IMP_ASTNode *r_aexpr);
+IMP_ASTNode *imp_ast_aop(IMP_ASTArena *arena, IMP_ASTArithmeticOperator aopr, IMP_ASTNode *l_aexpr, IMP_ASTNode *r_aexpr);
 
 /** Creates a boolean operation node. */
-IMP_ASTNode *imp_ast_bop(IMP_ASTBooleanOperator bopr, IMP_ASTNode *l_bexpr, IMP_ASTNode *r_bexpr);
+IMP_ASTNode *imp_ast_bop(IMP_ASTArena *arena, IMP_ASTBooleanOperator bopr, IMP_ASTNode *l_bexpr, IMP_ASTNode *r_bexpr);
 
 /** Creates a boolean negation node. */
-IMP_ASTNode *imp_ast_not(IMP_ASTNode *bexpr);
+IMP_ASTNode *imp_ast_not(IMP_ASTArena *arena, IMP_ASTNode *bexpr);
 
 /** Creates a relational operation node. */
-IMP_ASTNode *imp_ast_rop(IMP_ASTRelationalOperator ropr, IMP_ASTNode *l_aexpr, IMP_ASTNode *r_aexpr);
+IMP_ASTNode *imp_ast_rop(IMP_ASTArena *arena, IMP_ASTRelationalOperator ropr, IMP_ASTNode *l_aexpr, IMP_ASTNode *r_aexpr);
 
 /** Creates a let-in-end (local variable declaration) node. */
-IMP_ASTNode *imp_ast_let(IMP_ASTNode *var, IMP_ASTNode *aexpr, IMP_ASTNode *body_stmt);
+IMP_ASTNode *imp_ast_let(IMP_ASTArena *arena, IMP_ASTNode *var, IMP_ASTNode *aexpr, IMP_ASTNode *body_stmt);
 
-/** Creates a procedure declaration node. (Name is copied internally.) */
-IMP_ASTNode *imp_ast_procdecl(const char *name, IMP_ASTNodeList *val_args, IMP_ASTNodeList *var_args, IMP_ASTNode *body_stmt);
+/** Creates a procedure declaration node. */
+IMP_ASTNode *imp_ast_procdecl(IMP_ASTArena *arena, const IMP_Symbol *symbol, IMP_ASTNodeList *val_args, IMP_ASTNodeList *var_args, IMP_ASTNode *body_stmt);
 
-/** Creates a procedure call node. (Name is copied internally.) */
-IMP_ASTNode *imp_ast_proccall(const char *name, IMP_ASTNodeList *val_args, IMP_ASTNodeList *var_args);
+/** Creates a procedure call node. */
+IMP_ASTNode *imp_ast_proccall(IMP_ASTArena *arena, const IMP_Symbol *symbol, IMP_ASTNodeList *val_args, IMP_ASTNodeList *var_args);
 
 /* === AST Utility Functions === */
 
@@ -132,27 +182,31 @@ IMP_ASTNode *imp_ast_proccall(const char *name, IMP_ASTNodeList *val_args, IMP_A
  * Creates a deep copy of the given AST node and all its sub-nodes.
  *
  * @param node Node to clone.
- * @return Pointer to cloned node; must be freed by the caller.
+ * @param arena Arena to clone into, or NULL to clone onto the heap.
+ * @return Pointer to cloned node; must be freed by the caller if arena is NULL.
  */
-IMP_ASTNode *imp_ast_clone(const IMP_ASTNode *node);
+IMP_ASTNode *imp_ast_clone(const IMP_ASTNode *node, IMP_ASTArena *arena);
 
 /**
  * Frees an AST node and recursively all its sub-nodes.
  *
  * @param node Node to free.
+ *
+ * @note Only for nodes allocated on the heap, nodes in an arena are freed with the arena.
  */
 void imp_ast_destroy(IMP_ASTNode *node);
 
 /**
  * Creates a new linked list of AST nodes.
  *
+ * @param arena Arena to allocate the list cell in, or NULL for the heap.
  * @param node Node to prepend to the list.
  * @param list Existing list or NULL if starting a new one.
  * @return New head of the list.
  *
  * @note Ownership of the list nodes is transferred; freed automatically when parent AST node is freed.
  */
-IMP_ASTNodeList *imp_ast_list(IMP_ASTNode *node, IMP_ASTNodeList *list);
+IMP_ASTNodeList *imp_ast_list(IMP_ASTArena *arena, IMP_ASTNode *node, IMP_ASTNodeList *list);
 
 /**
  * Frees a linked list of AST nodes. Typically not required directly, as it's freed with the parent AST node.
@@ -0,0 +1,134 @@
+#ifndef IMP_BYTECODE_H
+#define IMP_BYTECODE_H
+
+
+/**
+ * @file bytecode.h
+ * @brief Compiler from resolved IMP ASTs to a linear, stack-based instruction stream.
+ *
+ * A chunk holds the code of the top-level program, followed by the bodies of
+ * all procedures it may call. Expressions operate on a value stack, variables
+ * are addressed by the frame slots assigned by the resolver.
+ *
+ * @author Flavian Kaufmann
+ */
+
+
+#include "ast.h"
+#include "interpreter_context.h"
+
+
+/** Instruction opcodes. */
+typedef enum {
+  IMP_OP_PUSH,  /**< Push immediate arg */
+  IMP_OP_LOAD,  /**< Push frame slot arg */
+  IMP_OP_STORE, /**< Pop into frame slot arg */
+  IMP_OP_ADD,   /**< Pop r, l; push l + r */
+  IMP_OP_SUB,   /**< Pop r, l; push l - r */
+  IMP_OP_MUL,   /**< Pop r, l; push l * r */
+  IMP_OP_EQ,    /**< Pop r, l; push l == r */
+  IMP_OP_NE,    /**< Pop r, l; push l != r */
+  IMP_OP_LT,    /**< Pop r, l; push l < r */
+  IMP_OP_LE,    /**< Pop r, l; push l <= r */
+  IMP_OP_GT,    /**< Pop r, l; push l > r */
+  IMP_OP_GE,    /**< Pop r, l; push l >= r */
+  IMP_OP_AND,   /**< Pop r, l; push l && r */
+  IMP_OP_OR,    /**< Pop r, l; push l || r */
+  IMP_OP_NOT,   /**< Pop v; push !v */
+  IMP_OP_JMP,   /**< Jump to instruction arg */
+  IMP_OP_JZ,    /**< Pop v; jump to instruction arg if v is 0 */
+  IMP_OP_DECL,  /**< Declare procedure arg */
+  IMP_OP_CALL,  /**< Call with call site arg, popping its value arguments */
+  IMP_OP_RET,   /**< Return from procedure, copying out variable arguments */
+  IMP_OP_HALT,  /**< End of top-level program */
+  /* Superinstructions, selected while lowering common statement shapes. */
+  IMP_OP_INC,   /**< Add immediate arg2 to frame slot arg (x := x + c, x := x - c) */
+  IMP_OP_ADDVV, /**< Frame slot arg = slot arg2 + slot arg3 */
+  IMP_OP_SUBVV, /**< Frame slot arg = slot arg2 - slot arg3 */
+  IMP_OP_MULVV, /**< Frame slot arg = slot arg2 * slot arg3 */
+  IMP_OP_JZ_EQ, /**< Jump to instruction arg3 unless frame slot arg == immediate arg2 */
+  IMP_OP_JZ_NE, /**< Jump to instruction arg3 unless frame slot arg != immediate arg2 */
+  IMP_OP_JZ_LT, /**< Jump to instruction arg3 unless frame slot arg < immediate arg2 */
+  IMP_OP_JZ_LE, /**< Jump to instruction arg3 unless frame slot arg <= immediate arg2 */
+  IMP_OP_JZ_GT, /**< Jump to instruction arg3 unless frame slot arg > immediate arg2 */
+  IMP_OP_JZ_GE, /**< Jump to instruction arg3 unless frame slot arg >= immediate arg2 */
+  IMP_OP_COUNT  /**< Number of opcodes */
+} IMP_Opcode;
+
+/** A single instruction. */
+typedef struct IMP_Instruction {
+  IMP_Opcode op; /**< Opcode. */
+  int arg;       /**< Immediate, slot, jump target, procedure or call site index. */
+  int arg2;      /**< Second operand of superinstructions. */
+  int arg3;      /**< Third operand of superinstructions. */
+} IMP_Instruction;
+
+/** A procedure compiled into a chunk. */
+typedef struct IMP_BytecodeProc {
+  const IMP_ASTNode *decl; /**< Procedure declaration (borrowed from program or context). */
+  int entry;               /**< Index of the first instruction of the body. */
+  int frame_size;          /**< Number of slots of an activation frame. */
+  int val_argc;            /**< Number of value arguments. */
+  int var_argc;            /**< Number of variable arguments. */
+  int *val_slots;          /**< Callee slots of the value arguments. */
+  int *var_slots;          /**< Callee slots of the variable arguments. */
+  int predeclared;         /**< Whether the procedure was already declared in the context. */
+} IMP_BytecodeProc;
+
+/** A procedure call site. */
+typedef struct IMP_BytecodeCall {
+  const IMP_Symbol *symbol; /**< Name of the called procedure. */
+  int proc;                /**< Index of the called procedure, or -1 if it is never declared. */
+  int val_argc;            /**< Number of value arguments passed. */
+  int var_argc;            /**< Number of variable arguments passed. */
+  int *var_slots;          /**< Caller slots receiving the variable arguments. */
+} IMP_BytecodeCall;
+
+/** A compiled program. */
+typedef struct IMP_BytecodeChunk {
+  IMP_Instruction *code;   /**< Instructions; top-level program starts at 0. */
+  int code_len;            /**< Number of instructions. */
+  IMP_BytecodeProc *procs; /**< Procedures. */
+  int procs_len;           /**< Number of procedures. */
+  IMP_BytecodeCall *calls; /**< Call sites. */
+  int calls_len;           /**< Number of call sites. */
+  int max_stack;           /**< Maximum depth of the value stack. */
+} IMP_BytecodeChunk;
+
+/**
+ * Compiles a resolved AST node into a chunk.
+ *
+ * @param context The interpreter context, used to look up procedures declared by earlier programs.
+ * @param node AST node to compile.
+ * @return Pointer to the compiled chunk; must be freed by the caller.
+ *
+ * @note The chunk borrows procedure declarations from the AST node and the context.
+ */
+IMP_BytecodeChunk *imp_bytecode_compile(IMP_InterpreterContext *context, const IMP_ASTNode *node);
+
+/**
+ * Retrieves the mnemonic of an opcode.
+ *
+ * @param op The opcode.
+ * @return Lower-case name of the opcode, e.g. "jz_ne".
+ */
+const char *imp_bytecode_opcode_name(IMP_Opcode op);
+
+/**
+ * Counts the instructions of a chunk with a given opcode.
+ *
+ * @param chunk The chunk.
+ * @param op The opcode.
+ * @return Number of instructions with the opcode.
+ */
+int imp_bytecode_count(const IMP_BytecodeChunk *chunk, IMP_Opcode op);
+
+/**
+ * Frees a chunk.
+ *
+ * @param chunk Chunk to free.
+ */
+void imp_bytecode_destroy(IMP_BytecodeChunk *chunk);
+
+
+#endif /* IMP_BYTECODE_H */
@@ -0,0 +1,54 @@
+#ifndef IMP_CLOSURE_H
+#define IMP_CLOSURE_H
+
+
+/**
+ * @file closure.h
+ * @brief Closure compiler, turning resolved IMP ASTs into a graph of pre-bound function pointers.
+ *
+ * Every node becomes a closure holding a function specialised for its
+ * operator and the kinds of its operands (e.g. add_var_int for x + 1),
+ * with its leaf operands (slots, constants) and child closures bound in
+ * advance. Executing a closure calls its function directly, without
+ * switching on the node type or operator. Constant subexpressions are
+ * folded while compiling. Procedure bodies are compiled on their first call.
+ *
+ * @author Flavian Kaufmann
+ */
+
+
+#include "ast.h"
+#include "interpreter_context.h"
+
+
+/** Opaque type representing a compiled program. */
+typedef struct IMP_ClosureProgram IMP_ClosureProgram;
+
+/**
+ * Compiles a resolved AST node into closures.
+ *
+ * @param node AST node to compile.
+ * @return Pointer to the compiled program; must be freed by the caller.
+ *
+ * @note The program borrows procedure declarations from the AST node and, once run, the context.
+ */
+IMP_ClosureProgram *imp_closure_compile(const IMP_ASTNode *node);
+
+/**
+ * Executes a compiled program within a given context.
+ *
+ * @param context The interpreter context the AST node was resolved against.
+ * @param program The compiled program.
+ * @return Status code (0 for success, non-zero for error).
+ */
+int imp_closure_run(IMP_InterpreterContext *context, IMP_ClosureProgram *program);
+
+/**
+ * Frees a compiled program, including the procedure bodies it compiled.
+ *
+ * @param program Program to free.
+ */
+void imp_closure_destroy(IMP_ClosureProgram *program);
+
+
+#endif /* IMP_CLOSURE_H */
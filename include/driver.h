@@ -1,13 +1,59 @@
 #ifndef IMP_DRIVER_H
 #define IMP_DRIVER_H
 
+#include "ast.h"
 #include "interpreter_context.h"
+#include "optimizer.h"
 
-int imp_driver_interpret_file (IMP_InterpreterContext *context, const char *path);
-int imp_driver_interpret_str (IMP_InterpreterContext *context, const char *str);
-int imp_driver_print_ast_file (const char *path);
+/** Execution engines. */
+typedef enum {
+  IMP_DRIVER_ENGINE_AST,   /**< Tree-walking interpreter */
+  IMP_DRIVER_ENGINE_STACK, /**< Tree-walking interpreter with a heap-allocated work stack */
+  IMP_DRIVER_ENGINE_VM,    /**< Bytecode compiler and virtual machine */
+  IMP_DRIVER_ENGINE_FLAT,  /**< Tree-walking interpreter over a flat, index-based AST */
+  IMP_DRIVER_ENGINE_JIT,   /**< Bytecode compiler and x86-64 template JIT, falling back to the VM */
+  IMP_DRIVER_ENGINE_CLOSURE, /**< Closure compiler, executing pre-bound specialised function pointers */
+  IMP_DRIVER_ENGINE_IR     /**< Interpreter of the SSA-form IR, optimized by the default passes */
+} IMP_DriverEngine;
+
+/** Options controlling how programs are executed. */
+typedef struct IMP_DriverOptions {
+  IMP_DriverEngine engine; /**< Execution engine. */
+  size_t stack_limit;      /**< Memory limit of each execution stack in bytes (0 for no limit). */
+  int fused_report;        /**< Whether the bytecode engines (vm, jit) report the superinstructions selected. */
+  int trace_threshold;     /**< Back-edges after which the ast engine traces a loop (0 disables tracing). */
+  int trace_stats;         /**< Whether the ast engine reports tracing statistics. */
+  int optimize;            /**< Whether programs are optimized before they are executed or printed (see optimizer.h). */
+  int optimize_stats;      /**< Whether the optimizer reports what it did. */
+  IMP_OptimizerOptions optimizer; /**< Options of the optimizer. */
+} IMP_DriverOptions;
+
+/** Default options, used whenever NULL is passed as options. */
+extern const IMP_DriverOptions imp_driver_default_options;
+
+/**
+ * Parses a file into an AST.
+ *
+ * @param path Path of the file.
+ * @param arena Arena to allocate the AST in.
+ * @return Root of the AST, or NULL if the file cannot be read or parsed.
+ */
+IMP_ASTNode *imp_driver_parse_file (const char *path, IMP_ASTArena *arena);
+
+int imp_driver_interpret_file (IMP_InterpreterContext *context, const char *path, const IMP_DriverOptions *options);
+int imp_driver_interpret_str (IMP_InterpreterContext *context, const char *str, const IMP_DriverOptions *options);
+int imp_driver_print_ast_file (const char *path, const IMP_DriverOptions *options);
+
+/**
+ * Prints the IR of a file, as the ir engine runs it in a fresh context.
+ *
+ * @param path Path of the file.
+ * @param options Options (optimize, optimizer), or NULL for the defaults.
+ * @return Status code (0 for success, non-zero for error).
+ */
+int imp_driver_print_ir_file (const char *path, const IMP_DriverOptions *options);
 
 void imp_driver_print_var_table(IMP_InterpreterContext *context);
 void imp_driver_print_proc_table(IMP_InterpreterContext *context);
 
-#endif /* IMP_DRIVER_H */
\ No newline at end of file
+#endif /* IMP_DRIVER_H */
@@ -0,0 +1,102 @@
+#ifndef IMP_FLAT_AST_H
+#define IMP_FLAT_AST_H
+
+
+/**
+ * @file flat_ast.h
+ * @brief Flat, index-based representation of IMP ASTs.
+ *
+ * All nodes of a program are stored contiguously in a single array in the
+ * order in which the interpreter visits them (pre-order, so the first child
+ * of a node directly follows it). Children are referenced by 32-bit indices,
+ * names by symbol id, and the argument lists of procedures by offsets into
+ * a side array of extra data.
+ *
+ * Node fields by type:
+ * - ASSIGN: a = var, b = aexpr
+ * - SEQ: a = fst_stmt, b = snd_stmt
+ * - BLOCK: a = extra offset of [len, stmts...]
+ * - IF: a = cond_bexpr, b = then_stmt, c = else_stmt
+ * - WHILE: a = cond_bexpr, b = body_stmt
+ * - INT: a = val
+ * - VAR: a = symbol, b = slot
+ * - AOP, BOP, ROP: op = operator, a = left, b = right
+ * - NOT: a = bexpr
+ * - LET: a = var, b = aexpr, c = body_stmt
+ * - PROCDECL: a = symbol, b = body_stmt, c = extra offset of
+ *   [val_argc, var_argc, frame_size, decl id, val_args..., var_args...]
+ * - PROCCALL: a = symbol, b = extra offset of
+ *   [val_argc, var_argc, called PROCDECL node or -1, val_args..., var_args...]
+ *
+ * @author Flavian Kaufmann
+ */
+
+
+#include <stdint.h>
+
+#include "ast.h"
+#include "interpreter_context.h"
+
+
+/** A node of a flat AST. */
+typedef struct IMP_FlatNode {
+  uint8_t type;          /**< Type of the node (IMP_ASTNodeType). */
+  uint8_t op;            /**< Operator of AOP, BOP and ROP nodes. */
+  int32_t a, b, c;       /**< Type dependent fields, see file description. */
+} IMP_FlatNode;
+
+/** A flat AST. */
+typedef struct IMP_FlatAST {
+  IMP_FlatNode *nodes;   /**< Nodes in pre-order. */
+  int32_t nodes_len;     /**< Number of nodes. */
+  int32_t *extra;        /**< Argument lists of procedure declarations and calls. */
+  int32_t extra_len;     /**< Number of extra entries. */
+  const IMP_Symbol **symbols; /**< Names by symbol id. */
+  int32_t symbols_len;   /**< Number of symbols. */
+  int32_t *decls;        /**< PROCDECL nodes by decl id. */
+  int32_t decls_len;     /**< Number of procedure declarations. */
+  int32_t root;          /**< Root node of the program. */
+  int32_t predeclared;   /**< Decl ids from this one on were already declared in the context. */
+} IMP_FlatAST;
+
+/**
+ * Converts a resolved AST into a flat AST.
+ *
+ * Procedure calls are linked against the procedures of the context, which are
+ * appended to the flat AST as extra roots, or else against the first declaration
+ * of the program.
+ *
+ * @param node AST node to convert.
+ * @param context Context to link against, or NULL to link against the program only.
+ * @return Pointer to the flat AST; must be freed by the caller.
+ */
+IMP_FlatAST *imp_flat_ast_from_ast(const IMP_ASTNode *node, IMP_InterpreterContext *context);
+
+/**
+ * Converts (a subtree of) a flat AST back into an AST.
+ *
+ * @param flat The flat AST.
+ * @param index Node to convert, e.g. the root of the flat AST.
+ * @param arena Arena to allocate in, or NULL for the heap.
+ * @return The AST node.
+ */
+IMP_ASTNode *imp_flat_ast_to_ast(const IMP_FlatAST *flat, int32_t index, IMP_ASTArena *arena);
+
+/**
+ * Frees a flat AST.
+ *
+ * @param flat Flat AST to free.
+ */
+void imp_flat_ast_destroy(IMP_FlatAST *flat);
+
+/**
+ * Evaluates the root of a flat AST within a given context.
+ *
+ * @param context The interpreter context, the AST was resolved and linked against.
+ * @param flat The flat AST.
+ * @return Status code (0 for success, non-zero for error).
+ */
+int imp_flat_ast_interpret(IMP_InterpreterContext *context, const IMP_FlatAST *flat);
+
+
+#endif /* IMP_FLAT_AST_H */
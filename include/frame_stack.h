@@ -0,0 +1,72 @@
+#ifndef IMP_FRAME_STACK_H
+#define IMP_FRAME_STACK_H
+
+
+/**
+ * @file frame_stack.h
+ * @brief Stack allocator for procedure activation frames.
+ *
+ * Frames are carved out of large contiguous blocks and popped in LIFO order.
+ * Blocks are kept for reuse once allocated, so steady-state procedure calls
+ * do not touch the heap. Frames never move, pointers to them stay valid
+ * until they are popped.
+ *
+ * @author Flavian Kaufmann
+ */
+
+
+#include <stddef.h>
+
+
+/** Opaque type representing a frame stack. */
+typedef struct IMP_FrameStack IMP_FrameStack;
+
+/**
+ * Creates an empty frame stack.
+ *
+ * @return Pointer to the frame stack; must be freed by the caller.
+ */
+IMP_FrameStack *imp_frame_stack_create(void);
+
+/**
+ * Frees a frame stack and all its blocks.
+ *
+ * @param stack Frame stack to free.
+ */
+void imp_frame_stack_destroy(IMP_FrameStack *stack);
+
+/**
+ * Limits the total size of the blocks of a frame stack.
+ *
+ * @param stack The frame stack.
+ * @param limit Maximum number of bytes, or 0 for no limit.
+ */
+void imp_frame_stack_set_limit(IMP_FrameStack *stack, size_t limit);
+
+/**
+ * Pushes a zero-initialised frame.
+ *
+ * @param stack The frame stack.
+ * @param size Number of slots of the frame.
+ * @return Pointer to the first slot of the frame, or NULL if the limit would be exceeded.
+ */
+int *imp_frame_stack_push(IMP_FrameStack *stack, int size);
+
+/**
+ * Pops the topmost frame.
+ *
+ * @param stack The frame stack.
+ * @param frame The frame returned by the matching push.
+ */
+void imp_frame_stack_pop(IMP_FrameStack *stack, int *frame);
+
+/**
+ * Retrieves the number of blocks allocated by the frame stack so far.
+ *
+ * @param stack The frame stack.
+ * @return Number of heap allocations performed.
+ */
+size_t imp_frame_stack_allocations(const IMP_FrameStack *stack);
+
+
+#endif /* IMP_FRAME_STACK_H */
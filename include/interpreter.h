@@ -12,6 +12,7 @@
 
 #include "ast.h"
 #include "interpreter_context.h"
+#include "ir.h"
 
 
 /**
@@ -22,9 +23,40 @@
  * @return Status code or result of evaluation. (0 for success, non-zero for error).
  *
  * @note The interpreter does neither take ownership of the context nor the AST node.
+ * @note The AST node must have been resolved against the context (see imp_resolver_resolve).
+ * @note Hot while loops are traced by the tracer of the context (see trace.h); the traces are
+ *       dropped when the evaluation returns.
+ * @note Operations and procedure calls are quickened in place on their first execution: operations
+ *       record the kinds of their operands, procedure calls cache the declaration they resolve to
+ *       (revalidated against imp_interpreter_context_proc_epoch).
  */
 int imp_interpreter_interpret_ast(IMP_InterpreterContext *context, const IMP_ASTNode *node);
 
+/**
+ * Evaluates an AST node within a given context, without recursing on the C stack for statements.
+ *
+ * Pending statements and procedure returns are kept on a heap-allocated work stack,
+ * so the depth of recursion is only bounded by the stack limit of the context.
+ *
+ * @param context The interpreter context.
+ * @param node AST node to evaluate.
+ * @return Status code or result of evaluation. (0 for success, non-zero for error).
+ *
+ * @note Same ownership and resolution requirements as imp_interpreter_interpret_ast.
+ */
+int imp_interpreter_interpret_ast_iterative(IMP_InterpreterContext *context, const IMP_ASTNode *node);
+
+/**
+ * Executes the IR of a program within a given context.
+ *
+ * Each function runs with its values in a register frame pushed onto the frame stack of the
+ * context, next to the frame of the procedure. Procedures are built into IR on their first call.
+ *
+ * @param context The interpreter context the AST node of the program was resolved against.
+ * @param program The IR of the program (see imp_ir_build).
+ * @return Status code or result of evaluation. (0 for success, non-zero for error).
+ */
+int imp_interpreter_interpret_ir(IMP_InterpreterContext *context, IMP_IRProgram *program);
 
 
 #endif /* IMP_INTERPRETER_H */
\ No newline at end of file
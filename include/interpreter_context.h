@@ -6,12 +6,19 @@
  * @brief Defines the context structure for the IMP interpreter.
  *
  * Provides the interface for managing the interpreter state, specifically
- * the variable and procedure environments.
+ * the variable and procedure environments. Variables live in a flat frame
+ * of slots, named variables are mapped to their slot by the context.
+ * Variables and procedures are keyed by interned symbols (see symbol.h).
+ * The procedure table is the program-wide namespace shared by all procedure
+ * activations; procedure bodies run against their own frames.
  *
  * Author: Flavian Kaufmann
  */
 
 #include "ast.h"
+#include "symbol.h"
+#include "frame_stack.h"
+#include "trace.h"
 
 /**
  * @brief Opaque type representing the interpreter context.
@@ -32,7 +39,7 @@ typedef struct IMP_InterpreterContextProcIter IMP_InterpreterContextProcIter;
  * @brief A single variable entry in the interpreter's environment.
  */
 typedef struct IMP_InterpreterContextVarTableEntry {
-  const char *key;  /**< The variable name (identifier). */
+  const IMP_Symbol *key;  /**< The variable name (identifier). */
   int value;        /**< The value associated with the variable. */
 } IMP_InterpreterContextVarTableEntry;
 
@@ -40,7 +47,7 @@ typedef struct IMP_InterpreterContextVarTableEntry {
  * @brief A single procedure entry in the interpreter's environment.
  */
 typedef struct IMP_InterpreterContextProcTableEntry {
-  const char *key;             /**< The procedure name (identifier). */
+  const IMP_Symbol *key;       /**< The procedure name (identifier). */
   const IMP_ASTNode *value;    /**< The AST node representing the procedure declaration. */
 } IMP_InterpreterContextProcTableEntry;
 
@@ -62,40 +69,114 @@ void imp_interpreter_context_destroy(IMP_InterpreterContext *context);
  * @brief Retrieves the value of a variable from the context.
  * 
  * @param context The interpreter context.
- * @param name The name of the variable. (Is copied internally.)
+ * @param name The name of the variable.
  * @return The value of the variable. Returns 0 if the variable is not found.
  */
-int imp_interpreter_context_var_get(IMP_InterpreterContext *context, const char *name);
+int imp_interpreter_context_var_get(IMP_InterpreterContext *context, const IMP_Symbol *name);
 
 /**
  * @brief Sets or updates the value of a variable in the context.
  * 
  * @param context The interpreter context.
- * @param name The name of the variable. (Is copied internally.)
- * @param value The value to assign. (If value is 0, the variable is removed from the context.)
+ * @param name The name of the variable.
+ * @param value The value to assign. (Variables stay resident once set, assigning to an
+ *              existing variable never allocates. Variables with value 0 are not iterated.)
  */
-void imp_interpreter_context_var_set(IMP_InterpreterContext *context, const char *name, int value);
+void imp_interpreter_context_var_set(IMP_InterpreterContext *context, const IMP_Symbol *name, int value);
+
+/**
+ * @brief Retrieves the frame slot of a named variable, allocating a new slot if the name is unknown.
+ * 
+ * @param context The interpreter context.
+ * @param name The name of the variable.
+ * @return The slot index of the variable in the frame of the context.
+ */
+int imp_interpreter_context_var_slot(IMP_InterpreterContext *context, const IMP_Symbol *name);
+
+/**
+ * @brief Retrieves the frame of the context, a flat array of variable values indexed by slot.
+ * 
+ * @param context The interpreter context.
+ * @return Pointer to the first slot. (Is invalid once the frame is resized.)
+ */
+int *imp_interpreter_context_frame(IMP_InterpreterContext *context);
+
+/**
+ * @brief Retrieves the number of slots in the frame of the context.
+ * 
+ * @param context The interpreter context.
+ * @return The number of slots.
+ */
+int imp_interpreter_context_frame_size(IMP_InterpreterContext *context);
+
+/**
+ * @brief Grows the frame of the context to at least the given number of slots. (New slots are 0.)
+ * 
+ * @param context The interpreter context.
+ * @param size The minimum number of slots.
+ */
+void imp_interpreter_context_frame_reserve(IMP_InterpreterContext *context, int size);
+
+/**
+ * @brief Retrieves the stack on which procedure activation frames are allocated.
+ * 
+ * @param context The interpreter context.
+ * @return The frame stack owned by the context.
+ */
+IMP_FrameStack *imp_interpreter_context_frame_stack(IMP_InterpreterContext *context);
+
+/**
+ * @brief Limits the memory of each execution stack (activation frames, pending statements).
+ * 
+ * @param context The interpreter context.
+ * @param limit Maximum number of bytes per stack, or 0 for no limit.
+ */
+void imp_interpreter_context_set_stack_limit(IMP_InterpreterContext *context, size_t limit);
+
+/**
+ * @brief Retrieves the memory limit of each execution stack.
+ * 
+ * @param context The interpreter context.
+ * @return Maximum number of bytes per stack, or 0 for no limit.
+ */
+size_t imp_interpreter_context_stack_limit(IMP_InterpreterContext *context);
+
+/**
+ * @brief Retrieves the tracer profiling the while loops run by the tree walker.
+ * 
+ * @param context The interpreter context.
+ * @return The tracer owned by the context.
+ */
+IMP_Tracer *imp_interpreter_context_tracer(IMP_InterpreterContext *context);
 
 /**
  * @brief Retrieves the AST node for a procedure from the context.
  * 
  * @param context The interpreter context.
- * @param name The name of the procedure. (Is copied internally.)
+ * @param name The name of the procedure.
  * @return A pointer to the procedure's AST node, or NULL if not found.
  */
-const IMP_ASTNode *imp_interpreter_context_proc_get(IMP_InterpreterContext *context, const char *name);
+const IMP_ASTNode *imp_interpreter_context_proc_get(IMP_InterpreterContext *context, const IMP_Symbol *name);
 
 /**
  * @brief Adds or updates a procedure in the context.
  * 
  * @param context The interpreter context.
- * @param name The name of the procedure. (Is copied internally.)
- * @param proc The AST node representing the procedure body. (Is cloned internally.)
+ * @param name The name of the procedure.
+ * @param proc The AST node representing the procedure body. (Is cloned into an arena owned by the context.)
+ */
+void imp_interpreter_context_proc_set(IMP_InterpreterContext *context, const IMP_Symbol *name, const IMP_ASTNode *proc);
+
+/**
+ * @brief Retrieves the epoch of the procedure table, for validating cached procedure lookups.
+ * 
+ * @param context The interpreter context.
+ * @return A nonzero number, distinct across contexts, that changes whenever the procedure table is modified.
  */
-void imp_interpreter_context_proc_set(IMP_InterpreterContext *context, const char *name, const IMP_ASTNode *proc);
+unsigned long imp_interpreter_context_proc_epoch(const IMP_InterpreterContext *context);
 
 /**
- * @brief Creates an iterator over the variables in the context. (Is invalid if the variable table is modified.)
+ * @brief Creates an iterator over the non-zero named variables in the context. (Is invalid if the variable table is modified.)
  * 
  * @param context The interpreter context.
  * @return A pointer to the variable iterator.
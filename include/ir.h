@@ -0,0 +1,153 @@
+#ifndef IMP_IR_H
+#define IMP_IR_H
+
+
+/**
+ * @file ir.h
+ * @brief Intermediate representation of IMP programs: control-flow graphs of basic blocks in SSA form.
+ *
+ * The top level of a program and every procedure body become a function.
+ * Variables (identified by their resolved frame slots, so that let-bound
+ * variables are distinct from the ones they shadow) are replaced by values,
+ * each defined by exactly one instruction; phi instructions at the start of
+ * a block select the value flowing in from each of its predecessors.
+ *
+ * Frames are only accessed at the boundaries of functions: a function loads
+ * the variables it reads before writing them (procedures start out with
+ * their value arguments, all other variables are 0), and stores the
+ * variables that outlive it when it returns: the var args of procedures,
+ * and the variables of the top level, which the top level also stores ahead
+ * of every procedure call or declaration (as these may fail and end the
+ * program, leaving the variables as they are at that point).
+ *
+ * Functions are built from resolved ASTs on demand, procedures on their
+ * first call, and optimized by the passes of a pass manager (see ir_pass.h).
+ * The interpreter executes them with imp_interpreter_interpret_ir.
+ *
+ * @author Flavian Kaufmann
+ */
+
+
+#include <stdio.h>
+
+#include "ast.h"
+
+
+/** IR instruction opcodes. */
+typedef enum {
+  IMP_IR_CONST,     /**< dst = imm */
+  IMP_IR_LOAD,      /**< dst = frame[imm] */
+  IMP_IR_STORE,     /**< frame[imm] = a */
+  IMP_IR_ADD,       /**< dst = a + b (wrapping around) */
+  IMP_IR_SUB,       /**< dst = a - b (wrapping around) */
+  IMP_IR_MUL,       /**< dst = a * b (wrapping around) */
+  IMP_IR_DIVU,      /**< dst = a / b, as unsigned integers (introduced by passes, for non-zero b only) */
+  IMP_IR_EQ,        /**< dst = a == b */
+  IMP_IR_NE,        /**< dst = a != b */
+  IMP_IR_LT,        /**< dst = a < b */
+  IMP_IR_LE,        /**< dst = a <= b */
+  IMP_IR_GT,        /**< dst = a > b */
+  IMP_IR_GE,        /**< dst = a >= b */
+  IMP_IR_AND,       /**< dst = a && b */
+  IMP_IR_OR,        /**< dst = a || b */
+  IMP_IR_NOT,       /**< dst = !a */
+  IMP_IR_PHI,       /**< dst = args[i] when entered from preds[i] */
+  IMP_IR_PROCDECL,  /**< Declares the procedure of node. */
+  IMP_IR_CALL,      /**< Calls the procedure of call site node with args, defining results as its var args. */
+  IMP_IR_OP_COUNT
+} IMP_IROpcode;
+
+/** An IR instruction. */
+typedef struct IMP_IRInstr {
+  IMP_IROpcode op;
+  int dst;                 /**< Value defined, or -1. */
+  int a, b;                /**< Operand values. */
+  int imm;                 /**< Constant, or frame slot of loads and stores. */
+  int *args;               /**< Operands of phis, value arguments of calls (stb_ds array). */
+  int *results;            /**< Values of the var args after a call (stb_ds array). */
+  const IMP_ASTNode *node; /**< Declaration or call site. */
+} IMP_IRInstr;
+
+/** Terminators of basic blocks. */
+typedef enum {
+  IMP_IR_JUMP,    /**< Continues with succs[0]. */
+  IMP_IR_BRANCH,  /**< Continues with succs[0] if cond is non-zero, else with succs[1]. */
+  IMP_IR_RETURN   /**< Returns from the function. */
+} IMP_IRTerminatorKind;
+
+/** A basic block. */
+typedef struct IMP_IRBlock {
+  IMP_IRInstr *phis;       /**< Phi instructions (stb_ds array). */
+  IMP_IRInstr *instrs;     /**< Other instructions (stb_ds array). */
+  int *preds;              /**< Predecessor blocks, in the order of phi operands (stb_ds array). */
+  IMP_IRTerminatorKind term;
+  int cond;                /**< Condition value of branches. */
+  int succs[2];            /**< Successor blocks. */
+} IMP_IRBlock;
+
+/** A function: the top level of a program or a procedure body. Block 0 is the entry. */
+typedef struct IMP_IRFunction {
+  const IMP_ASTNode *procdecl; /**< Procedure declaration, or NULL for the top level. */
+  IMP_IRBlock *blocks;         /**< Basic blocks (stb_ds array). */
+  int values;                  /**< Number of values defined. */
+} IMP_IRFunction;
+
+/** Opaque type representing the functions of a program. */
+typedef struct IMP_IRProgram IMP_IRProgram;
+
+/** Opaque type representing a sequence of passes (see ir_pass.h). */
+typedef struct IMP_IRPassManager IMP_IRPassManager;
+
+/**
+ * Builds the IR of a resolved AST node.
+ *
+ * @param node AST node to build the top-level function of.
+ * @param passes Passes to optimize each function with once built, or NULL.
+ * @return Pointer to the program; must be freed by the caller.
+ *
+ * @note The program borrows the AST node and the procedure declarations it builds functions of.
+ */
+IMP_IRProgram *imp_ir_build(const IMP_ASTNode *node, const IMP_IRPassManager *passes);
+
+/**
+ * Returns the top-level function of a program.
+ *
+ * @param program The program.
+ * @return The top-level function.
+ */
+IMP_IRFunction *imp_ir_program_main(IMP_IRProgram *program);
+
+/**
+ * Returns the function of a procedure body, building (and optimizing) it on first use.
+ *
+ * @param program The program.
+ * @param procdecl Resolved procedure declaration.
+ * @return The function of the procedure body.
+ */
+IMP_IRFunction *imp_ir_program_procedure(IMP_IRProgram *program, const IMP_ASTNode *procdecl);
+
+/**
+ * Allocates a new value of a function, for passes introducing instructions.
+ *
+ * @param function The function.
+ * @return The new value.
+ */
+int imp_ir_function_new_value(IMP_IRFunction *function);
+
+/**
+ * Prints a function in a readable form.
+ *
+ * @param function Function to print.
+ * @param out Stream to print to.
+ */
+void imp_ir_print(const IMP_IRFunction *function, FILE *out);
+
+/**
+ * Frees a program, including all of its functions.
+ *
+ * @param program Program to free.
+ */
+void imp_ir_destroy(IMP_IRProgram *program);
+
+
+#endif /* IMP_IR_H */
@@ -0,0 +1,94 @@
+#ifndef IMP_IR_PASS_H
+#define IMP_IR_PASS_H
+
+
+/**
+ * @file ir_pass.h
+ * @brief Passes over IR functions, and a pass manager composing them.
+ *
+ * A pass rewrites a function in place and reports whether it changed it.
+ * Analyses the passes share (uses of values, constant values, reachable
+ * blocks, contents of the frame) are computed from the function when a pass
+ * runs, so that passes can be composed in any order. The pass manager runs
+ * its passes in order, repeating the sequence until none of them changes the
+ * function any more.
+ *
+ * @author Flavian Kaufmann
+ */
+
+
+#include "ir.h"
+
+
+/** A pass over a function. */
+typedef struct IMP_IRPass {
+  const char *name;                       /**< Name of the pass. */
+  int (*run)(IMP_IRFunction *function);   /**< Runs the pass, returning whether the function changed. */
+} IMP_IRPass;
+
+/** Replaces phis all of whose operands are the same value (or the phi itself) by that value. */
+extern const IMP_IRPass imp_ir_pass_simplify_phis;
+
+/**
+ * Folds operations on constants (wrapping around like the engines do), operations with a neutral
+ * constant operand (x + 0, x - 0, x * 1) into that operand, and branches on constants into jumps.
+ */
+extern const IMP_IRPass imp_ir_pass_fold_constants;
+
+/** Removes unreachable blocks, and instructions without effects whose values are not used. */
+extern const IMP_IRPass imp_ir_pass_dead_code;
+
+/** Removes stores of the value a frame slot is known to hold already, on all paths (by earlier loads and stores). */
+extern const IMP_IRPass imp_ir_pass_redundant_stores;
+
+/**
+ * Replaces while loops by the closed forms of the variables they change, if the body is a single
+ * block without effects, and each variable is an induction variable (advanced by an invariant
+ * step), a sum of one, or assigned an invariant value. The number of iterations follows from the
+ * condition comparing an induction variable with a constant step to an invariant bound, or from
+ * repeatedly subtracting a positive bound (computing a remainder). The closed forms are taken if
+ * the loop is entered and the bound rules out the induction variable wrapping around; otherwise
+ * the loop runs as before, so that results wrap around exactly as they would by iterating.
+ */
+extern const IMP_IRPass imp_ir_pass_scalar_evolution;
+
+/**
+ * Creates an empty pass manager.
+ *
+ * @return Pointer to the pass manager; must be freed with imp_ir_pass_manager_destroy.
+ */
+IMP_IRPassManager *imp_ir_pass_manager_create(void);
+
+/**
+ * Creates a pass manager running all passes above.
+ *
+ * @return Pointer to the pass manager; must be freed with imp_ir_pass_manager_destroy.
+ */
+IMP_IRPassManager *imp_ir_pass_manager_create_default(void);
+
+/**
+ * Appends a pass to a pass manager.
+ *
+ * @param manager The pass manager.
+ * @param pass Pass to append; borrowed.
+ */
+void imp_ir_pass_manager_add(IMP_IRPassManager *manager, const IMP_IRPass *pass);
+
+/**
+ * Runs the passes of a pass manager over a function until none of them changes it.
+ *
+ * @param manager The pass manager.
+ * @param function Function to optimize.
+ * @return Number of times a pass changed the function.
+ */
+int imp_ir_pass_manager_run(const IMP_IRPassManager *manager, IMP_IRFunction *function);
+
+/**
+ * Frees a pass manager.
+ *
+ * @param manager Pass manager to free.
+ */
+void imp_ir_pass_manager_destroy(IMP_IRPassManager *manager);
+
+
+#endif /* IMP_IR_PASS_H */
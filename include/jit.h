@@ -0,0 +1,65 @@
+#ifndef IMP_JIT_H
+#define IMP_JIT_H
+
+
+/**
+ * @file jit.h
+ * @brief Template JIT translating compiled IMP bytecode to x86-64 machine code.
+ *
+ * Every bytecode instruction of a chunk (top-level program and procedure
+ * bodies) is replaced by a fixed machine code template. Variables stay in
+ * their activation frames, addressed relative to a frame register; the value
+ * stack lives in memory like the VM's. Procedure calls, returns and
+ * declarations are delegated to the same runtime as the VM (vm_runtime.h),
+ * so both engines report identical errors and limits.
+ *
+ * The JIT is only available on x86-64 hosts with mmap; elsewhere (or if no
+ * executable memory can be mapped) compilation fails and callers fall back to
+ * the VM.
+ *
+ * @author Flavian Kaufmann
+ */
+
+
+#include "bytecode.h"
+#include "interpreter_context.h"
+
+
+/** Machine code of a chunk, held in executable pages. */
+typedef struct IMP_JitCode IMP_JitCode;
+
+/**
+ * Checks whether the JIT supports the host.
+ *
+ * @return 1 if machine code can be generated for the host, 0 otherwise.
+ */
+int imp_jit_supported(void);
+
+/**
+ * Translates a chunk to machine code.
+ *
+ * @param chunk The chunk to translate.
+ * @return Pointer to the machine code; must be freed by the caller.
+ *         NULL if the host is unsupported or no executable memory is available.
+ */
+IMP_JitCode *imp_jit_compile(const IMP_BytecodeChunk *chunk);
+
+/**
+ * Executes the machine code of a chunk within a given context.
+ *
+ * @param context The interpreter context, holding the top-level frame and procedures.
+ * @param chunk Chunk the machine code was translated from.
+ * @param code Machine code of the chunk.
+ * @return Status code (0 for success, non-zero for error).
+ */
+int imp_jit_run(IMP_InterpreterContext *context, const IMP_BytecodeChunk *chunk, const IMP_JitCode *code);
+
+/**
+ * Frees machine code, unmapping its pages.
+ *
+ * @param code Machine code to free.
+ */
+void imp_jit_destroy(IMP_JitCode *code);
+
+
+#endif /* IMP_JIT_H */
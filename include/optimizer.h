@@ -0,0 +1,72 @@
+#ifndef IMP_OPTIMIZER_H
+#define IMP_OPTIMIZER_H
+
+
+/**
+ * @file optimizer.h
+ * @brief Optimizer rewriting IMP ASTs between parsing and execution.
+ *
+ * Linearly recursive procedures are rewritten into loops and small procedures
+ * inlined, then constants are folded, procedures specialized to constant
+ * arguments, loop invariants hoisted, common subexpressions reused and dead
+ * code removed (see optimizer.c for each pass).
+ *
+ * @author Flavian Kaufmann
+ */
+
+
+#include "ast.h"
+#include "interpreter_context.h"
+
+
+/** Options controlling the optimizer. */
+typedef struct IMP_OptimizerOptions {
+  int whole_program;     /**< Whether no later program runs within the context, so that uncalled procedures can be removed. */
+  int licm;              /**< Whether loop-invariant computations are hoisted out of loops. */
+  int cse;               /**< Whether common subexpressions of straight-line assignments are computed once. */
+  int accumulate;        /**< Whether linearly recursive procedures updating their var arg are rewritten into loops. */
+  int inline_size;       /**< Maximum number of AST nodes in the body of an inlined procedure (0 disables inlining). */
+  int specialize_budget; /**< Maximum number of AST nodes in procedures specialized to constant arguments (0 disables specialization). */
+} IMP_OptimizerOptions;
+
+/** Default options, used whenever NULL is passed as options. */
+extern const IMP_OptimizerOptions imp_optimizer_default_options;
+
+/** Statistics of an optimization. */
+typedef struct IMP_OptimizerStats {
+  int nodes_removed;  /**< Number of AST nodes removed, by folding and dead code elimination. */
+  int hoisted;        /**< Number of loop-invariant computations hoisted out of loops. */
+  int cse_eliminated; /**< Number of arithmetic operations no longer evaluated, as their value is reused. */
+  int inlined;        /**< Number of calls replaced by the body of the called procedure. */
+  int specialized;    /**< Number of calls redirected to a procedure specialized to their constant arguments. */
+  int accumulated;    /**< Number of recursive procedures rewritten into accumulator loops. */
+  const IMP_Symbol **accumulated_procs; /**< Names of those procedures (stb_ds array, NULL if none), see imp_optimizer_stats_free. */
+} IMP_OptimizerStats;
+
+/**
+ * Optimizes an AST node.
+ *
+ * @param context The interpreter context the node is run in, or NULL for a fresh context.
+ * @param node AST node to optimize; its subtrees are rewritten in place.
+ * @param arena Arena to allocate new nodes in, i.e. the arena of the AST node.
+ * @param options Options, or NULL for the defaults.
+ * @param stats Statistics to fill in, or NULL.
+ * @return The optimized node, which may differ from node.
+ *
+ * @note Optimized nodes have to be resolved again (see imp_resolver_resolve). Variables whose
+ *       references are all removed are not declared by resolving the optimized node.
+ * @note Declarations of procedures already declared in the context are kept, as are those of
+ *       procedures declared more than once, for the errors they raise.
+ */
+IMP_ASTNode *imp_optimizer_optimize(IMP_InterpreterContext *context, IMP_ASTNode *node, IMP_ASTArena *arena,
+                                   const IMP_OptimizerOptions *options, IMP_OptimizerStats *stats);
+
+/**
+ * Frees the names of the procedures listed by statistics of an optimization.
+ *
+ * @param stats Statistics filled in by imp_optimizer_optimize.
+ */
+void imp_optimizer_stats_free(IMP_OptimizerStats *stats);
+
+
+#endif /* IMP_OPTIMIZER_H */
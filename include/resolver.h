@@ -0,0 +1,35 @@
+#ifndef IMP_RESOLVER_H
+#define IMP_RESOLVER_H
+
+
+/**
+ * @file resolver.h
+ * @brief Name resolution of IMP variables to frame slots.
+ *
+ * Every variable reference is assigned a dense slot index within its scope.
+ * Top-level variables are resolved against the named slots of the context,
+ * let-bound variables receive a fresh slot in the enclosing frame, and each
+ * procedure body gets a frame of its own (value arguments first, then
+ * variable arguments, then locals).
+ *
+ * @author Flavian Kaufmann
+ */
+
+
+#include "ast.h"
+#include "interpreter_context.h"
+
+
+/**
+ * Resolves all variables of an AST node in place.
+ *
+ * @param context The interpreter context, whose frame is grown to hold new top-level slots.
+ * @param node AST node to resolve.
+ * @return Status code (0 for success, non-zero for error).
+ *
+ * @note Must be called before the AST node is interpreted within the context.
+ */
+int imp_resolver_resolve(IMP_InterpreterContext *context, IMP_ASTNode *node);
+
+
+#endif /* IMP_RESOLVER_H */
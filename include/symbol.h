@@ -0,0 +1,53 @@
+#ifndef IMP_SYMBOL_H
+#define IMP_SYMBOL_H
+
+
+/**
+ * @file symbol.h
+ * @brief Global table of interned identifiers.
+ *
+ * Every distinct identifier is stored exactly once and represented by a
+ * stable IMP_Symbol handle, so names compare equal if and only if their
+ * handles are the same pointer. Symbols live until the end of the program.
+ *
+ * @author Flavian Kaufmann
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** An interned identifier. */
+typedef struct IMP_Symbol {
+  const char *name;  /**< The identifier (NUL-terminated). */
+  size_t len;        /**< Length of the identifier. */
+  uint64_t hash;     /**< Precomputed hash of the identifier. */
+} IMP_Symbol;
+
+/**
+ * Interns an identifier.
+ *
+ * @param name The identifier. (Is copied internally on first use.)
+ * @return The symbol of the identifier, the same for equal identifiers.
+ */
+const IMP_Symbol *imp_symbol_intern(const char *name);
+
+/**
+ * Interns an identifier given by its first len characters.
+ *
+ * @param name The identifier, not necessarily NUL-terminated.
+ * @param len Length of the identifier.
+ * @return The symbol of the identifier, the same for equal identifiers.
+ */
+const IMP_Symbol *imp_symbol_intern_len(const char *name, size_t len);
+
+/**
+ * Retrieves the number of interned identifiers.
+ *
+ * @return Number of symbols in the table.
+ */
+size_t imp_symbol_count(void);
+
+
+#endif /* IMP_SYMBOL_H */
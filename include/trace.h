@@ -0,0 +1,206 @@
+#ifndef IMP_TRACE_H
+#define IMP_TRACE_H
+
+
+/**
+ * @file trace.h
+ * @brief Traces of hot while loops, recorded and run on behalf of the tree walker.
+ *
+ * The tree walker counts the back-edges of every while loop. Once a loop
+ * gets hot, one iteration of its body is recorded into a trace: a linear
+ * sequence of register operations along the branches taken, with a guard
+ * for the loop condition and for every if condition on the way. After an
+ * optimization pass (constant folding, direct assignment of results,
+ * removal of redundant guards) the trace runs the loop until its condition
+ * fails, or until a guard fails, in which case the tree walker resumes the
+ * iteration at the if statement of the guard (a side exit).
+ *
+ * Variables are loaded into registers when a trace is entered and written
+ * back when it exits, so traces only cover statements touching the current
+ * frame: assignments, if, let, skip and sequences. Recording is aborted for
+ * loops whose body calls procedures, declares them, or contains loops.
+ *
+ * @author Flavian Kaufmann
+ */
+
+
+#include "ast.h"
+
+
+/** Position in a statement sequence (a block or seq node, and the index of the current child). */
+typedef struct IMP_TraceCont {
+  const IMP_ASTNode *node; /**< Block or seq node. */
+  int index;               /**< Index of the child being executed. */
+} IMP_TraceCont;
+
+/** Side exit of a trace. */
+typedef struct IMP_TraceExit {
+  const IMP_ASTNode *stmt; /**< Statement to resume with, i.e. the if statement whose guard failed. */
+  IMP_TraceCont *cont;     /**< Enclosing sequence positions, outermost first; their later children follow stmt. */
+  int cont_len;            /**< Number of enclosing sequence positions. */
+} IMP_TraceExit;
+
+/** A recorded trace. */
+typedef struct IMP_Trace IMP_Trace;
+
+/**
+ * Starts recording a trace of a while loop, guarded by its condition.
+ *
+ * @param loop The while loop (resolved).
+ * @return Pointer to the trace; must be freed by the caller.
+ */
+IMP_Trace *imp_trace_create(const IMP_ASTNode *loop);
+
+/**
+ * Records an assignment to a frame slot.
+ *
+ * @param trace The trace being recorded.
+ * @param slot The frame slot assigned to.
+ * @param aexpr The assigned arithmetic expression (resolved).
+ */
+void imp_trace_assign(IMP_Trace *trace, int slot, const IMP_ASTNode *aexpr);
+
+/**
+ * Records a guard, exiting the trace unless a condition evaluates as observed.
+ *
+ * @param trace The trace being recorded.
+ * @param bexpr The boolean expression (resolved).
+ * @param expected Value of the expression observed while recording.
+ * @param stmt Statement to resume with on a side exit.
+ * @param cont Enclosing sequence positions of stmt, outermost first (copied).
+ * @param cont_len Number of enclosing sequence positions.
+ */
+void imp_trace_guard(IMP_Trace *trace, const IMP_ASTNode *bexpr, int expected,
+                     const IMP_ASTNode *stmt, const IMP_TraceCont *cont, int cont_len);
+
+/**
+ * Completes the recording of a trace and optimizes it.
+ *
+ * @param trace The trace.
+ */
+void imp_trace_finish(IMP_Trace *trace);
+
+/**
+ * Runs a finished trace until its loop condition or one of its guards fails.
+ *
+ * @param trace The trace.
+ * @param frame Frame of the loop.
+ * @param iterations Set to the number of loop iterations completed.
+ * @return -1 if the loop condition failed, otherwise the index of the side exit taken.
+ */
+int imp_trace_run(IMP_Trace *trace, int *frame, long *iterations);
+
+/**
+ * Retrieves a side exit of a trace.
+ *
+ * @param trace The trace.
+ * @param index Index of the side exit, as returned by imp_trace_run.
+ * @return The side exit.
+ */
+const IMP_TraceExit *imp_trace_exit(const IMP_Trace *trace, int index);
+
+/**
+ * Retrieves the number of operations of a trace.
+ *
+ * @param trace The trace.
+ * @return Number of operations, including guards.
+ */
+int imp_trace_len(const IMP_Trace *trace);
+
+/**
+ * Frees a trace.
+ *
+ * @param trace Trace to free.
+ */
+void imp_trace_destroy(IMP_Trace *trace);
+
+
+/** Default number of back-edges after which a loop is traced. */
+#define IMP_TRACER_DEFAULT_THRESHOLD 100
+
+/** Statistics of a tracer. */
+typedef struct IMP_TraceStats {
+  long recorded;    /**< Traces recorded. */
+  long aborted;     /**< Recordings aborted, the loops are not traced again. */
+  long entries;     /**< Times a trace was entered. */
+  long guard_exits; /**< Side exits taken on failed guards. */
+  long iterations;  /**< Loop iterations completed in traces. */
+  double seconds;   /**< Time spent in traces. */
+} IMP_TraceStats;
+
+/** Profiling state of a while loop. */
+typedef struct IMP_TraceLoop {
+  int count;        /**< Back-edges taken in the tree walker. */
+  int blacklisted;  /**< Whether recording a trace of the loop was aborted. */
+  IMP_Trace *trace; /**< Trace of the loop, or NULL if not recorded yet. */
+} IMP_TraceLoop;
+
+/** Opaque type holding the loops profiled during an execution. */
+typedef struct IMP_Tracer IMP_Tracer;
+
+/**
+ * Creates a tracer with the default threshold.
+ *
+ * @return Pointer to the tracer; must be freed by the caller.
+ */
+IMP_Tracer *imp_tracer_create(void);
+
+/**
+ * Frees a tracer and its traces.
+ *
+ * @param tracer Tracer to free.
+ */
+void imp_tracer_destroy(IMP_Tracer *tracer);
+
+/**
+ * Sets the number of back-edges after which a loop is traced.
+ *
+ * @param tracer The tracer.
+ * @param threshold Number of back-edges, or 0 to disable tracing.
+ */
+void imp_tracer_set_threshold(IMP_Tracer *tracer, int threshold);
+
+/**
+ * Retrieves the number of back-edges after which a loop is traced.
+ *
+ * @param tracer The tracer.
+ * @return Number of back-edges, or 0 if tracing is disabled.
+ */
+int imp_tracer_threshold(const IMP_Tracer *tracer);
+
+/**
+ * Retrieves the profiling state of a while loop, creating it on first use.
+ *
+ * @param tracer The tracer.
+ * @param loop The while loop.
+ * @return The profiling state (owned by the tracer), or NULL if tracing is disabled.
+ */
+IMP_TraceLoop *imp_tracer_loop(IMP_Tracer *tracer, const IMP_ASTNode *loop);
+
+/**
+ * Runs the trace of a loop, accounting for it in the statistics.
+ *
+ * @param tracer The tracer.
+ * @param loop Profiling state of a loop with a trace.
+ * @param frame Frame of the loop.
+ * @return As imp_trace_run.
+ */
+int imp_tracer_run(IMP_Tracer *tracer, IMP_TraceLoop *loop, int *frame);
+
+/**
+ * Forgets all loops and their traces, e.g. before the ASTs they refer to are freed.
+ *
+ * @param tracer The tracer.
+ */
+void imp_tracer_reset(IMP_Tracer *tracer);
+
+/**
+ * Retrieves the statistics of a tracer, accumulated since its creation.
+ *
+ * @param tracer The tracer.
+ * @return The statistics (owned by the tracer).
+ */
+IMP_TraceStats *imp_tracer_stats(IMP_Tracer *tracer);
+
+
+#endif /* IMP_TRACE_H */
@@ -0,0 +1,40 @@
+#ifndef IMP_VM_H
+#define IMP_VM_H
+
+
+/**
+ * @file vm.h
+ * @brief Virtual machine executing compiled IMP bytecode.
+ *
+ * Instructions are dispatched by direct threading where the compiler
+ * supports labels-as-values (GCC, Clang), and by a switch otherwise or
+ * when built with IMP_VM_SWITCH_DISPATCH defined.
+ *
+ * @author Flavian Kaufmann
+ */
+
+
+#include "bytecode.h"
+#include "interpreter_context.h"
+
+
+/**
+ * Executes a chunk within a given context.
+ *
+ * @param context The interpreter context, holding the top-level frame and procedures.
+ * @param chunk Chunk to execute, compiled against the same context.
+ * @return Status code (0 for success, non-zero for error).
+ *
+ * @note The VM does neither take ownership of the context nor the chunk.
+ */
+int imp_vm_run(IMP_InterpreterContext *context, const IMP_BytecodeChunk *chunk);
+
+/**
+ * Retrieves the dispatch technique the VM was built with.
+ *
+ * @return "threaded" or "switch".
+ */
+const char *imp_vm_dispatch(void);
+
+
+#endif /* IMP_VM_H */
@@ -0,0 +1,102 @@
+#ifndef IMP_VM_RUNTIME_H
+#define IMP_VM_RUNTIME_H
+
+
+/**
+ * @file vm_runtime.h
+ * @brief Procedure declarations, calls and returns of compiled IMP bytecode.
+ *
+ * Shared by the VM's DECL, CALL and RET handlers and the JIT's runtime
+ * helpers, so that both engines report identical errors and limits. The
+ * engines keep their own activation records (holding where to continue in
+ * the caller), only the frames and arguments are handled here.
+ *
+ * @author Flavian Kaufmann
+ */
+
+
+#include <stdio.h>
+
+#include "bytecode.h"
+#include "interpreter_context.h"
+
+
+/**
+ * Declares a procedure of a chunk in the context.
+ *
+ * @param context The interpreter context.
+ * @param chunk The chunk declaring the procedure.
+ * @param declared Whether each procedure of the chunk is declared, updated.
+ * @param proc Index of the procedure.
+ * @return 0 on success, -1 if a procedure of the same name is already declared.
+ */
+static inline int imp_vm_runtime_decl(IMP_InterpreterContext *context, const IMP_BytecodeChunk *chunk, char *declared, int proc) {
+  const IMP_ASTNode *decl = chunk->procs[proc].decl;
+  const IMP_Symbol *name = decl->data.proc_decl.symbol;
+  if (imp_interpreter_context_proc_get(context, name)) {
+    fprintf(stderr, "Error: procedure %s already defined\n", name->name);
+    return -1;
+  }
+  imp_interpreter_context_proc_set(context, name, decl);
+  declared[proc] = 1;
+  return 0;
+}
+
+/**
+ * Enters a procedure call, pushing the frame of the callee and passing it the value arguments.
+ *
+ * @param frame_stack The frame stack of the context.
+ * @param chunk The chunk of the call.
+ * @param declared Whether each procedure of the chunk is declared.
+ * @param index Index of the call site.
+ * @param sp Top of the value stack, holding the value arguments below it.
+ * @return Frame of the callee, or NULL if the procedure is not declared, the number of value
+ *         arguments does not match, or the stack limit is exceeded.
+ */
+static inline int *imp_vm_runtime_call(IMP_FrameStack *frame_stack, const IMP_BytecodeChunk *chunk, const char *declared, int index, const int *sp) {
+  const IMP_BytecodeCall *call = &chunk->calls[index];
+  if (call->proc < 0 || !declared[call->proc]) {
+    fprintf(stderr, "Error: procedure %s not defined\n", call->symbol->name);
+    return NULL;
+  }
+  const IMP_BytecodeProc *proc = &chunk->procs[call->proc];
+  if (call->val_argc != proc->val_argc) {
+    fprintf(stderr, "Error: procedure %s called with wrong number of value arguments\n", call->symbol->name);
+    return NULL;
+  }
+  int *callee_fp = imp_frame_stack_push(frame_stack, proc->frame_size);
+  if (!callee_fp) {
+    fprintf(stderr, "Error: stack limit exceeded\n");
+    return NULL;
+  }
+  sp -= call->val_argc;
+  for (int i = 0; i < call->val_argc; ++i) callee_fp[proc->val_slots[i]] = sp[i];
+  return callee_fp;
+}
+
+/**
+ * Returns from a procedure call, copying the var args out to the caller and popping the frame of the callee.
+ *
+ * @param frame_stack The frame stack of the context.
+ * @param chunk The chunk of the call.
+ * @param index Index of the call site.
+ * @param proc Index of the procedure returning.
+ * @param fp Frame of the callee.
+ * @param caller_fp Frame of the caller.
+ * @return 0 on success, -1 if the number of var args does not match.
+ */
+static inline int imp_vm_runtime_ret(IMP_FrameStack *frame_stack, const IMP_BytecodeChunk *chunk, int index, int proc, int *fp, int *caller_fp) {
+  const IMP_BytecodeCall *call = &chunk->calls[index];
+  const IMP_BytecodeProc *callee = &chunk->procs[proc];
+  int argc = call->var_argc < callee->var_argc ? call->var_argc : callee->var_argc;
+  for (int i = 0; i < argc; ++i) caller_fp[call->var_slots[i]] = fp[callee->var_slots[i]];
+  imp_frame_stack_pop(frame_stack, fp);
+  if (call->var_argc != callee->var_argc) {
+    fprintf(stderr, "Error: procedure %s called with wrong number of variable arguments\n", call->symbol->name);
+    return -1;
+  }
+  return 0;
+}
+
+
+#endif /* IMP_VM_RUNTIME_H */
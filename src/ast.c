@@ -1,171 +1,258 @@
 #include "ast.h"
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <assert.h>
 
 
-static IMP_ASTNode *ast_create(IMP_ASTNodeType type) {
-  IMP_ASTNode *node = malloc(sizeof(IMP_ASTNode));
-  assert(node && "Memory allocation failed");
+#define AST_ARENA_BLOCK_SIZE 4096
+#define AST_ARENA_ALIGN _Alignof(max_align_t)
+
+typedef struct ASTArenaBlock {
+  struct ASTArenaBlock *prev;
+  size_t capacity;
+  size_t used;
+  max_align_t data[];
+} ASTArenaBlock;
+
+struct IMP_ASTArena {
+  ASTArenaBlock *top;
+  size_t bytes;
+};
+
+IMP_ASTArena *imp_ast_arena_create(void) {
+  IMP_ASTArena *arena = malloc(sizeof(IMP_ASTArena));
+  assert(arena && "Memory allocation failed");
+  arena->top = NULL;
+  arena->bytes = 0;
+  return arena;
+}
+
+void imp_ast_arena_destroy(IMP_ASTArena *arena) {
+  if (!arena) return;
+  ASTArenaBlock *block = arena->top;
+  while (block) {
+    ASTArenaBlock *prev = block->prev;
+    free(block);
+    block = prev;
+  }
+  free(arena);
+}
+
+size_t imp_ast_arena_bytes(const IMP_ASTArena *arena) {
+  return arena->bytes;
+}
+
+static void *ast_alloc(IMP_ASTArena *arena, size_t size) {
+  if (!arena) {
+    void *ptr = malloc(size);
+    assert(ptr && "Memory allocation failed");
+    return ptr;
+  }
+  size = (size + AST_ARENA_ALIGN - 1) & ~(AST_ARENA_ALIGN - 1);
+  ASTArenaBlock *block = arena->top;
+  if (!block || block->capacity - block->used < size) {
+    size_t capacity = block ? block->capacity * 2 : AST_ARENA_BLOCK_SIZE;
+    if (capacity < size) capacity = size;
+    block = malloc(sizeof(ASTArenaBlock) + capacity);
+    assert(block && "Memory allocation failed");
+    block->prev = arena->top;
+    block->capacity = capacity;
+    block->used = 0;
+    arena->top = block;
+  }
+  void *ptr = (char *)block->data + block->used;
+  block->used += size;
+  arena->bytes += size;
+  return ptr;
+}
+
+static IMP_ASTNode *ast_create(IMP_ASTArena *arena, IMP_ASTNodeType type) {
+  IMP_ASTNode *node = ast_alloc(arena, sizeof(IMP_ASTNode));
   node->type = type;
   return node;
 }
 
-static IMP_ASTNodeList *ast_list_clone(IMP_ASTNodeList *list) {
+static IMP_ASTNodeList *ast_list_clone(IMP_ASTNodeList *list, IMP_ASTArena *arena) {
   if (!list) return NULL;
-  return imp_ast_list(imp_ast_clone(list->node), ast_list_clone(list->next));
+  return imp_ast_list(arena, imp_ast_clone(list->node, arena), ast_list_clone(list->next, arena));
 }
 
-IMP_ASTNode *imp_ast_skip(void) {
-  return ast_create(IMP_AST_NT_SKIP);
+IMP_ASTNode *imp_ast_skip(IMP_ASTArena *arena) {
+  return ast_create(arena, IMP_AST_NT_SKIP);
 }
 
-IMP_ASTNode *imp_ast_assign(IMP_ASTNode *var, IMP_ASTNode *aexpr) {
-  IMP_ASTNode *node = ast_create(IMP_AST_NT_ASSIGN);
+IMP_ASTNode *imp_ast_assign(IMP_ASTArena *arena, IMP_ASTNode *var, IMP_ASTNode *aexpr) {
+  IMP_ASTNode *node = ast_create(arena, IMP_AST_NT_ASSIGN);
   node->data.assign.var = var;
   node->data.assign.aexpr = aexpr;
   return node;
 }
 
-IMP_ASTNode *imp_ast_seq(IMP_ASTNode *fst_stmt, IMP_ASTNode *snd_stmt) {
-  IMP_ASTNode *node = ast_create(IMP_AST_NT_SEQ);
+IMP_ASTNode *imp_ast_seq(IMP_ASTArena *arena, IMP_ASTNode *fst_stmt, IMP_ASTNode *snd_stmt) {
+  IMP_ASTNode *node = ast_create(arena, IMP_AST_NT_SEQ);
   node->data.seq.fst_stmt = fst_stmt;
   node->data.seq.snd_stmt = snd_stmt;
   return node;
 }
 
-IMP_ASTNode *imp_ast_if(IMP_ASTNode *cond_bexpr, IMP_ASTNode *then_stmt, IMP_ASTNode *else_stmt) {
-  IMP_ASTNode *node = ast_create(IMP_AST_NT_IF);
+IMP_ASTNode *imp_ast_block(IMP_ASTArena *arena, IMP_ASTNode **stmts, int len) {
+  IMP_ASTNode *node = ast_create(arena, IMP_AST_NT_BLOCK);
+  node->data.block.stmts = ast_alloc(arena, sizeof(IMP_ASTNode *) * (len > 0 ? len : 1));
+  memcpy(node->data.block.stmts, stmts, sizeof(IMP_ASTNode *) * len);
+  node->data.block.len = len;
+  return node;
+}
+
+IMP_ASTNode *imp_ast_if(IMP_ASTArena *arena, IMP_ASTNode *cond_bexpr, IMP_ASTNode *then_stmt, IMP_ASTNode *else_stmt) {
+  IMP_ASTNode *node = ast_create(arena, IMP_AST_NT_IF);
   node->data.if_stmt.cond_bexpr = cond_bexpr;
   node->data.if_stmt.then_stmt = then_stmt;
   node->data.if_stmt.else_stmt = else_stmt;
   return node;
 }
 
-IMP_ASTNode *imp_ast_while(IMP_ASTNode *cond_bexpr, IMP_ASTNode *body_stmt) {
-  IMP_ASTNode *node = ast_create(IMP_AST_NT_WHILE);
+IMP_ASTNode *imp_ast_while(IMP_ASTArena *arena, IMP_ASTNode *cond_bexpr, IMP_ASTNode *body_stmt) {
+  IMP_ASTNode *node = ast_create(arena, IMP_AST_NT_WHILE);
   node->data.while_stmt.cond_bexpr = cond_bexpr;
   node->data.while_stmt.body_stmt = body_stmt;
   return node;
 }
 
-IMP_ASTNode *imp_ast_int(int val) {
-  IMP_ASTNode *node = ast_create(IMP_AST_NT_INT);
+IMP_ASTNode *imp_ast_int(IMP_ASTArena *arena, int val) {
+  IMP_ASTNode *node = ast_create(arena, IMP_AST_NT_INT);
   node->data.integer.val = val;
   return node;
 }
 
-IMP_ASTNode *imp_ast_var(const char *name) {
-  IMP_ASTNode *node = ast_create(IMP_AST_NT_VAR);
-  node->data.variable.name = strdup(name);
-  assert(node->data.variable.name && "Memory allocation failed");
+IMP_ASTNode *imp_ast_var(IMP_ASTArena *arena, const IMP_Symbol *symbol) {
+  IMP_ASTNode *node = ast_create(arena, IMP_AST_NT_VAR);
+  node->data.variable.symbol = symbol;
+  node->data.variable.slot = -1;
   return node;
 }
 
-IMP_ASTNode *imp_ast_aop(IMP_ASTArithmeticOperator aopr, IMP_ASTNode *l_aexpr, IMP_ASTNode *r_aexpr) {
-  IMP_ASTNode *node = ast_create(IMP_AST_NT_AOP);
+IMP_ASTNode *imp_ast_aop(IMP_ASTArena *arena, IMP_ASTArithmeticOperator aopr, IMP_ASTNode *l_aexpr, IMP_ASTNode *r_aexpr) {
+  IMP_ASTNode *node = ast_create(arena, IMP_AST_NT_AOP);
   node->data.arith_op.aopr = aopr;
   node->data.arith_op.l_aexpr = l_aexpr;
   node->data.arith_op.r_aexpr = r_aexpr;
+  node->data.arith_op.quick = IMP_AST_QUICK_NONE;
   return node;
 }
 
-IMP_ASTNode *imp_ast_bop(IMP_ASTBooleanOperator bopr, IMP_ASTNode *l_bexpr, IMP_ASTNode *r_bexpr) {
-  IMP_ASTNode *node = ast_create(IMP_AST_NT_BOP);
+IMP_ASTNode *imp_ast_bop(IMP_ASTArena *arena, IMP_ASTBooleanOperator bopr, IMP_ASTNode *l_bexpr, IMP_ASTNode *r_bexpr) {
+  IMP_ASTNode *node = ast_create(arena, IMP_AST_NT_BOP);
   node->data.bool_op.bopr = bopr;
   node->data.bool_op.l_bexpr = l_bexpr;
   node->data.bool_op.r_bexpr = r_bexpr;
   return node;
 }
 
-IMP_ASTNode *imp_ast_not(IMP_ASTNode *bexpr) {
-  IMP_ASTNode *node = ast_create(IMP_AST_NT_NOT);
+IMP_ASTNode *imp_ast_not(IMP_ASTArena *arena, IMP_ASTNode *bexpr) {
+  IMP_ASTNode *node = ast_create(arena, IMP_AST_NT_NOT);
   node->data.bool_not.bexpr = bexpr;
   return node;
 }
 
-IMP_ASTNode *imp_ast_rop(IMP_ASTRelationalOperator ropr, IMP_ASTNode *l_aexpr, IMP_ASTNode *r_aexpr) {
-  IMP_ASTNode *node = ast_create(IMP_AST_NT_ROP);
+IMP_ASTNode *imp_ast_rop(IMP_ASTArena *arena, IMP_ASTRelationalOperator ropr, IMP_ASTNode *l_aexpr, IMP_ASTNode *r_aexpr) {
+  IMP_ASTNode *node = ast_create(arena, IMP_AST_NT_ROP);
   node->data.rel_op.ropr = ropr;
   node->data.rel_op.l_aexpr = l_aexpr;
   node->data.rel_op.r_aexpr = r_aexpr;
+  node->data.rel_op.quick = IMP_AST_QUICK_NONE;
   return node;
 }
 
-IMP_ASTNode *imp_ast_let(IMP_ASTNode *var, IMP_ASTNode *aexpr, IMP_ASTNode *body_stmt) {
-  IMP_ASTNode *node = ast_create(IMP_AST_NT_LET);
+IMP_ASTNode *imp_ast_let(IMP_ASTArena *arena, IMP_ASTNode *var, IMP_ASTNode *aexpr, IMP_ASTNode *body_stmt) {
+  IMP_ASTNode *node = ast_create(arena, IMP_AST_NT_LET);
   node->data.let_stmt.var = var;
   node->data.let_stmt.aexpr = aexpr;
   node->data.let_stmt.body_stmt = body_stmt;
   return node;
 }
 
-IMP_ASTNode *imp_ast_procdecl(const char *name, IMP_ASTNodeList *val_args, IMP_ASTNodeList *var_args, IMP_ASTNode *body_stmt) {
-  IMP_ASTNode *node = ast_create(IMP_AST_NT_PROCDECL);
-  node->data.proc_decl.name = strdup(name);
-  assert(node->data.proc_decl.name && "Memory allocation failed");
+IMP_ASTNode *imp_ast_procdecl(IMP_ASTArena *arena, const IMP_Symbol *symbol, IMP_ASTNodeList *val_args, IMP_ASTNodeList *var_args, IMP_ASTNode *body_stmt) {
+  IMP_ASTNode *node = ast_create(arena, IMP_AST_NT_PROCDECL);
+  node->data.proc_decl.symbol = symbol;
   node->data.proc_decl.val_args = val_args;
   node->data.proc_decl.var_args = var_args;
   node->data.proc_decl.body_stmt = body_stmt;
+  node->data.proc_decl.frame_size = 0;
   return node;
 }
 
-IMP_ASTNode *imp_ast_proccall(const char *name, IMP_ASTNodeList *val_args, IMP_ASTNodeList *var_args) {
-  IMP_ASTNode *node = ast_create(IMP_AST_NT_PROCCALL);
-  node->data.proc_call.name = strdup(name);
-  assert(node->data.proc_call.name && "Memory allocation failed");
+IMP_ASTNode *imp_ast_proccall(IMP_ASTArena *arena, const IMP_Symbol *symbol, IMP_ASTNodeList *val_args, IMP_ASTNodeList *var_args) {
+  IMP_ASTNode *node = ast_create(arena, IMP_AST_NT_PROCCALL);
+  node->data.proc_call.symbol = symbol;
   node->data.proc_call.val_args = val_args;
   node->data.proc_call.var_args = var_args;
+  node->data.proc_call.procdecl = NULL;
+  node->data.proc_call.proc_epoch = 0;
   return node;
 }
 
-IMP_ASTNode *imp_ast_clone(const IMP_ASTNode *node) {
+IMP_ASTNode *imp_ast_clone(const IMP_ASTNode *node, IMP_ASTArena *arena) {
   if (!node) return NULL;
   switch (node->type) {
-    case IMP_AST_NT_SKIP: return imp_ast_skip();
-    case IMP_AST_NT_ASSIGN: return imp_ast_assign(
-      imp_ast_clone(node->data.assign.var), 
-      imp_ast_clone(node->data.assign.aexpr));
-    case IMP_AST_NT_SEQ: return imp_ast_seq(
-      imp_ast_clone(node->data.seq.fst_stmt), 
-      imp_ast_clone(node->data.seq.snd_stmt));
-    case IMP_AST_NT_IF: return imp_ast_if(
-      imp_ast_clone(node->data.if_stmt.cond_bexpr),
-      imp_ast_clone(node->data.if_stmt.then_stmt),
-      imp_ast_clone(node->data.if_stmt.else_stmt));
-    case IMP_AST_NT_WHILE: return imp_ast_while(
-      imp_ast_clone(node->data.while_stmt.cond_bexpr),
-      imp_ast_clone(node->data.while_stmt.body_stmt));
-    case IMP_AST_NT_INT: return imp_ast_int(node->data.integer.val);
-    case IMP_AST_NT_VAR: return imp_ast_var(node->data.variable.name);
-    case IMP_AST_NT_AOP: return imp_ast_aop(
+    case IMP_AST_NT_SKIP: return imp_ast_skip(arena);
+    case IMP_AST_NT_ASSIGN: return imp_ast_assign(arena,
+      imp_ast_clone(node->data.assign.var, arena), 
+      imp_ast_clone(node->data.assign.aexpr, arena));
+    case IMP_AST_NT_SEQ: return imp_ast_seq(arena,
+      imp_ast_clone(node->data.seq.fst_stmt, arena), 
+      imp_ast_clone(node->data.seq.snd_stmt, arena));
+    case IMP_AST_NT_BLOCK: {
+      int len = node->data.block.len;
+      IMP_ASTNode *clone = imp_ast_block(arena, node->data.block.stmts, len);
+      for (int i = 0; i < len; ++i) clone->data.block.stmts[i] = imp_ast_clone(node->data.block.stmts[i], arena);
+      return clone;
+    }
+    case IMP_AST_NT_IF: return imp_ast_if(arena,
+      imp_ast_clone(node->data.if_stmt.cond_bexpr, arena),
+      imp_ast_clone(node->data.if_stmt.then_stmt, arena),
+      imp_ast_clone(node->data.if_stmt.else_stmt, arena));
+    case IMP_AST_NT_WHILE: return imp_ast_while(arena,
+      imp_ast_clone(node->data.while_stmt.cond_bexpr, arena),
+      imp_ast_clone(node->data.while_stmt.body_stmt, arena));
+    case IMP_AST_NT_INT: return imp_ast_int(arena, node->data.integer.val);
+    case IMP_AST_NT_VAR: {
+      IMP_ASTNode *clone = imp_ast_var(arena, node->data.variable.symbol);
+      clone->data.variable.slot = node->data.variable.slot;
+      return clone;
+    }
+    case IMP_AST_NT_AOP: return imp_ast_aop(arena,
       node->data.arith_op.aopr,
-      imp_ast_clone(node->data.arith_op.l_aexpr),
-      imp_ast_clone(node->data.arith_op.r_aexpr));
-    case IMP_AST_NT_BOP: return imp_ast_bop(
+      imp_ast_clone(node->data.arith_op.l_aexpr, arena),
+      imp_ast_clone(node->data.arith_op.r_aexpr, arena));
+    case IMP_AST_NT_BOP: return imp_ast_bop(arena,
       node->data.bool_op.bopr,
-      imp_ast_clone(node->data.bool_op.l_bexpr),
-      imp_ast_clone(node->data.bool_op.r_bexpr));
-    case IMP_AST_NT_NOT: return imp_ast_not(
-      imp_ast_clone(node->data.bool_not.bexpr));
-    case IMP_AST_NT_ROP: return imp_ast_rop(
+      imp_ast_clone(node->data.bool_op.l_bexpr, arena),
+      imp_ast_clone(node->data.bool_op.r_bexpr, arena));
+    case IMP_AST_NT_NOT: return imp_ast_not(arena,
+      imp_ast_clone(node->data.bool_not.bexpr, arena));
+    case IMP_AST_NT_ROP: return imp_ast_rop(arena,
       node->data.rel_op.ropr,
-      imp_ast_clone(node->data.rel_op.l_aexpr),
-      imp_ast_clone(node->data.rel_op.r_aexpr));
-    case IMP_AST_NT_LET: return imp_ast_let(
-      imp_ast_clone(node->data.let_stmt.var),
-      imp_ast_clone(node->data.let_stmt.aexpr),
-      imp_ast_clone(node->data.let_stmt.body_stmt));
-    case IMP_AST_NT_PROCDECL: return imp_ast_procdecl(
-      node->data.proc_decl.name,
-      ast_list_clone(node->data.proc_decl.val_args),
-      ast_list_clone(node->data.proc_decl.var_args),
-      imp_ast_clone(node->data.proc_decl.body_stmt));
-    case IMP_AST_NT_PROCCALL: return imp_ast_proccall(
-      node->data.proc_call.name,
-      ast_list_clone(node->data.proc_call.val_args),
-      ast_list_clone(node->data.proc_call.var_args));
+      imp_ast_clone(node->data.rel_op.l_aexpr, arena),
+      imp_ast_clone(node->data.rel_op.r_aexpr, arena));
+    case IMP_AST_NT_LET: return imp_ast_let(arena,
+      imp_ast_clone(node->data.let_stmt.var, arena),
+      imp_ast_clone(node->data.let_stmt.aexpr, arena),
+      imp_ast_clone(node->data.let_stmt.body_stmt, arena));
+    case IMP_AST_NT_PROCDECL: {
+      IMP_ASTNode *clone = imp_ast_procdecl(arena,
+        node->data.proc_decl.symbol,
+        ast_list_clone(node->data.proc_decl.val_args, arena),
+        ast_list_clone(node->data.proc_decl.var_args, arena),
+        imp_ast_clone(node->data.proc_decl.body_stmt, arena));
+      clone->data.proc_decl.frame_size = node->data.proc_decl.frame_size;
+      return clone;
+    }
+    case IMP_AST_NT_PROCCALL: return imp_ast_proccall(arena,
+      node->data.proc_call.symbol,
+      ast_list_clone(node->data.proc_call.val_args, arena),
+      ast_list_clone(node->data.proc_call.var_args, arena));
     default: assert(0 && "Unknown AST node type");
   }
 }
@@ -183,6 +270,10 @@ void imp_ast_destroy(IMP_ASTNode *node) {
       imp_ast_destroy(node->data.seq.fst_stmt);
       imp_ast_destroy(node->data.seq.snd_stmt);
       break;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) imp_ast_destroy(node->data.block.stmts[i]);
+      free(node->data.block.stmts);
+      break;
     case IMP_AST_NT_IF:
       imp_ast_destroy(node->data.if_stmt.cond_bexpr);
       imp_ast_destroy(node->data.if_stmt.then_stmt);
@@ -193,9 +284,7 @@ void imp_ast_destroy(IMP_ASTNode *node) {
       imp_ast_destroy(node->data.while_stmt.body_stmt);
       break;
     case IMP_AST_NT_INT:
-      break;
     case IMP_AST_NT_VAR:
-      free(node->data.variable.name);
       break;
     case IMP_AST_NT_AOP:
       imp_ast_destroy(node->data.arith_op.l_aexpr);
@@ -218,13 +307,11 @@ void imp_ast_destroy(IMP_ASTNode *node) {
       imp_ast_destroy(node->data.let_stmt.body_stmt);
       break;
     case IMP_AST_NT_PROCDECL:
-      free(node->data.proc_decl.name);
       imp_ast_list_destroy(node->data.proc_decl.val_args);
       imp_ast_list_destroy(node->data.proc_decl.var_args);
       imp_ast_destroy(node->data.proc_decl.body_stmt);
       break;
     case IMP_AST_NT_PROCCALL:
-      free(node->data.proc_call.name);
       imp_ast_list_destroy(node->data.proc_call.val_args);
       imp_ast_list_destroy(node->data.proc_call.var_args);
       break;
@@ -233,9 +320,8 @@ void imp_ast_destroy(IMP_ASTNode *node) {
   free(node);
 }
 
-IMP_ASTNodeList *imp_ast_list(IMP_ASTNode *node, IMP_ASTNodeList *list) {
-  IMP_ASTNodeList *new_list = malloc(sizeof(IMP_ASTNodeList));
-  assert(new_list && "Memory allocation failed");
+IMP_ASTNodeList *imp_ast_list(IMP_ASTArena *arena, IMP_ASTNode *node, IMP_ASTNodeList *list) {
+  IMP_ASTNodeList *new_list = ast_alloc(arena, sizeof(IMP_ASTNodeList));
   new_list->node = node;
   new_list->next = list;
   return new_list;
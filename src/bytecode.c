@@ -0,0 +1,365 @@
+#include "bytecode.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "3rdparty/stb_ds/stb_ds.h"
+
+
+typedef struct ProcEntry {
+  const IMP_Symbol *key;
+  int value;
+} ProcEntry;
+
+typedef struct Compiler {
+  IMP_InterpreterContext *context;
+  IMP_BytecodeChunk *chunk;
+  ProcEntry *program_procs;
+  ProcEntry *context_procs;
+  int depth;
+} Compiler;
+
+static const char *const opcode_names[IMP_OP_COUNT] = {
+  [IMP_OP_PUSH] = "push", [IMP_OP_LOAD] = "load", [IMP_OP_STORE] = "store",
+  [IMP_OP_ADD] = "add", [IMP_OP_SUB] = "sub", [IMP_OP_MUL] = "mul",
+  [IMP_OP_EQ] = "eq", [IMP_OP_NE] = "ne", [IMP_OP_LT] = "lt",
+  [IMP_OP_LE] = "le", [IMP_OP_GT] = "gt", [IMP_OP_GE] = "ge",
+  [IMP_OP_AND] = "and", [IMP_OP_OR] = "or", [IMP_OP_NOT] = "not",
+  [IMP_OP_JMP] = "jmp", [IMP_OP_JZ] = "jz", [IMP_OP_DECL] = "decl",
+  [IMP_OP_CALL] = "call", [IMP_OP_RET] = "ret", [IMP_OP_HALT] = "halt",
+  [IMP_OP_INC] = "inc", [IMP_OP_ADDVV] = "addvv", [IMP_OP_SUBVV] = "subvv",
+  [IMP_OP_MULVV] = "mulvv", [IMP_OP_JZ_EQ] = "jz_eq", [IMP_OP_JZ_NE] = "jz_ne",
+  [IMP_OP_JZ_LT] = "jz_lt", [IMP_OP_JZ_LE] = "jz_le", [IMP_OP_JZ_GT] = "jz_gt",
+  [IMP_OP_JZ_GE] = "jz_ge",
+};
+
+static int emit3(Compiler *compiler, IMP_Opcode op, int arg, int arg2, int arg3) {
+  IMP_Instruction ins = { op, arg, arg2, arg3 };
+  arrput(compiler->chunk->code, ins);
+  switch (op) {
+    case IMP_OP_PUSH:
+    case IMP_OP_LOAD:
+      compiler->depth++;
+      break;
+    case IMP_OP_STORE:
+    case IMP_OP_ADD: case IMP_OP_SUB: case IMP_OP_MUL:
+    case IMP_OP_EQ: case IMP_OP_NE: case IMP_OP_LT: case IMP_OP_LE: case IMP_OP_GT: case IMP_OP_GE:
+    case IMP_OP_AND: case IMP_OP_OR:
+    case IMP_OP_JZ:
+      compiler->depth--;
+      break;
+    case IMP_OP_CALL:
+      compiler->depth -= compiler->chunk->calls[arg].val_argc;
+      break;
+    default:
+      break;
+  }
+  if (compiler->depth > compiler->chunk->max_stack) compiler->chunk->max_stack = compiler->depth;
+  return (int)arrlen(compiler->chunk->code) - 1;
+}
+
+static int emit(Compiler *compiler, IMP_Opcode op, int arg) {
+  return emit3(compiler, op, arg, 0, 0);
+}
+
+static int here(Compiler *compiler) {
+  return (int)arrlen(compiler->chunk->code);
+}
+
+static void patch(Compiler *compiler, int at, int target) {
+  IMP_Instruction *ins = &compiler->chunk->code[at];
+  if (ins->op == IMP_OP_JMP || ins->op == IMP_OP_JZ) ins->arg = target;
+  else ins->arg3 = target;
+}
+
+static int add_proc(Compiler *compiler, const IMP_ASTNode *decl, int predeclared) {
+  IMP_BytecodeProc proc = { 0 };
+  proc.decl = decl;
+  proc.entry = -1;
+  proc.frame_size = decl->data.proc_decl.frame_size;
+  proc.predeclared = predeclared;
+  for (IMP_ASTNodeList *arg = decl->data.proc_decl.val_args; arg; arg = arg->next) {
+    arrput(proc.val_slots, arg->node->data.variable.slot);
+  }
+  for (IMP_ASTNodeList *arg = decl->data.proc_decl.var_args; arg; arg = arg->next) {
+    arrput(proc.var_slots, arg->node->data.variable.slot);
+  }
+  proc.val_argc = (int)arrlen(proc.val_slots);
+  proc.var_argc = (int)arrlen(proc.var_slots);
+  arrput(compiler->chunk->procs, proc);
+  return (int)arrlen(compiler->chunk->procs) - 1;
+}
+
+static void compile_aexpr(Compiler *compiler, const IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_INT:
+      emit(compiler, IMP_OP_PUSH, node->data.integer.val);
+      break;
+    case IMP_AST_NT_VAR:
+      emit(compiler, IMP_OP_LOAD, node->data.variable.slot);
+      break;
+    case IMP_AST_NT_AOP:
+      compile_aexpr(compiler, node->data.arith_op.l_aexpr);
+      compile_aexpr(compiler, node->data.arith_op.r_aexpr);
+      switch (node->data.arith_op.aopr) {
+        case IMP_AST_AOP_ADD: emit(compiler, IMP_OP_ADD, 0); break;
+        case IMP_AST_AOP_SUB: emit(compiler, IMP_OP_SUB, 0); break;
+        case IMP_AST_AOP_MUL: emit(compiler, IMP_OP_MUL, 0); break;
+        default: assert(0);
+      }
+      break;
+    default: assert(0);
+  }
+}
+
+static void compile_bexpr(Compiler *compiler, const IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_BOP:
+      compile_bexpr(compiler, node->data.bool_op.l_bexpr);
+      compile_bexpr(compiler, node->data.bool_op.r_bexpr);
+      switch (node->data.bool_op.bopr) {
+        case IMP_AST_BOP_AND: emit(compiler, IMP_OP_AND, 0); break;
+        case IMP_AST_BOP_OR:  emit(compiler, IMP_OP_OR, 0); break;
+        default: assert(0);
+      }
+      break;
+    case IMP_AST_NT_NOT:
+      compile_bexpr(compiler, node->data.bool_not.bexpr);
+      emit(compiler, IMP_OP_NOT, 0);
+      break;
+    case IMP_AST_NT_ROP:
+      compile_aexpr(compiler, node->data.rel_op.l_aexpr);
+      compile_aexpr(compiler, node->data.rel_op.r_aexpr);
+      switch (node->data.rel_op.ropr) {
+        case IMP_AST_ROP_EQ: emit(compiler, IMP_OP_EQ, 0); break;
+        case IMP_AST_ROP_NE: emit(compiler, IMP_OP_NE, 0); break;
+        case IMP_AST_ROP_LT: emit(compiler, IMP_OP_LT, 0); break;
+        case IMP_AST_ROP_LE: emit(compiler, IMP_OP_LE, 0); break;
+        case IMP_AST_ROP_GT: emit(compiler, IMP_OP_GT, 0); break;
+        case IMP_AST_ROP_GE: emit(compiler, IMP_OP_GE, 0); break;
+        default: assert(0);
+      }
+      break;
+    default: assert(0);
+  }
+}
+
+static int is_var(const IMP_ASTNode *node) {
+  return node->type == IMP_AST_NT_VAR;
+}
+
+static int is_int(const IMP_ASTNode *node) {
+  return node->type == IMP_AST_NT_INT;
+}
+
+static int is_slot(const IMP_ASTNode *node, int slot) {
+  return is_var(node) && node->data.variable.slot == slot;
+}
+
+/* Wrapping negation, so that x - c and x + (-c) agree for every c. */
+static int negate(int val) {
+  return (int)(0u - (unsigned)val);
+}
+
+/* Lowers x := x + c, x := c + x and x := x - c to INC, and x := y op z to a
+ * var-op-var superinstruction. Returns 0 if the assignment has neither shape. */
+static int compile_fused_assign(Compiler *compiler, int slot, const IMP_ASTNode *aexpr) {
+  if (aexpr->type != IMP_AST_NT_AOP) return 0;
+  const IMP_ASTNode *l = aexpr->data.arith_op.l_aexpr;
+  const IMP_ASTNode *r = aexpr->data.arith_op.r_aexpr;
+  IMP_ASTArithmeticOperator aopr = aexpr->data.arith_op.aopr;
+  if (aopr == IMP_AST_AOP_ADD && is_slot(l, slot) && is_int(r)) {
+    emit3(compiler, IMP_OP_INC, slot, r->data.integer.val, 0);
+  } else if (aopr == IMP_AST_AOP_ADD && is_int(l) && is_slot(r, slot)) {
+    emit3(compiler, IMP_OP_INC, slot, l->data.integer.val, 0);
+  } else if (aopr == IMP_AST_AOP_SUB && is_slot(l, slot) && is_int(r)) {
+    emit3(compiler, IMP_OP_INC, slot, negate(r->data.integer.val), 0);
+  } else if (is_var(l) && is_var(r)) {
+    IMP_Opcode op;
+    switch (aopr) {
+      case IMP_AST_AOP_ADD: op = IMP_OP_ADDVV; break;
+      case IMP_AST_AOP_SUB: op = IMP_OP_SUBVV; break;
+      case IMP_AST_AOP_MUL: op = IMP_OP_MULVV; break;
+      default: assert(0); return 0;
+    }
+    emit3(compiler, op, slot, l->data.variable.slot, r->data.variable.slot);
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+/* Emits a branch taken when cond is false, fusing var-relop-const conditions.
+ * Returns the index of the branch, to be patched with its target. */
+static int compile_branch_false(Compiler *compiler, const IMP_ASTNode *cond) {
+  if (cond->type == IMP_AST_NT_ROP) {
+    const IMP_ASTNode *l = cond->data.rel_op.l_aexpr;
+    const IMP_ASTNode *r = cond->data.rel_op.r_aexpr;
+    IMP_ASTRelationalOperator ropr = cond->data.rel_op.ropr;
+    if (is_int(l) && is_var(r)) {
+      const IMP_ASTNode *tmp = l;
+      l = r;
+      r = tmp;
+      switch (ropr) {
+        case IMP_AST_ROP_LT: ropr = IMP_AST_ROP_GT; break;
+        case IMP_AST_ROP_LE: ropr = IMP_AST_ROP_GE; break;
+        case IMP_AST_ROP_GT: ropr = IMP_AST_ROP_LT; break;
+        case IMP_AST_ROP_GE: ropr = IMP_AST_ROP_LE; break;
+        default: break;
+      }
+    }
+    if (is_var(l) && is_int(r)) {
+      IMP_Opcode op;
+      switch (ropr) {
+        case IMP_AST_ROP_EQ: op = IMP_OP_JZ_EQ; break;
+        case IMP_AST_ROP_NE: op = IMP_OP_JZ_NE; break;
+        case IMP_AST_ROP_LT: op = IMP_OP_JZ_LT; break;
+        case IMP_AST_ROP_LE: op = IMP_OP_JZ_LE; break;
+        case IMP_AST_ROP_GT: op = IMP_OP_JZ_GT; break;
+        case IMP_AST_ROP_GE: op = IMP_OP_JZ_GE; break;
+        default: assert(0); return -1;
+      }
+      return emit3(compiler, op, l->data.variable.slot, r->data.integer.val, -1);
+    }
+  }
+  compile_bexpr(compiler, cond);
+  return emit(compiler, IMP_OP_JZ, -1);
+}
+
+static void compile_proccall(Compiler *compiler, const IMP_ASTNode *node) {
+  IMP_BytecodeCall call = { 0 };
+  call.symbol = node->data.proc_call.symbol;
+  call.proc = -1;
+  for (IMP_ASTNodeList *arg = node->data.proc_call.val_args; arg; arg = arg->next) {
+    compile_aexpr(compiler, arg->node);
+    call.val_argc++;
+  }
+  for (IMP_ASTNodeList *arg = node->data.proc_call.var_args; arg; arg = arg->next) {
+    arrput(call.var_slots, arg->node->data.variable.slot);
+  }
+  call.var_argc = (int)arrlen(call.var_slots);
+  arrput(compiler->chunk->calls, call);
+  emit(compiler, IMP_OP_CALL, (int)arrlen(compiler->chunk->calls) - 1);
+}
+
+static void compile_stmt(Compiler *compiler, const IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_SKIP:
+      break;
+    case IMP_AST_NT_ASSIGN: {
+      int slot = node->data.assign.var->data.variable.slot;
+      if (compile_fused_assign(compiler, slot, node->data.assign.aexpr)) break;
+      compile_aexpr(compiler, node->data.assign.aexpr);
+      emit(compiler, IMP_OP_STORE, slot);
+      break;
+    }
+    case IMP_AST_NT_SEQ:
+      compile_stmt(compiler, node->data.seq.fst_stmt);
+      compile_stmt(compiler, node->data.seq.snd_stmt);
+      break;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) compile_stmt(compiler, node->data.block.stmts[i]);
+      break;
+    case IMP_AST_NT_IF: {
+      int jz = compile_branch_false(compiler, node->data.if_stmt.cond_bexpr);
+      compile_stmt(compiler, node->data.if_stmt.then_stmt);
+      int jmp = emit(compiler, IMP_OP_JMP, -1);
+      patch(compiler, jz, here(compiler));
+      compile_stmt(compiler, node->data.if_stmt.else_stmt);
+      patch(compiler, jmp, here(compiler));
+      break;
+    }
+    case IMP_AST_NT_WHILE: {
+      int top = here(compiler);
+      int jz = compile_branch_false(compiler, node->data.while_stmt.cond_bexpr);
+      compile_stmt(compiler, node->data.while_stmt.body_stmt);
+      emit(compiler, IMP_OP_JMP, top);
+      patch(compiler, jz, here(compiler));
+      break;
+    }
+    case IMP_AST_NT_LET:
+      compile_aexpr(compiler, node->data.let_stmt.aexpr);
+      emit(compiler, IMP_OP_STORE, node->data.let_stmt.var->data.variable.slot);
+      compile_stmt(compiler, node->data.let_stmt.body_stmt);
+      break;
+    case IMP_AST_NT_PROCDECL: {
+      int proc = add_proc(compiler, node, 0);
+      if (hmgeti(compiler->program_procs, node->data.proc_decl.symbol) < 0) {
+        hmput(compiler->program_procs, node->data.proc_decl.symbol, proc);
+      }
+      emit(compiler, IMP_OP_DECL, proc);
+      break;
+    }
+    case IMP_AST_NT_PROCCALL:
+      compile_proccall(compiler, node);
+      break;
+    default: assert(0);
+  }
+}
+
+static void resolve_call(Compiler *compiler, IMP_BytecodeCall *call) {
+  const IMP_ASTNode *decl = imp_interpreter_context_proc_get(compiler->context, call->symbol);
+  if (decl) {
+    ptrdiff_t index = hmgeti(compiler->context_procs, call->symbol);
+    if (index >= 0) {
+      call->proc = compiler->context_procs[index].value;
+    } else {
+      call->proc = add_proc(compiler, decl, 1);
+      hmput(compiler->context_procs, decl->data.proc_decl.symbol, call->proc);
+    }
+    return;
+  }
+  ptrdiff_t index = hmgeti(compiler->program_procs, call->symbol);
+  if (index >= 0) call->proc = compiler->program_procs[index].value;
+}
+
+static void compile_proc(Compiler *compiler, int proc) {
+  compiler->chunk->procs[proc].entry = here(compiler);
+  compiler->depth = 0;
+  compile_stmt(compiler, compiler->chunk->procs[proc].decl->data.proc_decl.body_stmt);
+  emit(compiler, IMP_OP_RET, proc);
+}
+
+IMP_BytecodeChunk *imp_bytecode_compile(IMP_InterpreterContext *context, const IMP_ASTNode *node) {
+  IMP_BytecodeChunk *chunk = calloc(1, sizeof(IMP_BytecodeChunk));
+  assert(chunk && "Memory allocation failed");
+  Compiler compiler = { context, chunk, NULL, NULL, 0 };
+  compile_stmt(&compiler, node);
+  emit(&compiler, IMP_OP_HALT, 0);
+  ptrdiff_t next_call = 0, next_proc = 0;
+  while (next_call < arrlen(chunk->calls) || next_proc < arrlen(chunk->procs)) {
+    if (next_call < arrlen(chunk->calls)) resolve_call(&compiler, &chunk->calls[next_call++]);
+    else compile_proc(&compiler, (int)next_proc++);
+  }
+  hmfree(compiler.program_procs);
+  hmfree(compiler.context_procs);
+  chunk->code_len = (int)arrlen(chunk->code);
+  chunk->procs_len = (int)arrlen(chunk->procs);
+  chunk->calls_len = (int)arrlen(chunk->calls);
+  return chunk;
+}
+
+const char *imp_bytecode_opcode_name(IMP_Opcode op) {
+  assert(op >= 0 && op < IMP_OP_COUNT);
+  return opcode_names[op];
+}
+
+int imp_bytecode_count(const IMP_BytecodeChunk *chunk, IMP_Opcode op) {
+  int count = 0;
+  for (int i = 0; i < chunk->code_len; ++i) count += chunk->code[i].op == op;
+  return count;
+}
+
+void imp_bytecode_destroy(IMP_BytecodeChunk *chunk) {
+  if (!chunk) return;
+  for (int i = 0; i < chunk->procs_len; ++i) {
+    arrfree(chunk->procs[i].val_slots);
+    arrfree(chunk->procs[i].var_slots);
+  }
+  for (int i = 0; i < chunk->calls_len; ++i) arrfree(chunk->calls[i].var_slots);
+  arrfree(chunk->code);
+  arrfree(chunk->procs);
+  arrfree(chunk->calls);
+  free(chunk);
+}
@@ -0,0 +1,408 @@
+#include "closure.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "3rdparty/stb_ds/stb_ds.h"
+
+
+typedef struct Closure Closure;
+
+/** Evaluates an expression closure. */
+typedef int (*EvalFn)(const Closure *c, int *frame);
+
+/** Executes a statement closure, returning a status code. */
+typedef int (*ExecFn)(Closure *c, IMP_InterpreterContext *context, int *frame);
+
+struct Closure {
+  union {
+    EvalFn eval;
+    ExecFn exec;
+  } fn;
+  int a, b;                  /**< Leaf operands (slot or constant), assigned slot. */
+  Closure *kids[3];          /**< Child closures. */
+  Closure **list;            /**< Statements of a block, value arguments of a call. */
+  int len;                   /**< Number of list entries. */
+  const IMP_ASTNode *node;   /**< Declaration or call site of procedure statements. */
+  IMP_ClosureProgram *program;
+  const IMP_ASTNode *procdecl; /**< Procedure last called from a call site. */
+  Closure *body;               /**< Compiled body of procdecl. */
+};
+
+typedef struct BodyEntry {
+  const IMP_ASTNode *key;
+  Closure *value;
+} BodyEntry;
+
+struct IMP_ClosureProgram {
+  Closure *root;
+  Closure **closures; /**< All closures, for freeing. */
+  BodyEntry *bodies;  /**< Compiled procedure bodies by declaration. */
+};
+
+
+/* Expressions: leaves and specialised operators. */
+
+static int eval_int(const Closure *c, int *frame) {
+  (void)frame;
+  return c->a;
+}
+
+static int eval_var(const Closure *c, int *frame) {
+  return frame[c->a];
+}
+
+#define OPERAND_var(c, frame, leaf, kid) ((frame)[(c)->leaf])
+#define OPERAND_int(c, frame, leaf, kid) ((c)->leaf)
+#define OPERAND_expr(c, frame, leaf, kid) ((c)->kids[kid]->fn.eval((c)->kids[kid], frame))
+
+#define DEFINE_BINARY(name, op, lk, rk) \
+  static int name##_##lk##_##rk(const Closure *c, int *frame) { \
+    int l = OPERAND_##lk(c, frame, a, 0); \
+    int r = OPERAND_##rk(c, frame, b, 1); \
+    return l op r; \
+  }
+
+#define DEFINE_KINDS(name, op) \
+  DEFINE_BINARY(name, op, var, var) DEFINE_BINARY(name, op, var, int) DEFINE_BINARY(name, op, var, expr) \
+  DEFINE_BINARY(name, op, int, var) DEFINE_BINARY(name, op, int, expr) \
+  DEFINE_BINARY(name, op, expr, var) DEFINE_BINARY(name, op, expr, int) DEFINE_BINARY(name, op, expr, expr)
+
+/* Indexed by [left kind][right kind], int-int operations are folded. */
+#define KINDS_TABLE(name) { \
+    { name##_var_var, name##_var_int, name##_var_expr }, \
+    { name##_int_var, NULL, name##_int_expr }, \
+    { name##_expr_var, name##_expr_int, name##_expr_expr } \
+  }
+
+DEFINE_KINDS(add, +)
+DEFINE_KINDS(sub, -)
+DEFINE_KINDS(mul, *)
+DEFINE_KINDS(eq, ==)
+DEFINE_KINDS(ne, !=)
+DEFINE_KINDS(lt, <)
+DEFINE_KINDS(le, <=)
+DEFINE_KINDS(gt, >)
+DEFINE_KINDS(ge, >=)
+
+enum { KIND_VAR, KIND_INT, KIND_EXPR };
+
+/* Indexed by IMP_ASTArithmeticOperator. */
+static const EvalFn arith_fns[3][3][3] = { KINDS_TABLE(add), KINDS_TABLE(sub), KINDS_TABLE(mul) };
+
+/* Indexed by IMP_ASTRelationalOperator. */
+static const EvalFn rel_fns[6][3][3] = {
+  KINDS_TABLE(eq), KINDS_TABLE(ne), KINDS_TABLE(lt), KINDS_TABLE(le), KINDS_TABLE(gt), KINDS_TABLE(ge)
+};
+
+static int eval_and(const Closure *c, int *frame) {
+  return c->kids[0]->fn.eval(c->kids[0], frame) && c->kids[1]->fn.eval(c->kids[1], frame);
+}
+
+static int eval_or(const Closure *c, int *frame) {
+  return c->kids[0]->fn.eval(c->kids[0], frame) || c->kids[1]->fn.eval(c->kids[1], frame);
+}
+
+static int eval_not(const Closure *c, int *frame) {
+  return !c->kids[0]->fn.eval(c->kids[0], frame);
+}
+
+
+/* Statements. */
+
+static int exec_skip(Closure *c, IMP_InterpreterContext *context, int *frame) {
+  (void)c; (void)context; (void)frame;
+  return 0;
+}
+
+static int exec_assign(Closure *c, IMP_InterpreterContext *context, int *frame) {
+  (void)context;
+  frame[c->a] = c->kids[0]->fn.eval(c->kids[0], frame);
+  return 0;
+}
+
+static int exec_assign_int(Closure *c, IMP_InterpreterContext *context, int *frame) {
+  (void)context;
+  frame[c->a] = c->b;
+  return 0;
+}
+
+static int exec_seq(Closure *c, IMP_InterpreterContext *context, int *frame) {
+  if (c->kids[0]->fn.exec(c->kids[0], context, frame)) return -1;
+  return c->kids[1]->fn.exec(c->kids[1], context, frame);
+}
+
+static int exec_block(Closure *c, IMP_InterpreterContext *context, int *frame) {
+  for (int i = 0; i < c->len; ++i) {
+    if (c->list[i]->fn.exec(c->list[i], context, frame)) return -1;
+  }
+  return 0;
+}
+
+static int exec_if(Closure *c, IMP_InterpreterContext *context, int *frame) {
+  Closure *branch = c->kids[0]->fn.eval(c->kids[0], frame) ? c->kids[1] : c->kids[2];
+  return branch->fn.exec(branch, context, frame);
+}
+
+static int exec_while(Closure *c, IMP_InterpreterContext *context, int *frame) {
+  const Closure *cond = c->kids[0];
+  Closure *body = c->kids[1];
+  while (cond->fn.eval(cond, frame)) {
+    if (body->fn.exec(body, context, frame)) return -1;
+  }
+  return 0;
+}
+
+static int exec_let(Closure *c, IMP_InterpreterContext *context, int *frame) {
+  frame[c->a] = c->kids[0]->fn.eval(c->kids[0], frame);
+  return c->kids[1]->fn.exec(c->kids[1], context, frame);
+}
+
+static int exec_procdecl(Closure *c, IMP_InterpreterContext *context, int *frame) {
+  (void)frame;
+  const IMP_Symbol *name = c->node->data.proc_decl.symbol;
+  if (imp_interpreter_context_proc_get(context, name)) {
+    fprintf(stderr, "Error: procedure %s already defined\n", name->name);
+    return -1;
+  }
+  imp_interpreter_context_proc_set(context, name, c->node);
+  return 0;
+}
+
+static Closure *procedure_body(IMP_ClosureProgram *program, const IMP_ASTNode *procdecl);
+
+static int exec_proccall(Closure *c, IMP_InterpreterContext *context, int *frame) {
+  const IMP_ASTNode *node = c->node;
+  const IMP_Symbol *name = node->data.proc_call.symbol;
+  const IMP_ASTNode *procdecl = imp_interpreter_context_proc_get(context, name);
+  if (!procdecl) {
+    fprintf(stderr, "Error: procedure %s not defined\n", name->name);
+    return -1;
+  }
+  if (procdecl != c->procdecl) {
+    c->procdecl = procdecl;
+    c->body = procedure_body(c->program, procdecl);
+  }
+  IMP_FrameStack *frame_stack = imp_interpreter_context_frame_stack(context);
+  int *proc_frame = imp_frame_stack_push(frame_stack, procdecl->data.proc_decl.frame_size);
+  if (!proc_frame) {
+    fprintf(stderr, "Error: stack limit exceeded\n");
+    return -1;
+  }
+  int i = 0;
+  IMP_ASTNodeList *callee_val_args = procdecl->data.proc_decl.val_args;
+  for (; i < c->len && callee_val_args; ++i, callee_val_args = callee_val_args->next) {
+    proc_frame[callee_val_args->node->data.variable.slot] = c->list[i]->fn.eval(c->list[i], frame);
+  }
+  if (i < c->len || callee_val_args) {
+    fprintf(stderr, "Error: procedure %s called with wrong number of value arguments\n", name->name);
+    imp_frame_stack_pop(frame_stack, proc_frame);
+    return -1;
+  }
+  if (c->body->fn.exec(c->body, context, proc_frame)) {
+    imp_frame_stack_pop(frame_stack, proc_frame);
+    return -1;
+  }
+  IMP_ASTNodeList *caller_var_args = node->data.proc_call.var_args;
+  IMP_ASTNodeList *callee_var_args = procdecl->data.proc_decl.var_args;
+  while (caller_var_args && callee_var_args) {
+    frame[caller_var_args->node->data.variable.slot] = proc_frame[callee_var_args->node->data.variable.slot];
+    caller_var_args = caller_var_args->next;
+    callee_var_args = callee_var_args->next;
+  }
+  imp_frame_stack_pop(frame_stack, proc_frame);
+  if (caller_var_args || callee_var_args) {
+    fprintf(stderr, "Error: procedure %s called with wrong number of variable arguments\n", name->name);
+    return -1;
+  }
+  return 0;
+}
+
+
+/* Compilation. */
+
+static Closure *closure_new(IMP_ClosureProgram *program) {
+  Closure *c = calloc(1, sizeof(Closure));
+  assert(c && "Memory allocation failed");
+  c->program = program;
+  arrput(program->closures, c);
+  return c;
+}
+
+static int kind(const Closure *c) {
+  if (c->fn.eval == eval_var) return KIND_VAR;
+  if (c->fn.eval == eval_int) return KIND_INT;
+  return KIND_EXPR;
+}
+
+/* Binds the operands of a binary operation: leaves into a and b, expressions into kids. */
+static Closure *binary(IMP_ClosureProgram *program, const EvalFn fns[3][3], Closure *l, Closure *r) {
+  int lk = kind(l), rk = kind(r);
+  Closure *c = closure_new(program);
+  if (lk == KIND_INT && rk == KIND_INT) {
+    /* Fold by evaluating the int-int operation through the var-var function. */
+    int operands[2] = { l->a, r->a };
+    Closure fold = { 0 };
+    fold.a = 0;
+    fold.b = 1;
+    c->fn.eval = eval_int;
+    c->a = fns[KIND_VAR][KIND_VAR](&fold, operands);
+    return c;
+  }
+  c->fn.eval = fns[lk][rk];
+  if (lk == KIND_EXPR) c->kids[0] = l;
+  else c->a = l->a;
+  if (rk == KIND_EXPR) c->kids[1] = r;
+  else c->b = r->a;
+  return c;
+}
+
+static Closure *compile_aexpr(IMP_ClosureProgram *program, const IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_INT: {
+      Closure *c = closure_new(program);
+      c->fn.eval = eval_int;
+      c->a = node->data.integer.val;
+      return c;
+    }
+    case IMP_AST_NT_VAR: {
+      Closure *c = closure_new(program);
+      c->fn.eval = eval_var;
+      c->a = node->data.variable.slot;
+      return c;
+    }
+    case IMP_AST_NT_AOP: {
+      Closure *l = compile_aexpr(program, node->data.arith_op.l_aexpr);
+      Closure *r = compile_aexpr(program, node->data.arith_op.r_aexpr);
+      return binary(program, arith_fns[node->data.arith_op.aopr], l, r);
+    }
+    default: assert(0);
+  }
+  return NULL;
+}
+
+static Closure *compile_bexpr(IMP_ClosureProgram *program, const IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_BOP: {
+      Closure *c = closure_new(program);
+      c->fn.eval = node->data.bool_op.bopr == IMP_AST_BOP_AND ? eval_and : eval_or;
+      c->kids[0] = compile_bexpr(program, node->data.bool_op.l_bexpr);
+      c->kids[1] = compile_bexpr(program, node->data.bool_op.r_bexpr);
+      return c;
+    }
+    case IMP_AST_NT_NOT: {
+      Closure *c = closure_new(program);
+      c->fn.eval = eval_not;
+      c->kids[0] = compile_bexpr(program, node->data.bool_not.bexpr);
+      return c;
+    }
+    case IMP_AST_NT_ROP: {
+      Closure *l = compile_aexpr(program, node->data.rel_op.l_aexpr);
+      Closure *r = compile_aexpr(program, node->data.rel_op.r_aexpr);
+      return binary(program, rel_fns[node->data.rel_op.ropr], l, r);
+    }
+    default: assert(0);
+  }
+  return NULL;
+}
+
+static Closure *compile_stmt(IMP_ClosureProgram *program, const IMP_ASTNode *node) {
+  Closure *c = closure_new(program);
+  switch (node->type) {
+    case IMP_AST_NT_SKIP:
+      c->fn.exec = exec_skip;
+      break;
+    case IMP_AST_NT_ASSIGN: {
+      Closure *val = compile_aexpr(program, node->data.assign.aexpr);
+      c->a = node->data.assign.var->data.variable.slot;
+      if (val->fn.eval == eval_int) {
+        c->fn.exec = exec_assign_int;
+        c->b = val->a;
+      } else {
+        c->fn.exec = exec_assign;
+        c->kids[0] = val;
+      }
+      break;
+    }
+    case IMP_AST_NT_SEQ:
+      c->fn.exec = exec_seq;
+      c->kids[0] = compile_stmt(program, node->data.seq.fst_stmt);
+      c->kids[1] = compile_stmt(program, node->data.seq.snd_stmt);
+      break;
+    case IMP_AST_NT_BLOCK:
+      c->fn.exec = exec_block;
+      c->len = node->data.block.len;
+      c->list = malloc(sizeof(Closure *) * (c->len + 1));
+      assert(c->list && "Memory allocation failed");
+      for (int i = 0; i < c->len; ++i) c->list[i] = compile_stmt(program, node->data.block.stmts[i]);
+      break;
+    case IMP_AST_NT_IF:
+      c->fn.exec = exec_if;
+      c->kids[0] = compile_bexpr(program, node->data.if_stmt.cond_bexpr);
+      c->kids[1] = compile_stmt(program, node->data.if_stmt.then_stmt);
+      c->kids[2] = compile_stmt(program, node->data.if_stmt.else_stmt);
+      break;
+    case IMP_AST_NT_WHILE:
+      c->fn.exec = exec_while;
+      c->kids[0] = compile_bexpr(program, node->data.while_stmt.cond_bexpr);
+      c->kids[1] = compile_stmt(program, node->data.while_stmt.body_stmt);
+      break;
+    case IMP_AST_NT_LET:
+      c->fn.exec = exec_let;
+      c->a = node->data.let_stmt.var->data.variable.slot;
+      c->kids[0] = compile_aexpr(program, node->data.let_stmt.aexpr);
+      c->kids[1] = compile_stmt(program, node->data.let_stmt.body_stmt);
+      break;
+    case IMP_AST_NT_PROCDECL:
+      c->fn.exec = exec_procdecl;
+      c->node = node;
+      break;
+    case IMP_AST_NT_PROCCALL: {
+      c->fn.exec = exec_proccall;
+      c->node = node;
+      Closure **args = NULL;
+      for (IMP_ASTNodeList *arg = node->data.proc_call.val_args; arg; arg = arg->next) {
+        arrput(args, compile_aexpr(program, arg->node));
+      }
+      c->len = (int)arrlen(args);
+      c->list = malloc(sizeof(Closure *) * (c->len + 1));
+      assert(c->list && "Memory allocation failed");
+      for (int i = 0; i < c->len; ++i) c->list[i] = args[i];
+      arrfree(args);
+      break;
+    }
+    default: assert(0);
+  }
+  return c;
+}
+
+static Closure *procedure_body(IMP_ClosureProgram *program, const IMP_ASTNode *procdecl) {
+  ptrdiff_t index = hmgeti(program->bodies, procdecl);
+  if (index >= 0) return program->bodies[index].value;
+  Closure *body = compile_stmt(program, procdecl->data.proc_decl.body_stmt);
+  hmput(program->bodies, procdecl, body);
+  return body;
+}
+
+IMP_ClosureProgram *imp_closure_compile(const IMP_ASTNode *node) {
+  IMP_ClosureProgram *program = calloc(1, sizeof(IMP_ClosureProgram));
+  assert(program && "Memory allocation failed");
+  program->root = compile_stmt(program, node);
+  return program;
+}
+
+int imp_closure_run(IMP_InterpreterContext *context, IMP_ClosureProgram *program) {
+  return program->root->fn.exec(program->root, context, imp_interpreter_context_frame(context));
+}
+
+void imp_closure_destroy(IMP_ClosureProgram *program) {
+  if (!program) return;
+  for (ptrdiff_t i = 0; i < arrlen(program->closures); ++i) {
+    free(program->closures[i]->list);
+    free(program->closures[i]);
+  }
+  arrfree(program->closures);
+  hmfree(program->bodies);
+  free(program);
+}
@@ -6,49 +6,167 @@
 
 #include "ast.h"
 #include "interpreter.h"
+#include "resolver.h"
+#include "optimizer.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "jit.h"
+#include "closure.h"
+#include "flat_ast.h"
+#include "ir.h"
+#include "ir_pass.h"
 
 
 typedef void *YY_BUFFER_STATE;
 extern FILE *yyin;
 extern IMP_ASTNode *ast_root;
+extern IMP_ASTArena *ast_arena;
 extern int yyparse(void);
 extern void yyrestart (FILE*);
 extern YY_BUFFER_STATE yy_scan_string(const char*);
 extern void yy_delete_buffer(YY_BUFFER_STATE);
 
-int imp_driver_interpret_file (IMP_InterpreterContext *context, const char *path) {
+const IMP_DriverOptions imp_driver_default_options = {
+  .engine = IMP_DRIVER_ENGINE_AST,
+  .stack_limit = 256 * 1024 * 1024,
+  .fused_report = 0,
+  .trace_threshold = IMP_TRACER_DEFAULT_THRESHOLD,
+  .trace_stats = 0,
+  .optimize = 0,
+  .optimize_stats = 0,
+  .optimizer = { .whole_program = 0, .licm = 1, .cse = 1, .accumulate = 1, .inline_size = 40, .specialize_budget = 400 },
+};
+
+static void print_fused_report(const IMP_BytecodeChunk *chunk) {
+  fprintf(stderr, "Superinstructions:\n");
+  for (IMP_Opcode op = IMP_OP_INC; op < IMP_OP_COUNT; ++op) {
+    fprintf(stderr, "  %-6s %d\n", imp_bytecode_opcode_name(op), imp_bytecode_count(chunk, op));
+  }
+}
+
+static void print_trace_stats(IMP_Tracer *tracer) {
+  const IMP_TraceStats *stats = imp_tracer_stats(tracer);
+  fprintf(stderr, "Traces:\n");
+  fprintf(stderr, "  recorded     %ld\n", stats->recorded);
+  fprintf(stderr, "  aborted      %ld\n", stats->aborted);
+  fprintf(stderr, "  entries      %ld\n", stats->entries);
+  fprintf(stderr, "  guard exits  %ld\n", stats->guard_exits);
+  fprintf(stderr, "  iterations   %ld\n", stats->iterations);
+  fprintf(stderr, "  time         %.6fs\n", stats->seconds);
+}
+
+static void print_optimizer_stats(const IMP_OptimizerStats *stats) {
+  fprintf(stderr, "Optimizer:\n");
+  fprintf(stderr, "  nodes removed  %d\n", stats->nodes_removed);
+  fprintf(stderr, "  hoisted        %d\n", stats->hoisted);
+  fprintf(stderr, "  cse eliminated %d\n", stats->cse_eliminated);
+  fprintf(stderr, "  inlined        %d\n", stats->inlined);
+  fprintf(stderr, "  specialized    %d\n", stats->specialized);
+  fprintf(stderr, "  accumulated    %d", stats->accumulated);
+  for (int i = 0; i < stats->accumulated; ++i) {
+    fprintf(stderr, "%s%s", i ? ", " : " (", stats->accumulated_procs[i]->name);
+  }
+  fprintf(stderr, "%s\n", stats->accumulated ? ")" : "");
+}
+
+static int execute(IMP_InterpreterContext *context, IMP_ASTNode *node, IMP_ASTArena *arena, const IMP_DriverOptions *options) {
+  if (!options) options = &imp_driver_default_options;
+  if (imp_resolver_resolve(context, node)) return -1;
+  if (options->optimize) {
+    /* Resolved before optimizing as well, which declares the variables of the program as written,
+     * including those whose references the optimizer removes. */
+    IMP_OptimizerStats stats;
+    node = imp_optimizer_optimize(context, node, arena, &options->optimizer, &stats);
+    if (options->optimize_stats) print_optimizer_stats(&stats);
+    imp_optimizer_stats_free(&stats);
+    if (imp_resolver_resolve(context, node)) return -1;
+  }
+  imp_interpreter_context_set_stack_limit(context, options->stack_limit);
+  switch (options->engine) {
+    case IMP_DRIVER_ENGINE_AST: {
+      IMP_Tracer *tracer = imp_interpreter_context_tracer(context);
+      imp_tracer_set_threshold(tracer, options->trace_threshold);
+      int ret = imp_interpreter_interpret_ast(context, node);
+      if (options->trace_stats) print_trace_stats(tracer);
+      return ret;
+    }
+    case IMP_DRIVER_ENGINE_STACK:
+      return imp_interpreter_interpret_ast_iterative(context, node);
+    case IMP_DRIVER_ENGINE_VM: {
+      IMP_BytecodeChunk *chunk = imp_bytecode_compile(context, node);
+      if (options->fused_report) print_fused_report(chunk);
+      int ret = imp_vm_run(context, chunk);
+      imp_bytecode_destroy(chunk);
+      return ret;
+    }
+    case IMP_DRIVER_ENGINE_JIT: {
+      IMP_BytecodeChunk *chunk = imp_bytecode_compile(context, node);
+      if (options->fused_report) print_fused_report(chunk);
+      IMP_JitCode *code = imp_jit_compile(chunk);
+      int ret = code ? imp_jit_run(context, chunk, code) : imp_vm_run(context, chunk);
+      imp_jit_destroy(code);
+      imp_bytecode_destroy(chunk);
+      return ret;
+    }
+    case IMP_DRIVER_ENGINE_CLOSURE: {
+      IMP_ClosureProgram *program = imp_closure_compile(node);
+      int ret = imp_closure_run(context, program);
+      imp_closure_destroy(program);
+      return ret;
+    }
+    case IMP_DRIVER_ENGINE_FLAT: {
+      IMP_FlatAST *flat = imp_flat_ast_from_ast(node, context);
+      int ret = imp_flat_ast_interpret(context, flat);
+      imp_flat_ast_destroy(flat);
+      return ret;
+    }
+    case IMP_DRIVER_ENGINE_IR: {
+      IMP_IRPassManager *passes = imp_ir_pass_manager_create_default();
+      IMP_IRProgram *program = imp_ir_build(node, passes);
+      int ret = imp_interpreter_interpret_ir(context, program);
+      imp_ir_destroy(program);
+      imp_ir_pass_manager_destroy(passes);
+      return ret;
+    }
+    default: assert(0);
+  }
+}
+
+IMP_ASTNode *imp_driver_parse_file (const char *path, IMP_ASTArena *arena) {
   yyin = fopen(path, "r");
-  if (!yyin) return -1;
+  if (!yyin) return NULL;
   yyrestart(yyin);
   ast_root = NULL;
-  if (yyparse()) {
-    imp_ast_destroy(ast_root);
-    fclose(yyin);
-    return -1;
-  }
-  if (imp_interpreter_interpret_ast(context, ast_root)) {
-    imp_ast_destroy(ast_root);
-    fclose(yyin);
-    return -1;
-  }
-  imp_ast_destroy(ast_root);
+  ast_arena = arena;
+  int ret = yyparse();
+  ast_arena = NULL;
   fclose(yyin);
-  return 0;
+  return ret ? NULL : ast_root;
+}
+
+int imp_driver_interpret_file (IMP_InterpreterContext *context, const char *path, const IMP_DriverOptions *options) {
+  IMP_ASTArena *arena = imp_ast_arena_create();
+  IMP_ASTNode *node = imp_driver_parse_file(path, arena);
+  int ret = node ? execute(context, node, arena, options) : -1;
+  imp_ast_arena_destroy(arena);
+  return ret;
 }
 
-int imp_driver_interpret_str (IMP_InterpreterContext *context, const char *str) {
+int imp_driver_interpret_str (IMP_InterpreterContext *context, const char *str, const IMP_DriverOptions *options) {
   YY_BUFFER_STATE buf = yy_scan_string(str);
   ast_root = NULL;
+  ast_arena = imp_ast_arena_create();
   if (yyparse()) {
-    imp_ast_destroy(ast_root);
+    imp_ast_arena_destroy(ast_arena);
     yy_delete_buffer(buf);
     return -1;
   }
-  if (imp_interpreter_interpret_ast(context, ast_root)) {
-    imp_ast_destroy(ast_root);
+  if (execute(context, ast_root, ast_arena, options)) {
+    imp_ast_arena_destroy(ast_arena);
     yy_delete_buffer(buf);
     return -1;
   }
+  imp_ast_arena_destroy(ast_arena);
   yy_delete_buffer(buf);
   return 0;
 }
@@ -62,7 +180,7 @@ static void ast_print (IMP_ASTNode *node, int depth) {
     }
     case IMP_AST_NT_ASSIGN: {
       printf("%*sASSIGN %s = ", indent, "", 
-             node->data.assign.var->data.variable.name);
+             node->data.assign.var->data.variable.symbol->name);
       ast_print(node->data.assign.aexpr, 0);
       printf("\n");
       break;
@@ -72,6 +190,10 @@ static void ast_print (IMP_ASTNode *node, int depth) {
       ast_print(node->data.seq.snd_stmt, depth);
       break;
     }
+    case IMP_AST_NT_BLOCK: {
+      for (int i = 0; i < node->data.block.len; ++i) ast_print(node->data.block.stmts[i], depth);
+      break;
+    }
     case IMP_AST_NT_IF: {
       printf("%*sIF (", indent, "");
       ast_print(node->data.if_stmt.cond_bexpr, 0);
@@ -93,7 +215,7 @@ static void ast_print (IMP_ASTNode *node, int depth) {
       break;
     }
     case IMP_AST_NT_VAR: {
-      printf("%s", node->data.variable.name);
+      printf("%s", node->data.variable.symbol->name);
       break;
     }
     case IMP_AST_NT_AOP: {
@@ -143,24 +265,24 @@ static void ast_print (IMP_ASTNode *node, int depth) {
       break;
     }
     case IMP_AST_NT_LET: {
-      printf("%*sLET %s = ", indent, "", node->data.let_stmt.var->data.variable.name);
+      printf("%*sLET %s = ", indent, "", node->data.let_stmt.var->data.variable.symbol->name);
       ast_print(node->data.let_stmt.aexpr, 0);
       printf("\n");
       ast_print(node->data.let_stmt.body_stmt, depth + 1);
       break;
     }
     case IMP_AST_NT_PROCDECL: {
-      printf("%*sPROC %s(", indent, "", node->data.proc_decl.name);
+      printf("%*sPROC %s(", indent, "", node->data.proc_decl.symbol->name);
       IMP_ASTNodeList *args = node->data.proc_decl.val_args;
       while (args) {
-        printf("%s", args->node->data.variable.name);
+        printf("%s", args->node->data.variable.symbol->name);
         args = args->next;
         if (args) printf(", ");
       }
       printf("; ");
       IMP_ASTNodeList *vargs = node->data.proc_decl.var_args;
       while (vargs) {
-        printf("%s", vargs->node->data.variable.name);
+        printf("%s", vargs->node->data.variable.symbol->name);
         vargs = vargs->next;
         if (vargs) printf(", ");
       }
@@ -169,7 +291,7 @@ static void ast_print (IMP_ASTNode *node, int depth) {
       break;
     }
     case IMP_AST_NT_PROCCALL: {
-      printf("%*sCALL %s(", indent, "", node->data.proc_call.name);
+      printf("%*sCALL %s(", indent, "", node->data.proc_call.symbol->name);
       IMP_ASTNodeList *args = node->data.proc_call.val_args;
       while (args) {
         ast_print(args->node, 0);
@@ -179,7 +301,7 @@ static void ast_print (IMP_ASTNode *node, int depth) {
       printf("; ");
       IMP_ASTNodeList *vargs = node->data.proc_call.var_args;
       while (vargs) {
-        printf("%s", vargs->node->data.variable.name);
+        printf("%s", vargs->node->data.variable.symbol->name);
         vargs = vargs->next;
         if (vargs) printf(", ");
       }
@@ -190,26 +312,79 @@ static void ast_print (IMP_ASTNode *node, int depth) {
   }
 }
 
-int imp_driver_print_ast_file (const char *path) {
-  yyin = fopen(path, "r");
-  if (!yyin) return -1;
-  yyrestart(yyin);
-  if (yyparse()) {
-    imp_ast_destroy(ast_root);
-    fclose(yyin);
-    return -1;
+int imp_driver_print_ast_file (const char *path, const IMP_DriverOptions *options) {
+  if (!options) options = &imp_driver_default_options;
+  IMP_ASTArena *arena = imp_ast_arena_create();
+  IMP_ASTNode *node = imp_driver_parse_file(path, arena);
+  if (node && options->optimize) {
+    IMP_OptimizerOptions optimizer = options->optimizer;
+    optimizer.whole_program = 1;
+    node = imp_optimizer_optimize(NULL, node, arena, &optimizer, NULL);
   }
-  ast_print(ast_root, 0);
-  imp_ast_destroy(ast_root);
-  fclose(yyin);
-  return 0;
+  if (node) ast_print(node, 0);
+  imp_ast_arena_destroy(arena);
+  return node ? 0 : -1;
+}
+
+/* Prints the IR of the procedures declared by a statement, including nested ones. */
+static void print_procedure_irs(IMP_IRProgram *program, const IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_SEQ:
+      print_procedure_irs(program, node->data.seq.fst_stmt);
+      print_procedure_irs(program, node->data.seq.snd_stmt);
+      return;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) print_procedure_irs(program, node->data.block.stmts[i]);
+      return;
+    case IMP_AST_NT_IF:
+      print_procedure_irs(program, node->data.if_stmt.then_stmt);
+      print_procedure_irs(program, node->data.if_stmt.else_stmt);
+      return;
+    case IMP_AST_NT_WHILE:
+      print_procedure_irs(program, node->data.while_stmt.body_stmt);
+      return;
+    case IMP_AST_NT_LET:
+      print_procedure_irs(program, node->data.let_stmt.body_stmt);
+      return;
+    case IMP_AST_NT_PROCDECL:
+      imp_ir_print(imp_ir_program_procedure(program, node), stdout);
+      print_procedure_irs(program, node->data.proc_decl.body_stmt);
+      return;
+    default:
+      return;
+  }
+}
+
+int imp_driver_print_ir_file (const char *path, const IMP_DriverOptions *options) {
+  if (!options) options = &imp_driver_default_options;
+  IMP_ASTArena *arena = imp_ast_arena_create();
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  IMP_ASTNode *node = imp_driver_parse_file(path, arena);
+  int ret = node ? imp_resolver_resolve(context, node) : -1;
+  if (!ret && options->optimize) {
+    IMP_OptimizerOptions optimizer = options->optimizer;
+    optimizer.whole_program = 1;
+    node = imp_optimizer_optimize(context, node, arena, &optimizer, NULL);
+    ret = imp_resolver_resolve(context, node);
+  }
+  if (!ret) {
+    IMP_IRPassManager *passes = imp_ir_pass_manager_create_default();
+    IMP_IRProgram *program = imp_ir_build(node, passes);
+    imp_ir_print(imp_ir_program_main(program), stdout);
+    print_procedure_irs(program, node);
+    imp_ir_destroy(program);
+    imp_ir_pass_manager_destroy(passes);
+  }
+  imp_interpreter_context_destroy(context);
+  imp_ast_arena_destroy(arena);
+  return ret;
 }
 
 void imp_driver_print_var_table(IMP_InterpreterContext *context) {
   IMP_InterpreterContextVarIter *iter = imp_interpreter_context_var_iter_create(context);
   const IMP_InterpreterContextVarTableEntry *var_entry;
   while ((var_entry = imp_interpreter_context_var_iter_next(iter))) {
-    printf("%s = %d\n", var_entry->key, var_entry->value);
+    printf("%s = %d\n", var_entry->key->name, var_entry->value);
   }
   imp_interpreter_context_var_iter_destroy(iter);
 }
@@ -219,17 +394,17 @@ void imp_driver_print_proc_table(IMP_InterpreterContext *context) {
   const IMP_InterpreterContextProcTableEntry *proc_entry;
   while ((proc_entry = imp_interpreter_context_proc_iter_next(iter))) {
     const IMP_ASTNode *procdecl = proc_entry->value;
-    printf("%s(", proc_entry->key);
+    printf("%s(", proc_entry->key->name);
     IMP_ASTNodeList *args = procdecl->data.proc_decl.val_args;
     while (args) {
-      printf("%s", args->node->data.variable.name);
+      printf("%s", args->node->data.variable.symbol->name);
       args = args->next;
       if (args) printf(", ");
     }
     printf("; ");
     IMP_ASTNodeList *vargs = procdecl->data.proc_decl.var_args;
     while (vargs) {
-      printf("%s", vargs->node->data.variable.name);
+      printf("%s", vargs->node->data.variable.symbol->name);
       vargs = vargs->next;
       if (vargs) printf(", ");
     }
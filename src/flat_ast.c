@@ -0,0 +1,445 @@
+#include "flat_ast.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "3rdparty/stb_ds/stb_ds.h"
+
+
+typedef struct NameEntry {
+  const IMP_Symbol *key;
+  int32_t value;
+} NameEntry;
+
+typedef struct FlatBuilder {
+  IMP_FlatNode *nodes;
+  int32_t *extra;
+  const IMP_Symbol **symbols;
+  int32_t *decls;
+  NameEntry *symbol_ids;
+  NameEntry *program_procs;
+  NameEntry *context_procs;
+  int32_t *calls;
+  int predeclaring;
+} FlatBuilder;
+
+static int32_t flat_symbol(FlatBuilder *builder, const IMP_Symbol *symbol) {
+  ptrdiff_t index = hmgeti(builder->symbol_ids, symbol);
+  if (index >= 0) return builder->symbol_ids[index].value;
+  int32_t id = (int32_t)arrlen(builder->symbols);
+  arrput(builder->symbols, symbol);
+  hmput(builder->symbol_ids, symbol, id);
+  return id;
+}
+
+static int32_t flat_list_len(const IMP_ASTNodeList *list) {
+  int32_t len = 0;
+  for (; list; list = list->next) len++;
+  return len;
+}
+
+static int32_t flatten(FlatBuilder *builder, const IMP_ASTNode *node);
+
+static void flatten_list(FlatBuilder *builder, const IMP_ASTNodeList *list, int32_t offset) {
+  for (; list; list = list->next) {
+    int32_t child = flatten(builder, list->node);
+    builder->extra[offset++] = child;
+  }
+}
+
+static int32_t flatten(FlatBuilder *builder, const IMP_ASTNode *node) {
+  IMP_FlatNode flat_node = { (uint8_t)node->type, 0, 0, 0, 0 };
+  int32_t index = (int32_t)arrlen(builder->nodes);
+  arrput(builder->nodes, flat_node);
+  int32_t a = 0, b = 0, c = 0;
+  switch (node->type) {
+    case IMP_AST_NT_SKIP:
+      break;
+    case IMP_AST_NT_ASSIGN:
+      a = flatten(builder, node->data.assign.var);
+      b = flatten(builder, node->data.assign.aexpr);
+      break;
+    case IMP_AST_NT_SEQ:
+      a = flatten(builder, node->data.seq.fst_stmt);
+      b = flatten(builder, node->data.seq.snd_stmt);
+      break;
+    case IMP_AST_NT_BLOCK: {
+      int32_t len = node->data.block.len;
+      a = (int32_t)arrlen(builder->extra);
+      arrput(builder->extra, len);
+      arraddnptr(builder->extra, len);
+      for (int32_t i = 0; i < len; ++i) {
+        int32_t child = flatten(builder, node->data.block.stmts[i]);
+        builder->extra[a + 1 + i] = child;
+      }
+      break;
+    }
+    case IMP_AST_NT_IF:
+      a = flatten(builder, node->data.if_stmt.cond_bexpr);
+      b = flatten(builder, node->data.if_stmt.then_stmt);
+      c = flatten(builder, node->data.if_stmt.else_stmt);
+      break;
+    case IMP_AST_NT_WHILE:
+      a = flatten(builder, node->data.while_stmt.cond_bexpr);
+      b = flatten(builder, node->data.while_stmt.body_stmt);
+      break;
+    case IMP_AST_NT_INT:
+      a = node->data.integer.val;
+      break;
+    case IMP_AST_NT_VAR:
+      a = flat_symbol(builder, node->data.variable.symbol);
+      b = node->data.variable.slot;
+      break;
+    case IMP_AST_NT_AOP:
+      builder->nodes[index].op = (uint8_t)node->data.arith_op.aopr;
+      a = flatten(builder, node->data.arith_op.l_aexpr);
+      b = flatten(builder, node->data.arith_op.r_aexpr);
+      break;
+    case IMP_AST_NT_BOP:
+      builder->nodes[index].op = (uint8_t)node->data.bool_op.bopr;
+      a = flatten(builder, node->data.bool_op.l_bexpr);
+      b = flatten(builder, node->data.bool_op.r_bexpr);
+      break;
+    case IMP_AST_NT_NOT:
+      a = flatten(builder, node->data.bool_not.bexpr);
+      break;
+    case IMP_AST_NT_ROP:
+      builder->nodes[index].op = (uint8_t)node->data.rel_op.ropr;
+      a = flatten(builder, node->data.rel_op.l_aexpr);
+      b = flatten(builder, node->data.rel_op.r_aexpr);
+      break;
+    case IMP_AST_NT_LET:
+      a = flatten(builder, node->data.let_stmt.var);
+      b = flatten(builder, node->data.let_stmt.aexpr);
+      c = flatten(builder, node->data.let_stmt.body_stmt);
+      break;
+    case IMP_AST_NT_PROCDECL: {
+      const IMP_Symbol *name = node->data.proc_decl.symbol;
+      int32_t val_argc = flat_list_len(node->data.proc_decl.val_args);
+      int32_t var_argc = flat_list_len(node->data.proc_decl.var_args);
+      a = flat_symbol(builder, name);
+      c = (int32_t)arrlen(builder->extra);
+      arrput(builder->extra, val_argc);
+      arrput(builder->extra, var_argc);
+      arrput(builder->extra, node->data.proc_decl.frame_size);
+      arrput(builder->extra, (int32_t)arrlen(builder->decls));
+      arraddnptr(builder->extra, val_argc + var_argc);
+      arrput(builder->decls, index);
+      if (!builder->predeclaring && hmgeti(builder->program_procs, name) < 0) {
+        hmput(builder->program_procs, name, index);
+      }
+      flatten_list(builder, node->data.proc_decl.val_args, c + 4);
+      flatten_list(builder, node->data.proc_decl.var_args, c + 4 + val_argc);
+      b = flatten(builder, node->data.proc_decl.body_stmt);
+      break;
+    }
+    case IMP_AST_NT_PROCCALL: {
+      int32_t val_argc = flat_list_len(node->data.proc_call.val_args);
+      int32_t var_argc = flat_list_len(node->data.proc_call.var_args);
+      a = flat_symbol(builder, node->data.proc_call.symbol);
+      b = (int32_t)arrlen(builder->extra);
+      arrput(builder->extra, val_argc);
+      arrput(builder->extra, var_argc);
+      arrput(builder->extra, -1);
+      arraddnptr(builder->extra, val_argc + var_argc);
+      arrput(builder->calls, index);
+      flatten_list(builder, node->data.proc_call.val_args, b + 3);
+      flatten_list(builder, node->data.proc_call.var_args, b + 3 + val_argc);
+      break;
+    }
+    default: assert(0);
+  }
+  builder->nodes[index].a = a;
+  builder->nodes[index].b = b;
+  builder->nodes[index].c = c;
+  return index;
+}
+
+static void flat_link_call(FlatBuilder *builder, IMP_InterpreterContext *context, int32_t call) {
+  const IMP_Symbol *name = builder->symbols[builder->nodes[call].a];
+  int32_t *target = &builder->extra[builder->nodes[call].b + 2];
+  const IMP_ASTNode *decl = context ? imp_interpreter_context_proc_get(context, name) : NULL;
+  if (decl) {
+    ptrdiff_t index = hmgeti(builder->context_procs, name);
+    if (index >= 0) {
+      *target = builder->context_procs[index].value;
+    } else {
+      builder->predeclaring = 1;
+      int32_t decl_index = flatten(builder, decl);
+      hmput(builder->context_procs, name, decl_index);
+      target = &builder->extra[builder->nodes[call].b + 2];
+      *target = decl_index;
+    }
+    return;
+  }
+  ptrdiff_t index = hmgeti(builder->program_procs, name);
+  if (index >= 0) *target = builder->program_procs[index].value;
+}
+
+IMP_FlatAST *imp_flat_ast_from_ast(const IMP_ASTNode *node, IMP_InterpreterContext *context) {
+  FlatBuilder builder = { 0 };
+  IMP_FlatAST *flat = malloc(sizeof(IMP_FlatAST));
+  assert(flat && "Memory allocation failed");
+  flat->root = flatten(&builder, node);
+  flat->predeclared = (int32_t)arrlen(builder.decls);
+  for (ptrdiff_t i = 0; i < arrlen(builder.calls); ++i) flat_link_call(&builder, context, builder.calls[i]);
+  flat->nodes = builder.nodes;
+  flat->nodes_len = (int32_t)arrlen(builder.nodes);
+  flat->extra = builder.extra;
+  flat->extra_len = (int32_t)arrlen(builder.extra);
+  flat->symbols = builder.symbols;
+  flat->symbols_len = (int32_t)arrlen(builder.symbols);
+  flat->decls = builder.decls;
+  flat->decls_len = (int32_t)arrlen(builder.decls);
+  hmfree(builder.symbol_ids);
+  hmfree(builder.program_procs);
+  hmfree(builder.context_procs);
+  arrfree(builder.calls);
+  return flat;
+}
+
+static IMP_ASTNodeList *flat_list_to_ast(const IMP_FlatAST *flat, int32_t offset, int32_t len, IMP_ASTArena *arena) {
+  IMP_ASTNodeList *list = NULL;
+  for (int32_t i = len - 1; i >= 0; --i) {
+    list = imp_ast_list(arena, imp_flat_ast_to_ast(flat, flat->extra[offset + i], arena), list);
+  }
+  return list;
+}
+
+IMP_ASTNode *imp_flat_ast_to_ast(const IMP_FlatAST *flat, int32_t index, IMP_ASTArena *arena) {
+  const IMP_FlatNode *node = &flat->nodes[index];
+  switch ((IMP_ASTNodeType)node->type) {
+    case IMP_AST_NT_SKIP: return imp_ast_skip(arena);
+    case IMP_AST_NT_ASSIGN: return imp_ast_assign(arena,
+      imp_flat_ast_to_ast(flat, node->a, arena),
+      imp_flat_ast_to_ast(flat, node->b, arena));
+    case IMP_AST_NT_SEQ: return imp_ast_seq(arena,
+      imp_flat_ast_to_ast(flat, node->a, arena),
+      imp_flat_ast_to_ast(flat, node->b, arena));
+    case IMP_AST_NT_BLOCK: {
+      int32_t len = flat->extra[node->a];
+      IMP_ASTNode **stmts = malloc(sizeof(IMP_ASTNode *) * (len > 0 ? len : 1));
+      assert(stmts && "Memory allocation failed");
+      for (int32_t i = 0; i < len; ++i) stmts[i] = imp_flat_ast_to_ast(flat, flat->extra[node->a + 1 + i], arena);
+      IMP_ASTNode *block = imp_ast_block(arena, stmts, len);
+      free(stmts);
+      return block;
+    }
+    case IMP_AST_NT_IF: return imp_ast_if(arena,
+      imp_flat_ast_to_ast(flat, node->a, arena),
+      imp_flat_ast_to_ast(flat, node->b, arena),
+      imp_flat_ast_to_ast(flat, node->c, arena));
+    case IMP_AST_NT_WHILE: return imp_ast_while(arena,
+      imp_flat_ast_to_ast(flat, node->a, arena),
+      imp_flat_ast_to_ast(flat, node->b, arena));
+    case IMP_AST_NT_INT: return imp_ast_int(arena, node->a);
+    case IMP_AST_NT_VAR: {
+      IMP_ASTNode *var = imp_ast_var(arena, flat->symbols[node->a]);
+      var->data.variable.slot = node->b;
+      return var;
+    }
+    case IMP_AST_NT_AOP: return imp_ast_aop(arena,
+      (IMP_ASTArithmeticOperator)node->op,
+      imp_flat_ast_to_ast(flat, node->a, arena),
+      imp_flat_ast_to_ast(flat, node->b, arena));
+    case IMP_AST_NT_BOP: return imp_ast_bop(arena,
+      (IMP_ASTBooleanOperator)node->op,
+      imp_flat_ast_to_ast(flat, node->a, arena),
+      imp_flat_ast_to_ast(flat, node->b, arena));
+    case IMP_AST_NT_NOT: return imp_ast_not(arena,
+      imp_flat_ast_to_ast(flat, node->a, arena));
+    case IMP_AST_NT_ROP: return imp_ast_rop(arena,
+      (IMP_ASTRelationalOperator)node->op,
+      imp_flat_ast_to_ast(flat, node->a, arena),
+      imp_flat_ast_to_ast(flat, node->b, arena));
+    case IMP_AST_NT_LET: return imp_ast_let(arena,
+      imp_flat_ast_to_ast(flat, node->a, arena),
+      imp_flat_ast_to_ast(flat, node->b, arena),
+      imp_flat_ast_to_ast(flat, node->c, arena));
+    case IMP_AST_NT_PROCDECL: {
+      const int32_t *extra = &flat->extra[node->c];
+      IMP_ASTNode *decl = imp_ast_procdecl(arena,
+        flat->symbols[node->a],
+        flat_list_to_ast(flat, node->c + 4, extra[0], arena),
+        flat_list_to_ast(flat, node->c + 4 + extra[0], extra[1], arena),
+        imp_flat_ast_to_ast(flat, node->b, arena));
+      decl->data.proc_decl.frame_size = extra[2];
+      return decl;
+    }
+    case IMP_AST_NT_PROCCALL: {
+      const int32_t *extra = &flat->extra[node->b];
+      return imp_ast_proccall(arena,
+        flat->symbols[node->a],
+        flat_list_to_ast(flat, node->b + 3, extra[0], arena),
+        flat_list_to_ast(flat, node->b + 3 + extra[0], extra[1], arena));
+    }
+    default: assert(0 && "Unknown AST node type");
+  }
+}
+
+void imp_flat_ast_destroy(IMP_FlatAST *flat) {
+  if (!flat) return;
+  arrfree(flat->symbols);
+  arrfree(flat->nodes);
+  arrfree(flat->extra);
+  arrfree(flat->decls);
+  free(flat);
+}
+
+typedef struct FlatInterpreter {
+  IMP_InterpreterContext *context;
+  const IMP_FlatAST *flat;
+  const IMP_FlatNode *nodes;
+  const int32_t *extra;
+  char *declared;
+} FlatInterpreter;
+
+static int flat_eval_aexpr(const IMP_FlatNode *nodes, int *frame, int32_t index) {
+  const IMP_FlatNode *node = &nodes[index];
+  switch ((IMP_ASTNodeType)node->type) {
+    case IMP_AST_NT_INT: return node->a;
+    case IMP_AST_NT_VAR: return frame[node->b];
+    case IMP_AST_NT_AOP: {
+      int l_val = flat_eval_aexpr(nodes, frame, node->a);
+      int r_val = flat_eval_aexpr(nodes, frame, node->b);
+      switch ((IMP_ASTArithmeticOperator)node->op) {
+        case IMP_AST_AOP_ADD: return l_val + r_val;
+        case IMP_AST_AOP_SUB: return l_val - r_val;
+        case IMP_AST_AOP_MUL: return l_val * r_val;
+        default: assert(0); return 0;
+      }
+    }
+    default: assert(0);
+  }
+}
+
+static int flat_eval_bexpr(const IMP_FlatNode *nodes, int *frame, int32_t index) {
+  const IMP_FlatNode *node = &nodes[index];
+  switch ((IMP_ASTNodeType)node->type) {
+    case IMP_AST_NT_BOP: {
+      int l_val = flat_eval_bexpr(nodes, frame, node->a);
+      int r_val = flat_eval_bexpr(nodes, frame, node->b);
+      switch ((IMP_ASTBooleanOperator)node->op) {
+        case IMP_AST_BOP_AND: return l_val && r_val;
+        case IMP_AST_BOP_OR:  return l_val || r_val;
+        default: assert(0); return 0;
+      }
+    }
+    case IMP_AST_NT_NOT: return !flat_eval_bexpr(nodes, frame, node->a);
+    case IMP_AST_NT_ROP: {
+      int l_val = flat_eval_aexpr(nodes, frame, node->a);
+      int r_val = flat_eval_aexpr(nodes, frame, node->b);
+      switch ((IMP_ASTRelationalOperator)node->op) {
+        case IMP_AST_ROP_EQ: return l_val == r_val;
+        case IMP_AST_ROP_NE: return l_val != r_val;
+        case IMP_AST_ROP_LT: return l_val < r_val;
+        case IMP_AST_ROP_LE: return l_val <= r_val;
+        case IMP_AST_ROP_GT: return l_val > r_val;
+        case IMP_AST_ROP_GE: return l_val >= r_val;
+        default: assert(0); return 0;
+      }
+    }
+    default: assert(0);
+  }
+}
+
+static int flat_interpret(FlatInterpreter *interpreter, int *frame, int32_t index);
+
+static int flat_interpret_procdecl(FlatInterpreter *interpreter, const IMP_FlatNode *node, int32_t index) {
+  const IMP_Symbol *name = interpreter->flat->symbols[node->a];
+  if (imp_interpreter_context_proc_get(interpreter->context, name)) {
+    fprintf(stderr, "Error: procedure %s already defined\n", name->name);
+    return -1;
+  }
+  IMP_ASTArena *arena = imp_ast_arena_create();
+  imp_interpreter_context_proc_set(interpreter->context, name, imp_flat_ast_to_ast(interpreter->flat, index, arena));
+  imp_ast_arena_destroy(arena);
+  interpreter->declared[interpreter->extra[node->c + 3]] = 1;
+  return 0;
+}
+
+static int flat_interpret_proccall(FlatInterpreter *interpreter, int *frame, const IMP_FlatNode *node) {
+  const IMP_Symbol *name = interpreter->flat->symbols[node->a];
+  const int32_t *call = &interpreter->extra[node->b];
+  int32_t target = call[2];
+  if (target < 0 || !interpreter->declared[interpreter->extra[interpreter->nodes[target].c + 3]]) {
+    fprintf(stderr, "Error: procedure %s not defined\n", name->name);
+    return -1;
+  }
+  const IMP_FlatNode *procdecl = &interpreter->nodes[target];
+  const int32_t *decl = &interpreter->extra[procdecl->c];
+  if (call[0] != decl[0]) {
+    fprintf(stderr, "Error: procedure %s called with wrong number of value arguments\n", name->name);
+    return -1;
+  }
+  IMP_FrameStack *frame_stack = imp_interpreter_context_frame_stack(interpreter->context);
+  int *proc_frame = imp_frame_stack_push(frame_stack, decl[2]);
+  if (!proc_frame) {
+    fprintf(stderr, "Error: stack limit exceeded\n");
+    return -1;
+  }
+  for (int32_t i = 0; i < call[0]; ++i) {
+    proc_frame[interpreter->nodes[decl[4 + i]].b] = flat_eval_aexpr(interpreter->nodes, frame, call[3 + i]);
+  }
+  if (flat_interpret(interpreter, proc_frame, procdecl->b)) {
+    imp_frame_stack_pop(frame_stack, proc_frame);
+    return -1;
+  }
+  int32_t var_argc = call[1] < decl[1] ? call[1] : decl[1];
+  for (int32_t i = 0; i < var_argc; ++i) {
+    frame[interpreter->nodes[call[3 + call[0] + i]].b] = proc_frame[interpreter->nodes[decl[4 + decl[0] + i]].b];
+  }
+  imp_frame_stack_pop(frame_stack, proc_frame);
+  if (call[1] != decl[1]) {
+    fprintf(stderr, "Error: procedure %s called with wrong number of variable arguments\n", name->name);
+    return -1;
+  }
+  return 0;
+}
+
+static int flat_interpret(FlatInterpreter *interpreter, int *frame, int32_t index) {
+  const IMP_FlatNode *nodes = interpreter->nodes;
+  const IMP_FlatNode *node = &nodes[index];
+  switch ((IMP_ASTNodeType)node->type) {
+    case IMP_AST_NT_SKIP: return 0;
+    case IMP_AST_NT_ASSIGN:
+      frame[nodes[node->a].b] = flat_eval_aexpr(nodes, frame, node->b);
+      return 0;
+    case IMP_AST_NT_SEQ:
+      if (flat_interpret(interpreter, frame, node->a)) return -1;
+      return flat_interpret(interpreter, frame, node->b);
+    case IMP_AST_NT_BLOCK:
+      for (int32_t i = 0; i < interpreter->extra[node->a]; ++i) {
+        if (flat_interpret(interpreter, frame, interpreter->extra[node->a + 1 + i])) return -1;
+      }
+      return 0;
+    case IMP_AST_NT_IF:
+      if (flat_eval_bexpr(nodes, frame, node->a)) return flat_interpret(interpreter, frame, node->b);
+      else return flat_interpret(interpreter, frame, node->c);
+    case IMP_AST_NT_WHILE:
+      while (flat_eval_bexpr(nodes, frame, node->a)) {
+        if (flat_interpret(interpreter, frame, node->b)) return -1;
+      }
+      return 0;
+    case IMP_AST_NT_LET:
+      frame[nodes[node->a].b] = flat_eval_aexpr(nodes, frame, node->b);
+      return flat_interpret(interpreter, frame, node->c);
+    case IMP_AST_NT_PROCDECL:
+      return flat_interpret_procdecl(interpreter, node, index);
+    case IMP_AST_NT_PROCCALL:
+      return flat_interpret_proccall(interpreter, frame, node);
+    default: assert(0);
+  }
+}
+
+int imp_flat_ast_interpret(IMP_InterpreterContext *context, const IMP_FlatAST *flat) {
+  char *declared = calloc(flat->decls_len + 1, sizeof(char));
+  assert(declared && "Memory allocation failed");
+  for (int32_t i = flat->predeclared; i < flat->decls_len; ++i) declared[i] = 1;
+  FlatInterpreter interpreter = { context, flat, flat->nodes, flat->extra, declared };
+  int ret = flat_interpret(&interpreter, imp_interpreter_context_frame(context), flat->root);
+  free(declared);
+  return ret;
+}
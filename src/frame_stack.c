@@ -0,0 +1,102 @@
+#include "frame_stack.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+
+#define FRAME_STACK_BLOCK_SIZE 4096
+
+typedef struct FrameBlock {
+  struct FrameBlock *prev, *next;
+  size_t capacity;
+  size_t used;
+  int slots[];
+} FrameBlock;
+
+struct IMP_FrameStack {
+  FrameBlock *top;
+  size_t allocations;
+  size_t bytes;
+  size_t limit;
+};
+
+static FrameBlock *block_create(IMP_FrameStack *stack, FrameBlock *prev, size_t capacity) {
+  FrameBlock *block = malloc(sizeof(FrameBlock) + capacity * sizeof(int));
+  assert(block && "Memory allocation failed");
+  block->prev = prev;
+  block->next = NULL;
+  block->capacity = capacity;
+  block->used = 0;
+  stack->allocations++;
+  stack->bytes += capacity * sizeof(int);
+  return block;
+}
+
+IMP_FrameStack *imp_frame_stack_create(void) {
+  IMP_FrameStack *stack = malloc(sizeof(IMP_FrameStack));
+  assert(stack && "Memory allocation failed");
+  stack->allocations = 0;
+  stack->bytes = 0;
+  stack->limit = 0;
+  stack->top = block_create(stack, NULL, FRAME_STACK_BLOCK_SIZE);
+  return stack;
+}
+
+void imp_frame_stack_destroy(IMP_FrameStack *stack) {
+  FrameBlock *block = stack->top;
+  while (block->prev) block = block->prev;
+  while (block) {
+    FrameBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+  free(stack);
+}
+
+void imp_frame_stack_set_limit(IMP_FrameStack *stack, size_t limit) {
+  stack->limit = limit;
+}
+
+int *imp_frame_stack_push(IMP_FrameStack *stack, int size) {
+  FrameBlock *block = stack->top;
+  if (block->capacity - block->used < (size_t)size) {
+    FrameBlock *next = block->next;
+    if (next && next->capacity < (size_t)size) {
+      block->next = NULL;
+      while (next) {
+        FrameBlock *tmp = next->next;
+        stack->bytes -= next->capacity * sizeof(int);
+        free(next);
+        next = tmp;
+      }
+    }
+    if (!next) {
+      size_t capacity = block->capacity * 2;
+      if (stack->limit) {
+        size_t available = stack->bytes < stack->limit ? (stack->limit - stack->bytes) / sizeof(int) : 0;
+        if (available < (size_t)size) return NULL;
+        if (capacity > available) capacity = available;
+      }
+      if (capacity < (size_t)size) capacity = size;
+      next = block_create(stack, block, capacity);
+      block->next = next;
+    }
+    block = stack->top = next;
+  }
+  int *frame = block->slots + block->used;
+  block->used += size;
+  memset(frame, 0, sizeof(int) * size);
+  return frame;
+}
+
+void imp_frame_stack_pop(IMP_FrameStack *stack, int *frame) {
+  FrameBlock *block = stack->top;
+  assert(frame >= block->slots && frame <= block->slots + block->used && "Frame is not on top of the stack");
+  block->used = frame - block->slots;
+  if (block->used == 0 && block->prev) stack->top = block->prev;
+}
+
+size_t imp_frame_stack_allocations(const IMP_FrameStack *stack) {
+  return stack->allocations;
+}
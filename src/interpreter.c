@@ -4,14 +4,58 @@
 #include <stdio.h>
 #include <assert.h>
 
+#include "3rdparty/stb_ds/stb_ds.h"
 
-static int eval_aexpr(IMP_InterpreterContext *context, const IMP_ASTNode *node) {
+
+static int interpret(IMP_InterpreterContext *context, int *frame, const IMP_ASTNode *node);
+
+static int eval_aexpr(int *frame, const IMP_ASTNode *node);
+
+static IMP_ASTQuickening quicken(const IMP_ASTNode *l_aexpr, const IMP_ASTNode *r_aexpr) {
+  int l_var = l_aexpr->type == IMP_AST_NT_VAR, l_int = l_aexpr->type == IMP_AST_NT_INT;
+  int r_var = r_aexpr->type == IMP_AST_NT_VAR, r_int = r_aexpr->type == IMP_AST_NT_INT;
+  if (l_var && r_var) return IMP_AST_QUICK_VAR_VAR;
+  if (l_var && r_int) return IMP_AST_QUICK_VAR_INT;
+  if (l_int && r_var) return IMP_AST_QUICK_INT_VAR;
+  return IMP_AST_QUICK_GENERIC;
+}
+
+/* Evaluates the operands of an operation. On its first execution the operation is rewritten in
+ * place into the variant for its operand kinds, which afterwards loads leaves without recursing. */
+static void eval_operands(int *frame, IMP_ASTQuickening *quick, const IMP_ASTNode *l_aexpr, const IMP_ASTNode *r_aexpr, int *l_val, int *r_val) {
+  switch (*quick) {
+    case IMP_AST_QUICK_VAR_VAR:
+      *l_val = frame[l_aexpr->data.variable.slot];
+      *r_val = frame[r_aexpr->data.variable.slot];
+      return;
+    case IMP_AST_QUICK_VAR_INT:
+      *l_val = frame[l_aexpr->data.variable.slot];
+      *r_val = r_aexpr->data.integer.val;
+      return;
+    case IMP_AST_QUICK_INT_VAR:
+      *l_val = l_aexpr->data.integer.val;
+      *r_val = frame[r_aexpr->data.variable.slot];
+      return;
+    case IMP_AST_QUICK_NONE:
+      *quick = quicken(l_aexpr, r_aexpr);
+      eval_operands(frame, quick, l_aexpr, r_aexpr, l_val, r_val);
+      return;
+    case IMP_AST_QUICK_GENERIC:
+      *l_val = eval_aexpr(frame, l_aexpr);
+      *r_val = eval_aexpr(frame, r_aexpr);
+      return;
+    default: assert(0);
+  }
+}
+
+static int eval_aexpr(int *frame, const IMP_ASTNode *node) {
   switch (node->type) {
     case IMP_AST_NT_INT: return node->data.integer.val;
-    case IMP_AST_NT_VAR: return imp_interpreter_context_var_get(context, node->data.variable.name);
+    case IMP_AST_NT_VAR: return frame[node->data.variable.slot];
     case IMP_AST_NT_AOP: {
-      int l_val = eval_aexpr(context, node->data.arith_op.l_aexpr);
-      int r_val = eval_aexpr(context, node->data.arith_op.r_aexpr);
+      int l_val, r_val;
+      eval_operands(frame, &((IMP_ASTNode *)node)->data.arith_op.quick,
+                    node->data.arith_op.l_aexpr, node->data.arith_op.r_aexpr, &l_val, &r_val);
       switch (node->data.arith_op.aopr) {
         case IMP_AST_AOP_ADD: return l_val + r_val;
         case IMP_AST_AOP_SUB: return l_val - r_val;
@@ -23,21 +67,22 @@ static int eval_aexpr(IMP_InterpreterContext *context, const IMP_ASTNode *node)
   }
 }
 
-static int eval_bexpr(IMP_InterpreterContext *context, const IMP_ASTNode *node) {
+static int eval_bexpr(int *frame, const IMP_ASTNode *node) {
   switch (node->type) {
     case IMP_AST_NT_BOP: {
-      int l_val = eval_bexpr(context, node->data.bool_op.l_bexpr);
-      int r_val = eval_bexpr(context, node->data.bool_op.r_bexpr);
+      int l_val = eval_bexpr(frame, node->data.bool_op.l_bexpr);
+      int r_val = eval_bexpr(frame, node->data.bool_op.r_bexpr);
       switch (node->data.bool_op.bopr) {
         case IMP_AST_BOP_AND: return l_val && r_val;
         case IMP_AST_BOP_OR:  return l_val || r_val;
         default: assert(0);
       }
     }
-    case IMP_AST_NT_NOT: return !eval_bexpr(context, node->data.bool_not.bexpr);
+    case IMP_AST_NT_NOT: return !eval_bexpr(frame, node->data.bool_not.bexpr);
     case IMP_AST_NT_ROP: {
-      int l_val = eval_aexpr(context, node->data.rel_op.l_aexpr);
-      int r_val = eval_aexpr(context, node->data.rel_op.r_aexpr);
+      int l_val, r_val;
+      eval_operands(frame, &((IMP_ASTNode *)node)->data.rel_op.quick,
+                    node->data.rel_op.l_aexpr, node->data.rel_op.r_aexpr, &l_val, &r_val);
       switch (node->data.rel_op.ropr) {
         case IMP_AST_ROP_EQ: return l_val == r_val;
         case IMP_AST_ROP_NE: return l_val != r_val;
@@ -52,98 +97,412 @@ static int eval_bexpr(IMP_InterpreterContext *context, const IMP_ASTNode *node)
   }
 }
 
-static int interpret_proccall(IMP_InterpreterContext *context, const IMP_ASTNode *node) {
-  const char *name = node->data.proc_call.name;
-  const IMP_ASTNode *procdecl = imp_interpreter_context_proc_get(context, name);
-  if (!procdecl) {
-    fprintf(stderr, "Error: procedure %s not defined\n", name);
-    return -1;
+static int *proccall_enter(IMP_InterpreterContext *context, int *frame, const IMP_ASTNode *node, const IMP_ASTNode **procdecl_out) {
+  const IMP_Symbol *name = node->data.proc_call.symbol;
+  const IMP_ASTNode *procdecl = node->data.proc_call.procdecl;
+  unsigned long proc_epoch = imp_interpreter_context_proc_epoch(context);
+  if (node->data.proc_call.proc_epoch != proc_epoch) {
+    /* First call against this procedure table: resolve the declaration and cache it in the node. */
+    procdecl = imp_interpreter_context_proc_get(context, name);
+    if (!procdecl) {
+      fprintf(stderr, "Error: procedure %s not defined\n", name->name);
+      return NULL;
+    }
+    IMP_ASTNode *quick = (IMP_ASTNode *)node;
+    quick->data.proc_call.procdecl = procdecl;
+    quick->data.proc_call.proc_epoch = proc_epoch;
   }
-  IMP_InterpreterContext *proc_context = imp_interpreter_context_create();
-  IMP_InterpreterContextProcIter *proc_iter = imp_interpreter_context_proc_iter_create(context);
-  const IMP_InterpreterContextProcTableEntry *proc_entry;
-  while ((proc_entry = imp_interpreter_context_proc_iter_next(proc_iter))) {
-    imp_interpreter_context_proc_set(proc_context, proc_entry->key, proc_entry->value);
+  IMP_FrameStack *frame_stack = imp_interpreter_context_frame_stack(context);
+  int *proc_frame = imp_frame_stack_push(frame_stack, procdecl->data.proc_decl.frame_size);
+  if (!proc_frame) {
+    fprintf(stderr, "Error: stack limit exceeded\n");
+    return NULL;
   }
-  imp_interpreter_context_proc_iter_destroy(proc_iter);
   IMP_ASTNodeList *caller_val_args = node->data.proc_call.val_args;
   IMP_ASTNodeList *callee_val_args = procdecl->data.proc_decl.val_args;
   while (caller_val_args && callee_val_args) {
-    int val = eval_aexpr(context, caller_val_args->node);
-    const char *callee_arg_name = callee_val_args->node->data.variable.name;
-    imp_interpreter_context_var_set(proc_context, callee_arg_name, val);
+    int val = eval_aexpr(frame, caller_val_args->node);
+    proc_frame[callee_val_args->node->data.variable.slot] = val;
     caller_val_args = caller_val_args->next;
     callee_val_args = callee_val_args->next;
   }
   if (caller_val_args || callee_val_args) {
-    fprintf(stderr, "Error: procedure %s called with wrong number of value arguments\n", name);
-    imp_interpreter_context_destroy(proc_context);
-    return -1;
-  }
-  if (imp_interpreter_interpret_ast(proc_context, procdecl->data.proc_decl.body_stmt)) {
-    imp_interpreter_context_destroy(proc_context);
-    return -1;
+    fprintf(stderr, "Error: procedure %s called with wrong number of value arguments\n", name->name);
+    imp_frame_stack_pop(frame_stack, proc_frame);
+    return NULL;
   }
+  *procdecl_out = procdecl;
+  return proc_frame;
+}
+
+static int proccall_leave(IMP_InterpreterContext *context, int *frame, int *proc_frame, const IMP_ASTNode *node, const IMP_ASTNode *procdecl) {
   IMP_ASTNodeList *caller_var_args = node->data.proc_call.var_args;
   IMP_ASTNodeList *callee_var_args = procdecl->data.proc_decl.var_args;
   while (caller_var_args && callee_var_args) {
-    const char *caller_varg_name = caller_var_args->node->data.variable.name;
-    const char *callee_varg_name = callee_var_args->node->data.variable.name;
-    imp_interpreter_context_var_set(context, caller_varg_name, imp_interpreter_context_var_get(proc_context, callee_varg_name));
+    int caller_varg_slot = caller_var_args->node->data.variable.slot;
+    int callee_varg_slot = callee_var_args->node->data.variable.slot;
+    frame[caller_varg_slot] = proc_frame[callee_varg_slot];
     caller_var_args = caller_var_args->next;
     callee_var_args = callee_var_args->next;
   }
+  imp_frame_stack_pop(imp_interpreter_context_frame_stack(context), proc_frame);
   if (caller_var_args || callee_var_args) {
-    fprintf(stderr, "Error: procedure %s called with wrong number of variable arguments\n", name);
-    imp_interpreter_context_destroy(proc_context);
+    fprintf(stderr, "Error: procedure %s called with wrong number of variable arguments\n", node->data.proc_call.symbol->name);
     return -1;
   }
-  imp_interpreter_context_destroy(proc_context);
   return 0;
 }
 
-int imp_interpreter_interpret_ast(IMP_InterpreterContext *context, const IMP_ASTNode *node) {
+static int interpret_proccall(IMP_InterpreterContext *context, int *frame, const IMP_ASTNode *node) {
+  const IMP_ASTNode *procdecl;
+  int *proc_frame = proccall_enter(context, frame, node, &procdecl);
+  if (!proc_frame) return -1;
+  if (interpret(context, proc_frame, procdecl->data.proc_decl.body_stmt)) {
+    imp_frame_stack_pop(imp_interpreter_context_frame_stack(context), proc_frame);
+    return -1;
+  }
+  return proccall_leave(context, frame, proc_frame, node, procdecl);
+}
+
+static int interpret_procdecl(IMP_InterpreterContext *context, const IMP_ASTNode *node) {
+  const IMP_Symbol *name = node->data.proc_decl.symbol;
+  if (imp_interpreter_context_proc_get(context, name)) {
+    fprintf(stderr, "Error: procedure %s already defined\n", name->name);
+    return -1;
+  }
+  imp_interpreter_context_proc_set(context, name, node);
+  return 0;
+}
+
+/* Completes a loop iteration in the tree walker from stmt on, after a side exit of its trace
+ * or an aborted recording. */
+static int resume(IMP_InterpreterContext *context, int *frame, const IMP_ASTNode *stmt, const IMP_TraceCont *cont, int cont_len) {
+  if (interpret(context, frame, stmt)) return -1;
+  for (int i = cont_len - 1; i >= 0; --i) {
+    const IMP_ASTNode *node = cont[i].node;
+    if (node->type == IMP_AST_NT_SEQ) {
+      if (cont[i].index == 0 && interpret(context, frame, node->data.seq.snd_stmt)) return -1;
+      continue;
+    }
+    for (int j = cont[i].index + 1; j < node->data.block.len; ++j) {
+      if (interpret(context, frame, node->data.block.stmts[j])) return -1;
+    }
+  }
+  return 0;
+}
+
+/** State of the recording of a trace. */
+typedef struct Recorder {
+  IMP_Trace *trace;
+  IMP_TraceCont *cont; /**< Sequence positions enclosing the statement being recorded. */
+} Recorder;
+
+enum { RECORD_OK, RECORD_ABORTED };
+
+/* Executes a statement of a loop body while recording it into a trace. Statements that
+ * cannot be traced abort the recording, the rest of the iteration is left to the tree walker. */
+static int record(IMP_InterpreterContext *context, int *frame, Recorder *rec, const IMP_ASTNode *node) {
   switch (node->type) {
-    case IMP_AST_NT_SKIP: return 0;
+    case IMP_AST_NT_SKIP: return RECORD_OK;
     case IMP_AST_NT_ASSIGN: {
-      const char *name = node->data.assign.var->data.variable.name;
-      int val = eval_aexpr(context, node->data.assign.aexpr);
-      imp_interpreter_context_var_set(context, name, val);
-      return 0;
+      int slot = node->data.assign.var->data.variable.slot;
+      imp_trace_assign(rec->trace, slot, node->data.assign.aexpr);
+      frame[slot] = eval_aexpr(frame, node->data.assign.aexpr);
+      return RECORD_OK;
+    }
+    case IMP_AST_NT_SEQ:
+    case IMP_AST_NT_BLOCK: {
+      int len = node->type == IMP_AST_NT_SEQ ? 2 : node->data.block.len;
+      IMP_TraceCont cont = { node, 0 };
+      arrput(rec->cont, cont);
+      for (int i = 0; i < len; ++i) {
+        const IMP_ASTNode *stmt;
+        if (node->type == IMP_AST_NT_BLOCK) stmt = node->data.block.stmts[i];
+        else stmt = i == 0 ? node->data.seq.fst_stmt : node->data.seq.snd_stmt;
+        arrlast(rec->cont).index = i;
+        int ret = record(context, frame, rec, stmt);
+        if (ret != RECORD_OK) return ret;
+      }
+      (void)arrpop(rec->cont);
+      return RECORD_OK;
+    }
+    case IMP_AST_NT_IF: {
+      int cond = eval_bexpr(frame, node->data.if_stmt.cond_bexpr);
+      imp_trace_guard(rec->trace, node->data.if_stmt.cond_bexpr, cond, node, rec->cont, (int)arrlen(rec->cont));
+      return record(context, frame, rec, cond ? node->data.if_stmt.then_stmt : node->data.if_stmt.else_stmt);
+    }
+    case IMP_AST_NT_LET: {
+      int slot = node->data.let_stmt.var->data.variable.slot;
+      imp_trace_assign(rec->trace, slot, node->data.let_stmt.aexpr);
+      frame[slot] = eval_aexpr(frame, node->data.let_stmt.aexpr);
+      return record(context, frame, rec, node->data.let_stmt.body_stmt);
+    }
+    default:
+      if (resume(context, frame, node, rec->cont, (int)arrlen(rec->cont))) return -1;
+      return RECORD_ABORTED;
+  }
+}
+
+/* Runs one iteration of a hot loop while recording its trace. */
+static int record_iteration(IMP_InterpreterContext *context, int *frame, IMP_TraceLoop *loop, const IMP_ASTNode *node) {
+  IMP_TraceStats *stats = imp_tracer_stats(imp_interpreter_context_tracer(context));
+  Recorder rec = { imp_trace_create(node), NULL };
+  int ret = record(context, frame, &rec, node->data.while_stmt.body_stmt);
+  arrfree(rec.cont);
+  if (ret == RECORD_OK) {
+    imp_trace_finish(rec.trace);
+    loop->trace = rec.trace;
+    stats->recorded++;
+    return 0;
+  }
+  imp_trace_destroy(rec.trace);
+  if (ret < 0) return -1;
+  loop->blacklisted = 1;
+  stats->aborted++;
+  return 0;
+}
+
+static int interpret_while(IMP_InterpreterContext *context, int *frame, const IMP_ASTNode *node) {
+  IMP_Tracer *tracer = imp_interpreter_context_tracer(context);
+  IMP_TraceLoop *loop = imp_tracer_loop(tracer, node);
+  while (eval_bexpr(frame, node->data.while_stmt.cond_bexpr)) {
+    if (loop && loop->trace) {
+      int exit = imp_tracer_run(tracer, loop, frame);
+      if (exit < 0) return 0;
+      const IMP_TraceExit *side_exit = imp_trace_exit(loop->trace, exit);
+      if (resume(context, frame, side_exit->stmt, side_exit->cont, side_exit->cont_len)) return -1;
+      continue;
     }
+    if (loop && !loop->blacklisted && ++loop->count >= imp_tracer_threshold(tracer)) {
+      if (record_iteration(context, frame, loop, node)) return -1;
+      continue;
+    }
+    if (interpret(context, frame, node->data.while_stmt.body_stmt)) return -1;
+  }
+  return 0;
+}
+
+static int interpret(IMP_InterpreterContext *context, int *frame, const IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_SKIP: return 0;
+    case IMP_AST_NT_ASSIGN:
+      frame[node->data.assign.var->data.variable.slot] = eval_aexpr(frame, node->data.assign.aexpr);
+      return 0;
     case IMP_AST_NT_SEQ:
-      if (imp_interpreter_interpret_ast(context, node->data.seq.fst_stmt)) return -1;
-      if (imp_interpreter_interpret_ast(context, node->data.seq.snd_stmt)) return -1;
+      if (interpret(context, frame, node->data.seq.fst_stmt)) return -1;
+      if (interpret(context, frame, node->data.seq.snd_stmt)) return -1;
+      return 0;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) {
+        if (interpret(context, frame, node->data.block.stmts[i])) return -1;
+      }
       return 0;
     case IMP_AST_NT_IF:
-      if (eval_bexpr(context, node->data.if_stmt.cond_bexpr)) return imp_interpreter_interpret_ast(context, node->data.if_stmt.then_stmt);
-      else return imp_interpreter_interpret_ast(context, node->data.if_stmt.else_stmt);
+      if (eval_bexpr(frame, node->data.if_stmt.cond_bexpr)) return interpret(context, frame, node->data.if_stmt.then_stmt);
+      else return interpret(context, frame, node->data.if_stmt.else_stmt);
     case IMP_AST_NT_WHILE:
-      while (eval_bexpr(context, node->data.while_stmt.cond_bexpr)) {
-        if (imp_interpreter_interpret_ast(context, node->data.while_stmt.body_stmt)) return -1;
-      }
+      return interpret_while(context, frame, node);
+    case IMP_AST_NT_LET:
+      frame[node->data.let_stmt.var->data.variable.slot] = eval_aexpr(frame, node->data.let_stmt.aexpr);
+      return interpret(context, frame, node->data.let_stmt.body_stmt);
+    case IMP_AST_NT_PROCDECL:
+      return interpret_procdecl(context, node);
+    case IMP_AST_NT_PROCCALL:
+      return interpret_proccall(context, frame, node);
+    default: assert(0);
+  }
+}
+
+int imp_interpreter_interpret_ast(IMP_InterpreterContext *context, const IMP_ASTNode *node) {
+  int ret = interpret(context, imp_interpreter_context_frame(context), node);
+  imp_tracer_reset(imp_interpreter_context_tracer(context));
+  return ret;
+}
+
+
+/** Pending work of the iterative interpreter. */
+typedef struct WorkItem {
+  enum { WORK_EXEC, WORK_RETURN } kind;
+  const IMP_ASTNode *node;      /**< Statement to execute, or call site to return to. */
+  int *frame;                   /**< Frame of the statement, or of the caller. */
+  int *proc_frame;              /**< Frame of the callee (WORK_RETURN only). */
+  const IMP_ASTNode *procdecl;  /**< Called procedure (WORK_RETURN only). */
+} WorkItem;
+
+static int work_push(WorkItem **work, size_t limit, WorkItem item) {
+  if (limit && (arrlenu(*work) + 1) * sizeof(WorkItem) > limit) {
+    fprintf(stderr, "Error: stack limit exceeded\n");
+    return -1;
+  }
+  arrput(*work, item);
+  return 0;
+}
+
+static int work_exec(WorkItem **work, size_t limit, const IMP_ASTNode *node, int *frame) {
+  WorkItem item = { WORK_EXEC, node, frame, NULL, NULL };
+  return work_push(work, limit, item);
+}
+
+static int interpret_step(IMP_InterpreterContext *context, WorkItem **work, size_t limit, const IMP_ASTNode *node, int *frame) {
+  switch (node->type) {
+    case IMP_AST_NT_SKIP: return 0;
+    case IMP_AST_NT_ASSIGN:
+      frame[node->data.assign.var->data.variable.slot] = eval_aexpr(frame, node->data.assign.aexpr);
       return 0;
-    case IMP_AST_NT_LET: {
-      const char *name = node->data.let_stmt.var->data.variable.name;
-      int old_val = imp_interpreter_context_var_get(context, name);
-      int new_val = eval_aexpr(context, node->data.let_stmt.aexpr);
-      imp_interpreter_context_var_set(context, name, new_val);
-      int ret = imp_interpreter_interpret_ast(context, node->data.let_stmt.body_stmt);
-      imp_interpreter_context_var_set(context, name, old_val);
-      return ret;
-    }
-    case IMP_AST_NT_PROCDECL: {
-      const char *name = node->data.proc_decl.name;
-      if (imp_interpreter_context_proc_get(context, name)) {
-        fprintf(stderr, "Error: procedure %s already defined\n", name);
-        return -1;
+    case IMP_AST_NT_SEQ:
+      if (work_exec(work, limit, node->data.seq.snd_stmt, frame)) return -1;
+      return work_exec(work, limit, node->data.seq.fst_stmt, frame);
+    case IMP_AST_NT_BLOCK:
+      for (int i = node->data.block.len - 1; i >= 0; --i) {
+        if (work_exec(work, limit, node->data.block.stmts[i], frame)) return -1;
       }
-      imp_interpreter_context_proc_set(context, name, node);
       return 0;
-    }
+    case IMP_AST_NT_IF:
+      if (eval_bexpr(frame, node->data.if_stmt.cond_bexpr)) return work_exec(work, limit, node->data.if_stmt.then_stmt, frame);
+      else return work_exec(work, limit, node->data.if_stmt.else_stmt, frame);
+    case IMP_AST_NT_WHILE:
+      if (!eval_bexpr(frame, node->data.while_stmt.cond_bexpr)) return 0;
+      if (work_exec(work, limit, node, frame)) return -1;
+      return work_exec(work, limit, node->data.while_stmt.body_stmt, frame);
+    case IMP_AST_NT_LET:
+      frame[node->data.let_stmt.var->data.variable.slot] = eval_aexpr(frame, node->data.let_stmt.aexpr);
+      return work_exec(work, limit, node->data.let_stmt.body_stmt, frame);
+    case IMP_AST_NT_PROCDECL:
+      return interpret_procdecl(context, node);
     case IMP_AST_NT_PROCCALL: {
-      return interpret_proccall(context, node);
+      const IMP_ASTNode *procdecl;
+      int *proc_frame = proccall_enter(context, frame, node, &procdecl);
+      if (!proc_frame) return -1;
+      WorkItem item = { WORK_RETURN, node, frame, proc_frame, procdecl };
+      if (work_push(work, limit, item)) {
+        imp_frame_stack_pop(imp_interpreter_context_frame_stack(context), proc_frame);
+        return -1;
+      }
+      return work_exec(work, limit, procdecl->data.proc_decl.body_stmt, proc_frame);
     }
     default: assert(0);
   }
-}
\ No newline at end of file
+}
+
+int imp_interpreter_interpret_ast_iterative(IMP_InterpreterContext *context, const IMP_ASTNode *node) {
+  size_t limit = imp_interpreter_context_stack_limit(context);
+  IMP_FrameStack *frame_stack = imp_interpreter_context_frame_stack(context);
+  WorkItem *work = NULL;
+  int ret = work_exec(&work, limit, node, imp_interpreter_context_frame(context));
+  while (!ret && arrlen(work) > 0) {
+    WorkItem item = arrpop(work);
+    if (item.kind == WORK_RETURN) ret = proccall_leave(context, item.frame, item.proc_frame, item.node, item.procdecl);
+    else ret = interpret_step(context, &work, limit, item.node, item.frame);
+  }
+  while (arrlen(work) > 0) {
+    WorkItem item = arrpop(work);
+    if (item.kind == WORK_RETURN) imp_frame_stack_pop(frame_stack, item.proc_frame);
+  }
+  arrfree(work);
+  return ret;
+}
+
+
+/* Executes an IR function on a frame, keeping its values in a register frame of its own. */
+static int interpret_ir_function(IMP_InterpreterContext *context, IMP_IRProgram *program, const IMP_IRFunction *function, int *frame);
+
+static int interpret_ir_call(IMP_InterpreterContext *context, IMP_IRProgram *program, int *regs, const IMP_IRInstr *instr) {
+  const IMP_Symbol *name = instr->node->data.proc_call.symbol;
+  const IMP_ASTNode *procdecl = imp_interpreter_context_proc_get(context, name);
+  if (!procdecl) {
+    fprintf(stderr, "Error: procedure %s not defined\n", name->name);
+    return -1;
+  }
+  IMP_FrameStack *frame_stack = imp_interpreter_context_frame_stack(context);
+  int *proc_frame = imp_frame_stack_push(frame_stack, procdecl->data.proc_decl.frame_size);
+  if (!proc_frame) {
+    fprintf(stderr, "Error: stack limit exceeded\n");
+    return -1;
+  }
+  ptrdiff_t i = 0;
+  IMP_ASTNodeList *callee_val_args = procdecl->data.proc_decl.val_args;
+  for (; i < arrlen(instr->args) && callee_val_args; ++i, callee_val_args = callee_val_args->next) {
+    proc_frame[callee_val_args->node->data.variable.slot] = regs[instr->args[i]];
+  }
+  if (i < arrlen(instr->args) || callee_val_args) {
+    fprintf(stderr, "Error: procedure %s called with wrong number of value arguments\n", name->name);
+    imp_frame_stack_pop(frame_stack, proc_frame);
+    return -1;
+  }
+  if (interpret_ir_function(context, program, imp_ir_program_procedure(program, procdecl), proc_frame)) {
+    imp_frame_stack_pop(frame_stack, proc_frame);
+    return -1;
+  }
+  i = 0;
+  IMP_ASTNodeList *callee_var_args = procdecl->data.proc_decl.var_args;
+  for (; i < arrlen(instr->results) && callee_var_args; ++i, callee_var_args = callee_var_args->next) {
+    regs[instr->results[i]] = proc_frame[callee_var_args->node->data.variable.slot];
+  }
+  imp_frame_stack_pop(frame_stack, proc_frame);
+  if (i < arrlen(instr->results) || callee_var_args) {
+    fprintf(stderr, "Error: procedure %s called with wrong number of variable arguments\n", name->name);
+    return -1;
+  }
+  return 0;
+}
+
+static int interpret_ir_function(IMP_InterpreterContext *context, IMP_IRProgram *program, const IMP_IRFunction *function, int *frame) {
+  IMP_FrameStack *frame_stack = imp_interpreter_context_frame_stack(context);
+  /* Values, followed by scratch space for the phis of a block, which are assigned all at once. */
+  int max_phis = 0;
+  for (ptrdiff_t i = 0; i < arrlen(function->blocks); ++i) {
+    if (arrlen(function->blocks[i].phis) > max_phis) max_phis = (int)arrlen(function->blocks[i].phis);
+  }
+  int *regs = imp_frame_stack_push(frame_stack, function->values + max_phis);
+  if (!regs) {
+    fprintf(stderr, "Error: stack limit exceeded\n");
+    return -1;
+  }
+  int *scratch = regs + function->values;
+  int ret = 0;
+  int pred = -1;
+  for (int current = 0;;) {
+    const IMP_IRBlock *block = &function->blocks[current];
+    if (arrlen(block->phis) > 0) {
+      ptrdiff_t edge = 0;
+      while (block->preds[edge] != pred) ++edge;
+      for (ptrdiff_t i = 0; i < arrlen(block->phis); ++i) scratch[i] = regs[block->phis[i].args[edge]];
+      for (ptrdiff_t i = 0; i < arrlen(block->phis); ++i) regs[block->phis[i].dst] = scratch[i];
+    }
+    for (ptrdiff_t i = 0; i < arrlen(block->instrs); ++i) {
+      const IMP_IRInstr *instr = &block->instrs[i];
+      int a = instr->a >= 0 ? regs[instr->a] : 0, b = instr->b >= 0 ? regs[instr->b] : 0;
+      switch (instr->op) {
+        case IMP_IR_CONST: regs[instr->dst] = instr->imm; break;
+        case IMP_IR_LOAD: regs[instr->dst] = frame[instr->imm]; break;
+        case IMP_IR_STORE: frame[instr->imm] = a; break;
+        case IMP_IR_ADD: regs[instr->dst] = (int)((unsigned)a + (unsigned)b); break;
+        case IMP_IR_SUB: regs[instr->dst] = (int)((unsigned)a - (unsigned)b); break;
+        case IMP_IR_MUL: regs[instr->dst] = (int)((unsigned)a * (unsigned)b); break;
+        case IMP_IR_DIVU: regs[instr->dst] = (int)((unsigned)a / (unsigned)b); break;
+        case IMP_IR_EQ: regs[instr->dst] = a == b; break;
+        case IMP_IR_NE: regs[instr->dst] = a != b; break;
+        case IMP_IR_LT: regs[instr->dst] = a < b; break;
+        case IMP_IR_LE: regs[instr->dst] = a <= b; break;
+        case IMP_IR_GT: regs[instr->dst] = a > b; break;
+        case IMP_IR_GE: regs[instr->dst] = a >= b; break;
+        case IMP_IR_AND: regs[instr->dst] = a && b; break;
+        case IMP_IR_OR: regs[instr->dst] = a || b; break;
+        case IMP_IR_NOT: regs[instr->dst] = !a; break;
+        case IMP_IR_PROCDECL: ret = interpret_procdecl(context, instr->node); break;
+        case IMP_IR_CALL: ret = interpret_ir_call(context, program, regs, instr); break;
+        default: assert(0);
+      }
+      if (ret) break;
+    }
+    if (ret || block->term == IMP_IR_RETURN) break;
+    pred = current;
+    current = block->term == IMP_IR_JUMP || regs[block->cond] ? block->succs[0] : block->succs[1];
+  }
+  imp_frame_stack_pop(frame_stack, regs);
+  return ret;
+}
+
+int imp_interpreter_interpret_ir(IMP_InterpreterContext *context, IMP_IRProgram *program) {
+  return interpret_ir_function(context, program, imp_ir_program_main(program), imp_interpreter_context_frame(context));
+}
@@ -1,18 +1,36 @@
 #include "interpreter_context.h"
 
+#include <string.h>
+
 #define STB_DS_IMPLEMENTATION
 #include "3rdparty/stb_ds/stb_ds.h"
 
 
+typedef struct VarSlotEntry {
+  const IMP_Symbol *key;
+  int value;
+} VarSlotEntry;
+
 struct IMP_InterpreterContext {
-  IMP_InterpreterContextVarTableEntry *var_table;
+  VarSlotEntry *var_table;
+  int *frame;
+  IMP_FrameStack *frame_stack;
+  size_t stack_limit;
+  IMP_Tracer *tracer;
   IMP_InterpreterContextProcTableEntry *proc_table;
+  IMP_ASTArena *proc_arena;
+  unsigned long proc_epoch;
 };
 
+/* Source of procedure table epochs, shared by all contexts so that an epoch identifies a single table state. */
+static unsigned long proc_epoch_counter = 0;
+
 struct IMP_InterpreterContextVarIter {
-  IMP_InterpreterContextVarTableEntry *var_table;
+  VarSlotEntry *var_table;
+  const int *frame;
   ptrdiff_t index;
   ptrdiff_t len;
+  IMP_InterpreterContextVarTableEntry entry;
 };
 
 struct IMP_InterpreterContextProcIter {
@@ -25,80 +43,112 @@ IMP_InterpreterContext *imp_interpreter_context_create(void) {
   IMP_InterpreterContext *context = malloc(sizeof(IMP_InterpreterContext));
   assert(context && "Memory allocation failed");
   context->var_table = NULL;
+  context->frame = NULL;
+  context->frame_stack = imp_frame_stack_create();
+  context->stack_limit = 0;
+  context->tracer = imp_tracer_create();
   context->proc_table = NULL;
+  context->proc_arena = imp_ast_arena_create();
+  context->proc_epoch = ++proc_epoch_counter;
   return context;
 }
 
 void imp_interpreter_context_destroy(IMP_InterpreterContext *context) {
-  ptrdiff_t len = shlen(context->var_table);
-  for (ptrdiff_t i = 0; i < len; ++i) free((char*)context->var_table[i].key);
-  shfree(context->var_table);
-  len = shlen(context->proc_table);
-  for (ptrdiff_t i = 0; i < len; ++i) {
-    free((char*)context->proc_table[i].key);
-    imp_ast_destroy((IMP_ASTNode*)context->proc_table[i].value);
-  }
-  shfree(context->proc_table);
+  hmfree(context->var_table);
+  arrfree(context->frame);
+  imp_frame_stack_destroy(context->frame_stack);
+  imp_tracer_destroy(context->tracer);
+  hmfree(context->proc_table);
+  imp_ast_arena_destroy(context->proc_arena);
   free(context);
 }
 
-int imp_interpreter_context_var_get(IMP_InterpreterContext *context, const char *name) {
-  ptrdiff_t index = shgeti(context->var_table, name);
+int imp_interpreter_context_var_get(IMP_InterpreterContext *context, const IMP_Symbol *name) {
+  ptrdiff_t index = hmgeti(context->var_table, name);
   if (index < 0) return 0;
-  return context->var_table[index].value;
+  return context->frame[context->var_table[index].value];
 }
 
-void imp_interpreter_context_var_set(IMP_InterpreterContext *context, const char *name, int value) {
-  ptrdiff_t index = shgeti(context->var_table, name);
-  if (index < 0) {
-    if (value == 0) return;
-    const char* key = strdup(name);
-    assert(key && "Memory allocation failed");
-    shput(context->var_table, key, value);
-  } else {
-    if (value == 0) {
-      const char *key = context->var_table[index].key;
-      shdel(context->var_table, name);
-      free((char*)key);
-      return;
-    }
-    context->var_table[index].value = value;
-  }
+void imp_interpreter_context_var_set(IMP_InterpreterContext *context, const IMP_Symbol *name, int value) {
+  int slot = imp_interpreter_context_var_slot(context, name);
+  context->frame[slot] = value;
+}
+
+int imp_interpreter_context_var_slot(IMP_InterpreterContext *context, const IMP_Symbol *name) {
+  ptrdiff_t index = hmgeti(context->var_table, name);
+  if (index >= 0) return context->var_table[index].value;
+  int slot = (int)arrlen(context->frame);
+  imp_interpreter_context_frame_reserve(context, slot + 1);
+  hmput(context->var_table, name, slot);
+  return slot;
+}
+
+int *imp_interpreter_context_frame(IMP_InterpreterContext *context) {
+  return context->frame;
+}
+
+int imp_interpreter_context_frame_size(IMP_InterpreterContext *context) {
+  return (int)arrlen(context->frame);
 }
 
-const IMP_ASTNode *imp_interpreter_context_proc_get(IMP_InterpreterContext *context, const char *name) {
-  ptrdiff_t index = shgeti(context->proc_table, name);
+void imp_interpreter_context_frame_reserve(IMP_InterpreterContext *context, int size) {
+  int len = (int)arrlen(context->frame);
+  if (len >= size) return;
+  arrsetlen(context->frame, size);
+  memset(context->frame + len, 0, sizeof(int) * (size - len));
+}
+
+IMP_FrameStack *imp_interpreter_context_frame_stack(IMP_InterpreterContext *context) {
+  return context->frame_stack;
+}
+
+void imp_interpreter_context_set_stack_limit(IMP_InterpreterContext *context, size_t limit) {
+  context->stack_limit = limit;
+  imp_frame_stack_set_limit(context->frame_stack, limit);
+}
+
+size_t imp_interpreter_context_stack_limit(IMP_InterpreterContext *context) {
+  return context->stack_limit;
+}
+
+IMP_Tracer *imp_interpreter_context_tracer(IMP_InterpreterContext *context) {
+  return context->tracer;
+}
+
+const IMP_ASTNode *imp_interpreter_context_proc_get(IMP_InterpreterContext *context, const IMP_Symbol *name) {
+  ptrdiff_t index = hmgeti(context->proc_table, name);
   if (index < 0) return NULL;
   return context->proc_table[index].value;
 }
 
-void imp_interpreter_context_proc_set(IMP_InterpreterContext *context, const char *name, const IMP_ASTNode *proc) {
-  ptrdiff_t index = shgeti(context->proc_table, name);
-  proc = imp_ast_clone(proc);
+void imp_interpreter_context_proc_set(IMP_InterpreterContext *context, const IMP_Symbol *name, const IMP_ASTNode *proc) {
+  ptrdiff_t index = hmgeti(context->proc_table, name);
+  proc = imp_ast_clone(proc, context->proc_arena);
+  context->proc_epoch = ++proc_epoch_counter;
   if (proc) assert(proc->type == IMP_AST_NT_PROCDECL);
   if (index < 0) {
     if (proc == NULL) return;
-    const char* key = strdup(name);
-    assert(key && "Memory allocation failed");
-    shput(context->proc_table, key, proc);
+    hmput(context->proc_table, name, proc);
   } else {
-    imp_ast_destroy((IMP_ASTNode*)context->proc_table[index].value);
     if (proc == NULL) {
-      const char *key = context->proc_table[index].key;
-      shdel(context->proc_table, name);
-      free((char*)key);
+      (void)hmdel(context->proc_table, name);
       return;
     }
     context->proc_table[index].value = proc;
   }
 }
 
+unsigned long imp_interpreter_context_proc_epoch(const IMP_InterpreterContext *context) {
+  return context->proc_epoch;
+}
+
 IMP_InterpreterContextVarIter *imp_interpreter_context_var_iter_create(IMP_InterpreterContext *context) {
   IMP_InterpreterContextVarIter *iter = malloc(sizeof(IMP_InterpreterContextVarIter));
   assert(iter && "Memory allocation failed");
   iter->var_table = context->var_table;
+  iter->frame = context->frame;
   iter->index = 0;
-  iter->len = shlen(context->var_table);
+  iter->len = hmlen(context->var_table);
   return iter;
 }
 
@@ -107,8 +157,15 @@ void imp_interpreter_context_var_iter_destroy(IMP_InterpreterContextVarIter *ite
 }
 
 IMP_InterpreterContextVarTableEntry *imp_interpreter_context_var_iter_next(IMP_InterpreterContextVarIter *iter) {
-  if (iter->index >= iter->len) return NULL;
-  return &iter->var_table[iter->index++];
+  while (iter->index < iter->len) {
+    const VarSlotEntry *slot_entry = &iter->var_table[iter->index++];
+    int value = iter->frame[slot_entry->value];
+    if (value == 0) continue;
+    iter->entry.key = slot_entry->key;
+    iter->entry.value = value;
+    return &iter->entry;
+  }
+  return NULL;
 }
 
 IMP_InterpreterContextProcIter *imp_interpreter_context_proc_iter_create(IMP_InterpreterContext *context) {
@@ -116,7 +173,7 @@ IMP_InterpreterContextProcIter *imp_interpreter_context_proc_iter_create(IMP_Int
   assert(iter && "Memory allocation failed");
   iter->proc_table = context->proc_table;
   iter->index = 0;
-  iter->len = shlen(context->proc_table);
+  iter->len = hmlen(context->proc_table);
   return iter;
 }
 
@@ -0,0 +1,482 @@
+#include "ir.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "ir_pass.h"
+#include "3rdparty/stb_ds/stb_ds.h"
+
+
+typedef struct FunctionEntry {
+  const IMP_ASTNode *key;
+  IMP_IRFunction *value;
+} FunctionEntry;
+
+struct IMP_IRProgram {
+  IMP_IRFunction *main;
+  FunctionEntry *procedures;        /**< Functions of procedure bodies by declaration. */
+  const IMP_IRPassManager *passes;
+};
+
+typedef struct DefEntry {
+  int key;   /**< Frame slot. */
+  int value; /**< Value of the variable at the end of the block (so far). */
+} DefEntry;
+
+typedef struct SlotSetEntry {
+  int key;
+  int value;
+} SlotSetEntry;
+
+typedef struct PendingPhi {
+  int slot;
+  int phi;   /**< Index of the phi within its block. */
+} PendingPhi;
+
+/** State of building a function (following Braun et al., Simple and Efficient Construction of SSA Form). */
+typedef struct Builder {
+  IMP_IRFunction *function;
+  DefEntry **defs;         /**< Variables defined by each block. */
+  PendingPhi **pending;    /**< Phis of each unsealed block whose operands are not yet known. */
+  int *sealed;             /**< Whether all predecessors of each block are known. */
+  IMP_IRInstr *initial;    /**< Loads and constants of the initial values of variables, ahead of the entry block. */
+  SlotSetEntry *val_args;  /**< Slots of the value arguments of a procedure. */
+  int *outlive;            /**< Slots stored on returns (and, at the top level, ahead of calls and declarations). */
+  int current;             /**< Block instructions are appended to. */
+} Builder;
+
+
+/* Blocks and instructions. */
+
+int imp_ir_function_new_value(IMP_IRFunction *function) {
+  return function->values++;
+}
+
+static int new_block(Builder *builder) {
+  IMP_IRBlock block = { NULL, NULL, NULL, IMP_IR_RETURN, -1, { -1, -1 } };
+  arrput(builder->function->blocks, block);
+  arrput(builder->defs, NULL);
+  arrput(builder->pending, NULL);
+  arrput(builder->sealed, 0);
+  return (int)arrlen(builder->function->blocks) - 1;
+}
+
+static IMP_IRInstr instr_new(IMP_IROpcode op, int dst, int a, int b) {
+  IMP_IRInstr instr = { op, dst, a, b, 0, NULL, NULL, NULL };
+  return instr;
+}
+
+static int emit(Builder *builder, IMP_IROpcode op, int a, int b) {
+  int dst = imp_ir_function_new_value(builder->function);
+  arrput(builder->function->blocks[builder->current].instrs, instr_new(op, dst, a, b));
+  return dst;
+}
+
+static void add_edge(Builder *builder, int from, int to) {
+  arrput(builder->function->blocks[to].preds, from);
+}
+
+static void jump(Builder *builder, int to) {
+  IMP_IRBlock *block = &builder->function->blocks[builder->current];
+  block->term = IMP_IR_JUMP;
+  block->succs[0] = to;
+  add_edge(builder, builder->current, to);
+}
+
+static void branch(Builder *builder, int cond, int then_block, int else_block) {
+  IMP_IRBlock *block = &builder->function->blocks[builder->current];
+  block->term = IMP_IR_BRANCH;
+  block->cond = cond;
+  block->succs[0] = then_block;
+  block->succs[1] = else_block;
+  add_edge(builder, builder->current, then_block);
+  add_edge(builder, builder->current, else_block);
+}
+
+
+/* SSA construction. */
+
+static void write_var(Builder *builder, int block, int slot, int value) {
+  hmput(builder->defs[block], slot, value);
+}
+
+static int read_var(Builder *builder, int block, int slot);
+
+static int new_phi(Builder *builder, int block) {
+  IMP_IRInstr phi = instr_new(IMP_IR_PHI, imp_ir_function_new_value(builder->function), -1, -1);
+  arrput(builder->function->blocks[block].phis, phi);
+  return (int)arrlen(builder->function->blocks[block].phis) - 1;
+}
+
+static void fill_phi(Builder *builder, int block, int phi, int slot) {
+  int *args = NULL;
+  /* Reading may add phis to the block, moving its phis. */
+  for (ptrdiff_t i = 0; i < arrlen(builder->function->blocks[block].preds); ++i) {
+    arrput(args, read_var(builder, builder->function->blocks[block].preds[i], slot));
+  }
+  builder->function->blocks[block].phis[phi].args = args;
+}
+
+static int initial_value(Builder *builder, int slot) {
+  IMP_IRInstr instr;
+  int dst = imp_ir_function_new_value(builder->function);
+  if (builder->function->procdecl && hmgeti(builder->val_args, slot) < 0) {
+    instr = instr_new(IMP_IR_CONST, dst, -1, -1);
+    instr.imm = 0;
+  } else {
+    instr = instr_new(IMP_IR_LOAD, dst, -1, -1);
+    instr.imm = slot;
+  }
+  arrput(builder->initial, instr);
+  return dst;
+}
+
+static int read_var(Builder *builder, int block, int slot) {
+  ptrdiff_t index = hmgeti(builder->defs[block], slot);
+  if (index >= 0) return builder->defs[block][index].value;
+  IMP_IRBlock *b = &builder->function->blocks[block];
+  int value;
+  if (!builder->sealed[block]) {
+    int phi = new_phi(builder, block);
+    PendingPhi pending = { slot, phi };
+    arrput(builder->pending[block], pending);
+    value = b->phis[phi].dst;
+  } else if (arrlen(b->preds) == 0) {
+    value = initial_value(builder, slot);
+  } else if (arrlen(b->preds) == 1) {
+    value = read_var(builder, b->preds[0], slot);
+  } else {
+    /* Defined ahead of reading the operands, which may lead back to this block through a loop. */
+    int phi = new_phi(builder, block);
+    value = b->phis[phi].dst;
+    write_var(builder, block, slot, value);
+    fill_phi(builder, block, phi, slot);
+  }
+  write_var(builder, block, slot, value);
+  return value;
+}
+
+static void seal(Builder *builder, int block) {
+  for (ptrdiff_t i = 0; i < arrlen(builder->pending[block]); ++i) {
+    fill_phi(builder, block, builder->pending[block][i].phi, builder->pending[block][i].slot);
+  }
+  arrfree(builder->pending[block]);
+  builder->sealed[block] = 1;
+}
+
+
+/* Lowering of ASTs. */
+
+static int build_aexpr(Builder *builder, const IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_INT: {
+      int dst = emit(builder, IMP_IR_CONST, -1, -1);
+      arrlast(builder->function->blocks[builder->current].instrs).imm = node->data.integer.val;
+      return dst;
+    }
+    case IMP_AST_NT_VAR:
+      return read_var(builder, builder->current, node->data.variable.slot);
+    case IMP_AST_NT_AOP: {
+      int l = build_aexpr(builder, node->data.arith_op.l_aexpr);
+      int r = build_aexpr(builder, node->data.arith_op.r_aexpr);
+      switch (node->data.arith_op.aopr) {
+        case IMP_AST_AOP_ADD: return emit(builder, IMP_IR_ADD, l, r);
+        case IMP_AST_AOP_SUB: return emit(builder, IMP_IR_SUB, l, r);
+        case IMP_AST_AOP_MUL: return emit(builder, IMP_IR_MUL, l, r);
+        default: assert(0); return -1;
+      }
+    }
+    default: assert(0);
+  }
+  return -1;
+}
+
+static int build_bexpr(Builder *builder, const IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_BOP: {
+      int l = build_bexpr(builder, node->data.bool_op.l_bexpr);
+      int r = build_bexpr(builder, node->data.bool_op.r_bexpr);
+      return emit(builder, node->data.bool_op.bopr == IMP_AST_BOP_AND ? IMP_IR_AND : IMP_IR_OR, l, r);
+    }
+    case IMP_AST_NT_NOT:
+      return emit(builder, IMP_IR_NOT, build_bexpr(builder, node->data.bool_not.bexpr), -1);
+    case IMP_AST_NT_ROP: {
+      static const IMP_IROpcode ops[] = { IMP_IR_EQ, IMP_IR_NE, IMP_IR_LT, IMP_IR_LE, IMP_IR_GT, IMP_IR_GE };
+      int l = build_aexpr(builder, node->data.rel_op.l_aexpr);
+      int r = build_aexpr(builder, node->data.rel_op.r_aexpr);
+      return emit(builder, ops[node->data.rel_op.ropr], l, r);
+    }
+    default: assert(0);
+  }
+  return -1;
+}
+
+/* Stores the variables outliving the function. */
+static void store_outliving(Builder *builder) {
+  for (ptrdiff_t i = 0; i < arrlen(builder->outlive); ++i) {
+    IMP_IRInstr instr = instr_new(IMP_IR_STORE, -1, read_var(builder, builder->current, builder->outlive[i]), -1);
+    instr.imm = builder->outlive[i];
+    arrput(builder->function->blocks[builder->current].instrs, instr);
+  }
+}
+
+static void build_stmt(Builder *builder, const IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_SKIP:
+      return;
+    case IMP_AST_NT_ASSIGN:
+      write_var(builder, builder->current, node->data.assign.var->data.variable.slot, build_aexpr(builder, node->data.assign.aexpr));
+      return;
+    case IMP_AST_NT_SEQ:
+      build_stmt(builder, node->data.seq.fst_stmt);
+      build_stmt(builder, node->data.seq.snd_stmt);
+      return;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) build_stmt(builder, node->data.block.stmts[i]);
+      return;
+    case IMP_AST_NT_IF: {
+      int cond = build_bexpr(builder, node->data.if_stmt.cond_bexpr);
+      int then_block = new_block(builder), else_block = new_block(builder), join = new_block(builder);
+      branch(builder, cond, then_block, else_block);
+      seal(builder, then_block);
+      seal(builder, else_block);
+      builder->current = then_block;
+      build_stmt(builder, node->data.if_stmt.then_stmt);
+      jump(builder, join);
+      builder->current = else_block;
+      build_stmt(builder, node->data.if_stmt.else_stmt);
+      jump(builder, join);
+      seal(builder, join);
+      builder->current = join;
+      return;
+    }
+    case IMP_AST_NT_WHILE: {
+      int header = new_block(builder), body = new_block(builder), exit = new_block(builder);
+      jump(builder, header);
+      builder->current = header;
+      branch(builder, build_bexpr(builder, node->data.while_stmt.cond_bexpr), body, exit);
+      seal(builder, body);
+      builder->current = body;
+      build_stmt(builder, node->data.while_stmt.body_stmt);
+      jump(builder, header);
+      seal(builder, header);
+      seal(builder, exit);
+      builder->current = exit;
+      return;
+    }
+    case IMP_AST_NT_LET:
+      write_var(builder, builder->current, node->data.let_stmt.var->data.variable.slot, build_aexpr(builder, node->data.let_stmt.aexpr));
+      build_stmt(builder, node->data.let_stmt.body_stmt);
+      return;
+    case IMP_AST_NT_PROCDECL: {
+      if (!builder->function->procdecl) store_outliving(builder);
+      IMP_IRInstr instr = instr_new(IMP_IR_PROCDECL, -1, -1, -1);
+      instr.node = node;
+      arrput(builder->function->blocks[builder->current].instrs, instr);
+      return;
+    }
+    case IMP_AST_NT_PROCCALL: {
+      IMP_IRInstr instr = instr_new(IMP_IR_CALL, -1, -1, -1);
+      instr.node = node;
+      for (IMP_ASTNodeList *args = node->data.proc_call.val_args; args; args = args->next) {
+        arrput(instr.args, build_aexpr(builder, args->node));
+      }
+      if (!builder->function->procdecl) store_outliving(builder);
+      for (IMP_ASTNodeList *args = node->data.proc_call.var_args; args; args = args->next) {
+        int result = imp_ir_function_new_value(builder->function);
+        arrput(instr.results, result);
+        write_var(builder, builder->current, args->node->data.variable.slot, result);
+      }
+      arrput(builder->function->blocks[builder->current].instrs, instr);
+      return;
+    }
+    default: assert(0);
+  }
+}
+
+/* Collects the slots of let-bound variables, and of assigned variables (skipping nested procedure bodies). */
+static void collect_slots(const IMP_ASTNode *node, SlotSetEntry **let_slots, SlotSetEntry **assigned) {
+  switch (node->type) {
+    case IMP_AST_NT_ASSIGN:
+      hmput(*assigned, node->data.assign.var->data.variable.slot, 1);
+      return;
+    case IMP_AST_NT_SEQ:
+      collect_slots(node->data.seq.fst_stmt, let_slots, assigned);
+      collect_slots(node->data.seq.snd_stmt, let_slots, assigned);
+      return;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) collect_slots(node->data.block.stmts[i], let_slots, assigned);
+      return;
+    case IMP_AST_NT_IF:
+      collect_slots(node->data.if_stmt.then_stmt, let_slots, assigned);
+      collect_slots(node->data.if_stmt.else_stmt, let_slots, assigned);
+      return;
+    case IMP_AST_NT_WHILE:
+      collect_slots(node->data.while_stmt.body_stmt, let_slots, assigned);
+      return;
+    case IMP_AST_NT_LET:
+      hmput(*let_slots, node->data.let_stmt.var->data.variable.slot, 1);
+      collect_slots(node->data.let_stmt.body_stmt, let_slots, assigned);
+      return;
+    case IMP_AST_NT_PROCCALL:
+      for (IMP_ASTNodeList *args = node->data.proc_call.var_args; args; args = args->next) {
+        hmput(*assigned, args->node->data.variable.slot, 1);
+      }
+      return;
+    default:
+      return;
+  }
+}
+
+static IMP_IRFunction *build_function(const IMP_ASTNode *node, const IMP_ASTNode *procdecl, const IMP_IRPassManager *passes) {
+  IMP_IRFunction *function = calloc(1, sizeof(IMP_IRFunction));
+  assert(function && "Memory allocation failed");
+  function->procdecl = procdecl;
+  Builder builder = { function, NULL, NULL, NULL, NULL, NULL, NULL, 0 };
+  if (procdecl) {
+    for (IMP_ASTNodeList *args = procdecl->data.proc_decl.val_args; args; args = args->next) {
+      hmput(builder.val_args, args->node->data.variable.slot, 1);
+    }
+    for (IMP_ASTNodeList *args = procdecl->data.proc_decl.var_args; args; args = args->next) {
+      arrput(builder.outlive, args->node->data.variable.slot);
+    }
+  } else {
+    /* The assigned variables of the top level, other than let-bound ones, outlive it. */
+    SlotSetEntry *let_slots = NULL, *assigned = NULL;
+    collect_slots(node, &let_slots, &assigned);
+    for (ptrdiff_t i = 0; i < hmlen(assigned); ++i) {
+      if (hmgeti(let_slots, assigned[i].key) < 0) arrput(builder.outlive, assigned[i].key);
+    }
+    hmfree(let_slots);
+    hmfree(assigned);
+  }
+  builder.current = new_block(&builder);
+  seal(&builder, builder.current);
+  build_stmt(&builder, node);
+  store_outliving(&builder);
+  /* The initial values are defined at the start of the entry block. */
+  IMP_IRBlock *entry = &function->blocks[0];
+  ptrdiff_t initial_len = arrlen(builder.initial), entry_len = arrlen(entry->instrs);
+  IMP_IRInstr *instrs = NULL;
+  arrsetlen(instrs, initial_len + entry_len);
+  if (initial_len) memcpy(instrs, builder.initial, sizeof(IMP_IRInstr) * initial_len);
+  if (entry_len) memcpy(instrs + initial_len, entry->instrs, sizeof(IMP_IRInstr) * entry_len);
+  arrfree(entry->instrs);
+  entry->instrs = instrs;
+  for (ptrdiff_t i = 0; i < arrlen(function->blocks); ++i) {
+    assert(builder.sealed[i]);
+    hmfree(builder.defs[i]);
+  }
+  arrfree(builder.defs);
+  arrfree(builder.pending);
+  arrfree(builder.sealed);
+  arrfree(builder.initial);
+  hmfree(builder.val_args);
+  arrfree(builder.outlive);
+  if (passes) imp_ir_pass_manager_run(passes, function);
+  return function;
+}
+
+static void function_destroy(IMP_IRFunction *function) {
+  for (ptrdiff_t i = 0; i < arrlen(function->blocks); ++i) {
+    IMP_IRBlock *block = &function->blocks[i];
+    for (ptrdiff_t j = 0; j < arrlen(block->phis); ++j) arrfree(block->phis[j].args);
+    for (ptrdiff_t j = 0; j < arrlen(block->instrs); ++j) {
+      arrfree(block->instrs[j].args);
+      arrfree(block->instrs[j].results);
+    }
+    arrfree(block->phis);
+    arrfree(block->instrs);
+    arrfree(block->preds);
+  }
+  arrfree(function->blocks);
+  free(function);
+}
+
+
+/* Programs. */
+
+IMP_IRProgram *imp_ir_build(const IMP_ASTNode *node, const IMP_IRPassManager *passes) {
+  IMP_IRProgram *program = calloc(1, sizeof(IMP_IRProgram));
+  assert(program && "Memory allocation failed");
+  program->passes = passes;
+  program->main = build_function(node, NULL, passes);
+  return program;
+}
+
+IMP_IRFunction *imp_ir_program_main(IMP_IRProgram *program) {
+  return program->main;
+}
+
+IMP_IRFunction *imp_ir_program_procedure(IMP_IRProgram *program, const IMP_ASTNode *procdecl) {
+  ptrdiff_t index = hmgeti(program->procedures, procdecl);
+  if (index >= 0) return program->procedures[index].value;
+  IMP_IRFunction *function = build_function(procdecl->data.proc_decl.body_stmt, procdecl, program->passes);
+  hmput(program->procedures, procdecl, function);
+  return function;
+}
+
+void imp_ir_destroy(IMP_IRProgram *program) {
+  if (!program) return;
+  function_destroy(program->main);
+  for (ptrdiff_t i = 0; i < hmlen(program->procedures); ++i) function_destroy(program->procedures[i].value);
+  hmfree(program->procedures);
+  free(program);
+}
+
+
+/* Printing. */
+
+static const char *const opcode_names[IMP_IR_OP_COUNT] = {
+  "const", "load", "store", "add", "sub", "mul", "divu", "eq", "ne", "lt", "le", "gt", "ge",
+  "and", "or", "not", "phi", "procdecl", "call",
+};
+
+static void print_values(const int *values, FILE *out) {
+  for (ptrdiff_t i = 0; i < arrlen(values); ++i) fprintf(out, "%sv%d", i ? ", " : "", values[i]);
+}
+
+void imp_ir_print(const IMP_IRFunction *function, FILE *out) {
+  if (function->procdecl) fprintf(out, "procedure %s:\n", function->procdecl->data.proc_decl.symbol->name);
+  else fprintf(out, "main:\n");
+  for (ptrdiff_t i = 0; i < arrlen(function->blocks); ++i) {
+    const IMP_IRBlock *block = &function->blocks[i];
+    fprintf(out, "b%td:", i);
+    if (arrlen(block->preds) > 0) {
+      fprintf(out, " ; preds");
+      for (ptrdiff_t j = 0; j < arrlen(block->preds); ++j) fprintf(out, " b%d", block->preds[j]);
+    }
+    fprintf(out, "\n");
+    for (ptrdiff_t j = 0; j < arrlen(block->phis); ++j) {
+      const IMP_IRInstr *phi = &block->phis[j];
+      fprintf(out, "  v%d = phi ", phi->dst);
+      print_values(phi->args, out);
+      fprintf(out, "\n");
+    }
+    for (ptrdiff_t j = 0; j < arrlen(block->instrs); ++j) {
+      const IMP_IRInstr *instr = &block->instrs[j];
+      switch (instr->op) {
+        case IMP_IR_CONST: fprintf(out, "  v%d = const %d\n", instr->dst, instr->imm); break;
+        case IMP_IR_LOAD: fprintf(out, "  v%d = load [%d]\n", instr->dst, instr->imm); break;
+        case IMP_IR_STORE: fprintf(out, "  store [%d], v%d\n", instr->imm, instr->a); break;
+        case IMP_IR_NOT: fprintf(out, "  v%d = not v%d\n", instr->dst, instr->a); break;
+        case IMP_IR_PROCDECL: fprintf(out, "  procdecl %s\n", instr->node->data.proc_decl.symbol->name); break;
+        case IMP_IR_CALL:
+          fprintf(out, "  ");
+          print_values(instr->results, out);
+          fprintf(out, "%scall %s(", arrlen(instr->results) ? " = " : "", instr->node->data.proc_call.symbol->name);
+          print_values(instr->args, out);
+          fprintf(out, ")\n");
+          break;
+        default: fprintf(out, "  v%d = %s v%d, v%d\n", instr->dst, opcode_names[instr->op], instr->a, instr->b); break;
+      }
+    }
+    switch (block->term) {
+      case IMP_IR_JUMP: fprintf(out, "  jump b%d\n", block->succs[0]); break;
+      case IMP_IR_BRANCH: fprintf(out, "  branch v%d, b%d, b%d\n", block->cond, block->succs[0], block->succs[1]); break;
+      case IMP_IR_RETURN: fprintf(out, "  return\n"); break;
+      default: assert(0);
+    }
+  }
+}
@@ -0,0 +1,790 @@
+#include "ir_pass.h"
+
+#include <stdlib.h>
+#include <assert.h>
+#include <limits.h>
+
+#include "3rdparty/stb_ds/stb_ds.h"
+
+
+struct IMP_IRPassManager {
+  const IMP_IRPass **passes; /**< Passes in order (stb_ds array). */
+};
+
+
+/* Analyses. */
+
+static int is_pure(IMP_IROpcode op) {
+  return op != IMP_IR_STORE && op != IMP_IR_PROCDECL && op != IMP_IR_CALL;
+}
+
+static int is_binary(IMP_IROpcode op) {
+  return op >= IMP_IR_ADD && op <= IMP_IR_OR;
+}
+
+/* Calls fn on every operand of the function, so that it can read or replace it. */
+static void for_each_operand(IMP_IRFunction *function, void (*fn)(int *operand, void *data), void *data) {
+  for (ptrdiff_t i = 0; i < arrlen(function->blocks); ++i) {
+    IMP_IRBlock *block = &function->blocks[i];
+    for (ptrdiff_t j = 0; j < arrlen(block->phis); ++j) {
+      for (ptrdiff_t k = 0; k < arrlen(block->phis[j].args); ++k) fn(&block->phis[j].args[k], data);
+    }
+    for (ptrdiff_t j = 0; j < arrlen(block->instrs); ++j) {
+      IMP_IRInstr *instr = &block->instrs[j];
+      if (instr->a >= 0) fn(&instr->a, data);
+      if (instr->b >= 0) fn(&instr->b, data);
+      for (ptrdiff_t k = 0; k < arrlen(instr->args); ++k) fn(&instr->args[k], data);
+    }
+    if (block->term == IMP_IR_BRANCH) fn(&block->cond, data);
+  }
+}
+
+static void count_use(int *operand, void *data) {
+  ((int *)data)[*operand]++;
+}
+
+/* Number of uses of each value. */
+static int *uses(IMP_IRFunction *function) {
+  int *counts = calloc(function->values + 1, sizeof(int));
+  assert(counts && "Memory allocation failed");
+  for_each_operand(function, count_use, counts);
+  return counts;
+}
+
+static void substitute(int *operand, void *data) {
+  const int *replacements = data;
+  while (replacements[*operand] != *operand) *operand = replacements[*operand];
+}
+
+/* Whether each value is a constant (and which), by the instructions defining them. */
+static int *constants(IMP_IRFunction *function, int **values) {
+  int *known = calloc(function->values + 1, sizeof(int));
+  *values = calloc(function->values + 1, sizeof(int));
+  assert(known && *values && "Memory allocation failed");
+  for (ptrdiff_t i = 0; i < arrlen(function->blocks); ++i) {
+    IMP_IRBlock *block = &function->blocks[i];
+    for (ptrdiff_t j = 0; j < arrlen(block->instrs); ++j) {
+      if (block->instrs[j].op != IMP_IR_CONST) continue;
+      known[block->instrs[j].dst] = 1;
+      (*values)[block->instrs[j].dst] = block->instrs[j].imm;
+    }
+  }
+  return known;
+}
+
+static void remove_pred(IMP_IRBlock *block, int pred) {
+  ptrdiff_t index = 0;
+  while (block->preds[index] != pred) ++index;
+  arrdel(block->preds, index);
+  for (ptrdiff_t i = 0; i < arrlen(block->phis); ++i) arrdel(block->phis[i].args, index);
+}
+
+
+/* Passes. */
+
+static int simplify_phis(IMP_IRFunction *function) {
+  int *replacements = malloc(sizeof(int) * (function->values + 1));
+  assert(replacements && "Memory allocation failed");
+  for (int i = 0; i < function->values; ++i) replacements[i] = i;
+  int changed = 0;
+  for (int found = 1; found;) {
+    found = 0;
+    for (ptrdiff_t i = 0; i < arrlen(function->blocks); ++i) {
+      IMP_IRBlock *block = &function->blocks[i];
+      for (ptrdiff_t j = arrlen(block->phis) - 1; j >= 0; --j) {
+        IMP_IRInstr *phi = &block->phis[j];
+        int same = -1, trivial = 1;
+        for (ptrdiff_t k = 0; trivial && k < arrlen(phi->args); ++k) {
+          substitute(&phi->args[k], replacements);
+          int arg = phi->args[k];
+          if (arg == phi->dst || arg == same) continue;
+          if (same >= 0) trivial = 0;
+          same = arg;
+        }
+        /* Phis only referring to themselves are in unreachable code, left to dead code elimination. */
+        if (!trivial || same < 0) continue;
+        replacements[phi->dst] = same;
+        arrfree(phi->args);
+        arrdel(block->phis, j);
+        found = changed = 1;
+      }
+    }
+  }
+  if (changed) for_each_operand(function, substitute, replacements);
+  free(replacements);
+  return changed;
+}
+
+static int fold(IMP_IROpcode op, int a, int b) {
+  switch (op) {
+    case IMP_IR_ADD: return (int)((unsigned)a + (unsigned)b);
+    case IMP_IR_SUB: return (int)((unsigned)a - (unsigned)b);
+    case IMP_IR_MUL: return (int)((unsigned)a * (unsigned)b);
+    case IMP_IR_DIVU: return (int)((unsigned)a / (unsigned)b);
+    case IMP_IR_EQ: return a == b;
+    case IMP_IR_NE: return a != b;
+    case IMP_IR_LT: return a < b;
+    case IMP_IR_LE: return a <= b;
+    case IMP_IR_GT: return a > b;
+    case IMP_IR_GE: return a >= b;
+    case IMP_IR_AND: return a && b;
+    case IMP_IR_OR: return a || b;
+    case IMP_IR_NOT: return !a;
+    default: assert(0);
+  }
+  return 0;
+}
+
+/* The operand an instruction with a neutral constant operand (x + 0, x - 0, x * 1, x / 1) evaluates to, or -1. */
+static int identity(const IMP_IRInstr *instr, const int *known, const int *values) {
+  int neutral = instr->op == IMP_IR_ADD || instr->op == IMP_IR_SUB ? 0 : 1;
+  if (instr->op != IMP_IR_ADD && instr->op != IMP_IR_SUB && instr->op != IMP_IR_MUL && instr->op != IMP_IR_DIVU) return -1;
+  if (known[instr->b] && values[instr->b] == neutral) return instr->a;
+  if ((instr->op == IMP_IR_ADD || instr->op == IMP_IR_MUL) && known[instr->a] && values[instr->a] == neutral) return instr->b;
+  return -1;
+}
+
+static int fold_constants(IMP_IRFunction *function) {
+  int *values;
+  int *known = constants(function, &values);
+  int *replacements = malloc(sizeof(int) * (function->values + 1));
+  assert(replacements && "Memory allocation failed");
+  for (int i = 0; i < function->values; ++i) replacements[i] = i;
+  int changed = 0, replaced = 0;
+  /* Blocks are visited in order of creation, in which definitions mostly precede their uses. */
+  for (ptrdiff_t i = 0; i < arrlen(function->blocks); ++i) {
+    IMP_IRBlock *block = &function->blocks[i];
+    for (ptrdiff_t j = 0; j < arrlen(block->instrs); ++j) {
+      IMP_IRInstr *instr = &block->instrs[j];
+      int foldable = instr->op == IMP_IR_NOT ? known[instr->a] : is_binary(instr->op) && known[instr->a] && known[instr->b];
+      if (foldable && instr->op == IMP_IR_DIVU && values[instr->b] == 0) foldable = 0;
+      int same = foldable ? -1 : identity(instr, known, values);
+      if (same >= 0) {
+        replacements[instr->dst] = same;
+        arrdel(block->instrs, j);
+        --j;
+        changed = replaced = 1;
+        continue;
+      }
+      if (!foldable) continue;
+      instr->imm = fold(instr->op, values[instr->a], instr->op == IMP_IR_NOT ? 0 : values[instr->b]);
+      instr->op = IMP_IR_CONST;
+      instr->a = instr->b = -1;
+      known[instr->dst] = 1;
+      values[instr->dst] = instr->imm;
+      changed = 1;
+    }
+    if (block->term == IMP_IR_BRANCH && known[block->cond]) {
+      int taken = values[block->cond] ? 0 : 1;
+      remove_pred(&function->blocks[block->succs[1 - taken]], (int)i);
+      block->term = IMP_IR_JUMP;
+      block->succs[0] = block->succs[taken];
+      block->succs[1] = -1;
+      block->cond = -1;
+      changed = 1;
+    }
+  }
+  if (replaced) for_each_operand(function, substitute, replacements);
+  free(replacements);
+  free(known);
+  free(values);
+  return changed;
+}
+
+static void reach(IMP_IRFunction *function, int block, int *reachable) {
+  if (reachable[block]) return;
+  reachable[block] = 1;
+  IMP_IRBlock *b = &function->blocks[block];
+  if (b->term == IMP_IR_JUMP || b->term == IMP_IR_BRANCH) reach(function, b->succs[0], reachable);
+  if (b->term == IMP_IR_BRANCH) reach(function, b->succs[1], reachable);
+}
+
+static void free_block(IMP_IRBlock *block) {
+  for (ptrdiff_t j = 0; j < arrlen(block->phis); ++j) arrfree(block->phis[j].args);
+  for (ptrdiff_t j = 0; j < arrlen(block->instrs); ++j) {
+    arrfree(block->instrs[j].args);
+    arrfree(block->instrs[j].results);
+  }
+  arrfree(block->phis);
+  arrfree(block->instrs);
+  arrfree(block->preds);
+}
+
+/* Removes the blocks not reachable from the entry, renumbering the others. */
+static int remove_unreachable(IMP_IRFunction *function) {
+  ptrdiff_t len = arrlen(function->blocks);
+  int *reachable = calloc(len, sizeof(int));
+  assert(reachable && "Memory allocation failed");
+  reach(function, 0, reachable);
+  int changed = 0;
+  for (ptrdiff_t i = 0; i < len; ++i) {
+    if (reachable[i]) continue;
+    IMP_IRBlock *block = &function->blocks[i];
+    for (int k = 0; k < (block->term == IMP_IR_BRANCH ? 2 : block->term == IMP_IR_JUMP ? 1 : 0); ++k) {
+      if (reachable[block->succs[k]]) remove_pred(&function->blocks[block->succs[k]], (int)i);
+    }
+    changed = 1;
+  }
+  if (changed) {
+    int *numbers = malloc(sizeof(int) * len);
+    assert(numbers && "Memory allocation failed");
+    int next = 0;
+    for (ptrdiff_t i = 0; i < len; ++i) numbers[i] = reachable[i] ? next++ : -1;
+    for (ptrdiff_t i = 0; i < len; ++i) {
+      if (!reachable[i]) {
+        free_block(&function->blocks[i]);
+        continue;
+      }
+      IMP_IRBlock *block = &function->blocks[i];
+      for (ptrdiff_t j = 0; j < arrlen(block->preds); ++j) block->preds[j] = numbers[block->preds[j]];
+      for (int k = 0; k < 2; ++k) if (block->succs[k] >= 0) block->succs[k] = numbers[block->succs[k]];
+      function->blocks[numbers[i]] = *block;
+    }
+    arrsetlen(function->blocks, next);
+    free(numbers);
+  }
+  free(reachable);
+  return changed;
+}
+
+static int dead_code(IMP_IRFunction *function) {
+  int changed = remove_unreachable(function);
+  for (int found = 1; found;) {
+    found = 0;
+    int *counts = uses(function);
+    for (ptrdiff_t i = 0; i < arrlen(function->blocks); ++i) {
+      IMP_IRBlock *block = &function->blocks[i];
+      for (ptrdiff_t j = arrlen(block->phis) - 1; j >= 0; --j) {
+        if (counts[block->phis[j].dst]) continue;
+        arrfree(block->phis[j].args);
+        arrdel(block->phis, j);
+        found = 1;
+      }
+      for (ptrdiff_t j = arrlen(block->instrs) - 1; j >= 0; --j) {
+        IMP_IRInstr *instr = &block->instrs[j];
+        if (!is_pure(instr->op) || counts[instr->dst]) continue;
+        arrdel(block->instrs, j);
+        found = 1;
+      }
+    }
+    free(counts);
+    changed |= found;
+  }
+  return changed;
+}
+
+typedef struct SlotEntry {
+  int key;   /**< Frame slot. */
+  int value; /**< Value the slot is known to hold. */
+} SlotEntry;
+
+/* Updates the known contents of the frame by the loads and stores of a block, removing stores
+ * of the value a slot already holds if remove is set. Returns whether a store was removed. */
+static int transfer(IMP_IRBlock *block, SlotEntry **memory, int remove) {
+  int removed = 0;
+  for (ptrdiff_t j = 0; j < arrlen(block->instrs); ++j) {
+    IMP_IRInstr *instr = &block->instrs[j];
+    if (instr->op == IMP_IR_LOAD) {
+      hmput(*memory, instr->imm, instr->dst);
+    } else if (instr->op == IMP_IR_STORE) {
+      ptrdiff_t index = hmgeti(*memory, instr->imm);
+      if (remove && index >= 0 && (*memory)[index].value == instr->a) {
+        arrdel(block->instrs, j);
+        --j;
+        removed = 1;
+        continue;
+      }
+      hmput(*memory, instr->imm, instr->a);
+    }
+  }
+  return removed;
+}
+
+/* Keeps the slots known to hold the same value in both states. */
+static void meet(SlotEntry **memory, SlotEntry *other) {
+  for (ptrdiff_t i = hmlen(*memory) - 1; i >= 0; --i) {
+    ptrdiff_t index = other ? hmgeti(other, (*memory)[i].key) : -1;
+    if (index < 0 || other[index].value != (*memory)[i].value) (void)hmdel(*memory, (*memory)[i].key);
+  }
+}
+
+static SlotEntry *memory_copy(SlotEntry *memory) {
+  SlotEntry *copy = NULL;
+  for (ptrdiff_t i = 0; i < hmlen(memory); ++i) hmput(copy, memory[i].key, memory[i].value);
+  return copy;
+}
+
+static int redundant_stores(IMP_IRFunction *function) {
+  /* Frames only change by stores (calls get frames of their own), so which value a slot holds
+   * is known forward from loads and stores, on all paths into a block. */
+  ptrdiff_t len = arrlen(function->blocks);
+  SlotEntry **out = calloc(len, sizeof(SlotEntry *));
+  int *visited = calloc(len, sizeof(int));
+  assert(out && visited && "Memory allocation failed");
+  for (int changed = 1; changed;) {
+    changed = 0;
+    for (ptrdiff_t i = 0; i < len; ++i) {
+      IMP_IRBlock *block = &function->blocks[i];
+      SlotEntry *memory = NULL;
+      int first = 1;
+      for (ptrdiff_t j = 0; j < arrlen(block->preds); ++j) {
+        if (!visited[block->preds[j]]) continue;
+        if (first) memory = memory_copy(out[block->preds[j]]);
+        else meet(&memory, out[block->preds[j]]);
+        first = 0;
+      }
+      /* Blocks are only known to be entered once one of their predecessors is. */
+      if (i > 0 && first) continue;
+      transfer(block, &memory, 0);
+      int same = visited[i] && hmlen(memory) == hmlen(out[i]);
+      for (ptrdiff_t j = 0; same && j < hmlen(memory); ++j) {
+        ptrdiff_t index = hmgeti(out[i], memory[j].key);
+        same = index >= 0 && out[i][index].value == memory[j].value;
+      }
+      if (same) {
+        hmfree(memory);
+        continue;
+      }
+      hmfree(out[i]);
+      out[i] = memory;
+      visited[i] = changed = 1;
+    }
+  }
+  int removed = 0;
+  for (ptrdiff_t i = 0; i < len; ++i) {
+    IMP_IRBlock *block = &function->blocks[i];
+    SlotEntry *memory = NULL;
+    for (ptrdiff_t j = 0; j < arrlen(block->preds); ++j) {
+      if (j == 0) memory = memory_copy(out[block->preds[j]]);
+      else meet(&memory, out[block->preds[j]]);
+    }
+    removed |= transfer(block, &memory, 1);
+    hmfree(memory);
+  }
+  for (ptrdiff_t i = 0; i < len; ++i) hmfree(out[i]);
+  free(out);
+  free(visited);
+  return removed;
+}
+
+/* Loops of a header and a single body block, without effects, whose header phis evolve by closed forms. */
+typedef struct Loop {
+  int preheader, header, body, exit;
+  int *def_block;              /**< Block defining each value, or -1. */
+  const IMP_IRInstr **defs;    /**< Instructions of the loop defining each value. */
+  int *invariant;              /**< Whether each value is the same in every iteration (0 if not yet known). */
+} Loop;
+
+typedef enum {
+  EVOLUTION_LAST,       /**< The value of the last iteration: step. */
+  EVOLUTION_INDUCTION,  /**< Advanced by step each iteration. */
+  EVOLUTION_SUM         /**< Advanced by the induction variable of the phi with index step each iteration. */
+} EvolutionKind;
+
+typedef struct Evolution {
+  EvolutionKind kind;
+  int init;   /**< Value entering the loop. */
+  int step;   /**< Invariant value, or phi index (see EvolutionKind). */
+  int negate; /**< Whether the step is subtracted. */
+  int advanced; /**< Whether a sum adds the induction variable after advancing it. */
+} Evolution;
+
+static int in_loop(const Loop *loop, int value) {
+  return loop->def_block[value] == loop->header || loop->def_block[value] == loop->body;
+}
+
+static int is_invariant(const Loop *loop, int value) {
+  if (!in_loop(loop, value)) return 1;
+  if (loop->invariant[value]) return loop->invariant[value] > 0;
+  const IMP_IRInstr *def = loop->defs[value];
+  int invariant = def && def->op != IMP_IR_PHI && (def->a < 0 || is_invariant(loop, def->a)) && (def->b < 0 || is_invariant(loop, def->b));
+  loop->invariant[value] = invariant ? 1 : -1;
+  return invariant;
+}
+
+static int emit_instr(IMP_IRFunction *function, int block, IMP_IROpcode op, int a, int b, int imm) {
+  IMP_IRInstr instr = { op, imp_ir_function_new_value(function), a, b, imm, NULL, NULL, NULL };
+  arrput(function->blocks[block].instrs, instr);
+  return instr.dst;
+}
+
+/* Returns an invariant value of the loop computed in a block outside of it, copying its computation there. */
+static int materialize(IMP_IRFunction *function, const Loop *loop, int value, int block, int *copies) {
+  if (!in_loop(loop, value)) return value;
+  if (copies[value] >= 0) return copies[value];
+  const IMP_IRInstr *def = loop->defs[value];
+  int a = def->a >= 0 ? materialize(function, loop, def->a, block, copies) : -1;
+  int b = def->b >= 0 ? materialize(function, loop, def->b, block, copies) : -1;
+  return copies[value] = emit_instr(function, block, def->op, a, b, def->imm);
+}
+
+/* Finds the loop of a header, if it has the shape of a while loop whose body is a single block. */
+static int find_loop(const IMP_IRFunction *function, int header, Loop *loop) {
+  const IMP_IRBlock *h = &function->blocks[header];
+  if (h->term != IMP_IR_BRANCH || arrlen(h->preds) != 2) return 0;
+  loop->header = header;
+  loop->body = h->succs[0];
+  loop->exit = h->succs[1];
+  const IMP_IRBlock *body = &function->blocks[loop->body];
+  if (loop->body == header || body->term != IMP_IR_JUMP || body->succs[0] != header || arrlen(body->preds) != 1) return 0;
+  loop->preheader = h->preds[0] == loop->body ? h->preds[1] : h->preds[0];
+  const IMP_IRBlock *preheader = &function->blocks[loop->preheader];
+  if (loop->preheader == loop->body || loop->preheader == header || preheader->term != IMP_IR_JUMP) return 0;
+  const IMP_IRBlock *exit = &function->blocks[loop->exit];
+  if (loop->exit == header || loop->exit == loop->body || arrlen(exit->preds) != 1 || arrlen(exit->phis) > 0) return 0;
+  for (ptrdiff_t i = 0; i < arrlen(h->instrs); ++i) if (!is_pure(h->instrs[i].op)) return 0;
+  for (ptrdiff_t i = 0; i < arrlen(body->instrs); ++i) if (!is_pure(body->instrs[i].op)) return 0;
+  return 1;
+}
+
+static void define_values(const IMP_IRFunction *function, Loop *loop) {
+  for (ptrdiff_t i = 0; i < arrlen(function->blocks); ++i) {
+    const IMP_IRBlock *block = &function->blocks[i];
+    int in = (int)i == loop->header || (int)i == loop->body;
+    for (ptrdiff_t j = 0; j < arrlen(block->phis); ++j) {
+      loop->def_block[block->phis[j].dst] = (int)i;
+      if (in) loop->defs[block->phis[j].dst] = &block->phis[j];
+    }
+    for (ptrdiff_t j = 0; j < arrlen(block->instrs); ++j) {
+      const IMP_IRInstr *instr = &block->instrs[j];
+      if (instr->dst >= 0) loop->def_block[instr->dst] = (int)i;
+      for (ptrdiff_t k = 0; k < arrlen(instr->results); ++k) loop->def_block[instr->results[k]] = (int)i;
+      if (in && instr->dst >= 0) loop->defs[instr->dst] = instr;
+    }
+  }
+}
+
+/* Classifies how each header phi evolves, failing for phis without a closed form. */
+static int classify(const IMP_IRFunction *function, const Loop *loop, Evolution *evolutions) {
+  const IMP_IRBlock *h = &function->blocks[loop->header];
+  int from_body = h->preds[0] == loop->body ? 0 : 1;
+  ptrdiff_t len = arrlen(h->phis);
+  for (ptrdiff_t i = 0; i < len; ++i) {
+    const IMP_IRInstr *phi = &h->phis[i];
+    int next = phi->args[from_body];
+    Evolution *evolution = &evolutions[i];
+    evolution->init = phi->args[1 - from_body];
+    evolution->negate = 0;
+    evolution->advanced = 0;
+    if (is_invariant(loop, next)) {
+      evolution->kind = EVOLUTION_LAST;
+      evolution->step = next;
+      continue;
+    }
+    const IMP_IRInstr *def = loop->defs[next];
+    if (!def || (def->op != IMP_IR_ADD && def->op != IMP_IR_SUB)) return 0;
+    int other = def->a == phi->dst ? def->b : def->op == IMP_IR_ADD && def->b == phi->dst ? def->a : -1;
+    if (other < 0) return 0;
+    evolution->negate = def->op == IMP_IR_SUB;
+    /* Sums refer to the value of the phi they add for now. */
+    evolution->kind = is_invariant(loop, other) ? EVOLUTION_INDUCTION : EVOLUTION_SUM;
+    evolution->step = other;
+  }
+  for (ptrdiff_t i = 0; i < len; ++i) {
+    if (evolutions[i].kind != EVOLUTION_SUM) continue;
+    ptrdiff_t summed = 0;
+    while (summed < len && h->phis[summed].dst != evolutions[i].step && h->phis[summed].args[from_body] != evolutions[i].step) ++summed;
+    if (summed == len || evolutions[summed].kind != EVOLUTION_INDUCTION) return 0;
+    evolutions[i].advanced = h->phis[summed].dst != evolutions[i].step;
+    evolutions[i].step = (int)summed;
+  }
+  return 1;
+}
+
+/* Whether values defined by the loop, other than the header phis, are used outside of it. */
+static int escapes(const IMP_IRFunction *function, const Loop *loop) {
+  for (ptrdiff_t i = 0; i < arrlen(function->blocks); ++i) {
+    if ((int)i == loop->header || (int)i == loop->body) continue;
+    const IMP_IRBlock *block = &function->blocks[i];
+    for (ptrdiff_t j = 0; j < arrlen(block->phis); ++j) {
+      for (ptrdiff_t k = 0; k < arrlen(block->phis[j].args); ++k) {
+        int arg = block->phis[j].args[k];
+        if (in_loop(loop, arg) && loop->defs[arg]->op != IMP_IR_PHI) return 1;
+      }
+    }
+    for (ptrdiff_t j = 0; j < arrlen(block->instrs); ++j) {
+      const IMP_IRInstr *instr = &block->instrs[j];
+      if (instr->a >= 0 && in_loop(loop, instr->a) && loop->defs[instr->a]->op != IMP_IR_PHI) return 1;
+      if (instr->b >= 0 && in_loop(loop, instr->b) && loop->defs[instr->b]->op != IMP_IR_PHI) return 1;
+      for (ptrdiff_t k = 0; k < arrlen(instr->args); ++k) {
+        if (in_loop(loop, instr->args[k]) && loop->defs[instr->args[k]]->op != IMP_IR_PHI) return 1;
+      }
+    }
+    if (block->term == IMP_IR_BRANCH && in_loop(loop, block->cond) && loop->defs[block->cond]->op != IMP_IR_PHI) return 1;
+  }
+  return 0;
+}
+
+static IMP_IROpcode swapped(IMP_IROpcode op) {
+  switch (op) {
+    case IMP_IR_LT: return IMP_IR_GT;
+    case IMP_IR_LE: return IMP_IR_GE;
+    case IMP_IR_GT: return IMP_IR_LT;
+    case IMP_IR_GE: return IMP_IR_LE;
+    default: return op;
+  }
+}
+
+/* The exit condition of a loop: an induction variable compared to an invariant bound, such that the
+ * number of iterations follows from them, given a guard on the bound (ruling out wrapping around). */
+typedef struct TripCount {
+  IMP_IROpcode op;       /**< Comparison continuing the loop, with the induction variable on the left. */
+  int phi;               /**< Index of the induction variable. */
+  int bound;             /**< Invariant bound. */
+  int stride;            /**< Constant step of the induction variable (its absolute value), or 0 for a step of -bound. */
+  int ascending;         /**< Whether the induction variable increases. */
+  IMP_IROpcode guard_op; /**< Comparison of the bound to guard, or IMP_IR_OP_COUNT for none. */
+  int guard;
+} TripCount;
+
+static int trip_count(const IMP_IRFunction *function, const Loop *loop, const Evolution *evolutions, const int *known, const int *values, TripCount *trip) {
+  const IMP_IRBlock *h = &function->blocks[loop->header];
+  if (!in_loop(loop, h->cond) || !loop->defs[h->cond]) return 0;
+  const IMP_IRInstr *cond = loop->defs[h->cond];
+  if (cond->op < IMP_IR_NE || cond->op > IMP_IR_GE) return 0;
+  int l = cond->a, r = cond->b;
+  trip->op = cond->op;
+  if (!is_invariant(loop, r)) {
+    l = cond->b;
+    r = cond->a;
+    trip->op = swapped(cond->op);
+  }
+  if (!is_invariant(loop, r)) return 0;
+  ptrdiff_t phi = 0;
+  while (phi < arrlen(h->phis) && h->phis[phi].dst != l) ++phi;
+  if (phi == arrlen(h->phis) || evolutions[phi].kind != EVOLUTION_INDUCTION) return 0;
+  const Evolution *iv = &evolutions[phi];
+  trip->phi = (int)phi;
+  trip->bound = r;
+  trip->guard_op = IMP_IR_OP_COUNT;
+  trip->guard = 0;
+  if (iv->negate && iv->step == r && trip->op == IMP_IR_GE) {
+    /* Repeated subtraction of a positive bound (q >= b, q := q - b), leaving q mod b. */
+    trip->stride = 0;
+    trip->ascending = 0;
+    trip->guard_op = IMP_IR_GT;
+    trip->guard = 0;
+    return 1;
+  }
+  if (!known[iv->step]) return 0;
+  long long step = iv->negate ? -(long long)values[iv->step] : values[iv->step];
+  long long stride = step > 0 ? step : -step;
+  if (step == 0 || stride > INT_MAX) return 0;
+  trip->stride = (int)stride;
+  trip->ascending = step > 0;
+  /* The last value of the induction variable must not wrap around when advanced. */
+  switch (trip->op) {
+    case IMP_IR_NE: return stride == 1;
+    case IMP_IR_LT: trip->guard_op = IMP_IR_LE; trip->guard = (int)(INT_MAX - (stride - 1)); return step > 0;
+    case IMP_IR_LE: trip->guard_op = IMP_IR_LE; trip->guard = (int)(INT_MAX - stride); return step > 0;
+    case IMP_IR_GT: trip->guard_op = IMP_IR_GE; trip->guard = (int)(INT_MIN + (stride - 1)); return step < 0;
+    case IMP_IR_GE: trip->guard_op = IMP_IR_GE; trip->guard = (int)(INT_MIN + stride); return step < 0;
+    default: return 0;
+  }
+}
+
+/* Number of iterations of a loop entered with its condition true, as an unsigned integer: the distance
+ * of the induction variable to the bound divided by the stride, rounded up for strict comparisons. */
+static int emit_trip_count(IMP_IRFunction *function, int block, const TripCount *trip, int init, int bound) {
+  int distance = trip->ascending ? emit_instr(function, block, IMP_IR_SUB, bound, init, 0)
+                                 : emit_instr(function, block, IMP_IR_SUB, init, bound, 0);
+  int strict = trip->op == IMP_IR_NE || trip->op == IMP_IR_LT || trip->op == IMP_IR_GT;
+  if (strict && trip->stride == 1) return distance;
+  int one = emit_instr(function, block, IMP_IR_CONST, -1, -1, 1);
+  if (strict) distance = emit_instr(function, block, IMP_IR_SUB, distance, one, 0);
+  int stride = trip->stride ? emit_instr(function, block, IMP_IR_CONST, -1, -1, trip->stride) : bound;
+  if (trip->stride != 1) distance = emit_instr(function, block, IMP_IR_DIVU, distance, stride, 0);
+  return emit_instr(function, block, IMP_IR_ADD, distance, one, 0);
+}
+
+/* Replaces a loop by the closed forms of its header phis, on entering it with the guard holding and
+ * its condition true; the loop is kept for all other cases. */
+static int eliminate_loop(IMP_IRFunction *function, int header) {
+  Loop loop;
+  if (!find_loop(function, header, &loop)) return 0;
+  ptrdiff_t phis = arrlen(function->blocks[header].phis);
+  if (phis == 0) return 0;
+  int values_len = function->values;
+  loop.def_block = malloc(sizeof(int) * values_len);
+  loop.defs = calloc(values_len, sizeof(IMP_IRInstr *));
+  loop.invariant = calloc(values_len, sizeof(int));
+  Evolution *evolutions = malloc(sizeof(Evolution) * phis);
+  int *copies = malloc(sizeof(int) * values_len);
+  assert(loop.def_block && loop.defs && loop.invariant && evolutions && copies && "Memory allocation failed");
+  for (int i = 0; i < values_len; ++i) loop.def_block[i] = copies[i] = -1;
+  define_values(function, &loop);
+  int *values;
+  int *known = constants(function, &values);
+  TripCount trip;
+  int eliminated = classify(function, &loop, evolutions) && !escapes(function, &loop)
+                   && trip_count(function, &loop, evolutions, known, values, &trip);
+  int init = eliminated ? evolutions[trip.phi].init : -1;
+  if (eliminated) {
+    /* Loops known not to be entered, or to fail the guard, are left alone. */
+    if (known[init] && known[trip.bound]) eliminated = fold(trip.op, values[init], values[trip.bound]);
+    if (trip.guard_op != IMP_IR_OP_COUNT && known[trip.bound]) {
+      eliminated = eliminated && fold(trip.guard_op, values[trip.bound], trip.guard);
+    }
+  }
+  /* The closed forms are taken if the condition holds on entering the loop, and so does the guard. */
+  int go = -1;
+  if (eliminated && !(known[init] && known[trip.bound])) {
+    go = emit_instr(function, loop.preheader, trip.op, init, materialize(function, &loop, trip.bound, loop.preheader, copies), 0);
+  }
+  if (eliminated && trip.guard_op != IMP_IR_OP_COUNT && !known[trip.bound]) {
+    int guard = emit_instr(function, loop.preheader, IMP_IR_CONST, -1, -1, trip.guard);
+    guard = emit_instr(function, loop.preheader, trip.guard_op, materialize(function, &loop, trip.bound, loop.preheader, copies), guard, 0);
+    go = go < 0 ? guard : emit_instr(function, loop.preheader, IMP_IR_AND, go, guard, 0);
+  }
+  free(known);
+  free(values);
+  if (!eliminated) {
+    free(loop.def_block);
+    free(loop.defs);
+    free(loop.invariant);
+    free(evolutions);
+    free(copies);
+    return 0;
+  }
+  /* Closed forms, computed in a new block from the values entering the loop. */
+  IMP_IRBlock block = { NULL, NULL, NULL, IMP_IR_JUMP, -1, { loop.exit, -1 } };
+  arrput(block.preds, loop.preheader);
+  arrput(function->blocks, block);
+  int closed = (int)arrlen(function->blocks) - 1;
+  for (int i = 0; i < values_len; ++i) copies[i] = -1;
+  int count = emit_trip_count(function, closed, &trip, init, materialize(function, &loop, trip.bound, closed, copies));
+  int *finals = malloc(sizeof(int) * phis);
+  assert(finals && "Memory allocation failed");
+  int triangle = -1;
+  for (ptrdiff_t i = 0; i < phis; ++i) {
+    const Evolution *evolution = &evolutions[i];
+    IMP_IROpcode advance = evolution->negate ? IMP_IR_SUB : IMP_IR_ADD;
+    if (evolution->kind == EVOLUTION_LAST) {
+      finals[i] = materialize(function, &loop, evolution->step, closed, copies);
+    } else if (evolution->kind == EVOLUTION_INDUCTION) {
+      int step = materialize(function, &loop, evolution->step, closed, copies);
+      int total = emit_instr(function, closed, IMP_IR_MUL, count, step, 0);
+      finals[i] = emit_instr(function, closed, advance, evolution->init, total, 0);
+    } else {
+      /* init + count * iv_first +- iv_step * count * (count - 1) / 2, where iv_first is the first value
+       * added, and half of the (even) product is (count / 2) * (count - 1) + (count % 2) * (count / 2). */
+      const Evolution *iv = &evolutions[evolution->step];
+      if (triangle < 0) {
+        int one = emit_instr(function, closed, IMP_IR_CONST, -1, -1, 1);
+        int two = emit_instr(function, closed, IMP_IR_CONST, -1, -1, 2);
+        int half = emit_instr(function, closed, IMP_IR_DIVU, count, two, 0);
+        int pred = emit_instr(function, closed, IMP_IR_SUB, count, one, 0);
+        int even = emit_instr(function, closed, IMP_IR_MUL, half, pred, 0);
+        int odd = emit_instr(function, closed, IMP_IR_SUB, count, emit_instr(function, closed, IMP_IR_MUL, half, two, 0), 0);
+        triangle = emit_instr(function, closed, IMP_IR_ADD, even, emit_instr(function, closed, IMP_IR_MUL, odd, half, 0), 0);
+      }
+      int step = materialize(function, &loop, iv->step, closed, copies);
+      int first = evolution->advanced ? emit_instr(function, closed, iv->negate ? IMP_IR_SUB : IMP_IR_ADD, iv->init, step, 0) : iv->init;
+      int start = emit_instr(function, closed, IMP_IR_MUL, count, first, 0);
+      int growth = emit_instr(function, closed, IMP_IR_MUL, step, triangle, 0);
+      int total = emit_instr(function, closed, iv->negate ? IMP_IR_SUB : IMP_IR_ADD, start, growth, 0);
+      finals[i] = emit_instr(function, closed, advance, evolution->init, total, 0);
+    }
+  }
+  /* Uses after the loop refer to phis of the exit, merging the values of the loop and the closed forms. */
+  int *replacements = malloc(sizeof(int) * function->values);
+  assert(replacements && "Memory allocation failed");
+  for (int i = 0; i < function->values; ++i) replacements[i] = i;
+  IMP_IRInstr *exit_phis = NULL;
+  for (ptrdiff_t i = 0; i < phis; ++i) {
+    IMP_IRInstr phi = { IMP_IR_PHI, imp_ir_function_new_value(function), -1, -1, 0, NULL, NULL, NULL };
+    arrput(phi.args, function->blocks[header].phis[i].dst);
+    arrput(phi.args, finals[i]);
+    replacements[function->blocks[header].phis[i].dst] = phi.dst;
+    arrput(exit_phis, phi);
+  }
+  for (ptrdiff_t i = 0; i < arrlen(function->blocks); ++i) {
+    if ((int)i == header || (int)i == loop.body || (int)i == closed) continue;
+    IMP_IRBlock *b = &function->blocks[i];
+    for (ptrdiff_t j = 0; j < arrlen(b->phis); ++j) {
+      for (ptrdiff_t k = 0; k < arrlen(b->phis[j].args); ++k) b->phis[j].args[k] = replacements[b->phis[j].args[k]];
+    }
+    for (ptrdiff_t j = 0; j < arrlen(b->instrs); ++j) {
+      IMP_IRInstr *instr = &b->instrs[j];
+      if (instr->a >= 0) instr->a = replacements[instr->a];
+      if (instr->b >= 0) instr->b = replacements[instr->b];
+      for (ptrdiff_t k = 0; k < arrlen(instr->args); ++k) instr->args[k] = replacements[instr->args[k]];
+    }
+    if (b->term == IMP_IR_BRANCH) b->cond = replacements[b->cond];
+  }
+  IMP_IRBlock *exit = &function->blocks[loop.exit];
+  exit->phis = exit_phis;
+  arrput(exit->preds, closed);
+  IMP_IRBlock *preheader = &function->blocks[loop.preheader];
+  if (go < 0) {
+    preheader->succs[0] = closed;
+    remove_pred(&function->blocks[header], loop.preheader);
+  } else {
+    preheader->term = IMP_IR_BRANCH;
+    preheader->cond = go;
+    preheader->succs[0] = closed;
+    preheader->succs[1] = header;
+  }
+  free(replacements);
+  free(finals);
+  free(loop.def_block);
+  free(loop.defs);
+  free(loop.invariant);
+  free(evolutions);
+  free(copies);
+  return 1;
+}
+
+static int scalar_evolution(IMP_IRFunction *function) {
+  int changed = 0;
+  for (ptrdiff_t i = 0; i < arrlen(function->blocks); ++i) changed |= eliminate_loop(function, (int)i);
+  return changed;
+}
+
+const IMP_IRPass imp_ir_pass_simplify_phis = { "simplify-phis", simplify_phis };
+const IMP_IRPass imp_ir_pass_fold_constants = { "fold-constants", fold_constants };
+const IMP_IRPass imp_ir_pass_dead_code = { "dead-code", dead_code };
+const IMP_IRPass imp_ir_pass_redundant_stores = { "redundant-stores", redundant_stores };
+const IMP_IRPass imp_ir_pass_scalar_evolution = { "scalar-evolution", scalar_evolution };
+
+
+/* Pass manager. */
+
+IMP_IRPassManager *imp_ir_pass_manager_create(void) {
+  IMP_IRPassManager *manager = calloc(1, sizeof(IMP_IRPassManager));
+  assert(manager && "Memory allocation failed");
+  return manager;
+}
+
+IMP_IRPassManager *imp_ir_pass_manager_create_default(void) {
+  IMP_IRPassManager *manager = imp_ir_pass_manager_create();
+  imp_ir_pass_manager_add(manager, &imp_ir_pass_simplify_phis);
+  imp_ir_pass_manager_add(manager, &imp_ir_pass_fold_constants);
+  imp_ir_pass_manager_add(manager, &imp_ir_pass_dead_code);
+  imp_ir_pass_manager_add(manager, &imp_ir_pass_redundant_stores);
+  imp_ir_pass_manager_add(manager, &imp_ir_pass_scalar_evolution);
+  return manager;
+}
+
+void imp_ir_pass_manager_add(IMP_IRPassManager *manager, const IMP_IRPass *pass) {
+  arrput(manager->passes, pass);
+}
+
+int imp_ir_pass_manager_run(const IMP_IRPassManager *manager, IMP_IRFunction *function) {
+  int changes = 0;
+  for (int changed = 1; changed;) {
+    changed = 0;
+    for (ptrdiff_t i = 0; i < arrlen(manager->passes); ++i) {
+      if (!manager->passes[i]->run(function)) continue;
+      changed = 1;
+      changes++;
+    }
+  }
+  return changes;
+}
+
+void imp_ir_pass_manager_destroy(IMP_IRPassManager *manager) {
+  if (!manager) return;
+  arrfree(manager->passes);
+  free(manager);
+}
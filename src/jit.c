@@ -0,0 +1,355 @@
+#include "jit.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "vm_runtime.h"
+#include "3rdparty/stb_ds/stb_ds.h"
+
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define JIT_X86_64 1
+#include <sys/mman.h>
+#else
+#define JIT_X86_64 0
+#endif
+
+struct IMP_JitCode {
+  void *mem;   /**< Executable pages. */
+  size_t size; /**< Size of the mapping in bytes. */
+};
+
+/** Activation record of a procedure call. */
+typedef struct JitCall {
+  const void *ret; /**< Machine code to continue with in the caller. */
+  int call;        /**< Call site index. */
+  int *caller_fp;  /**< Frame of the caller. */
+} JitCall;
+
+/** State shared by the machine code and the runtime helpers. */
+typedef struct JitRuntime {
+  int *fp; /**< Current frame; must stay the first member, the code reloads it after returns. */
+  IMP_InterpreterContext *context;
+  const IMP_BytecodeChunk *chunk;
+  IMP_FrameStack *frame_stack;
+  char *declared;
+  JitCall *calls;
+} JitRuntime;
+
+#if JIT_X86_64
+
+/* Runtime helpers, called from the machine code. They run the same declarations, calls and
+ * returns as the VM's handlers (see vm_runtime.h) and return 0 (or NULL) on error. */
+
+static int jit_decl(JitRuntime *rt, int proc) {
+  return imp_vm_runtime_decl(rt->context, rt->chunk, rt->declared, proc);
+}
+
+static int *jit_call(JitRuntime *rt, int index, const int *sp, int *fp, const void *ret) {
+  int *callee_fp = imp_vm_runtime_call(rt->frame_stack, rt->chunk, rt->declared, index, sp);
+  if (!callee_fp) return NULL;
+  JitCall activation = { ret, index, fp };
+  arrput(rt->calls, activation);
+  rt->fp = callee_fp;
+  return callee_fp;
+}
+
+static const void *jit_ret(JitRuntime *rt, int index, int *fp) {
+  JitCall activation = arrpop(rt->calls);
+  rt->fp = activation.caller_fp;
+  if (imp_vm_runtime_ret(rt->frame_stack, rt->chunk, activation.call, index, fp, activation.caller_fp)) return NULL;
+  return activation.ret;
+}
+
+/*
+ * Register assignment of the generated code:
+ *   rbx  current frame (fp), slots are addressed as [rbx + 4 * slot]
+ *   r12  value stack pointer (sp), growing upwards like the VM's
+ *   r13  JitRuntime
+ * All three are callee-saved, so they survive calls into the helpers.
+ * eax and ecx are scratch registers of the templates.
+ */
+
+enum {
+  LABEL_EXIT = -1,  /**< Epilogue, returning eax. */
+  LABEL_ERROR = -2, /**< Sets eax to -1 and exits. */
+};
+
+/** A rel32 field to be patched with the distance to a label. */
+typedef struct Fixup {
+  int at;     /**< Offset of the rel32 field. */
+  int target; /**< Bytecode instruction index, or one of the LABEL_ constants. */
+} Fixup;
+
+typedef struct Assembler {
+  uint8_t *code;
+  int *labels;
+  Fixup *fixups;
+} Assembler;
+
+static void put(Assembler *as, const uint8_t *bytes, size_t len) {
+  memcpy(arraddnptr(as->code, len), bytes, len);
+}
+
+#define PUT(as, ...) do { const uint8_t bytes_[] = { __VA_ARGS__ }; put(as, bytes_, sizeof(bytes_)); } while (0)
+
+static void put32(Assembler *as, int32_t val) {
+  put(as, (const uint8_t *)&val, 4);
+}
+
+static void put64(Assembler *as, const void *ptr) {
+  uint64_t val = (uint64_t)(uintptr_t)ptr;
+  put(as, (const uint8_t *)&val, 8);
+}
+
+static void put_rel32(Assembler *as, int target) {
+  Fixup fixup = { (int)arrlen(as->code), target };
+  arrput(as->fixups, fixup);
+  put32(as, 0);
+}
+
+static void put_slot(Assembler *as, int slot) {
+  put32(as, (int32_t)(slot * (int)sizeof(int)));
+}
+
+/* mov rax, helper; call rax */
+static void put_call(Assembler *as, const void *helper) {
+  PUT(as, 0x48, 0xB8);
+  put64(as, helper);
+  PUT(as, 0xFF, 0xD0);
+}
+
+/* sub r12, 4; mov eax, [r12] */
+static void put_pop_eax(Assembler *as) {
+  PUT(as, 0x49, 0x83, 0xEC, 0x04, 0x41, 0x8B, 0x04, 0x24);
+}
+
+/* mov [r12], eax; add r12, 4 */
+static void put_push_eax(Assembler *as) {
+  PUT(as, 0x41, 0x89, 0x04, 0x24, 0x49, 0x83, 0xC4, 0x04);
+}
+
+/* sub r12, 4; mov eax, [r12 - 4]; mov ecx, [r12] */
+static void put_pop_operands(Assembler *as) {
+  PUT(as, 0x49, 0x83, 0xEC, 0x04, 0x41, 0x8B, 0x44, 0x24, 0xFC, 0x41, 0x8B, 0x0C, 0x24);
+}
+
+/* mov [r12 - 4], eax */
+static void put_replace_top(Assembler *as) {
+  PUT(as, 0x41, 0x89, 0x44, 0x24, 0xFC);
+}
+
+/* cmp eax, ecx; setcc al; movzx eax, al */
+static void put_compare(Assembler *as, uint8_t setcc) {
+  PUT(as, 0x39, 0xC8, 0x0F, setcc, 0xC0, 0x0F, 0xB6, 0xC0);
+}
+
+/* Emits the template of instruction pc. */
+static void put_instruction(Assembler *as, const IMP_BytecodeChunk *chunk, int pc) {
+  IMP_Instruction ins = chunk->code[pc];
+  switch (ins.op) {
+    case IMP_OP_PUSH:
+      PUT(as, 0x41, 0xC7, 0x04, 0x24); put32(as, ins.arg);
+      PUT(as, 0x49, 0x83, 0xC4, 0x04);
+      break;
+    case IMP_OP_LOAD:
+      PUT(as, 0x8B, 0x83); put_slot(as, ins.arg);
+      put_push_eax(as);
+      break;
+    case IMP_OP_STORE:
+      put_pop_eax(as);
+      PUT(as, 0x89, 0x83); put_slot(as, ins.arg);
+      break;
+    case IMP_OP_ADD: put_pop_operands(as); PUT(as, 0x01, 0xC8); put_replace_top(as); break;
+    case IMP_OP_SUB: put_pop_operands(as); PUT(as, 0x29, 0xC8); put_replace_top(as); break;
+    case IMP_OP_MUL: put_pop_operands(as); PUT(as, 0x0F, 0xAF, 0xC1); put_replace_top(as); break;
+    case IMP_OP_EQ: put_pop_operands(as); put_compare(as, 0x94); put_replace_top(as); break;
+    case IMP_OP_NE: put_pop_operands(as); put_compare(as, 0x95); put_replace_top(as); break;
+    case IMP_OP_LT: put_pop_operands(as); put_compare(as, 0x9C); put_replace_top(as); break;
+    case IMP_OP_LE: put_pop_operands(as); put_compare(as, 0x9E); put_replace_top(as); break;
+    case IMP_OP_GT: put_pop_operands(as); put_compare(as, 0x9F); put_replace_top(as); break;
+    case IMP_OP_GE: put_pop_operands(as); put_compare(as, 0x9D); put_replace_top(as); break;
+    case IMP_OP_AND:
+      /* test eax, eax; setne al; test ecx, ecx; setne cl; and al, cl; movzx eax, al */
+      put_pop_operands(as);
+      PUT(as, 0x85, 0xC0, 0x0F, 0x95, 0xC0, 0x85, 0xC9, 0x0F, 0x95, 0xC1, 0x20, 0xC8, 0x0F, 0xB6, 0xC0);
+      put_replace_top(as);
+      break;
+    case IMP_OP_OR:
+      /* or eax, ecx; setne al; movzx eax, al */
+      put_pop_operands(as);
+      PUT(as, 0x09, 0xC8, 0x0F, 0x95, 0xC0, 0x0F, 0xB6, 0xC0);
+      put_replace_top(as);
+      break;
+    case IMP_OP_NOT:
+      /* mov eax, [r12 - 4]; test eax, eax; sete al; movzx eax, al */
+      PUT(as, 0x41, 0x8B, 0x44, 0x24, 0xFC, 0x85, 0xC0, 0x0F, 0x94, 0xC0, 0x0F, 0xB6, 0xC0);
+      put_replace_top(as);
+      break;
+    case IMP_OP_JMP:
+      PUT(as, 0xE9); put_rel32(as, ins.arg);
+      break;
+    case IMP_OP_JZ:
+      /* test eax, eax; jz */
+      put_pop_eax(as);
+      PUT(as, 0x85, 0xC0, 0x0F, 0x84); put_rel32(as, ins.arg);
+      break;
+    case IMP_OP_DECL:
+      /* mov rdi, r13; mov esi, proc; call jit_decl; test eax, eax; jnz error */
+      PUT(as, 0x4C, 0x89, 0xEF, 0xBE); put32(as, ins.arg);
+      put_call(as, (const void *)jit_decl);
+      PUT(as, 0x85, 0xC0, 0x0F, 0x85); put_rel32(as, LABEL_ERROR);
+      break;
+    case IMP_OP_CALL: {
+      const IMP_BytecodeCall *call = &chunk->calls[ins.arg];
+      /* mov rdi, r13; mov esi, call; mov rdx, r12; mov rcx, rbx; lea r8, [next instruction] */
+      PUT(as, 0x4C, 0x89, 0xEF, 0xBE); put32(as, ins.arg);
+      PUT(as, 0x4C, 0x89, 0xE2, 0x48, 0x89, 0xD9, 0x4C, 0x8D, 0x05); put_rel32(as, pc + 1);
+      put_call(as, (const void *)jit_call);
+      /* test rax, rax; jz error; mov rbx, rax; sub r12, 4 * val_argc */
+      PUT(as, 0x48, 0x85, 0xC0, 0x0F, 0x84); put_rel32(as, LABEL_ERROR);
+      PUT(as, 0x48, 0x89, 0xC3, 0x49, 0x81, 0xEC); put32(as, call->val_argc * (int)sizeof(int));
+      /* jit_call fails for undeclared procedures, so there is no entry to jump to */
+      if (call->proc >= 0) {
+        PUT(as, 0xE9); put_rel32(as, chunk->procs[call->proc].entry);
+      }
+      break;
+    }
+    case IMP_OP_RET:
+      /* mov rdi, r13; mov esi, proc; mov rdx, rbx; call jit_ret; mov rbx, [r13]; test rax, rax; jz error; jmp rax */
+      PUT(as, 0x4C, 0x89, 0xEF, 0xBE); put32(as, ins.arg);
+      PUT(as, 0x48, 0x89, 0xDA);
+      put_call(as, (const void *)jit_ret);
+      PUT(as, 0x49, 0x8B, 0x5D, 0x00, 0x48, 0x85, 0xC0, 0x0F, 0x84); put_rel32(as, LABEL_ERROR);
+      PUT(as, 0xFF, 0xE0);
+      break;
+    case IMP_OP_HALT:
+      /* xor eax, eax; jmp exit */
+      PUT(as, 0x31, 0xC0, 0xE9); put_rel32(as, LABEL_EXIT);
+      break;
+    case IMP_OP_INC:
+      /* add dword [rbx + slot], imm */
+      PUT(as, 0x81, 0x83); put_slot(as, ins.arg); put32(as, ins.arg2);
+      break;
+    case IMP_OP_ADDVV:
+    case IMP_OP_SUBVV:
+    case IMP_OP_MULVV:
+      /* mov eax, [rbx + arg2]; op eax, [rbx + arg3]; mov [rbx + arg], eax */
+      PUT(as, 0x8B, 0x83); put_slot(as, ins.arg2);
+      if (ins.op == IMP_OP_ADDVV) PUT(as, 0x03, 0x83);
+      else if (ins.op == IMP_OP_SUBVV) PUT(as, 0x2B, 0x83);
+      else PUT(as, 0x0F, 0xAF, 0x83);
+      put_slot(as, ins.arg3);
+      PUT(as, 0x89, 0x83); put_slot(as, ins.arg);
+      break;
+    case IMP_OP_JZ_EQ: case IMP_OP_JZ_NE: case IMP_OP_JZ_LT:
+    case IMP_OP_JZ_LE: case IMP_OP_JZ_GT: case IMP_OP_JZ_GE: {
+      /* cmp dword [rbx + slot], imm; jump unless the relation holds */
+      uint8_t jcc;
+      switch (ins.op) {
+        case IMP_OP_JZ_EQ: jcc = 0x85; break; /* jne */
+        case IMP_OP_JZ_NE: jcc = 0x84; break; /* je */
+        case IMP_OP_JZ_LT: jcc = 0x8D; break; /* jge */
+        case IMP_OP_JZ_LE: jcc = 0x8F; break; /* jg */
+        case IMP_OP_JZ_GT: jcc = 0x8E; break; /* jle */
+        default: jcc = 0x8C; break;           /* jl */
+      }
+      PUT(as, 0x81, 0xBB); put_slot(as, ins.arg); put32(as, ins.arg2);
+      PUT(as, 0x0F, jcc); put_rel32(as, ins.arg3);
+      break;
+    }
+    default: assert(0);
+  }
+}
+
+static IMP_JitCode *assemble(const IMP_BytecodeChunk *chunk) {
+  Assembler as = { NULL, NULL, NULL };
+  /* push rbx; push r12; push r13; mov r13, rdi; mov rbx, rsi; mov r12, rdx */
+  PUT(&as, 0x53, 0x41, 0x54, 0x41, 0x55, 0x49, 0x89, 0xFD, 0x48, 0x89, 0xF3, 0x49, 0x89, 0xD4);
+  for (int pc = 0; pc < chunk->code_len; ++pc) {
+    arrput(as.labels, (int)arrlen(as.code));
+    put_instruction(&as, chunk, pc);
+  }
+  arrput(as.labels, (int)arrlen(as.code));
+  /* error: mov eax, -1; exit: pop r13; pop r12; pop rbx; ret */
+  int error = (int)arrlen(as.code);
+  PUT(&as, 0xB8, 0xFF, 0xFF, 0xFF, 0xFF);
+  int exit = (int)arrlen(as.code);
+  PUT(&as, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3);
+  for (ptrdiff_t i = 0; i < arrlen(as.fixups); ++i) {
+    Fixup fixup = as.fixups[i];
+    int target = fixup.target == LABEL_EXIT ? exit : fixup.target == LABEL_ERROR ? error : as.labels[fixup.target];
+    int32_t rel = target - (fixup.at + 4);
+    memcpy(as.code + fixup.at, &rel, 4);
+  }
+
+  IMP_JitCode *code = NULL;
+  size_t size = (size_t)arrlen(as.code);
+  void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem != MAP_FAILED) {
+    memcpy(mem, as.code, size);
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) == 0) {
+      code = malloc(sizeof(IMP_JitCode));
+      assert(code && "Memory allocation failed");
+      code->mem = mem;
+      code->size = size;
+    } else {
+      munmap(mem, size);
+    }
+  }
+  arrfree(as.code);
+  arrfree(as.labels);
+  arrfree(as.fixups);
+  return code;
+}
+
+#endif /* JIT_X86_64 */
+
+int imp_jit_supported(void) {
+  return JIT_X86_64;
+}
+
+IMP_JitCode *imp_jit_compile(const IMP_BytecodeChunk *chunk) {
+#if JIT_X86_64
+  return assemble(chunk);
+#else
+  (void)chunk;
+  return NULL;
+#endif
+}
+
+int imp_jit_run(IMP_InterpreterContext *context, const IMP_BytecodeChunk *chunk, const IMP_JitCode *code) {
+  typedef int (*Entry)(JitRuntime *rt, int *fp, int *stack);
+  JitRuntime rt = { 0 };
+  rt.context = context;
+  rt.chunk = chunk;
+  rt.frame_stack = imp_interpreter_context_frame_stack(context);
+  rt.fp = imp_interpreter_context_frame(context);
+  rt.declared = calloc(chunk->procs_len + 1, sizeof(char));
+  int *stack = malloc(sizeof(int) * (chunk->max_stack + 1));
+  assert(stack && rt.declared && "Memory allocation failed");
+  for (int i = 0; i < chunk->procs_len; ++i) rt.declared[i] = (char)chunk->procs[i].predeclared;
+
+  Entry entry = (Entry)code->mem;
+  int ret = entry(&rt, rt.fp, stack);
+
+  while (arrlen(rt.calls) > 0) {
+    imp_frame_stack_pop(rt.frame_stack, rt.fp);
+    rt.fp = arrpop(rt.calls).caller_fp;
+  }
+  arrfree(rt.calls);
+  free(rt.declared);
+  free(stack);
+  return ret;
+}
+
+void imp_jit_destroy(IMP_JitCode *code) {
+  if (!code) return;
+#if JIT_X86_64
+  munmap(code->mem, code->size);
+#endif
+  free(code);
+}
@@ -1,16 +1,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
+#include <getopt.h>
 
 #include "interpreter_context.h"
 #include "driver.h"
 #include "repl.h"
 
 
-static int interpret_file(const char *path) {
+static int interpret_file(const char *path, const IMP_DriverOptions *options) {
+  /* Nothing but the variables is used after the program, it may be optimized as a whole. */
+  IMP_DriverOptions file_options = *options;
+  file_options.optimizer.whole_program = 1;
   IMP_InterpreterContext *context = imp_interpreter_context_create();
-  if (imp_driver_interpret_file(context, path)) {
+  if (imp_driver_interpret_file(context, path, &file_options)) {
     fprintf(stderr, "Error interpreting file: %s\n", path);
     imp_interpreter_context_destroy(context);
     return -1;
@@ -20,14 +23,134 @@ static int interpret_file(const char *path) {
   return 0;
 }
 
+static int parse_engine(const char *name, IMP_DriverEngine *engine) {
+  if (strcmp(name, "ast") == 0) *engine = IMP_DRIVER_ENGINE_AST;
+  else if (strcmp(name, "stack") == 0) *engine = IMP_DRIVER_ENGINE_STACK;
+  else if (strcmp(name, "vm") == 0) *engine = IMP_DRIVER_ENGINE_VM;
+  else if (strcmp(name, "flat") == 0) *engine = IMP_DRIVER_ENGINE_FLAT;
+  else if (strcmp(name, "jit") == 0) *engine = IMP_DRIVER_ENGINE_JIT;
+  else if (strcmp(name, "closure") == 0) *engine = IMP_DRIVER_ENGINE_CLOSURE;
+  else if (strcmp(name, "ir") == 0) *engine = IMP_DRIVER_ENGINE_IR;
+  else return -1;
+  return 0;
+}
+
+static int parse_size(const char *str, size_t *size) {
+  char *end;
+  unsigned long long val = strtoull(str, &end, 10);
+  if (end == str) return -1;
+  switch (*end) {
+    case 'k': case 'K': val <<= 10; end++; break;
+    case 'm': case 'M': val <<= 20; end++; break;
+    case 'g': case 'G': val <<= 30; end++; break;
+    default: break;
+  }
+  if (*end != '\0') return -1;
+  *size = (size_t)val;
+  return 0;
+}
+
+static int parse_count(const char *arg, long max, int *out) {
+  char *end;
+  long val = strtol(arg, &end, 10);
+  if (end == arg || *end != '\0' || val < 0 || val > max) return -1;
+  *out = (int)val;
+  return 0;
+}
+
+enum {
+  OPT_TRACE_STATS = 256,
+  OPT_TRACE_HOT,
+  OPT_OPT_STATS,
+  OPT_NO_LICM,
+  OPT_NO_CSE,
+  OPT_NO_ACCUMULATE,
+  OPT_INLINE_SIZE,
+  OPT_SPECIALIZE_BUDGET,
+  OPT_IR,
+};
+
+static const struct option long_options[] = {
+  { "ir", required_argument, NULL, OPT_IR },
+  { "trace-stats", no_argument, NULL, OPT_TRACE_STATS },
+  { "trace-hot", required_argument, NULL, OPT_TRACE_HOT },
+  { "opt-stats", no_argument, NULL, OPT_OPT_STATS },
+  { "no-licm", no_argument, NULL, OPT_NO_LICM },
+  { "no-cse", no_argument, NULL, OPT_NO_CSE },
+  { "no-accumulate", no_argument, NULL, OPT_NO_ACCUMULATE },
+  { "inline-size", required_argument, NULL, OPT_INLINE_SIZE },
+  { "spec-budget", required_argument, NULL, OPT_SPECIALIZE_BUDGET },
+  { NULL, 0, NULL, 0 },
+};
+
 int main(int argc, char **argv) {
+  IMP_DriverOptions options = imp_driver_default_options;
+  const char *interpret_path = NULL;
+  const char *ast_path = NULL;
+  const char *ir_path = NULL;
   int opt;
-  while ((opt = getopt(argc, argv, "i:a:h")) != -1) {
+  while ((opt = getopt_long_only(argc, argv, "i:a:e:s:fOh", long_options, NULL)) != -1) {
     switch (opt) {
-    case 'i': 
-      return interpret_file(optarg) ? EXIT_FAILURE : EXIT_SUCCESS;
+    case 'i':
+      interpret_path = optarg;
+      break;
     case 'a':
-      return imp_driver_print_ast_file(optarg) ? EXIT_FAILURE : EXIT_SUCCESS;
+      ast_path = optarg;
+      break;
+    case 'e':
+      if (parse_engine(optarg, &options.engine)) {
+        fprintf(stderr, "Unknown engine: %s\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 's':
+      if (parse_size(optarg, &options.stack_limit)) {
+        fprintf(stderr, "Invalid stack limit: %s\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'f':
+      options.fused_report = 1;
+      break;
+    case OPT_IR:
+      ir_path = optarg;
+      break;
+    case 'O':
+      options.optimize = 1;
+      break;
+    case OPT_OPT_STATS:
+      options.optimize_stats = 1;
+      break;
+    case OPT_NO_LICM:
+      options.optimizer.licm = 0;
+      break;
+    case OPT_NO_CSE:
+      options.optimizer.cse = 0;
+      break;
+    case OPT_NO_ACCUMULATE:
+      options.optimizer.accumulate = 0;
+      break;
+    case OPT_INLINE_SIZE:
+      if (parse_count(optarg, 1000000, &options.optimizer.inline_size)) {
+        fprintf(stderr, "Invalid inline size: %s\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case OPT_SPECIALIZE_BUDGET:
+      if (parse_count(optarg, 1000000, &options.optimizer.specialize_budget)) {
+        fprintf(stderr, "Invalid specialization budget: %s\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case OPT_TRACE_STATS:
+      options.trace_stats = 1;
+      break;
+    case OPT_TRACE_HOT:
+      if (parse_count(optarg, 1000000000, &options.trace_threshold)) {
+        fprintf(stderr, "Invalid trace threshold: %s\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
     case 'h':
     default:
       fprintf(stderr, 
@@ -35,11 +158,27 @@ int main(int argc, char **argv) {
         "  (no args)          start REPL\n"
         "  -i <program.imp>   interpret program\n"
         "  -a <program.imp>   print ast\n"
+        "  -ir <program.imp>  print the SSA-form intermediate representation run by the ir engine\n"
+        "  -e <engine>        execution engine: ast (default), stack, vm, flat, jit, closure, ir\n"
+        "  -s <bytes>[k|m|g]  memory limit of each execution stack (default 256m, 0 for none)\n"
+        "  -f                 report superinstructions selected by the vm and jit engines\n"
+        "  -O                 optimize programs before executing or printing them\n"
+        "  --opt-stats        report what the optimizer did (with -O)\n"
+        "  --no-licm          do not hoist loop-invariant computations (with -O)\n"
+        "  --no-cse           do not reuse values of common subexpressions (with -O)\n"
+        "  --no-accumulate    do not rewrite linearly recursive procedures into loops (with -O)\n"
+        "  --inline-size <n>  AST nodes of the largest procedure inlined (default 40, 0 disables; with -O)\n"
+        "  --spec-budget <n>  AST nodes of procedures specialized to constant arguments (default 400, 0 disables; with -O)\n"
+        "  --trace-hot <n>    loop iterations before the ast engine traces a loop (default 100, 0 disables)\n"
+        "  --trace-stats      report traces recorded, guard exits and time spent in traces (ast engine)\n"
         "  -h                 print this message\n",
         argv[0]);
       return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
     }
   }
+  if (ast_path) return imp_driver_print_ast_file(ast_path, &options) ? EXIT_FAILURE : EXIT_SUCCESS;
+  if (ir_path) return imp_driver_print_ir_file(ir_path, &options) ? EXIT_FAILURE : EXIT_SUCCESS;
+  if (interpret_path) return interpret_file(interpret_path, &options) ? EXIT_FAILURE : EXIT_SUCCESS;
   imp_repl();
   return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,1686 @@
+#include "optimizer.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "3rdparty/stb_ds/stb_ds.h"
+
+
+const IMP_OptimizerOptions imp_optimizer_default_options = {
+  .whole_program = 0,
+  .licm = 1,
+  .cse = 1,
+  .accumulate = 1,
+  .inline_size = 40,
+  .specialize_budget = 400,
+};
+
+typedef struct ConstEntry {
+  const IMP_Symbol *key;
+  int value;
+} ConstEntry;
+
+typedef struct SymbolSetEntry {
+  const IMP_Symbol *key;
+  int value;
+} SymbolSetEntry;
+
+typedef struct Optimizer {
+  IMP_InterpreterContext *context;
+  IMP_ASTArena *arena;
+  const IMP_OptimizerOptions *options;
+  ConstEntry *consts;          /**< Variables known to hold a constant at the current point. */
+  SymbolSetEntry *dead_procs;  /**< Procedures whose declarations are removed. */
+  int temps;                   /**< Temporaries introduced so far. */
+  int specializations;         /**< Specialized procedures named so far. */
+  IMP_OptimizerStats stats;
+} Optimizer;
+
+/* (Looking up a key in an empty stb_ds map allocates it, which would leak for a copy of the map.) */
+static int in_set(SymbolSetEntry *set, const IMP_Symbol *name) {
+  return set && hmgeti(set, name) >= 0;
+}
+
+static SymbolSetEntry *set_copy(SymbolSetEntry *set) {
+  SymbolSetEntry *copy = NULL;
+  for (ptrdiff_t i = 0; i < hmlen(set); ++i) hmput(copy, set[i].key, 1);
+  return copy;
+}
+
+static void set_union(SymbolSetEntry **set, SymbolSetEntry *other) {
+  for (ptrdiff_t i = 0; i < hmlen(other); ++i) hmput(*set, other[i].key, 1);
+}
+
+/* === Constant folding and propagation === */
+
+/* Arithmetic, relational and boolean subexpressions with constant operands are folded (wrapping
+ * around like the engines do), as are the lowered forms of true (1 = 1), false (0 = 1) and unary
+ * minus (0 - e). Variables known to hold a constant are replaced by it, following assignments
+ * through straight-line code and merging the knowledge of both branches of an if. Ifs with a
+ * constant condition are replaced by the branch taken, while loops whose condition is constantly
+ * false by skip. */
+
+static ConstEntry *consts_copy(ConstEntry *consts) {
+  ConstEntry *copy = NULL;
+  for (ptrdiff_t i = 0; i < hmlen(consts); ++i) hmput(copy, consts[i].key, consts[i].value);
+  return copy;
+}
+
+/* Keeps the constants two paths agree on. */
+static void consts_meet(ConstEntry **consts, ConstEntry *other) {
+  ConstEntry *met = NULL;
+  for (ptrdiff_t i = 0; i < hmlen(*consts); ++i) {
+    ptrdiff_t index = other ? hmgeti(other, (*consts)[i].key) : -1;
+    if (index >= 0 && other[index].value == (*consts)[i].value) hmput(met, (*consts)[i].key, (*consts)[i].value);
+  }
+  hmfree(*consts);
+  *consts = met;
+}
+
+/* Forgets the variables a statement may assign, skipping nested procedure bodies. */
+static void consts_kill(ConstEntry **consts, const IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_ASSIGN:
+      (void)hmdel(*consts, node->data.assign.var->data.variable.symbol);
+      return;
+    case IMP_AST_NT_SEQ:
+      consts_kill(consts, node->data.seq.fst_stmt);
+      consts_kill(consts, node->data.seq.snd_stmt);
+      return;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) consts_kill(consts, node->data.block.stmts[i]);
+      return;
+    case IMP_AST_NT_IF:
+      consts_kill(consts, node->data.if_stmt.then_stmt);
+      consts_kill(consts, node->data.if_stmt.else_stmt);
+      return;
+    case IMP_AST_NT_WHILE:
+      consts_kill(consts, node->data.while_stmt.body_stmt);
+      return;
+    case IMP_AST_NT_LET:
+      consts_kill(consts, node->data.let_stmt.body_stmt);
+      return;
+    case IMP_AST_NT_PROCCALL:
+      for (IMP_ASTNodeList *args = node->data.proc_call.var_args; args; args = args->next) {
+        (void)hmdel(*consts, args->node->data.variable.symbol);
+      }
+      return;
+    default:
+      return;
+  }
+}
+
+/* Arithmetic wrapping around like the engines do, without overflowing in the optimizer. */
+static int fold_aop(IMP_ASTArithmeticOperator aopr, int l_val, int r_val) {
+  switch (aopr) {
+    case IMP_AST_AOP_ADD: return (int)((unsigned)l_val + (unsigned)r_val);
+    case IMP_AST_AOP_SUB: return (int)((unsigned)l_val - (unsigned)r_val);
+    case IMP_AST_AOP_MUL: return (int)((unsigned)l_val * (unsigned)r_val);
+    default: assert(0);
+  }
+}
+
+static int fold_rop(IMP_ASTRelationalOperator ropr, int l_val, int r_val) {
+  switch (ropr) {
+    case IMP_AST_ROP_EQ: return l_val == r_val;
+    case IMP_AST_ROP_NE: return l_val != r_val;
+    case IMP_AST_ROP_LT: return l_val < r_val;
+    case IMP_AST_ROP_LE: return l_val <= r_val;
+    case IMP_AST_ROP_GT: return l_val > r_val;
+    case IMP_AST_ROP_GE: return l_val >= r_val;
+    default: assert(0);
+  }
+}
+
+static int is_int(const IMP_ASTNode *node, int val) {
+  return node->type == IMP_AST_NT_INT && node->data.integer.val == val;
+}
+
+/* Booleans are constant if they compare two integers, like the lowered true (1 = 1) and false (0 = 1). */
+static int is_bool(const IMP_ASTNode *node, int *val) {
+  if (node->type != IMP_AST_NT_ROP) return 0;
+  const IMP_ASTNode *l_aexpr = node->data.rel_op.l_aexpr, *r_aexpr = node->data.rel_op.r_aexpr;
+  if (l_aexpr->type != IMP_AST_NT_INT || r_aexpr->type != IMP_AST_NT_INT) return 0;
+  *val = fold_rop(node->data.rel_op.ropr, l_aexpr->data.integer.val, r_aexpr->data.integer.val);
+  return 1;
+}
+
+static IMP_ASTNode *make_bool(Optimizer *opt, int val) {
+  return imp_ast_rop(opt->arena, IMP_AST_ROP_EQ, imp_ast_int(opt->arena, val ? 1 : 0), imp_ast_int(opt->arena, 1));
+}
+
+static IMP_ASTNode *fold_aexpr(Optimizer *opt, IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_INT:
+      return node;
+    case IMP_AST_NT_VAR: {
+      ptrdiff_t index = hmgeti(opt->consts, node->data.variable.symbol);
+      return index >= 0 ? imp_ast_int(opt->arena, opt->consts[index].value) : node;
+    }
+    case IMP_AST_NT_AOP: {
+      IMP_ASTNode *l_aexpr = node->data.arith_op.l_aexpr = fold_aexpr(opt, node->data.arith_op.l_aexpr);
+      IMP_ASTNode *r_aexpr = node->data.arith_op.r_aexpr = fold_aexpr(opt, node->data.arith_op.r_aexpr);
+      if (l_aexpr->type == IMP_AST_NT_INT && r_aexpr->type == IMP_AST_NT_INT) {
+        return imp_ast_int(opt->arena, fold_aop(node->data.arith_op.aopr, l_aexpr->data.integer.val, r_aexpr->data.integer.val));
+      }
+      switch (node->data.arith_op.aopr) {
+        case IMP_AST_AOP_ADD:
+          if (is_int(l_aexpr, 0)) return r_aexpr;
+          if (is_int(r_aexpr, 0)) return l_aexpr;
+          return node;
+        case IMP_AST_AOP_SUB:
+          if (is_int(r_aexpr, 0)) return l_aexpr;
+          return node;
+        case IMP_AST_AOP_MUL:
+          if (is_int(l_aexpr, 1)) return r_aexpr;
+          if (is_int(r_aexpr, 1)) return l_aexpr;
+          if (is_int(l_aexpr, 0)) return l_aexpr;
+          if (is_int(r_aexpr, 0)) return r_aexpr;
+          return node;
+        default: assert(0); return node;
+      }
+    }
+    default: assert(0);
+  }
+}
+
+static IMP_ASTNode *fold_bexpr(Optimizer *opt, IMP_ASTNode *node) {
+  int l_val, r_val;
+  switch (node->type) {
+    case IMP_AST_NT_ROP: {
+      node->data.rel_op.l_aexpr = fold_aexpr(opt, node->data.rel_op.l_aexpr);
+      node->data.rel_op.r_aexpr = fold_aexpr(opt, node->data.rel_op.r_aexpr);
+      return is_bool(node, &l_val) ? make_bool(opt, l_val) : node;
+    }
+    case IMP_AST_NT_NOT: {
+      IMP_ASTNode *bexpr = node->data.bool_not.bexpr = fold_bexpr(opt, node->data.bool_not.bexpr);
+      if (is_bool(bexpr, &l_val)) return make_bool(opt, !l_val);
+      if (bexpr->type == IMP_AST_NT_NOT) return bexpr->data.bool_not.bexpr;
+      return node;
+    }
+    case IMP_AST_NT_BOP: {
+      IMP_ASTNode *l_bexpr = node->data.bool_op.l_bexpr = fold_bexpr(opt, node->data.bool_op.l_bexpr);
+      IMP_ASTNode *r_bexpr = node->data.bool_op.r_bexpr = fold_bexpr(opt, node->data.bool_op.r_bexpr);
+      int l_const = is_bool(l_bexpr, &l_val), r_const = is_bool(r_bexpr, &r_val);
+      switch (node->data.bool_op.bopr) {
+        case IMP_AST_BOP_AND:
+          if (l_const) return l_val ? r_bexpr : l_bexpr;
+          if (r_const) return r_val ? l_bexpr : r_bexpr;
+          return node;
+        case IMP_AST_BOP_OR:
+          if (l_const) return l_val ? l_bexpr : r_bexpr;
+          if (r_const) return r_val ? r_bexpr : l_bexpr;
+          return node;
+        default: assert(0); return node;
+      }
+    }
+    default: assert(0);
+  }
+}
+
+static IMP_ASTNode *optimize(Optimizer *opt, IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_SKIP:
+      return node;
+    case IMP_AST_NT_ASSIGN: {
+      const IMP_Symbol *name = node->data.assign.var->data.variable.symbol;
+      IMP_ASTNode *aexpr = node->data.assign.aexpr = fold_aexpr(opt, node->data.assign.aexpr);
+      if (aexpr->type == IMP_AST_NT_INT) hmput(opt->consts, name, aexpr->data.integer.val);
+      else (void)hmdel(opt->consts, name);
+      return node;
+    }
+    case IMP_AST_NT_SEQ:
+      node->data.seq.fst_stmt = optimize(opt, node->data.seq.fst_stmt);
+      node->data.seq.snd_stmt = optimize(opt, node->data.seq.snd_stmt);
+      return node;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) {
+        node->data.block.stmts[i] = optimize(opt, node->data.block.stmts[i]);
+      }
+      return node;
+    case IMP_AST_NT_IF: {
+      int cond;
+      IMP_ASTNode *cond_bexpr = node->data.if_stmt.cond_bexpr = fold_bexpr(opt, node->data.if_stmt.cond_bexpr);
+      if (is_bool(cond_bexpr, &cond)) {
+        return optimize(opt, cond ? node->data.if_stmt.then_stmt : node->data.if_stmt.else_stmt);
+      }
+      ConstEntry *consts = consts_copy(opt->consts);
+      node->data.if_stmt.then_stmt = optimize(opt, node->data.if_stmt.then_stmt);
+      ConstEntry *then_consts = opt->consts;
+      opt->consts = consts;
+      node->data.if_stmt.else_stmt = optimize(opt, node->data.if_stmt.else_stmt);
+      consts_meet(&opt->consts, then_consts);
+      hmfree(then_consts);
+      return node;
+    }
+    case IMP_AST_NT_WHILE: {
+      /* Only variables the body leaves alone keep their value across iterations. */
+      int cond;
+      consts_kill(&opt->consts, node->data.while_stmt.body_stmt);
+      IMP_ASTNode *cond_bexpr = node->data.while_stmt.cond_bexpr = fold_bexpr(opt, node->data.while_stmt.cond_bexpr);
+      if (is_bool(cond_bexpr, &cond) && !cond) return imp_ast_skip(opt->arena);
+      ConstEntry *consts = consts_copy(opt->consts);
+      node->data.while_stmt.body_stmt = optimize(opt, node->data.while_stmt.body_stmt);
+      hmfree(opt->consts);
+      opt->consts = consts;
+      return node;
+    }
+    case IMP_AST_NT_LET: {
+      /* The let-bound variable shadows the outer one, whose knowledge is restored afterwards. */
+      const IMP_Symbol *name = node->data.let_stmt.var->data.variable.symbol;
+      IMP_ASTNode *aexpr = node->data.let_stmt.aexpr = fold_aexpr(opt, node->data.let_stmt.aexpr);
+      ptrdiff_t index = hmgeti(opt->consts, name);
+      int outer_known = index >= 0, outer_val = outer_known ? opt->consts[index].value : 0;
+      if (aexpr->type == IMP_AST_NT_INT) hmput(opt->consts, name, aexpr->data.integer.val);
+      else (void)hmdel(opt->consts, name);
+      node->data.let_stmt.body_stmt = optimize(opt, node->data.let_stmt.body_stmt);
+      if (outer_known) hmput(opt->consts, name, outer_val);
+      else (void)hmdel(opt->consts, name);
+      return node;
+    }
+    case IMP_AST_NT_PROCDECL: {
+      /* Procedure bodies run in frames of their own, with nothing known on entry. */
+      ConstEntry *consts = opt->consts;
+      opt->consts = NULL;
+      node->data.proc_decl.body_stmt = optimize(opt, node->data.proc_decl.body_stmt);
+      hmfree(opt->consts);
+      opt->consts = consts;
+      return node;
+    }
+    case IMP_AST_NT_PROCCALL:
+      for (IMP_ASTNodeList *args = node->data.proc_call.val_args; args; args = args->next) {
+        args->node = fold_aexpr(opt, args->node);
+      }
+      consts_kill(&opt->consts, node);
+      return node;
+    default: assert(0);
+  }
+}
+
+static int count_nodes(const IMP_ASTNode *node) {
+  int count = 1;
+  switch (node->type) {
+    case IMP_AST_NT_ASSIGN: return count + count_nodes(node->data.assign.var) + count_nodes(node->data.assign.aexpr);
+    case IMP_AST_NT_SEQ: return count + count_nodes(node->data.seq.fst_stmt) + count_nodes(node->data.seq.snd_stmt);
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) count += count_nodes(node->data.block.stmts[i]);
+      return count;
+    case IMP_AST_NT_IF:
+      return count + count_nodes(node->data.if_stmt.cond_bexpr) + count_nodes(node->data.if_stmt.then_stmt) + count_nodes(node->data.if_stmt.else_stmt);
+    case IMP_AST_NT_WHILE: return count + count_nodes(node->data.while_stmt.cond_bexpr) + count_nodes(node->data.while_stmt.body_stmt);
+    case IMP_AST_NT_AOP: return count + count_nodes(node->data.arith_op.l_aexpr) + count_nodes(node->data.arith_op.r_aexpr);
+    case IMP_AST_NT_BOP: return count + count_nodes(node->data.bool_op.l_bexpr) + count_nodes(node->data.bool_op.r_bexpr);
+    case IMP_AST_NT_NOT: return count + count_nodes(node->data.bool_not.bexpr);
+    case IMP_AST_NT_ROP: return count + count_nodes(node->data.rel_op.l_aexpr) + count_nodes(node->data.rel_op.r_aexpr);
+    case IMP_AST_NT_LET:
+      return count + count_nodes(node->data.let_stmt.var) + count_nodes(node->data.let_stmt.aexpr) + count_nodes(node->data.let_stmt.body_stmt);
+    case IMP_AST_NT_PROCDECL:
+      for (IMP_ASTNodeList *args = node->data.proc_decl.val_args; args; args = args->next) count += count_nodes(args->node);
+      for (IMP_ASTNodeList *args = node->data.proc_decl.var_args; args; args = args->next) count += count_nodes(args->node);
+      return count + count_nodes(node->data.proc_decl.body_stmt);
+    case IMP_AST_NT_PROCCALL:
+      for (IMP_ASTNodeList *args = node->data.proc_call.val_args; args; args = args->next) count += count_nodes(args->node);
+      for (IMP_ASTNodeList *args = node->data.proc_call.var_args; args; args = args->next) count += count_nodes(args->node);
+      return count;
+    default:
+      return count;
+  }
+}
+
+/* === Loop-invariant code motion === */
+
+/* Computations in while loops that only depend on variables the loop does not change (by
+ * assignments, or calls through var args) are hoisted into let-bound temporaries ahead of the loop. */
+
+typedef struct Hoist {
+  IMP_ASTNode *aexpr;
+  const IMP_Symbol *temp;
+} Hoist;
+
+/* Adds the variables a loop body may change: assigned ones, var args of calls and let-bound
+ * ones (whose references in the body do not refer to the variables outside). */
+static void loop_writes(SymbolSetEntry **written, const IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_ASSIGN: hmput(*written, node->data.assign.var->data.variable.symbol, 1); return;
+    case IMP_AST_NT_SEQ: loop_writes(written, node->data.seq.fst_stmt); loop_writes(written, node->data.seq.snd_stmt); return;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) loop_writes(written, node->data.block.stmts[i]);
+      return;
+    case IMP_AST_NT_IF: loop_writes(written, node->data.if_stmt.then_stmt); loop_writes(written, node->data.if_stmt.else_stmt); return;
+    case IMP_AST_NT_WHILE: loop_writes(written, node->data.while_stmt.body_stmt); return;
+    case IMP_AST_NT_LET:
+      hmput(*written, node->data.let_stmt.var->data.variable.symbol, 1);
+      loop_writes(written, node->data.let_stmt.body_stmt);
+      return;
+    case IMP_AST_NT_PROCCALL:
+      for (IMP_ASTNodeList *args = node->data.proc_call.var_args; args; args = args->next) hmput(*written, args->node->data.variable.symbol, 1);
+      return;
+    default: return;
+  }
+}
+
+static int is_invariant(const IMP_ASTNode *aexpr, SymbolSetEntry *written) {
+  switch (aexpr->type) {
+    case IMP_AST_NT_INT: return 1;
+    case IMP_AST_NT_VAR: return !in_set(written, aexpr->data.variable.symbol);
+    case IMP_AST_NT_AOP: return is_invariant(aexpr->data.arith_op.l_aexpr, written) && is_invariant(aexpr->data.arith_op.r_aexpr, written);
+    default: assert(0);
+  }
+}
+
+static int aexpr_equal(const IMP_ASTNode *a, const IMP_ASTNode *b) {
+  if (a->type != b->type) return 0;
+  switch (a->type) {
+    case IMP_AST_NT_INT: return a->data.integer.val == b->data.integer.val;
+    case IMP_AST_NT_VAR: return a->data.variable.symbol == b->data.variable.symbol;
+    case IMP_AST_NT_AOP:
+      return a->data.arith_op.aopr == b->data.arith_op.aopr &&
+             aexpr_equal(a->data.arith_op.l_aexpr, b->data.arith_op.l_aexpr) &&
+             aexpr_equal(a->data.arith_op.r_aexpr, b->data.arith_op.r_aexpr);
+    default: assert(0);
+  }
+}
+
+static const IMP_Symbol *new_temp(Optimizer *opt) {
+  /* Not an identifier of the language, so it cannot clash with the variables of the program. */
+  char name[32];
+  snprintf(name, sizeof(name), "$t%d", opt->temps++);
+  return imp_symbol_intern(name);
+}
+
+/* Replaces the maximal invariant operations of an expression by temporaries (leaves are as cheap as a temporary). */
+static IMP_ASTNode *hoist_aexpr(Optimizer *opt, IMP_ASTNode *node, SymbolSetEntry *written, Hoist **hoists) {
+  if (node->type != IMP_AST_NT_AOP) return node;
+  if (!is_invariant(node, written)) {
+    node->data.arith_op.l_aexpr = hoist_aexpr(opt, node->data.arith_op.l_aexpr, written, hoists);
+    node->data.arith_op.r_aexpr = hoist_aexpr(opt, node->data.arith_op.r_aexpr, written, hoists);
+    return node;
+  }
+  ptrdiff_t i = 0;
+  while (i < arrlen(*hoists) && !aexpr_equal((*hoists)[i].aexpr, node)) ++i;
+  if (i == arrlen(*hoists)) {
+    Hoist hoist = { node, new_temp(opt) };
+    arrput(*hoists, hoist);
+  }
+  return imp_ast_var(opt->arena, (*hoists)[i].temp);
+}
+
+static void hoist_bexpr(Optimizer *opt, IMP_ASTNode *node, SymbolSetEntry *written, Hoist **hoists) {
+  switch (node->type) {
+    case IMP_AST_NT_BOP:
+      hoist_bexpr(opt, node->data.bool_op.l_bexpr, written, hoists);
+      hoist_bexpr(opt, node->data.bool_op.r_bexpr, written, hoists);
+      return;
+    case IMP_AST_NT_NOT:
+      hoist_bexpr(opt, node->data.bool_not.bexpr, written, hoists);
+      return;
+    case IMP_AST_NT_ROP:
+      node->data.rel_op.l_aexpr = hoist_aexpr(opt, node->data.rel_op.l_aexpr, written, hoists);
+      node->data.rel_op.r_aexpr = hoist_aexpr(opt, node->data.rel_op.r_aexpr, written, hoists);
+      return;
+    default: assert(0);
+  }
+}
+
+/* Hoists the invariant operations of a statement within a loop, skipping nested procedure bodies. */
+static void hoist_stmt(Optimizer *opt, IMP_ASTNode *node, SymbolSetEntry *written, Hoist **hoists) {
+  switch (node->type) {
+    case IMP_AST_NT_ASSIGN:
+      node->data.assign.aexpr = hoist_aexpr(opt, node->data.assign.aexpr, written, hoists);
+      return;
+    case IMP_AST_NT_SEQ:
+      hoist_stmt(opt, node->data.seq.fst_stmt, written, hoists);
+      hoist_stmt(opt, node->data.seq.snd_stmt, written, hoists);
+      return;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) hoist_stmt(opt, node->data.block.stmts[i], written, hoists);
+      return;
+    case IMP_AST_NT_IF:
+      hoist_bexpr(opt, node->data.if_stmt.cond_bexpr, written, hoists);
+      hoist_stmt(opt, node->data.if_stmt.then_stmt, written, hoists);
+      hoist_stmt(opt, node->data.if_stmt.else_stmt, written, hoists);
+      return;
+    case IMP_AST_NT_WHILE:
+      hoist_bexpr(opt, node->data.while_stmt.cond_bexpr, written, hoists);
+      hoist_stmt(opt, node->data.while_stmt.body_stmt, written, hoists);
+      return;
+    case IMP_AST_NT_LET:
+      node->data.let_stmt.aexpr = hoist_aexpr(opt, node->data.let_stmt.aexpr, written, hoists);
+      hoist_stmt(opt, node->data.let_stmt.body_stmt, written, hoists);
+      return;
+    case IMP_AST_NT_PROCCALL:
+      for (IMP_ASTNodeList *args = node->data.proc_call.val_args; args; args = args->next) {
+        args->node = hoist_aexpr(opt, args->node, written, hoists);
+      }
+      return;
+    default:
+      return;
+  }
+}
+
+/* Moves the computations of loops that only depend on variables the loop does not change into
+ * let-bound temporaries ahead of it, innermost loops first. Evaluating them before a loop that
+ * does not run is harmless, as expressions have no effects. */
+static IMP_ASTNode *licm(Optimizer *opt, IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_SEQ:
+      node->data.seq.fst_stmt = licm(opt, node->data.seq.fst_stmt);
+      node->data.seq.snd_stmt = licm(opt, node->data.seq.snd_stmt);
+      return node;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) node->data.block.stmts[i] = licm(opt, node->data.block.stmts[i]);
+      return node;
+    case IMP_AST_NT_IF:
+      node->data.if_stmt.then_stmt = licm(opt, node->data.if_stmt.then_stmt);
+      node->data.if_stmt.else_stmt = licm(opt, node->data.if_stmt.else_stmt);
+      return node;
+    case IMP_AST_NT_LET:
+      node->data.let_stmt.body_stmt = licm(opt, node->data.let_stmt.body_stmt);
+      return node;
+    case IMP_AST_NT_PROCDECL:
+      node->data.proc_decl.body_stmt = licm(opt, node->data.proc_decl.body_stmt);
+      return node;
+    case IMP_AST_NT_WHILE: {
+      node->data.while_stmt.body_stmt = licm(opt, node->data.while_stmt.body_stmt);
+      SymbolSetEntry *written = NULL;
+      Hoist *hoists = NULL;
+      loop_writes(&written, node->data.while_stmt.body_stmt);
+      hoist_bexpr(opt, node->data.while_stmt.cond_bexpr, written, &hoists);
+      hoist_stmt(opt, node->data.while_stmt.body_stmt, written, &hoists);
+      for (ptrdiff_t i = arrlen(hoists) - 1; i >= 0; --i) {
+        node = imp_ast_let(opt->arena, imp_ast_var(opt->arena, hoists[i].temp), hoists[i].aexpr, node);
+      }
+      opt->stats.hoisted += (int)arrlen(hoists);
+      hmfree(written);
+      arrfree(hoists);
+      return node;
+    }
+    default:
+      return node;
+  }
+}
+
+/* === Common subexpression elimination === */
+
+/* Within runs of assignments, values already computed are reused until a variable they are
+ * computed from is assigned (local value numbering), from the variable assigned the value or from
+ * a let-bound temporary. */
+
+typedef struct Value {
+  IMP_ASTNode *aexpr;       /**< Operation first computing the value. */
+  IMP_ASTNode **slot;       /**< Where it was computed, to be replaced by a temporary. */
+  int stmt;                 /**< Statement of the run it was computed in. */
+  const IMP_Symbol *holder; /**< Variable still holding the value, or NULL. */
+  const IMP_Symbol *temp;   /**< Temporary holding the value, or NULL. */
+  int number;
+} Value;
+
+typedef struct ValueTemp {
+  IMP_ASTNode *aexpr;
+  const IMP_Symbol *temp;
+  int stmt;
+  int number; /**< Values are numbered after the values they are computed from. */
+} ValueTemp;
+
+typedef struct ValueTable {
+  Value *values;     /**< Values available at the current point of the run. */
+  ValueTemp *temps;  /**< Temporaries introduced for the run. */
+  int numbered;      /**< Values numbered so far. */
+} ValueTable;
+
+static int aexpr_reads(const IMP_ASTNode *aexpr, const IMP_Symbol *name) {
+  switch (aexpr->type) {
+    case IMP_AST_NT_INT: return 0;
+    case IMP_AST_NT_VAR: return aexpr->data.variable.symbol == name;
+    case IMP_AST_NT_AOP: return aexpr_reads(aexpr->data.arith_op.l_aexpr, name) || aexpr_reads(aexpr->data.arith_op.r_aexpr, name);
+    default: assert(0);
+  }
+}
+
+static int count_ops(const IMP_ASTNode *aexpr) {
+  if (aexpr->type != IMP_AST_NT_AOP) return 0;
+  return 1 + count_ops(aexpr->data.arith_op.l_aexpr) + count_ops(aexpr->data.arith_op.r_aexpr);
+}
+
+/* Numbers the operations of an expression bottom-up, replacing those computing an available value
+ * by the variable or temporary holding it. The first computation of a value reused without a
+ * variable holding it is replaced by a temporary as well, computed ahead of its statement. */
+static void number_aexpr(Optimizer *opt, ValueTable *table, IMP_ASTNode **slot, int stmt) {
+  IMP_ASTNode *node = *slot;
+  if (node->type != IMP_AST_NT_AOP) return;
+  number_aexpr(opt, table, &node->data.arith_op.l_aexpr, stmt);
+  number_aexpr(opt, table, &node->data.arith_op.r_aexpr, stmt);
+  for (ptrdiff_t i = 0; i < arrlen(table->values); ++i) {
+    Value *value = &table->values[i];
+    if (!aexpr_equal(value->aexpr, node)) continue;
+    opt->stats.cse_eliminated += count_ops(node);
+    if (value->holder) {
+      *slot = imp_ast_var(opt->arena, value->holder);
+      return;
+    }
+    if (!value->temp) {
+      value->temp = new_temp(opt);
+      *value->slot = imp_ast_var(opt->arena, value->temp);
+      ValueTemp temp = { value->aexpr, value->temp, value->stmt, value->number };
+      arrput(table->temps, temp);
+    }
+    *slot = imp_ast_var(opt->arena, value->temp);
+    return;
+  }
+  Value value = { node, slot, stmt, NULL, NULL, table->numbered++ };
+  arrput(table->values, value);
+}
+
+/* Numbers an assignment of a run, then forgets the values computed from the assigned variable. */
+static void number_assign(Optimizer *opt, ValueTable *table, IMP_ASTNode *node, int stmt) {
+  const IMP_Symbol *name = node->data.assign.var->data.variable.symbol;
+  int numbered = table->numbered;
+  number_aexpr(opt, table, &node->data.assign.aexpr, stmt);
+  for (ptrdiff_t i = arrlen(table->values) - 1; i >= 0; --i) {
+    if (table->values[i].holder == name) table->values[i].holder = NULL;
+    if (aexpr_reads(table->values[i].aexpr, name)) arrdel(table->values, i);
+  }
+  /* A value newly computed by the whole right-hand side is now held by the variable. */
+  ptrdiff_t last = arrlen(table->values) - 1;
+  if (last >= 0 && table->values[last].number >= numbered && table->values[last].aexpr == node->data.assign.aexpr) table->values[last].holder = name;
+}
+
+static int compare_temps(const void *a, const void *b) {
+  return ((const ValueTemp *)a)->number - ((const ValueTemp *)b)->number;
+}
+
+static IMP_ASTNode *make_stmts(Optimizer *opt, IMP_ASTNode **stmts, int len) {
+  return len == 1 ? stmts[0] : imp_ast_block(opt->arena, stmts, len);
+}
+
+/* Numbers a run of assignments, appending it to stmts with its statements from the first
+ * computation of each temporary on wrapped in a let binding it. Returns whether any was introduced. */
+static int number_run(Optimizer *opt, IMP_ASTNode **run, int len, IMP_ASTNode ***stmts) {
+  ValueTable table = { NULL, NULL, 0 };
+  int base = (int)arrlen(*stmts);
+  for (int i = 0; i < len; ++i) {
+    number_assign(opt, &table, run[i], i);
+    arrput(*stmts, run[i]);
+  }
+  /* Temporaries computed from others are bound within them. */
+  int introduced = arrlen(table.temps) > 0;
+  if (introduced) qsort(table.temps, arrlen(table.temps), sizeof(ValueTemp), compare_temps);
+  for (ptrdiff_t i = arrlen(table.temps) - 1; i >= 0; --i) {
+    int from = base + table.temps[i].stmt;
+    IMP_ASTNode *body = make_stmts(opt, *stmts + from, (int)arrlen(*stmts) - from);
+    arrsetlen(*stmts, from);
+    arrput(*stmts, imp_ast_let(opt->arena, imp_ast_var(opt->arena, table.temps[i].temp), table.temps[i].aexpr, body));
+  }
+  arrfree(table.values);
+  arrfree(table.temps);
+  return introduced;
+}
+
+static IMP_ASTNode *cse(Optimizer *opt, IMP_ASTNode *node);
+
+static void collect_stmts(IMP_ASTNode *node, IMP_ASTNode ***stmts) {
+  switch (node->type) {
+    case IMP_AST_NT_SEQ:
+      collect_stmts(node->data.seq.fst_stmt, stmts);
+      collect_stmts(node->data.seq.snd_stmt, stmts);
+      return;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) collect_stmts(node->data.block.stmts[i], stmts);
+      return;
+    default:
+      arrput(*stmts, node);
+      return;
+  }
+}
+
+/* Eliminates common subexpressions within the runs of assignments of a statement (local value
+ * numbering). Values are reused until a variable they are computed from is assigned; control
+ * flow, calls and lets end a run. Statement lists are only rebuilt if temporaries are introduced. */
+static IMP_ASTNode *cse(Optimizer *opt, IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_ASSIGN:
+    case IMP_AST_NT_SEQ:
+    case IMP_AST_NT_BLOCK: {
+      IMP_ASTNode **flat = NULL, **stmts = NULL;
+      int introduced = 0;
+      collect_stmts(node, &flat);
+      for (ptrdiff_t i = 0; i < arrlen(flat);) {
+        ptrdiff_t end = i;
+        while (end < arrlen(flat) && flat[end]->type == IMP_AST_NT_ASSIGN) ++end;
+        if (end > i) {
+          introduced |= number_run(opt, flat + i, (int)(end - i), &stmts);
+          i = end;
+        } else {
+          IMP_ASTNode *stmt = cse(opt, flat[i++]);
+          introduced |= stmt != flat[i - 1];
+          arrput(stmts, stmt);
+        }
+      }
+      if (introduced) node = make_stmts(opt, stmts, (int)arrlen(stmts));
+      arrfree(flat);
+      arrfree(stmts);
+      return node;
+    }
+    case IMP_AST_NT_IF:
+      node->data.if_stmt.then_stmt = cse(opt, node->data.if_stmt.then_stmt);
+      node->data.if_stmt.else_stmt = cse(opt, node->data.if_stmt.else_stmt);
+      return node;
+    case IMP_AST_NT_WHILE:
+      node->data.while_stmt.body_stmt = cse(opt, node->data.while_stmt.body_stmt);
+      return node;
+    case IMP_AST_NT_LET:
+      node->data.let_stmt.body_stmt = cse(opt, node->data.let_stmt.body_stmt);
+      return node;
+    case IMP_AST_NT_PROCDECL:
+      node->data.proc_decl.body_stmt = cse(opt, node->data.proc_decl.body_stmt);
+      return node;
+    default:
+      return node;
+  }
+}
+
+/* === Dead procedures === */
+
+/* Declarations of procedures not called from the top level, directly or through other procedures,
+ * are removed, only for whole programs as later programs may call them. */
+
+/* Collects the procedures called by a statement, skipping nested procedure bodies. */
+static void collect_calls(const IMP_ASTNode *node, SymbolSetEntry **called) {
+  switch (node->type) {
+    case IMP_AST_NT_SEQ:
+      collect_calls(node->data.seq.fst_stmt, called);
+      collect_calls(node->data.seq.snd_stmt, called);
+      return;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) collect_calls(node->data.block.stmts[i], called);
+      return;
+    case IMP_AST_NT_IF:
+      collect_calls(node->data.if_stmt.then_stmt, called);
+      collect_calls(node->data.if_stmt.else_stmt, called);
+      return;
+    case IMP_AST_NT_WHILE:
+      collect_calls(node->data.while_stmt.body_stmt, called);
+      return;
+    case IMP_AST_NT_LET:
+      collect_calls(node->data.let_stmt.body_stmt, called);
+      return;
+    case IMP_AST_NT_PROCCALL:
+      hmput(*called, node->data.proc_call.symbol, 1);
+      return;
+    default:
+      return;
+  }
+}
+
+/* Collects the procedure declarations of a statement, including nested ones. */
+static void collect_procdecls(const IMP_ASTNode *node, const IMP_ASTNode ***procdecls) {
+  switch (node->type) {
+    case IMP_AST_NT_SEQ:
+      collect_procdecls(node->data.seq.fst_stmt, procdecls);
+      collect_procdecls(node->data.seq.snd_stmt, procdecls);
+      return;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) collect_procdecls(node->data.block.stmts[i], procdecls);
+      return;
+    case IMP_AST_NT_IF:
+      collect_procdecls(node->data.if_stmt.then_stmt, procdecls);
+      collect_procdecls(node->data.if_stmt.else_stmt, procdecls);
+      return;
+    case IMP_AST_NT_WHILE:
+      collect_procdecls(node->data.while_stmt.body_stmt, procdecls);
+      return;
+    case IMP_AST_NT_LET:
+      collect_procdecls(node->data.let_stmt.body_stmt, procdecls);
+      return;
+    case IMP_AST_NT_PROCDECL:
+      arrput(*procdecls, node);
+      collect_procdecls(node->data.proc_decl.body_stmt, procdecls);
+      return;
+    default:
+      return;
+  }
+}
+
+/* Finds the procedures declared by the program but never called from its top level, directly or
+ * through other procedures. Procedures declared more than once, or already declared in the context,
+ * are kept for the errors their declarations raise. */
+static void find_dead_procs(Optimizer *opt, const IMP_ASTNode *node) {
+  SymbolSetEntry *called = NULL, *declared = NULL;
+  const IMP_ASTNode **procdecls = NULL;
+  collect_calls(node, &called);
+  collect_procdecls(node, &procdecls);
+  for (ptrdiff_t i = 0; i < arrlen(procdecls); ++i) {
+    const IMP_Symbol *name = procdecls[i]->data.proc_decl.symbol;
+    ptrdiff_t index = hmgeti(declared, name);
+    if (index < 0) hmput(declared, name, 1);
+    else declared[index].value++;
+  }
+  for (ptrdiff_t len = -1; len != hmlen(called);) {
+    len = hmlen(called);
+    for (ptrdiff_t i = 0; i < arrlen(procdecls); ++i) {
+      if (in_set(called, procdecls[i]->data.proc_decl.symbol)) collect_calls(procdecls[i]->data.proc_decl.body_stmt, &called);
+    }
+  }
+  for (ptrdiff_t i = 0; i < hmlen(declared); ++i) {
+    const IMP_Symbol *name = declared[i].key;
+    if (in_set(called, name) || declared[i].value > 1) continue;
+    if (opt->context && imp_interpreter_context_proc_get(opt->context, name)) continue;
+    hmput(opt->dead_procs, name, 1);
+  }
+  hmfree(called);
+  hmfree(declared);
+  arrfree(procdecls);
+}
+
+/* === Inlining === */
+
+/* Calls to small procedures that do not call themselves (directly or through other procedures) are
+ * replaced by their bodies, with the variables of the procedure renamed to let-bound temporaries;
+ * var args are copied out at the end, as by a call. Only calls that run after the procedure is
+ * declared are inlined: those following its declaration at the top level, and calls to procedures
+ * declared by earlier programs run within the context. */
+
+typedef struct ProcEntry {
+  const IMP_Symbol *key;
+  const IMP_ASTNode *value;
+} ProcEntry;
+
+typedef struct RenameEntry {
+  const IMP_Symbol *key;
+  const IMP_Symbol *value;
+} RenameEntry;
+
+typedef struct Inliner {
+  ProcEntry *decls;          /**< Procedures declared once by the program, and not by the context. */
+  SymbolSetEntry *ambiguous; /**< Procedures declared more than once, or by both. */
+  ProcEntry *inlinable;      /**< Procedures inlined at the calls following their declaration. */
+  SymbolSetEntry *checked;   /**< Procedures of the context checked for inlining. */
+} Inliner;
+
+static const IMP_ASTNode *inliner_lookup(Optimizer *opt, Inliner *inliner, const IMP_Symbol *name) {
+  ptrdiff_t index = hmgeti(inliner->decls, name);
+  if (index >= 0) return inliner->decls[index].value;
+  return opt->context ? imp_interpreter_context_proc_get(opt->context, name) : NULL;
+}
+
+/* Whether a procedure body calls the named procedure, directly or through other procedures. */
+static int reaches(Optimizer *opt, Inliner *inliner, const IMP_ASTNode *body, const IMP_Symbol *name, SymbolSetEntry **visited) {
+  SymbolSetEntry *called = NULL;
+  int found = 0;
+  collect_calls(body, &called);
+  for (ptrdiff_t i = 0; !found && i < hmlen(called); ++i) {
+    const IMP_Symbol *callee = called[i].key;
+    if (callee == name || in_set(inliner->ambiguous, callee)) found = 1;
+    if (found || in_set(*visited, callee)) continue;
+    hmput(*visited, callee, 1);
+    const IMP_ASTNode *procdecl = inliner_lookup(opt, inliner, callee);
+    if (procdecl) found = reaches(opt, inliner, procdecl->data.proc_decl.body_stmt, name, visited);
+  }
+  hmfree(called);
+  return found;
+}
+
+/* Whether the body of a procedure can be cloned with its arguments bound by lets: it declares no
+ * procedures, and its arguments are distinct. */
+static int is_clonable(const IMP_ASTNode *procdecl) {
+  const IMP_ASTNode **procdecls = NULL;
+  collect_procdecls(procdecl->data.proc_decl.body_stmt, &procdecls);
+  int clonable = arrlen(procdecls) == 0;
+  arrfree(procdecls);
+  SymbolSetEntry *args = NULL;
+  for (IMP_ASTNodeList *arg = procdecl->data.proc_decl.val_args; clonable && arg; arg = arg->next) {
+    clonable = !in_set(args, arg->node->data.variable.symbol);
+    hmput(args, arg->node->data.variable.symbol, 1);
+  }
+  for (IMP_ASTNodeList *arg = procdecl->data.proc_decl.var_args; clonable && arg; arg = arg->next) {
+    clonable = !in_set(args, arg->node->data.variable.symbol);
+    hmput(args, arg->node->data.variable.symbol, 1);
+  }
+  hmfree(args);
+  return clonable;
+}
+
+/* Small, non-recursive procedures that can be cloned are inlined. */
+static int is_inlinable(Optimizer *opt, Inliner *inliner, const IMP_ASTNode *procdecl) {
+  const IMP_ASTNode *body = procdecl->data.proc_decl.body_stmt;
+  if (count_nodes(body) > opt->options->inline_size || !is_clonable(procdecl)) return 0;
+  SymbolSetEntry *visited = NULL;
+  int inlinable = !reaches(opt, inliner, body, procdecl->data.proc_decl.symbol, &visited);
+  hmfree(visited);
+  return inlinable;
+}
+
+static const IMP_Symbol *rename_var(Optimizer *opt, RenameEntry **renamed, const IMP_Symbol *name) {
+  ptrdiff_t index = hmgeti(*renamed, name);
+  if (index >= 0) return (*renamed)[index].value;
+  const IMP_Symbol *temp = new_temp(opt);
+  hmput(*renamed, name, temp);
+  return temp;
+}
+
+typedef struct Binding {
+  const IMP_Symbol *name;
+  const struct Binding *next;
+} Binding;
+
+static int is_bound(const Binding *bindings, const IMP_Symbol *name) {
+  for (; bindings; bindings = bindings->next) if (bindings->name == name) return 1;
+  return 0;
+}
+
+/* Renames every variable of a cloned procedure body (which has no nested declarations), collecting
+ * the variables not bound by a let within the body. */
+static void rename_vars(Optimizer *opt, IMP_ASTNode *node, const Binding *bindings, RenameEntry **renamed, SymbolSetEntry **unbound) {
+  switch (node->type) {
+    case IMP_AST_NT_SKIP:
+    case IMP_AST_NT_INT:
+      return;
+    case IMP_AST_NT_VAR:
+      if (!is_bound(bindings, node->data.variable.symbol)) hmput(*unbound, node->data.variable.symbol, 1);
+      node->data.variable.symbol = rename_var(opt, renamed, node->data.variable.symbol);
+      return;
+    case IMP_AST_NT_ASSIGN:
+      rename_vars(opt, node->data.assign.var, bindings, renamed, unbound);
+      rename_vars(opt, node->data.assign.aexpr, bindings, renamed, unbound);
+      return;
+    case IMP_AST_NT_SEQ:
+      rename_vars(opt, node->data.seq.fst_stmt, bindings, renamed, unbound);
+      rename_vars(opt, node->data.seq.snd_stmt, bindings, renamed, unbound);
+      return;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) rename_vars(opt, node->data.block.stmts[i], bindings, renamed, unbound);
+      return;
+    case IMP_AST_NT_IF:
+      rename_vars(opt, node->data.if_stmt.cond_bexpr, bindings, renamed, unbound);
+      rename_vars(opt, node->data.if_stmt.then_stmt, bindings, renamed, unbound);
+      rename_vars(opt, node->data.if_stmt.else_stmt, bindings, renamed, unbound);
+      return;
+    case IMP_AST_NT_WHILE:
+      rename_vars(opt, node->data.while_stmt.cond_bexpr, bindings, renamed, unbound);
+      rename_vars(opt, node->data.while_stmt.body_stmt, bindings, renamed, unbound);
+      return;
+    case IMP_AST_NT_AOP:
+      rename_vars(opt, node->data.arith_op.l_aexpr, bindings, renamed, unbound);
+      rename_vars(opt, node->data.arith_op.r_aexpr, bindings, renamed, unbound);
+      return;
+    case IMP_AST_NT_BOP:
+      rename_vars(opt, node->data.bool_op.l_bexpr, bindings, renamed, unbound);
+      rename_vars(opt, node->data.bool_op.r_bexpr, bindings, renamed, unbound);
+      return;
+    case IMP_AST_NT_NOT:
+      rename_vars(opt, node->data.bool_not.bexpr, bindings, renamed, unbound);
+      return;
+    case IMP_AST_NT_ROP:
+      rename_vars(opt, node->data.rel_op.l_aexpr, bindings, renamed, unbound);
+      rename_vars(opt, node->data.rel_op.r_aexpr, bindings, renamed, unbound);
+      return;
+    case IMP_AST_NT_LET: {
+      Binding binding = { node->data.let_stmt.var->data.variable.symbol, bindings };
+      rename_vars(opt, node->data.let_stmt.aexpr, bindings, renamed, unbound);
+      rename_vars(opt, node->data.let_stmt.var, &binding, renamed, unbound);
+      rename_vars(opt, node->data.let_stmt.body_stmt, &binding, renamed, unbound);
+      return;
+    }
+    case IMP_AST_NT_PROCCALL:
+      for (IMP_ASTNodeList *args = node->data.proc_call.val_args; args; args = args->next) rename_vars(opt, args->node, bindings, renamed, unbound);
+      for (IMP_ASTNodeList *args = node->data.proc_call.var_args; args; args = args->next) rename_vars(opt, args->node, bindings, renamed, unbound);
+      return;
+    default: assert(0);
+  }
+}
+
+/* Replaces a call by the body of the procedure, with its variables renamed to let-bound temporaries:
+ * value arguments bound to the values passed, all others to 0 like in a fresh frame. Value arguments
+ * the body does not change refer to the variable passed instead, as the body cannot change it either.
+ * The variables passed as var args are assigned the final values of the procedure's (copy-out). */
+static IMP_ASTNode *inline_call(Optimizer *opt, IMP_ASTNode *call, const IMP_ASTNode *procdecl) {
+  RenameEntry *renamed = NULL;
+  SymbolSetEntry *written = NULL, *unbound = NULL, *bound = NULL;
+  IMP_ASTNode **stmts = NULL;
+  IMP_ASTNode *body = imp_ast_clone(procdecl->data.proc_decl.body_stmt, opt->arena);
+  loop_writes(&written, body);
+  IMP_ASTNodeList *caller_args = call->data.proc_call.val_args;
+  for (IMP_ASTNodeList *args = procdecl->data.proc_decl.val_args; args; args = args->next) {
+    const IMP_Symbol *name = args->node->data.variable.symbol;
+    if (caller_args->node->type == IMP_AST_NT_VAR && !in_set(written, name)) {
+      hmput(renamed, name, caller_args->node->data.variable.symbol);
+    } else {
+      hmput(bound, name, 1);
+    }
+    caller_args = caller_args->next;
+  }
+  rename_vars(opt, body, NULL, &renamed, &unbound);
+  arrput(stmts, body);
+  caller_args = call->data.proc_call.var_args;
+  for (IMP_ASTNodeList *args = procdecl->data.proc_decl.var_args; args; args = args->next) {
+    hmput(unbound, args->node->data.variable.symbol, 1);
+    const IMP_Symbol *temp = rename_var(opt, &renamed, args->node->data.variable.symbol);
+    arrput(stmts, imp_ast_assign(opt->arena, caller_args->node, imp_ast_var(opt->arena, temp)));
+    caller_args = caller_args->next;
+  }
+  IMP_ASTNode *node = make_stmts(opt, stmts, (int)arrlen(stmts));
+  SymbolSetEntry *val_args = NULL;
+  for (IMP_ASTNodeList *args = procdecl->data.proc_decl.val_args; args; args = args->next) hmput(val_args, args->node->data.variable.symbol, 1);
+  for (ptrdiff_t i = hmlen(renamed) - 1; i >= 0; --i) {
+    if (!in_set(unbound, renamed[i].key) || in_set(val_args, renamed[i].key)) continue;
+    node = imp_ast_let(opt->arena, imp_ast_var(opt->arena, renamed[i].value), imp_ast_int(opt->arena, 0), node);
+  }
+  /* Unused value arguments are dropped, as expressions have no effects. */
+  caller_args = call->data.proc_call.val_args;
+  for (IMP_ASTNodeList *args = procdecl->data.proc_decl.val_args; args; args = args->next) {
+    ptrdiff_t index = hmgeti(renamed, args->node->data.variable.symbol);
+    if (index >= 0 && in_set(bound, args->node->data.variable.symbol)) {
+      node = imp_ast_let(opt->arena, imp_ast_var(opt->arena, renamed[index].value), caller_args->node, node);
+    }
+    caller_args = caller_args->next;
+  }
+  opt->stats.inlined++;
+  hmfree(val_args);
+  hmfree(written);
+  hmfree(unbound);
+  hmfree(bound);
+  hmfree(renamed);
+  arrfree(stmts);
+  return node;
+}
+
+static int list_len(const IMP_ASTNodeList *list) {
+  int len = 0;
+  for (; list; list = list->next) ++len;
+  return len;
+}
+
+/* Inlines the calls of a statement to inlinable procedures. Procedures of the context are checked
+ * on their first call, as the program cannot declare them again (without raising an error). */
+static IMP_ASTNode *inline_calls(Optimizer *opt, Inliner *inliner, IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_SEQ:
+      node->data.seq.fst_stmt = inline_calls(opt, inliner, node->data.seq.fst_stmt);
+      node->data.seq.snd_stmt = inline_calls(opt, inliner, node->data.seq.snd_stmt);
+      return node;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) node->data.block.stmts[i] = inline_calls(opt, inliner, node->data.block.stmts[i]);
+      return node;
+    case IMP_AST_NT_IF:
+      node->data.if_stmt.then_stmt = inline_calls(opt, inliner, node->data.if_stmt.then_stmt);
+      node->data.if_stmt.else_stmt = inline_calls(opt, inliner, node->data.if_stmt.else_stmt);
+      return node;
+    case IMP_AST_NT_WHILE:
+      node->data.while_stmt.body_stmt = inline_calls(opt, inliner, node->data.while_stmt.body_stmt);
+      return node;
+    case IMP_AST_NT_LET:
+      node->data.let_stmt.body_stmt = inline_calls(opt, inliner, node->data.let_stmt.body_stmt);
+      return node;
+    case IMP_AST_NT_PROCDECL:
+      node->data.proc_decl.body_stmt = inline_calls(opt, inliner, node->data.proc_decl.body_stmt);
+      return node;
+    case IMP_AST_NT_PROCCALL: {
+      const IMP_Symbol *name = node->data.proc_call.symbol;
+      if (opt->context && !in_set(inliner->checked, name) && hmgeti(inliner->decls, name) < 0 && !in_set(inliner->ambiguous, name)) {
+        hmput(inliner->checked, name, 1);
+        const IMP_ASTNode *procdecl = imp_interpreter_context_proc_get(opt->context, name);
+        if (procdecl && is_inlinable(opt, inliner, procdecl)) hmput(inliner->inlinable, name, procdecl);
+      }
+      ptrdiff_t index = hmgeti(inliner->inlinable, name);
+      if (index < 0) return node;
+      const IMP_ASTNode *procdecl = inliner->inlinable[index].value;
+      /* Calls with the wrong number of arguments are left to raise their error. */
+      if (list_len(node->data.proc_call.val_args) != list_len(procdecl->data.proc_decl.val_args)) return node;
+      if (list_len(node->data.proc_call.var_args) != list_len(procdecl->data.proc_decl.var_args)) return node;
+      return inline_call(opt, node, procdecl);
+    }
+    default:
+      return node;
+  }
+}
+
+/* Inlines calls in the top-level statements following the declaration of a procedure declared
+ * there, as only those run after it is declared, and calls to procedures of the context. */
+static IMP_ASTNode *inline_top(Optimizer *opt, Inliner *inliner, IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_SEQ:
+      node->data.seq.fst_stmt = inline_top(opt, inliner, node->data.seq.fst_stmt);
+      node->data.seq.snd_stmt = inline_top(opt, inliner, node->data.seq.snd_stmt);
+      return node;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) node->data.block.stmts[i] = inline_top(opt, inliner, node->data.block.stmts[i]);
+      return node;
+    case IMP_AST_NT_PROCDECL: {
+      const IMP_Symbol *name = node->data.proc_decl.symbol;
+      node->data.proc_decl.body_stmt = inline_calls(opt, inliner, node->data.proc_decl.body_stmt);
+      if (hmgeti(inliner->decls, name) >= 0 && is_inlinable(opt, inliner, node)) hmput(inliner->inlinable, name, node);
+      return node;
+    }
+    default:
+      return inline_calls(opt, inliner, node);
+  }
+}
+
+/* Collects the procedures declared once by a program and not by the context, and the procedures
+ * declared more than once, or by both. */
+static void collect_decls(Optimizer *opt, const IMP_ASTNode *node, ProcEntry **decls, SymbolSetEntry **ambiguous) {
+  const IMP_ASTNode **procdecls = NULL;
+  collect_procdecls(node, &procdecls);
+  for (ptrdiff_t i = 0; i < arrlen(procdecls); ++i) {
+    const IMP_Symbol *name = procdecls[i]->data.proc_decl.symbol;
+    if (in_set(*ambiguous, name)) continue;
+    if (hmgeti(*decls, name) >= 0 || (opt->context && imp_interpreter_context_proc_get(opt->context, name))) {
+      (void)hmdel(*decls, name);
+      hmput(*ambiguous, name, 1);
+    } else {
+      hmput(*decls, name, procdecls[i]);
+    }
+  }
+  arrfree(procdecls);
+}
+
+/* Inlines calls to small procedures that do not call themselves, directly or through others. */
+static IMP_ASTNode *inline_procs(Optimizer *opt, IMP_ASTNode *node) {
+  Inliner inliner = { NULL, NULL, NULL, NULL };
+  collect_decls(opt, node, &inliner.decls, &inliner.ambiguous);
+  node = inline_top(opt, &inliner, node);
+  hmfree(inliner.decls);
+  hmfree(inliner.ambiguous);
+  hmfree(inliner.inlinable);
+  hmfree(inliner.checked);
+  return node;
+}
+
+/* === Specialization === */
+
+/* Once constants are folded, calls passing constant value arguments to the other procedures (under
+ * the same conditions as inlining) call a clone of the procedure without those arguments, which
+ * are bound by lets around its body and folded into it. Clones are shared by the calls passing the
+ * same constants, and declared next to the procedure (ahead of the program for procedures of the
+ * context), until the clones reach a budget of AST nodes. */
+
+typedef struct Specialization {
+  int *known;            /**< Whether each value argument is a constant (stb_ds array). */
+  int *values;           /**< Constant value arguments (stb_ds array). */
+  IMP_ASTNode *procdecl; /**< Declaration of the specialized procedure. */
+} Specialization;
+
+typedef struct Specialized {
+  ProcEntry *visible;    /**< Procedures of the program visible to the body of the procedure. */
+  Specialization *specs; /**< Specializations created so far (stb_ds array). */
+  int top_level;         /**< Whether the program declares the procedure at its top level (else the context does). */
+} Specialized;
+
+typedef struct SpecializedEntry {
+  const IMP_ASTNode *key;
+  Specialized value;
+} SpecializedEntry;
+
+typedef struct Specializer {
+  ProcEntry *decls;          /**< Procedures declared once by the program, and not by the context. */
+  SymbolSetEntry *ambiguous; /**< Procedures declared more than once, or by both. */
+  ProcEntry *visible;        /**< Procedures declared by the top level so far. */
+  SpecializedEntry *procs;   /**< Specialized procedures by declaration. */
+  int budget;                /**< AST nodes left for specialized procedures. */
+} Specializer;
+
+static ProcEntry *procs_copy(ProcEntry *procs) {
+  ProcEntry *copy = NULL;
+  for (ptrdiff_t i = 0; i < hmlen(procs); ++i) hmput(copy, procs[i].key, procs[i].value);
+  return copy;
+}
+
+/* Procedures of the program are visible once declared by the top level, those of the context always. */
+static const IMP_ASTNode *specializer_lookup(Optimizer *opt, Specializer *spec, ProcEntry *visible, const IMP_Symbol *name) {
+  if (in_set(spec->ambiguous, name)) return NULL;
+  ptrdiff_t index = visible ? hmgeti(visible, name) : -1;
+  if (index >= 0) return visible[index].value;
+  if (hmgeti(spec->decls, name) >= 0) return NULL;
+  return opt->context ? imp_interpreter_context_proc_get(opt->context, name) : NULL;
+}
+
+static const IMP_Symbol *specialized_name(Optimizer *opt, const IMP_Symbol *name) {
+  /* Not an identifier of the language; names taken by specializations of earlier programs are skipped. */
+  size_t len = name->len + 16;
+  char *buf = malloc(len);
+  assert(buf && "Memory allocation failed");
+  const IMP_Symbol *symbol;
+  do {
+    snprintf(buf, len, "%s$%d", name->name, opt->specializations++);
+    symbol = imp_symbol_intern(buf);
+  } while (opt->context && imp_interpreter_context_proc_get(opt->context, symbol));
+  free(buf);
+  return symbol;
+}
+
+static IMP_ASTNodeList *clone_args(Optimizer *opt, const IMP_ASTNodeList *args, const int *known) {
+  if (!args) return NULL;
+  IMP_ASTNodeList *next = clone_args(opt, args->next, known ? known + 1 : NULL);
+  if (known && *known) return next;
+  return imp_ast_list(opt->arena, imp_ast_var(opt->arena, args->node->data.variable.symbol), next);
+}
+
+/* Clones a procedure without the constant value arguments, which are bound by lets around its body instead. */
+static IMP_ASTNode *clone_specialized(Optimizer *opt, const IMP_ASTNode *procdecl, const int *known, const int *values) {
+  IMP_ASTNode *body = imp_ast_clone(procdecl->data.proc_decl.body_stmt, opt->arena);
+  int i = 0;
+  for (IMP_ASTNodeList *args = procdecl->data.proc_decl.val_args; args; args = args->next, ++i) {
+    if (!known[i]) continue;
+    IMP_ASTNode *var = imp_ast_var(opt->arena, args->node->data.variable.symbol);
+    body = imp_ast_let(opt->arena, var, imp_ast_int(opt->arena, values[i]), body);
+  }
+  return imp_ast_procdecl(opt->arena, specialized_name(opt, procdecl->data.proc_decl.symbol),
+                          clone_args(opt, procdecl->data.proc_decl.val_args, known),
+                          clone_args(opt, procdecl->data.proc_decl.var_args, NULL), body);
+}
+
+static void specialize_calls(Optimizer *opt, Specializer *spec, IMP_ASTNode *node, ProcEntry *visible);
+
+/* Returns the specialization of a procedure to constant value arguments, creating it within the budget. */
+static const IMP_ASTNode *specialize(Optimizer *opt, Specializer *spec, const IMP_ASTNode *procdecl, const int *known, const int *values) {
+  ptrdiff_t index = hmgeti(spec->procs, procdecl);
+  if (index < 0) {
+    Specialized specialized = { NULL, NULL, 0 };
+    hmput(spec->procs, procdecl, specialized);
+    index = hmgeti(spec->procs, procdecl);
+  }
+  Specialization *specs = spec->procs[index].value.specs;
+  for (ptrdiff_t i = 0; i < arrlen(specs); ++i) {
+    int same = 1;
+    for (ptrdiff_t j = 0; same && j < arrlen(specs[i].known); ++j) {
+      same = specs[i].known[j] == known[j] && (!known[j] || specs[i].values[j] == values[j]);
+    }
+    if (same) return specs[i].procdecl;
+  }
+  int size = count_nodes(procdecl->data.proc_decl.body_stmt);
+  for (ptrdiff_t j = 0; j < arrlen(known); ++j) size += known[j] ? 3 : 0;
+  if (size > spec->budget || !is_clonable(procdecl)) return NULL;
+  spec->budget -= size;
+  Specialization specialization = { NULL, NULL, clone_specialized(opt, procdecl, known, values) };
+  for (ptrdiff_t j = 0; j < arrlen(known); ++j) {
+    arrput(specialization.known, known[j]);
+    arrput(specialization.values, values[j]);
+  }
+  arrput(spec->procs[index].value.specs, specialization);
+  /* Cached ahead of folding the constants into the body, which may lead to calls with the same constants. */
+  IMP_ASTNode *clone = optimize(opt, specialization.procdecl);
+  specialize_calls(opt, spec, clone->data.proc_decl.body_stmt, spec->procs[index].value.visible);
+  return clone;
+}
+
+/* Redirects a call passing constant value arguments to a specialization of the procedure called. */
+static void specialize_call(Optimizer *opt, Specializer *spec, IMP_ASTNode *call, ProcEntry *visible) {
+  const IMP_ASTNode *procdecl = specializer_lookup(opt, spec, visible, call->data.proc_call.symbol);
+  if (!procdecl) return;
+  /* Calls with the wrong number of arguments are left to raise their error. */
+  if (list_len(call->data.proc_call.val_args) != list_len(procdecl->data.proc_decl.val_args)) return;
+  if (list_len(call->data.proc_call.var_args) != list_len(procdecl->data.proc_decl.var_args)) return;
+  int *known = NULL, *values = NULL, constants = 0;
+  for (IMP_ASTNodeList *args = call->data.proc_call.val_args; args; args = args->next) {
+    int constant = args->node->type == IMP_AST_NT_INT;
+    arrput(known, constant);
+    arrput(values, constant ? args->node->data.integer.val : 0);
+    constants += constant;
+  }
+  const IMP_ASTNode *specialized = constants ? specialize(opt, spec, procdecl, known, values) : NULL;
+  arrfree(known);
+  arrfree(values);
+  if (!specialized) return;
+  call->data.proc_call.symbol = specialized->data.proc_decl.symbol;
+  for (IMP_ASTNodeList **args = &call->data.proc_call.val_args; *args;) {
+    if ((*args)->node->type == IMP_AST_NT_INT) *args = (*args)->next;
+    else args = &(*args)->next;
+  }
+  opt->stats.specialized++;
+}
+
+static void specialize_calls(Optimizer *opt, Specializer *spec, IMP_ASTNode *node, ProcEntry *visible) {
+  switch (node->type) {
+    case IMP_AST_NT_SEQ:
+      specialize_calls(opt, spec, node->data.seq.fst_stmt, visible);
+      specialize_calls(opt, spec, node->data.seq.snd_stmt, visible);
+      return;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) specialize_calls(opt, spec, node->data.block.stmts[i], visible);
+      return;
+    case IMP_AST_NT_IF:
+      specialize_calls(opt, spec, node->data.if_stmt.then_stmt, visible);
+      specialize_calls(opt, spec, node->data.if_stmt.else_stmt, visible);
+      return;
+    case IMP_AST_NT_WHILE:
+      specialize_calls(opt, spec, node->data.while_stmt.body_stmt, visible);
+      return;
+    case IMP_AST_NT_LET:
+      specialize_calls(opt, spec, node->data.let_stmt.body_stmt, visible);
+      return;
+    case IMP_AST_NT_PROCDECL:
+      specialize_calls(opt, spec, node->data.proc_decl.body_stmt, visible);
+      return;
+    case IMP_AST_NT_PROCCALL:
+      specialize_call(opt, spec, node, visible);
+      return;
+    default:
+      return;
+  }
+}
+
+/* Specializes calls in the top-level statements following the declaration of a procedure declared
+ * there, and in its body (which only runs once it is declared), and calls to procedures of the context. */
+static void specialize_top(Optimizer *opt, Specializer *spec, IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_SEQ:
+      specialize_top(opt, spec, node->data.seq.fst_stmt);
+      specialize_top(opt, spec, node->data.seq.snd_stmt);
+      return;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) specialize_top(opt, spec, node->data.block.stmts[i]);
+      return;
+    case IMP_AST_NT_PROCDECL: {
+      const IMP_Symbol *name = node->data.proc_decl.symbol;
+      if (hmgeti(spec->decls, name) < 0) {
+        specialize_calls(opt, spec, node->data.proc_decl.body_stmt, spec->visible);
+        return;
+      }
+      hmput(spec->visible, name, node);
+      Specialized specialized = { procs_copy(spec->visible), NULL, 1 };
+      hmput(spec->procs, node, specialized);
+      specialize_calls(opt, spec, node->data.proc_decl.body_stmt, specialized.visible);
+      return;
+    }
+    default:
+      specialize_calls(opt, spec, node, spec->visible);
+      return;
+  }
+}
+
+/* Declares the specializations of procedures declared by the top level right after them. */
+static IMP_ASTNode *declare_specialized(Optimizer *opt, Specializer *spec, IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_SEQ:
+      node->data.seq.fst_stmt = declare_specialized(opt, spec, node->data.seq.fst_stmt);
+      node->data.seq.snd_stmt = declare_specialized(opt, spec, node->data.seq.snd_stmt);
+      return node;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) node->data.block.stmts[i] = declare_specialized(opt, spec, node->data.block.stmts[i]);
+      return node;
+    case IMP_AST_NT_PROCDECL: {
+      ptrdiff_t index = hmgeti(spec->procs, node);
+      if (index < 0 || arrlen(spec->procs[index].value.specs) == 0) return node;
+      Specialization *specs = spec->procs[index].value.specs;
+      IMP_ASTNode **stmts = NULL;
+      arrput(stmts, node);
+      for (ptrdiff_t i = 0; i < arrlen(specs); ++i) arrput(stmts, specs[i].procdecl);
+      node = imp_ast_block(opt->arena, stmts, (int)arrlen(stmts));
+      arrfree(stmts);
+      return node;
+    }
+    default:
+      return node;
+  }
+}
+
+/* Specializes procedures to the constant value arguments of their calls, within a budget of AST nodes. */
+static IMP_ASTNode *specialize_procs(Optimizer *opt, IMP_ASTNode *node) {
+  Specializer spec = { NULL, NULL, NULL, NULL, opt->options->specialize_budget };
+  collect_decls(opt, node, &spec.decls, &spec.ambiguous);
+  specialize_top(opt, &spec, node);
+  node = declare_specialized(opt, &spec, node);
+  /* Specializations of procedures of the context are declared ahead of the program. */
+  IMP_ASTNode **stmts = NULL;
+  for (ptrdiff_t i = 0; i < hmlen(spec.procs); ++i) {
+    Specialized *specialized = &spec.procs[i].value;
+    if (!specialized->top_level) for (ptrdiff_t j = 0; j < arrlen(specialized->specs); ++j) arrput(stmts, specialized->specs[j].procdecl);
+    for (ptrdiff_t j = 0; j < arrlen(specialized->specs); ++j) {
+      arrfree(specialized->specs[j].known);
+      arrfree(specialized->specs[j].values);
+    }
+    arrfree(specialized->specs);
+    hmfree(specialized->visible);
+  }
+  if (stmts) {
+    arrput(stmts, node);
+    node = imp_ast_block(opt->arena, stmts, (int)arrlen(stmts));
+  }
+  arrfree(stmts);
+  hmfree(spec.decls);
+  hmfree(spec.ambiguous);
+  hmfree(spec.visible);
+  hmfree(spec.procs);
+  return node;
+}
+
+/* === Dead code === */
+
+/* Removes statements following a loop that never terminates, skips, and assignments to variables
+ * that are overwritten (or go out of scope) before being read. Top-level variables are considered
+ * read at the end of the program, as they are printed (or read by later programs run within the
+ * same context). */
+
+/* Adds the variables read by an expression. */
+static void live_uses(SymbolSetEntry **live, const IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_VAR: hmput(*live, node->data.variable.symbol, 1); return;
+    case IMP_AST_NT_AOP: live_uses(live, node->data.arith_op.l_aexpr); live_uses(live, node->data.arith_op.r_aexpr); return;
+    case IMP_AST_NT_BOP: live_uses(live, node->data.bool_op.l_bexpr); live_uses(live, node->data.bool_op.r_bexpr); return;
+    case IMP_AST_NT_NOT: live_uses(live, node->data.bool_not.bexpr); return;
+    case IMP_AST_NT_ROP: live_uses(live, node->data.rel_op.l_aexpr); live_uses(live, node->data.rel_op.r_aexpr); return;
+    default: return;
+  }
+}
+
+/* Adds the variables read anywhere in a statement, skipping nested procedure bodies. */
+static void live_reads(SymbolSetEntry **live, const IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_ASSIGN: live_uses(live, node->data.assign.aexpr); return;
+    case IMP_AST_NT_SEQ: live_reads(live, node->data.seq.fst_stmt); live_reads(live, node->data.seq.snd_stmt); return;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) live_reads(live, node->data.block.stmts[i]);
+      return;
+    case IMP_AST_NT_IF:
+      live_uses(live, node->data.if_stmt.cond_bexpr);
+      live_reads(live, node->data.if_stmt.then_stmt);
+      live_reads(live, node->data.if_stmt.else_stmt);
+      return;
+    case IMP_AST_NT_WHILE:
+      live_uses(live, node->data.while_stmt.cond_bexpr);
+      live_reads(live, node->data.while_stmt.body_stmt);
+      return;
+    case IMP_AST_NT_LET:
+      live_uses(live, node->data.let_stmt.aexpr);
+      live_reads(live, node->data.let_stmt.body_stmt);
+      return;
+    case IMP_AST_NT_PROCCALL:
+      for (IMP_ASTNodeList *args = node->data.proc_call.val_args; args; args = args->next) live_uses(live, args->node);
+      return;
+    default: return;
+  }
+}
+
+/* Adds the variables assigned anywhere in a statement, skipping nested procedure bodies. */
+static void live_writes(SymbolSetEntry **live, const IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_ASSIGN: hmput(*live, node->data.assign.var->data.variable.symbol, 1); return;
+    case IMP_AST_NT_SEQ: live_writes(live, node->data.seq.fst_stmt); live_writes(live, node->data.seq.snd_stmt); return;
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) live_writes(live, node->data.block.stmts[i]);
+      return;
+    case IMP_AST_NT_IF: live_writes(live, node->data.if_stmt.then_stmt); live_writes(live, node->data.if_stmt.else_stmt); return;
+    case IMP_AST_NT_WHILE: live_writes(live, node->data.while_stmt.body_stmt); return;
+    case IMP_AST_NT_LET: live_writes(live, node->data.let_stmt.body_stmt); return;
+    case IMP_AST_NT_PROCCALL:
+      for (IMP_ASTNodeList *args = node->data.proc_call.var_args; args; args = args->next) hmput(*live, args->node->data.variable.symbol, 1);
+      return;
+    default: return;
+  }
+}
+
+/* Whether a statement never completes, i.e. contains a loop whose condition is constantly true on every path. */
+static int diverges(const IMP_ASTNode *node) {
+  int cond;
+  switch (node->type) {
+    case IMP_AST_NT_SEQ: return diverges(node->data.seq.fst_stmt) || diverges(node->data.seq.snd_stmt);
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) {
+        if (diverges(node->data.block.stmts[i])) return 1;
+      }
+      return 0;
+    case IMP_AST_NT_IF: return diverges(node->data.if_stmt.then_stmt) && diverges(node->data.if_stmt.else_stmt);
+    case IMP_AST_NT_WHILE: return is_bool(node->data.while_stmt.cond_bexpr, &cond) && cond;
+    case IMP_AST_NT_LET: return diverges(node->data.let_stmt.body_stmt);
+    default: return 0;
+  }
+}
+
+/* Removes the dead code of a statement, given the variables live after it, which are updated
+ * to those live before it. Dropped statements are replaced by skip, skips are dropped from
+ * sequences. */
+static IMP_ASTNode *eliminate(Optimizer *opt, IMP_ASTNode *node, SymbolSetEntry **live) {
+  switch (node->type) {
+    case IMP_AST_NT_SKIP:
+      return node;
+    case IMP_AST_NT_ASSIGN: {
+      const IMP_Symbol *name = node->data.assign.var->data.variable.symbol;
+      if (!in_set(*live, name)) return imp_ast_skip(opt->arena);
+      (void)hmdel(*live, name);
+      live_uses(live, node->data.assign.aexpr);
+      return node;
+    }
+    case IMP_AST_NT_SEQ: {
+      /* Statements after one that never completes are unreachable. */
+      if (diverges(node->data.seq.fst_stmt)) return eliminate(opt, node->data.seq.fst_stmt, live);
+      IMP_ASTNode *snd_stmt = node->data.seq.snd_stmt = eliminate(opt, node->data.seq.snd_stmt, live);
+      IMP_ASTNode *fst_stmt = node->data.seq.fst_stmt = eliminate(opt, node->data.seq.fst_stmt, live);
+      if (fst_stmt->type == IMP_AST_NT_SKIP) return snd_stmt;
+      if (snd_stmt->type == IMP_AST_NT_SKIP) return fst_stmt;
+      return node;
+    }
+    case IMP_AST_NT_BLOCK: {
+      int len = 0;
+      while (len < node->data.block.len && !diverges(node->data.block.stmts[len])) ++len;
+      if (len < node->data.block.len) ++len;
+      for (int i = len - 1; i >= 0; --i) node->data.block.stmts[i] = eliminate(opt, node->data.block.stmts[i], live);
+      int kept = 0;
+      for (int i = 0; i < len; ++i) {
+        if (node->data.block.stmts[i]->type != IMP_AST_NT_SKIP) node->data.block.stmts[kept++] = node->data.block.stmts[i];
+      }
+      node->data.block.len = kept;
+      if (kept == 0) return imp_ast_skip(opt->arena);
+      if (kept == 1) return node->data.block.stmts[0];
+      return node;
+    }
+    case IMP_AST_NT_IF: {
+      SymbolSetEntry *else_live = set_copy(*live);
+      IMP_ASTNode *then_stmt = node->data.if_stmt.then_stmt = eliminate(opt, node->data.if_stmt.then_stmt, live);
+      IMP_ASTNode *else_stmt = node->data.if_stmt.else_stmt = eliminate(opt, node->data.if_stmt.else_stmt, &else_live);
+      set_union(live, else_live);
+      hmfree(else_live);
+      if (then_stmt->type == IMP_AST_NT_SKIP && else_stmt->type == IMP_AST_NT_SKIP) return then_stmt;
+      live_uses(live, node->data.if_stmt.cond_bexpr);
+      return node;
+    }
+    case IMP_AST_NT_WHILE: {
+      /* Variables read anywhere in the loop are live throughout it. */
+      live_uses(live, node->data.while_stmt.cond_bexpr);
+      live_reads(live, node->data.while_stmt.body_stmt);
+      SymbolSetEntry *body_live = set_copy(*live);
+      node->data.while_stmt.body_stmt = eliminate(opt, node->data.while_stmt.body_stmt, &body_live);
+      hmfree(body_live);
+      return node;
+    }
+    case IMP_AST_NT_LET: {
+      /* The let-bound variable is dead after the body, the outer one is not touched by it. */
+      const IMP_Symbol *name = node->data.let_stmt.var->data.variable.symbol;
+      int outer_live = in_set(*live, name);
+      (void)hmdel(*live, name);
+      IMP_ASTNode *body_stmt = node->data.let_stmt.body_stmt = eliminate(opt, node->data.let_stmt.body_stmt, live);
+      (void)hmdel(*live, name);
+      if (outer_live) hmput(*live, name, 1);
+      if (body_stmt->type == IMP_AST_NT_SKIP) return body_stmt;
+      live_uses(live, node->data.let_stmt.aexpr);
+      return node;
+    }
+    case IMP_AST_NT_PROCDECL: {
+      if (in_set(opt->dead_procs, node->data.proc_decl.symbol)) return imp_ast_skip(opt->arena);
+      /* Only the variable arguments are copied out of a procedure body. */
+      SymbolSetEntry *body_live = NULL;
+      for (IMP_ASTNodeList *args = node->data.proc_decl.var_args; args; args = args->next) {
+        hmput(body_live, args->node->data.variable.symbol, 1);
+      }
+      node->data.proc_decl.body_stmt = eliminate(opt, node->data.proc_decl.body_stmt, &body_live);
+      hmfree(body_live);
+      return node;
+    }
+    case IMP_AST_NT_PROCCALL:
+      for (IMP_ASTNodeList *args = node->data.proc_call.var_args; args; args = args->next) {
+        (void)hmdel(*live, args->node->data.variable.symbol);
+      }
+      for (IMP_ASTNodeList *args = node->data.proc_call.val_args; args; args = args->next) {
+        live_uses(live, args->node);
+      }
+      return node;
+    default: assert(0);
+  }
+}
+
+/* === Recursion to iteration === */
+
+/* Runs first, so that the procedures rewritten no longer call themselves when inlining and
+ * specializing. Only running out of stack behaves differently. */
+
+/* Number of calls to the named procedure in a statement. */
+static int count_calls(const IMP_ASTNode *node, const IMP_Symbol *name) {
+  int count = 0;
+  switch (node->type) {
+    case IMP_AST_NT_SEQ: return count_calls(node->data.seq.fst_stmt, name) + count_calls(node->data.seq.snd_stmt, name);
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) count += count_calls(node->data.block.stmts[i], name);
+      return count;
+    case IMP_AST_NT_IF: return count_calls(node->data.if_stmt.then_stmt, name) + count_calls(node->data.if_stmt.else_stmt, name);
+    case IMP_AST_NT_WHILE: return count_calls(node->data.while_stmt.body_stmt, name);
+    case IMP_AST_NT_LET: return count_calls(node->data.let_stmt.body_stmt, name);
+    case IMP_AST_NT_PROCCALL: return node->data.proc_call.symbol == name;
+    default: return 0;
+  }
+}
+
+/* The term an assignment accumulates into a variable (r := r op e, or r := e op r for the commutative
+ * operators, where e does not read r), or NULL. */
+static IMP_ASTNode *accumulated_term(const IMP_ASTNode *stmt, const IMP_Symbol *r, IMP_ASTArithmeticOperator *aopr) {
+  if (stmt->type != IMP_AST_NT_ASSIGN || stmt->data.assign.var->data.variable.symbol != r) return NULL;
+  const IMP_ASTNode *aexpr = stmt->data.assign.aexpr;
+  if (aexpr->type != IMP_AST_NT_AOP) return NULL;
+  IMP_ASTNode *l_aexpr = aexpr->data.arith_op.l_aexpr, *r_aexpr = aexpr->data.arith_op.r_aexpr;
+  IMP_ASTNode *term = NULL;
+  if (l_aexpr->type == IMP_AST_NT_VAR && l_aexpr->data.variable.symbol == r) term = r_aexpr;
+  else if (aexpr->data.arith_op.aopr != IMP_AST_AOP_SUB && r_aexpr->type == IMP_AST_NT_VAR && r_aexpr->data.variable.symbol == r) term = l_aexpr;
+  if (!term || aexpr_reads(term, r)) return NULL;
+  *aopr = aexpr->data.arith_op.aopr;
+  return term;
+}
+
+/* Rewrites the body of a procedure calling itself once, as the last call of one branch of its body
+ * and followed by at most an update of its only var arg r by an associative operator:
+ *
+ *   if b then base else pre; f(e1, ..., en; r); r := r op e end
+ *
+ * into a loop accumulating the terms e of the calls (with the branches the other way round, the
+ * condition is negated):
+ *
+ *   let acc = 0 (1 for *) in
+ *     while not b do
+ *       pre; acc := acc op e;
+ *       let t1 = e1 in ... let tn = en in x := 0 (for each x pre assigns); v1 := t1; ...; vn := tn
+ *     end;
+ *     base; r := r op acc
+ *
+ * Variables are reset as every call starts on a fresh frame (in which r stays 0 until the call it
+ * makes returns), and subtracted terms are accumulated as a sum. Returns whether it was rewritten. */
+static int accumulate_proc(Optimizer *opt, IMP_ASTNode *procdecl) {
+  const IMP_Symbol *name = procdecl->data.proc_decl.symbol;
+  IMP_ASTNode *body = procdecl->data.proc_decl.body_stmt;
+  IMP_ASTNodeList *params = procdecl->data.proc_decl.val_args, *var_args = procdecl->data.proc_decl.var_args;
+  if (body->type != IMP_AST_NT_IF || !var_args || var_args->next || count_calls(body, name) != 1 || !is_clonable(procdecl)) return 0;
+  const IMP_Symbol *r = var_args->node->data.variable.symbol;
+  int recurses_else = count_calls(body->data.if_stmt.else_stmt, name);
+  IMP_ASTNode *base = recurses_else ? body->data.if_stmt.then_stmt : body->data.if_stmt.else_stmt;
+  IMP_ASTNode **stmts = NULL;
+  collect_stmts(recurses_else ? body->data.if_stmt.else_stmt : body->data.if_stmt.then_stmt, &stmts);
+  int call = 0, len = (int)arrlen(stmts);
+  while (count_calls(stmts[call], name) == 0) ++call;
+  const IMP_ASTNode *proc_call = stmts[call];
+  IMP_ASTArithmeticOperator aopr = IMP_AST_AOP_ADD;
+  IMP_ASTNode *term = NULL;
+  int linear = proc_call->type == IMP_AST_NT_PROCCALL && list_len(proc_call->data.proc_call.val_args) == list_len(params)
+               && list_len(proc_call->data.proc_call.var_args) == 1 && proc_call->data.proc_call.var_args->node->data.variable.symbol == r
+               && (call == len - 1 || (call == len - 2 && (term = accumulated_term(stmts[len - 1], r, &aopr))));
+  if (!linear) {
+    arrfree(stmts);
+    return 0;
+  }
+  IMP_ASTArena *arena = opt->arena;
+  IMP_ASTArithmeticOperator accumulator = aopr == IMP_AST_AOP_MUL ? IMP_AST_AOP_MUL : IMP_AST_AOP_ADD;
+  const IMP_Symbol *acc = term ? new_temp(opt) : NULL;
+  IMP_ASTNode **iteration = NULL;
+  for (int i = 0; i < call; ++i) arrput(iteration, stmts[i]);
+  if (term) arrput(iteration, imp_ast_assign(arena, imp_ast_var(arena, acc), imp_ast_aop(arena, accumulator, imp_ast_var(arena, acc), term)));
+  /* The frame of the next call: variables assigned by pre are reset, the value arguments passed. */
+  SymbolSetEntry *written = NULL, *bound = NULL;
+  for (int i = 0; i < call; ++i) live_writes(&written, stmts[i]);
+  for (IMP_ASTNodeList *param = params; param; param = param->next) hmput(bound, param->node->data.variable.symbol, 1);
+  IMP_ASTNode **next = NULL;
+  for (ptrdiff_t i = 0; i < hmlen(written); ++i) {
+    if (!in_set(bound, written[i].key)) arrput(next, imp_ast_assign(arena, imp_ast_var(arena, written[i].key), imp_ast_int(arena, 0)));
+  }
+  const IMP_Symbol **temps = NULL;
+  IMP_ASTNode **args = NULL;
+  IMP_ASTNodeList *arg = proc_call->data.proc_call.val_args;
+  for (IMP_ASTNodeList *param = params; param; param = param->next, arg = arg->next) {
+    const IMP_Symbol *temp = new_temp(opt);
+    arrput(temps, temp);
+    arrput(args, arg->node);
+    arrput(next, imp_ast_assign(arena, imp_ast_var(arena, param->node->data.variable.symbol), imp_ast_var(arena, temp)));
+  }
+  IMP_ASTNode *step = arrlen(next) ? make_stmts(opt, next, (int)arrlen(next)) : imp_ast_skip(arena);
+  for (ptrdiff_t i = arrlen(temps) - 1; i >= 0; --i) step = imp_ast_let(arena, imp_ast_var(arena, temps[i]), args[i], step);
+  arrput(iteration, step);
+  IMP_ASTNode *cond = body->data.if_stmt.cond_bexpr;
+  if (recurses_else) cond = imp_ast_not(arena, cond);
+  IMP_ASTNode *loop[] = {
+    imp_ast_while(arena, cond, make_stmts(opt, iteration, (int)arrlen(iteration))),
+    base,
+    term ? imp_ast_assign(arena, imp_ast_var(arena, r), imp_ast_aop(arena, aopr, imp_ast_var(arena, r), imp_ast_var(arena, acc))) : NULL,
+  };
+  body = imp_ast_block(arena, loop, term ? 3 : 2);
+  if (term) body = imp_ast_let(arena, imp_ast_var(arena, acc), imp_ast_int(arena, aopr == IMP_AST_AOP_MUL ? 1 : 0), body);
+  procdecl->data.proc_decl.body_stmt = body;
+  arrfree(stmts);
+  arrfree(iteration);
+  hmfree(written);
+  hmfree(bound);
+  arrfree(next);
+  arrfree(temps);
+  arrfree(args);
+  return 1;
+}
+
+/* Rewrites the linearly recursive procedures declared by a program into accumulator loops. */
+static IMP_ASTNode *accumulate_procs(Optimizer *opt, IMP_ASTNode *node) {
+  const IMP_ASTNode **procdecls = NULL;
+  collect_procdecls(node, &procdecls);
+  for (ptrdiff_t i = 0; i < arrlen(procdecls); ++i) {
+    IMP_ASTNode *procdecl = (IMP_ASTNode *)procdecls[i];
+    if (!accumulate_proc(opt, procdecl)) continue;
+    opt->stats.accumulated++;
+    arrput(opt->stats.accumulated_procs, procdecl->data.proc_decl.symbol);
+  }
+  arrfree(procdecls);
+  return node;
+}
+
+IMP_ASTNode *imp_optimizer_optimize(IMP_InterpreterContext *context, IMP_ASTNode *node, IMP_ASTArena *arena,
+                                   const IMP_OptimizerOptions *options, IMP_OptimizerStats *stats) {
+  assert(arena && "Optimizer requires an arena");
+  if (!options) options = &imp_optimizer_default_options;
+  Optimizer opt = { context, arena, options, NULL, NULL, 0, 0, { 0 } };
+  if (options->accumulate) node = accumulate_procs(&opt, node);
+  if (options->inline_size > 0) node = inline_procs(&opt, node);
+  int nodes = count_nodes(node);
+  node = optimize(&opt, node);
+  opt.stats.nodes_removed = nodes - count_nodes(node);
+  if (options->specialize_budget > 0) node = specialize_procs(&opt, node);
+  if (options->licm) node = licm(&opt, node);
+  if (options->cse) node = cse(&opt, node);
+  nodes = count_nodes(node);
+  if (options->whole_program) find_dead_procs(&opt, node);
+  /* Every top-level variable is live at the end, as it may be printed or read by later programs. */
+  SymbolSetEntry *live = NULL;
+  live_writes(&live, node);
+  node = eliminate(&opt, node, &live);
+  hmfree(live);
+  opt.stats.nodes_removed += nodes - count_nodes(node);
+  if (stats) *stats = opt.stats;
+  else arrfree(opt.stats.accumulated_procs);
+  hmfree(opt.consts);
+  hmfree(opt.dead_procs);
+  return node;
+}
+
+void imp_optimizer_stats_free(IMP_OptimizerStats *stats) {
+  arrfree(stats->accumulated_procs);
+}
@@ -2,29 +2,49 @@
 %{
 #include <stdio.h>
 #include "ast.h"
+#include "3rdparty/stb_ds/stb_ds.h"
 
 extern int yylex();
 IMP_ASTNode *ast_root;
+IMP_ASTArena *ast_arena;
 
 void yyerror(const char *s) {
   extern char *yytext;
   extern int yylineno;
   fprintf(stderr, "Parse error at token \"%s\", line %d: %s\n", yytext, yylineno, s); 
 }
+
+/* Appends a statement to a statement vector, splicing in the statements of nested blocks. */
+static IMP_ASTNode **block_append(IMP_ASTNode **stmts, IMP_ASTNode *stmt) {
+  if (stmt->type != IMP_AST_NT_BLOCK) {
+    arrput(stmts, stmt);
+    return stmts;
+  }
+  for (int i = 0; i < stmt->data.block.len; ++i) arrput(stmts, stmt->data.block.stmts[i]);
+  return stmts;
+}
+
+/* Turns a statement vector into a block node (or its only statement) and frees the vector. */
+static IMP_ASTNode *block_create(IMP_ASTNode **stmts) {
+  IMP_ASTNode *node = arrlen(stmts) == 1 ? stmts[0] : imp_ast_block(ast_arena, stmts, (int)arrlen(stmts));
+  arrfree(stmts);
+  return node;
+}
 %}
 
 
 %union {
-  int                    num;
-  char                   *id;
-  struct IMP_ASTNode     *node;
-  struct IMP_ASTNodeList *node_list;
+  int                     num;
+  const struct IMP_Symbol *sym;
+  struct IMP_ASTNode      *node;
+  struct IMP_ASTNodeList  *node_list;
+  struct IMP_ASTNode      **stmts;
 }
 
 %start prog
 
 %token <num> T_NUM
-%token <id>  T_ID
+%token <sym> T_ID
 %token       T_EQ T_NE T_LT T_LE T_GT T_GE
 %token       T_TRUE T_FALSE
 %left        T_OR
@@ -37,112 +57,131 @@ void yyerror(const char *s) {
 %token       T_ASSIGN
 %token       T_LPAREN T_RPAREN T_COM T_SEM
 
-%type <node> prog tlstm stm var aexp bexp procd procc
+%type <node> prog tlstm stms stm basic var aexp bexp procd procc
 %type <node_list> argl, varl
+%type <stmts> tlseq stmseq
+
+%destructor { arrfree($$); } <stmts>
 
 %%
 
-prog  : tlstm
-        { ast_root = $1; }
+prog  : tlseq
+        { ast_root = block_create($1); }
       ;
 
-tlstm : T_LPAREN tlstm T_SEM tlstm T_RPAREN
-        { $$ = imp_ast_seq($2, $4); }
-      | tlstm T_SEM tlstm
-        { $$ = imp_ast_seq($1, $3); }
-      | tlstm T_SEM
+tlseq : tlstm
+        { $$ = block_append(NULL, $1); }
+      | tlseq T_SEM tlstm
+        { $$ = block_append($1, $3); }
+      | tlseq T_SEM
         { $$ = $1; }
-      | stm
+      ;
+
+tlstm : T_LPAREN tlseq T_RPAREN
+        { $$ = block_create($2); }
+      | basic
         { $$ = $1; }
       | procd
         { $$ = $1; }
+      ;
 
-stm   : T_LPAREN stm T_SEM stm T_RPAREN
-        { $$ = imp_ast_seq($2, $4); }
-      | stm T_SEM stm
-        { $$ = imp_ast_seq($1, $3); }
-      | stm T_SEM
+stms  : stmseq
+        { $$ = block_create($1); }
+      ;
+
+stmseq: stm
+        { $$ = block_append(NULL, $1); }
+      | stmseq T_SEM stm
+        { $$ = block_append($1, $3); }
+      | stmseq T_SEM
         { $$ = $1; }
-      | T_SKIP
-        { $$ = imp_ast_skip(); }
+      ;
+
+stm   : T_LPAREN stmseq T_RPAREN
+        { $$ = block_create($2); }
+      | basic
+        { $$ = $1; }
+      ;
+
+basic : T_SKIP
+        { $$ = imp_ast_skip(ast_arena); }
       | var T_ASSIGN aexp
-        { $$ = imp_ast_assign($1, $3); }
-      | T_IF bexp T_THEN stm T_ELSE stm T_END
-        { $$ = imp_ast_if($2, $4, $6); }
-      | T_IF bexp T_THEN stm T_END
-        { $$ = imp_ast_if($2, $4, imp_ast_skip()); }
-      | T_WHILE bexp T_DO stm T_END
-        { $$ = imp_ast_while($2, $4); }
-      | T_VAR var T_ASSIGN aexp T_IN stm T_END
-        { $$ = imp_ast_let($2, $4, $6); }
+        { $$ = imp_ast_assign(ast_arena, $1, $3); }
+      | T_IF bexp T_THEN stms T_ELSE stms T_END
+        { $$ = imp_ast_if(ast_arena, $2, $4, $6); }
+      | T_IF bexp T_THEN stms T_END
+        { $$ = imp_ast_if(ast_arena, $2, $4, imp_ast_skip(ast_arena)); }
+      | T_WHILE bexp T_DO stms T_END
+        { $$ = imp_ast_while(ast_arena, $2, $4); }
+      | T_VAR var T_ASSIGN aexp T_IN stms T_END
+        { $$ = imp_ast_let(ast_arena, $2, $4, $6); }
       | procc
         { $$ = $1; }
-        
       ;
 
 var   : T_ID
-        { $$ = imp_ast_var($1); }
+        { $$ = imp_ast_var(ast_arena, $1); }
       ;
 
 aexp  : aexp T_PLUS aexp
-        { $$ = imp_ast_aop(IMP_AST_AOP_ADD, $1, $3); }
+        { $$ = imp_ast_aop(ast_arena, IMP_AST_AOP_ADD, $1, $3); }
       | aexp T_MINUS aexp
-        { $$ = imp_ast_aop(IMP_AST_AOP_SUB, $1, $3); }
+        { $$ = imp_ast_aop(ast_arena, IMP_AST_AOP_SUB, $1, $3); }
       | aexp T_STAR aexp
-        { $$ = imp_ast_aop(IMP_AST_AOP_MUL, $1, $3); }
+        { $$ = imp_ast_aop(ast_arena, IMP_AST_AOP_MUL, $1, $3); }
       | T_MINUS aexp %prec T_UMINUS
-        { $$ = imp_ast_aop(IMP_AST_AOP_SUB, imp_ast_int(0), $2); }
+        { $$ = imp_ast_aop(ast_arena, IMP_AST_AOP_SUB, imp_ast_int(ast_arena, 0), $2); }
       | T_LPAREN aexp T_RPAREN
         { $$ = $2; }
       | var
         { $$ = $1; }
       | T_NUM
-        { $$ = imp_ast_int($1); }
+        { $$ = imp_ast_int(ast_arena, $1); }
       ;
 
 bexp  : bexp T_OR bexp
-        { $$ = imp_ast_bop(IMP_AST_BOP_OR, $1, $3); }
+        { $$ = imp_ast_bop(ast_arena, IMP_AST_BOP_OR, $1, $3); }
       | bexp T_AND bexp
-        { $$ = imp_ast_bop(IMP_AST_BOP_AND, $1, $3); }
+        { $$ = imp_ast_bop(ast_arena, IMP_AST_BOP_AND, $1, $3); }
       | T_NOT bexp
-        { $$ = imp_ast_not($2); }
+        { $$ = imp_ast_not(ast_arena, $2); }
       | aexp T_EQ aexp
-        { $$ = imp_ast_rop(IMP_AST_ROP_EQ, $1, $3); }
+        { $$ = imp_ast_rop(ast_arena, IMP_AST_ROP_EQ, $1, $3); }
       | aexp T_NE aexp
-        { $$ = imp_ast_rop(IMP_AST_ROP_NE, $1, $3); }
+        { $$ = imp_ast_rop(ast_arena, IMP_AST_ROP_NE, $1, $3); }
       | aexp T_LE aexp
-        { $$ = imp_ast_rop(IMP_AST_ROP_LE, $1, $3); }
+        { $$ = imp_ast_rop(ast_arena, IMP_AST_ROP_LE, $1, $3); }
       | aexp T_LT aexp
-        { $$ = imp_ast_rop(IMP_AST_ROP_LT, $1, $3); }
+        { $$ = imp_ast_rop(ast_arena, IMP_AST_ROP_LT, $1, $3); }
       | aexp T_GE aexp
-        { $$ = imp_ast_rop(IMP_AST_ROP_GE, $1, $3); }
+        { $$ = imp_ast_rop(ast_arena, IMP_AST_ROP_GE, $1, $3); }
       | aexp T_GT aexp
-        { $$ = imp_ast_rop(IMP_AST_ROP_GT, $1, $3); }
+        { $$ = imp_ast_rop(ast_arena, IMP_AST_ROP_GT, $1, $3); }
       | T_LPAREN bexp T_RPAREN
         { $$ = $2; }
       | T_TRUE
-        { $$ = imp_ast_rop(IMP_AST_ROP_EQ, imp_ast_int(1), imp_ast_int(1)); }
+        { $$ = imp_ast_rop(ast_arena, IMP_AST_ROP_EQ, imp_ast_int(ast_arena, 1), imp_ast_int(ast_arena, 1)); }
       | T_FALSE
-        { $$ = imp_ast_rop(IMP_AST_ROP_EQ, imp_ast_int(0), imp_ast_int(1)); }
+        { $$ = imp_ast_rop(ast_arena, IMP_AST_ROP_EQ, imp_ast_int(ast_arena, 0), imp_ast_int(ast_arena, 1)); }
       ;
 
 argl  : aexp
-        { $$ = imp_ast_list($1, NULL); }
+        { $$ = imp_ast_list(ast_arena, $1, NULL); }
       | argl T_COM aexp
-        { $$ = imp_ast_list($3, $1); }
+        { $$ = imp_ast_list(ast_arena, $3, $1); }
       ;
 
 varl  : var
-        { $$ = imp_ast_list($1, NULL); }
+        { $$ = imp_ast_list(ast_arena, $1, NULL); }
       | argl T_COM var
-        { $$ = imp_ast_list($3, $1); }
+        { $$ = imp_ast_list(ast_arena, $3, $1); }
       ;
 
-procd : T_PROC T_ID T_LPAREN varl T_SEM varl T_RPAREN T_BEGIN stm T_END
-        { $$ = imp_ast_procdecl($2, $4, $6, $9); }
+procd : T_PROC T_ID T_LPAREN varl T_SEM varl T_RPAREN T_BEGIN stms T_END
+        { $$ = imp_ast_procdecl(ast_arena, $2, $4, $6, $9); }
       ;
 
 procc : T_ID T_LPAREN argl T_SEM varl T_RPAREN
-        { $$ = imp_ast_proccall($1, $3, $5); }
+        { $$ = imp_ast_proccall(ast_arena, $1, $3, $5); }
       ;
 %%
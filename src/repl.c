@@ -10,6 +10,7 @@
 
 #include "interpreter_context.h"
 #include "driver.h"
+#include "symbol.h"
 
 
 static void print_help(void) {
@@ -41,7 +42,7 @@ static void repl_exec_command(IMP_InterpreterContext *context, char *command) {
   } else if (strcmp(cmd, "%run") == 0) {
     char *file = strtok(NULL, " \t");
     if (file) {
-      if (!imp_driver_interpret_file(context, file)) imp_driver_print_var_table(context);
+      if (!imp_driver_interpret_file(context, file, NULL)) imp_driver_print_var_table(context);
       else fprintf(stderr, "Error interpreting file: %s\n", file);
     } else {
       fprintf(stderr, "Usage: %%run <path/to/file.imp>\n");
@@ -51,7 +52,7 @@ static void repl_exec_command(IMP_InterpreterContext *context, char *command) {
     char *val = strtok(NULL, " \t");
     if (var && val) {
       if (is_valid_identifier(var)) {
-        imp_interpreter_context_var_set(context, var, atoi(val));
+        imp_interpreter_context_var_set(context, imp_symbol_intern(var), atoi(val));
       } else {
         fprintf(stderr, "Invalid variable name: %s\n", var);
       }
@@ -60,7 +61,7 @@ static void repl_exec_command(IMP_InterpreterContext *context, char *command) {
     char *var = strtok(NULL, " \t");
     if (var) {
       if (is_valid_identifier(var)) {
-        printf("%s = %d\n", var, imp_interpreter_context_var_get(context, var));
+        printf("%s = %d\n", var, imp_interpreter_context_var_get(context, imp_symbol_intern(var)));
       } else {
         fprintf(stderr, "Invalid variable name: %s\n", var);
       }
@@ -73,7 +74,7 @@ static void repl_exec_command(IMP_InterpreterContext *context, char *command) {
 }
 
 static void repl_exec_statement(IMP_InterpreterContext *context, const char *statement) {
-  if (imp_driver_interpret_str(context, statement)) {
+  if (imp_driver_interpret_str(context, statement, NULL)) {
     fprintf(stderr, "Error interpreting statement: %s\n", statement);
     return;
   }
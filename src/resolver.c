@@ -0,0 +1,147 @@
+#include "resolver.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "3rdparty/stb_ds/stb_ds.h"
+
+
+typedef struct SlotEntry {
+  const IMP_Symbol *key;
+  int value;
+} SlotEntry;
+
+/** A frame being resolved; top-level frames are backed by the context. */
+typedef struct ResolverFrame {
+  IMP_InterpreterContext *context;
+  SlotEntry *slots;
+  int size;
+} ResolverFrame;
+
+/** Chain of let bindings shadowing the frame slots. */
+typedef struct ResolverBinding {
+  const IMP_Symbol *name;
+  int slot;
+  const struct ResolverBinding *next;
+} ResolverBinding;
+
+static int frame_named_slot(ResolverFrame *frame, const IMP_Symbol *name) {
+  if (frame->context) return imp_interpreter_context_var_slot(frame->context, name);
+  ptrdiff_t index = hmgeti(frame->slots, name);
+  if (index >= 0) return frame->slots[index].value;
+  hmput(frame->slots, name, frame->size);
+  return frame->size++;
+}
+
+static int frame_anonymous_slot(ResolverFrame *frame) {
+  if (frame->context) {
+    int slot = imp_interpreter_context_frame_size(frame->context);
+    imp_interpreter_context_frame_reserve(frame->context, slot + 1);
+    return slot;
+  }
+  return frame->size++;
+}
+
+static int resolve_var(ResolverFrame *frame, const ResolverBinding *bindings, IMP_ASTNode *node) {
+  if (node->type != IMP_AST_NT_VAR) {
+    fprintf(stderr, "Error: expected variable\n");
+    return -1;
+  }
+  const IMP_Symbol *name = node->data.variable.symbol;
+  for (; bindings; bindings = bindings->next) {
+    if (bindings->name == name) {
+      node->data.variable.slot = bindings->slot;
+      return 0;
+    }
+  }
+  node->data.variable.slot = frame_named_slot(frame, name);
+  return 0;
+}
+
+static int resolve_var_list(ResolverFrame *frame, const ResolverBinding *bindings, IMP_ASTNodeList *list) {
+  for (; list; list = list->next) {
+    if (resolve_var(frame, bindings, list->node)) return -1;
+  }
+  return 0;
+}
+
+static int resolve(ResolverFrame *frame, const ResolverBinding *bindings, IMP_ASTNode *node);
+
+static int resolve_list(ResolverFrame *frame, const ResolverBinding *bindings, IMP_ASTNodeList *list) {
+  for (; list; list = list->next) {
+    if (resolve(frame, bindings, list->node)) return -1;
+  }
+  return 0;
+}
+
+static int resolve_procdecl(IMP_ASTNode *node) {
+  ResolverFrame proc_frame = { NULL, NULL, 0 };
+  int ret = 0;
+  if (resolve_var_list(&proc_frame, NULL, node->data.proc_decl.val_args) ||
+      resolve_var_list(&proc_frame, NULL, node->data.proc_decl.var_args) ||
+      resolve(&proc_frame, NULL, node->data.proc_decl.body_stmt)) {
+    ret = -1;
+  }
+  node->data.proc_decl.frame_size = proc_frame.size;
+  hmfree(proc_frame.slots);
+  return ret;
+}
+
+static int resolve(ResolverFrame *frame, const ResolverBinding *bindings, IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_SKIP:
+    case IMP_AST_NT_INT:
+      return 0;
+    case IMP_AST_NT_VAR:
+      return resolve_var(frame, bindings, node);
+    case IMP_AST_NT_ASSIGN:
+      if (resolve_var(frame, bindings, node->data.assign.var)) return -1;
+      return resolve(frame, bindings, node->data.assign.aexpr);
+    case IMP_AST_NT_SEQ:
+      if (resolve(frame, bindings, node->data.seq.fst_stmt)) return -1;
+      return resolve(frame, bindings, node->data.seq.snd_stmt);
+    case IMP_AST_NT_BLOCK:
+      for (int i = 0; i < node->data.block.len; ++i) {
+        if (resolve(frame, bindings, node->data.block.stmts[i])) return -1;
+      }
+      return 0;
+    case IMP_AST_NT_IF:
+      if (resolve(frame, bindings, node->data.if_stmt.cond_bexpr)) return -1;
+      if (resolve(frame, bindings, node->data.if_stmt.then_stmt)) return -1;
+      return resolve(frame, bindings, node->data.if_stmt.else_stmt);
+    case IMP_AST_NT_WHILE:
+      if (resolve(frame, bindings, node->data.while_stmt.cond_bexpr)) return -1;
+      return resolve(frame, bindings, node->data.while_stmt.body_stmt);
+    case IMP_AST_NT_AOP:
+      if (resolve(frame, bindings, node->data.arith_op.l_aexpr)) return -1;
+      return resolve(frame, bindings, node->data.arith_op.r_aexpr);
+    case IMP_AST_NT_BOP:
+      if (resolve(frame, bindings, node->data.bool_op.l_bexpr)) return -1;
+      return resolve(frame, bindings, node->data.bool_op.r_bexpr);
+    case IMP_AST_NT_NOT:
+      return resolve(frame, bindings, node->data.bool_not.bexpr);
+    case IMP_AST_NT_ROP:
+      if (resolve(frame, bindings, node->data.rel_op.l_aexpr)) return -1;
+      return resolve(frame, bindings, node->data.rel_op.r_aexpr);
+    case IMP_AST_NT_LET: {
+      IMP_ASTNode *var = node->data.let_stmt.var;
+      if (var->type != IMP_AST_NT_VAR) return resolve_var(frame, bindings, var);
+      if (resolve(frame, bindings, node->data.let_stmt.aexpr)) return -1;
+      ResolverBinding binding = { var->data.variable.symbol, frame_anonymous_slot(frame), bindings };
+      var->data.variable.slot = binding.slot;
+      return resolve(frame, &binding, node->data.let_stmt.body_stmt);
+    }
+    case IMP_AST_NT_PROCDECL:
+      return resolve_procdecl(node);
+    case IMP_AST_NT_PROCCALL:
+      if (resolve_list(frame, bindings, node->data.proc_call.val_args)) return -1;
+      return resolve_var_list(frame, bindings, node->data.proc_call.var_args);
+    default: assert(0);
+  }
+}
+
+int imp_resolver_resolve(IMP_InterpreterContext *context, IMP_ASTNode *node) {
+  ResolverFrame frame = { context, NULL, 0 };
+  return resolve(&frame, NULL, node);
+}
@@ -0,0 +1,76 @@
+#include "symbol.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+
+#define SYMBOL_TABLE_INITIAL_CAPACITY 256
+
+typedef struct SymbolEntry {
+  IMP_Symbol symbol;
+  char name[];
+} SymbolEntry;
+
+/* Open addressing with linear probing, at most half full. */
+static struct {
+  SymbolEntry **entries;
+  size_t capacity;
+  size_t count;
+} symbol_table;
+
+static uint64_t symbol_hash(const char *name, size_t len) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; ++i) {
+    hash ^= (unsigned char)name[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static void symbol_table_grow(void) {
+  size_t capacity = symbol_table.capacity ? symbol_table.capacity * 2 : SYMBOL_TABLE_INITIAL_CAPACITY;
+  SymbolEntry **entries = calloc(capacity, sizeof(SymbolEntry *));
+  assert(entries && "Memory allocation failed");
+  for (size_t i = 0; i < symbol_table.capacity; ++i) {
+    SymbolEntry *entry = symbol_table.entries[i];
+    if (!entry) continue;
+    size_t index = entry->symbol.hash & (capacity - 1);
+    while (entries[index]) index = (index + 1) & (capacity - 1);
+    entries[index] = entry;
+  }
+  free(symbol_table.entries);
+  symbol_table.entries = entries;
+  symbol_table.capacity = capacity;
+}
+
+const IMP_Symbol *imp_symbol_intern_len(const char *name, size_t len) {
+  if ((symbol_table.count + 1) * 2 > symbol_table.capacity) symbol_table_grow();
+  uint64_t hash = symbol_hash(name, len);
+  size_t index = hash & (symbol_table.capacity - 1);
+  SymbolEntry *entry;
+  while ((entry = symbol_table.entries[index])) {
+    if (entry->symbol.hash == hash && entry->symbol.len == len && memcmp(entry->name, name, len) == 0) {
+      return &entry->symbol;
+    }
+    index = (index + 1) & (symbol_table.capacity - 1);
+  }
+  entry = malloc(sizeof(SymbolEntry) + len + 1);
+  assert(entry && "Memory allocation failed");
+  memcpy(entry->name, name, len);
+  entry->name[len] = '\0';
+  entry->symbol.name = entry->name;
+  entry->symbol.len = len;
+  entry->symbol.hash = hash;
+  symbol_table.entries[index] = entry;
+  symbol_table.count++;
+  return &entry->symbol;
+}
+
+const IMP_Symbol *imp_symbol_intern(const char *name) {
+  return imp_symbol_intern_len(name, strlen(name));
+}
+
+size_t imp_symbol_count(void) {
+  return symbol_table.count;
+}
@@ -0,0 +1,403 @@
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "3rdparty/stb_ds/stb_ds.h"
+
+
+/** Trace operations; r[] is the register file of the trace. */
+typedef enum {
+  TOP_MOV,      /**< r[dst] = r[a] */
+  TOP_ADD,      /**< r[dst] = r[a] + r[b] */
+  TOP_SUB,      /**< r[dst] = r[a] - r[b] */
+  TOP_MUL,      /**< r[dst] = r[a] * r[b] */
+  TOP_EQ,       /**< r[dst] = r[a] == r[b] */
+  TOP_NE,       /**< r[dst] = r[a] != r[b] */
+  TOP_LT,       /**< r[dst] = r[a] < r[b] */
+  TOP_LE,       /**< r[dst] = r[a] <= r[b] */
+  TOP_GT,       /**< r[dst] = r[a] > r[b] */
+  TOP_GE,       /**< r[dst] = r[a] >= r[b] */
+  TOP_AND,      /**< r[dst] = r[a] && r[b] */
+  TOP_OR,       /**< r[dst] = r[a] || r[b] */
+  TOP_NOT,      /**< r[dst] = !r[a] */
+  TOP_GUARD_EQ, /**< Take exit dst unless r[a] == r[b] */
+  TOP_GUARD_NE, /**< Take exit dst unless r[a] != r[b] */
+  TOP_GUARD_LT, /**< Take exit dst unless r[a] < r[b] */
+  TOP_GUARD_LE, /**< Take exit dst unless r[a] <= r[b] */
+  TOP_GUARD_GT, /**< Take exit dst unless r[a] > r[b] */
+  TOP_GUARD_GE, /**< Take exit dst unless r[a] >= r[b] */
+  TOP_GUARD_NZ, /**< Take exit dst unless r[a] != 0 */
+  TOP_GUARD_Z   /**< Take exit dst unless r[a] == 0 */
+} TraceOpcode;
+
+typedef struct TraceOp {
+  TraceOpcode op;
+  int dst, a, b;
+} TraceOp;
+
+/** A register holds a frame slot, a constant or a temporary. */
+typedef struct TraceReg {
+  enum { REG_VAR, REG_CONST, REG_TEMP } kind;
+  int val;     /**< Slot of REG_VAR, value of REG_CONST. */
+  int written; /**< Whether a REG_VAR is written back on exit. */
+} TraceReg;
+
+typedef struct RegEntry {
+  int key;
+  int value;
+} RegEntry;
+
+struct IMP_Trace {
+  TraceOp *ops;
+  TraceReg *regs;
+  RegEntry *var_regs;
+  RegEntry *const_regs;
+  IMP_TraceExit *exits;
+  int *file;
+};
+
+static int is_guard(TraceOpcode op) {
+  return op >= TOP_GUARD_EQ;
+}
+
+static void emit(IMP_Trace *trace, TraceOpcode op, int dst, int a, int b) {
+  TraceOp top = { op, dst, a, b };
+  arrput(trace->ops, top);
+}
+
+static int add_reg(IMP_Trace *trace, int kind, int val) {
+  TraceReg reg = { kind, val, 0 };
+  arrput(trace->regs, reg);
+  return (int)arrlen(trace->regs) - 1;
+}
+
+static int var_reg(IMP_Trace *trace, int slot) {
+  ptrdiff_t index = hmgeti(trace->var_regs, slot);
+  if (index >= 0) return trace->var_regs[index].value;
+  int reg = add_reg(trace, REG_VAR, slot);
+  hmput(trace->var_regs, slot, reg);
+  return reg;
+}
+
+static int const_reg(IMP_Trace *trace, int val) {
+  ptrdiff_t index = hmgeti(trace->const_regs, val);
+  if (index >= 0) return trace->const_regs[index].value;
+  int reg = add_reg(trace, REG_CONST, val);
+  hmput(trace->const_regs, val, reg);
+  return reg;
+}
+
+static int is_const(const IMP_Trace *trace, int reg) {
+  return trace->regs[reg].kind == REG_CONST;
+}
+
+static int fold(TraceOpcode op, int l, int r) {
+  switch (op) {
+    case TOP_ADD: return l + r;
+    case TOP_SUB: return l - r;
+    case TOP_MUL: return l * r;
+    case TOP_EQ: return l == r;
+    case TOP_NE: return l != r;
+    case TOP_LT: return l < r;
+    case TOP_LE: return l <= r;
+    case TOP_GT: return l > r;
+    case TOP_GE: return l >= r;
+    case TOP_AND: return l && r;
+    case TOP_OR: return l || r;
+    case TOP_NOT: return !l;
+    default: assert(0); return 0;
+  }
+}
+
+/* Emits op on registers l and r into dst (a new temporary if dst < 0), folding constants. */
+static int binary(IMP_Trace *trace, TraceOpcode op, int dst, int l, int r) {
+  if (is_const(trace, l) && is_const(trace, r)) {
+    return const_reg(trace, fold(op, trace->regs[l].val, trace->regs[r].val));
+  }
+  if (dst < 0) dst = add_reg(trace, REG_TEMP, 0);
+  emit(trace, op, dst, l, r);
+  return dst;
+}
+
+static TraceOpcode rel_opcode(IMP_ASTRelationalOperator ropr) {
+  switch (ropr) {
+    case IMP_AST_ROP_EQ: return TOP_EQ;
+    case IMP_AST_ROP_NE: return TOP_NE;
+    case IMP_AST_ROP_LT: return TOP_LT;
+    case IMP_AST_ROP_LE: return TOP_LE;
+    case IMP_AST_ROP_GT: return TOP_GT;
+    case IMP_AST_ROP_GE: return TOP_GE;
+    default: assert(0); return TOP_EQ;
+  }
+}
+
+/* Returns the register holding the value of an arithmetic expression; the outermost
+ * operation writes into dst if given, so that assignments need no move. */
+static int trace_aexpr(IMP_Trace *trace, const IMP_ASTNode *node, int dst) {
+  switch (node->type) {
+    case IMP_AST_NT_INT: return const_reg(trace, node->data.integer.val);
+    case IMP_AST_NT_VAR: return var_reg(trace, node->data.variable.slot);
+    case IMP_AST_NT_AOP: {
+      int l = trace_aexpr(trace, node->data.arith_op.l_aexpr, -1);
+      int r = trace_aexpr(trace, node->data.arith_op.r_aexpr, -1);
+      switch (node->data.arith_op.aopr) {
+        case IMP_AST_AOP_ADD: return binary(trace, TOP_ADD, dst, l, r);
+        case IMP_AST_AOP_SUB: return binary(trace, TOP_SUB, dst, l, r);
+        case IMP_AST_AOP_MUL: return binary(trace, TOP_MUL, dst, l, r);
+        default: assert(0); return -1;
+      }
+    }
+    default: assert(0);
+  }
+  return -1;
+}
+
+/* Returns the register holding the value (0 or 1) of a boolean expression. */
+static int trace_bexpr(IMP_Trace *trace, const IMP_ASTNode *node) {
+  switch (node->type) {
+    case IMP_AST_NT_BOP: {
+      int l = trace_bexpr(trace, node->data.bool_op.l_bexpr);
+      int r = trace_bexpr(trace, node->data.bool_op.r_bexpr);
+      return binary(trace, node->data.bool_op.bopr == IMP_AST_BOP_AND ? TOP_AND : TOP_OR, -1, l, r);
+    }
+    case IMP_AST_NT_NOT: {
+      int v = trace_bexpr(trace, node->data.bool_not.bexpr);
+      if (is_const(trace, v)) return const_reg(trace, !trace->regs[v].val);
+      int dst = add_reg(trace, REG_TEMP, 0);
+      emit(trace, TOP_NOT, dst, v, v);
+      return dst;
+    }
+    case IMP_AST_NT_ROP: {
+      int l = trace_aexpr(trace, node->data.rel_op.l_aexpr, -1);
+      int r = trace_aexpr(trace, node->data.rel_op.r_aexpr, -1);
+      return binary(trace, rel_opcode(node->data.rel_op.ropr), -1, l, r);
+    }
+    default: assert(0);
+  }
+  return -1;
+}
+
+/* Emits a guard on a boolean expression; guards on constants are dropped. */
+static void guard(IMP_Trace *trace, const IMP_ASTNode *bexpr, int expected, int exit) {
+  if (bexpr->type == IMP_AST_NT_ROP) {
+    int l = trace_aexpr(trace, bexpr->data.rel_op.l_aexpr, -1);
+    int r = trace_aexpr(trace, bexpr->data.rel_op.r_aexpr, -1);
+    TraceOpcode op = rel_opcode(bexpr->data.rel_op.ropr);
+    if (is_const(trace, l) && is_const(trace, r)) {
+      assert(!fold(op, trace->regs[l].val, trace->regs[r].val) == !expected);
+      return;
+    }
+    if (!expected) {
+      /* Negate the relation: EQ <-> NE, LT <-> GE, LE <-> GT. */
+      static const TraceOpcode negated[] = {
+        [TOP_EQ] = TOP_NE, [TOP_NE] = TOP_EQ, [TOP_LT] = TOP_GE,
+        [TOP_LE] = TOP_GT, [TOP_GT] = TOP_LE, [TOP_GE] = TOP_LT,
+      };
+      op = negated[op];
+    }
+    emit(trace, TOP_GUARD_EQ + (op - TOP_EQ), exit, l, r);
+    return;
+  }
+  int v = trace_bexpr(trace, bexpr);
+  if (is_const(trace, v)) {
+    assert(!trace->regs[v].val == !expected);
+    return;
+  }
+  emit(trace, expected ? TOP_GUARD_NZ : TOP_GUARD_Z, exit, v, v);
+}
+
+IMP_Trace *imp_trace_create(const IMP_ASTNode *loop) {
+  IMP_Trace *trace = calloc(1, sizeof(IMP_Trace));
+  assert(trace && "Memory allocation failed");
+  guard(trace, loop->data.while_stmt.cond_bexpr, 1, -1);
+  return trace;
+}
+
+void imp_trace_assign(IMP_Trace *trace, int slot, const IMP_ASTNode *aexpr) {
+  int var = var_reg(trace, slot);
+  int val = trace_aexpr(trace, aexpr, var);
+  if (val != var) emit(trace, TOP_MOV, var, val, val);
+  trace->regs[var].written = 1;
+}
+
+void imp_trace_guard(IMP_Trace *trace, const IMP_ASTNode *bexpr, int expected,
+                     const IMP_ASTNode *stmt, const IMP_TraceCont *cont, int cont_len) {
+  IMP_TraceExit exit = { stmt, NULL, cont_len };
+  if (cont_len > 0) memcpy(arraddnptr(exit.cont, cont_len), cont, sizeof(IMP_TraceCont) * cont_len);
+  arrput(trace->exits, exit);
+  guard(trace, bexpr, expected, (int)arrlen(trace->exits) - 1);
+}
+
+/* Whether any operation in ops[from, to) writes register reg. */
+static int written_between(const IMP_Trace *trace, ptrdiff_t from, ptrdiff_t to, int reg) {
+  for (ptrdiff_t i = from; i < to; ++i) {
+    if (!is_guard(trace->ops[i].op) && trace->ops[i].dst == reg) return 1;
+  }
+  return 0;
+}
+
+void imp_trace_finish(IMP_Trace *trace) {
+  /* A guard repeating an earlier one on unchanged registers always holds. */
+  ptrdiff_t len = 0;
+  for (ptrdiff_t i = 0; i < arrlen(trace->ops); ++i) {
+    TraceOp op = trace->ops[i];
+    int redundant = 0;
+    if (is_guard(op.op)) {
+      for (ptrdiff_t j = len - 1; j >= 0 && !redundant; --j) {
+        const TraceOp *prev = &trace->ops[j];
+        if (prev->op == op.op && prev->a == op.a && prev->b == op.b) {
+          redundant = !written_between(trace, j, len, op.a) && !written_between(trace, j, len, op.b);
+          break;
+        }
+      }
+    }
+    if (!redundant) trace->ops[len++] = op;
+  }
+  arrsetlen(trace->ops, len);
+  arrsetlen(trace->file, arrlen(trace->regs));
+  for (ptrdiff_t i = 0; i < arrlen(trace->regs); ++i) {
+    trace->file[i] = trace->regs[i].kind == REG_CONST ? trace->regs[i].val : 0;
+  }
+}
+
+int imp_trace_run(IMP_Trace *trace, int *frame, long *iterations) {
+  const TraceReg *regs = trace->regs;
+  const ptrdiff_t regs_len = arrlen(trace->regs);
+  const TraceOp *ops = trace->ops;
+  const ptrdiff_t len = arrlen(trace->ops);
+  int *r = trace->file;
+  for (ptrdiff_t i = 0; i < regs_len; ++i) {
+    if (regs[i].kind == REG_VAR) r[i] = frame[regs[i].val];
+  }
+  long n = 0;
+  int exit;
+  for (;; ++n) {
+    for (const TraceOp *op = ops; op < ops + len; ++op) {
+      switch (op->op) {
+        case TOP_MOV: r[op->dst] = r[op->a]; break;
+        case TOP_ADD: r[op->dst] = r[op->a] + r[op->b]; break;
+        case TOP_SUB: r[op->dst] = r[op->a] - r[op->b]; break;
+        case TOP_MUL: r[op->dst] = r[op->a] * r[op->b]; break;
+        case TOP_EQ: r[op->dst] = r[op->a] == r[op->b]; break;
+        case TOP_NE: r[op->dst] = r[op->a] != r[op->b]; break;
+        case TOP_LT: r[op->dst] = r[op->a] < r[op->b]; break;
+        case TOP_LE: r[op->dst] = r[op->a] <= r[op->b]; break;
+        case TOP_GT: r[op->dst] = r[op->a] > r[op->b]; break;
+        case TOP_GE: r[op->dst] = r[op->a] >= r[op->b]; break;
+        case TOP_AND: r[op->dst] = r[op->a] && r[op->b]; break;
+        case TOP_OR: r[op->dst] = r[op->a] || r[op->b]; break;
+        case TOP_NOT: r[op->dst] = !r[op->a]; break;
+        case TOP_GUARD_EQ: if (!(r[op->a] == r[op->b])) { exit = op->dst; goto done; } break;
+        case TOP_GUARD_NE: if (!(r[op->a] != r[op->b])) { exit = op->dst; goto done; } break;
+        case TOP_GUARD_LT: if (!(r[op->a] < r[op->b])) { exit = op->dst; goto done; } break;
+        case TOP_GUARD_LE: if (!(r[op->a] <= r[op->b])) { exit = op->dst; goto done; } break;
+        case TOP_GUARD_GT: if (!(r[op->a] > r[op->b])) { exit = op->dst; goto done; } break;
+        case TOP_GUARD_GE: if (!(r[op->a] >= r[op->b])) { exit = op->dst; goto done; } break;
+        case TOP_GUARD_NZ: if (!r[op->a]) { exit = op->dst; goto done; } break;
+        case TOP_GUARD_Z: if (r[op->a]) { exit = op->dst; goto done; } break;
+        default: assert(0);
+      }
+    }
+  }
+done:
+  for (ptrdiff_t i = 0; i < regs_len; ++i) {
+    if (regs[i].written) frame[regs[i].val] = r[i];
+  }
+  *iterations = n;
+  return exit;
+}
+
+const IMP_TraceExit *imp_trace_exit(const IMP_Trace *trace, int index) {
+  assert(index >= 0 && index < arrlen(trace->exits));
+  return &trace->exits[index];
+}
+
+int imp_trace_len(const IMP_Trace *trace) {
+  return (int)arrlen(trace->ops);
+}
+
+void imp_trace_destroy(IMP_Trace *trace) {
+  if (!trace) return;
+  for (ptrdiff_t i = 0; i < arrlen(trace->exits); ++i) arrfree(trace->exits[i].cont);
+  arrfree(trace->exits);
+  arrfree(trace->ops);
+  arrfree(trace->regs);
+  hmfree(trace->var_regs);
+  hmfree(trace->const_regs);
+  arrfree(trace->file);
+  free(trace);
+}
+
+
+typedef struct LoopEntry {
+  const IMP_ASTNode *key;
+  IMP_TraceLoop *value;
+} LoopEntry;
+
+struct IMP_Tracer {
+  int threshold;
+  LoopEntry *loops;
+  IMP_TraceStats stats;
+};
+
+IMP_Tracer *imp_tracer_create(void) {
+  IMP_Tracer *tracer = calloc(1, sizeof(IMP_Tracer));
+  assert(tracer && "Memory allocation failed");
+  tracer->threshold = IMP_TRACER_DEFAULT_THRESHOLD;
+  return tracer;
+}
+
+void imp_tracer_destroy(IMP_Tracer *tracer) {
+  imp_tracer_reset(tracer);
+  free(tracer);
+}
+
+void imp_tracer_set_threshold(IMP_Tracer *tracer, int threshold) {
+  tracer->threshold = threshold;
+}
+
+int imp_tracer_threshold(const IMP_Tracer *tracer) {
+  return tracer->threshold;
+}
+
+IMP_TraceLoop *imp_tracer_loop(IMP_Tracer *tracer, const IMP_ASTNode *loop) {
+  if (tracer->threshold <= 0) return NULL;
+  ptrdiff_t index = hmgeti(tracer->loops, loop);
+  if (index >= 0) return tracer->loops[index].value;
+  IMP_TraceLoop *state = calloc(1, sizeof(IMP_TraceLoop));
+  assert(state && "Memory allocation failed");
+  hmput(tracer->loops, loop, state);
+  return state;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int imp_tracer_run(IMP_Tracer *tracer, IMP_TraceLoop *loop, int *frame) {
+  long iterations;
+  double start = now();
+  int exit = imp_trace_run(loop->trace, frame, &iterations);
+  tracer->stats.seconds += now() - start;
+  tracer->stats.entries++;
+  tracer->stats.iterations += iterations;
+  if (exit >= 0) tracer->stats.guard_exits++;
+  return exit;
+}
+
+void imp_tracer_reset(IMP_Tracer *tracer) {
+  for (ptrdiff_t i = 0; i < hmlen(tracer->loops); ++i) {
+    imp_trace_destroy(tracer->loops[i].value->trace);
+    free(tracer->loops[i].value);
+  }
+  hmfree(tracer->loops);
+}
+
+IMP_TraceStats *imp_tracer_stats(IMP_Tracer *tracer) {
+  return &tracer->stats;
+}
@@ -0,0 +1,147 @@
+#include "vm.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "vm_runtime.h"
+#include "3rdparty/stb_ds/stb_ds.h"
+
+
+/*
+ * Dispatch: with GCC/Clang labels-as-values every handler jumps directly to
+ * the handler of the next instruction (direct threading), otherwise a switch
+ * in a loop is used. Define IMP_VM_SWITCH_DISPATCH to force the switch.
+ */
+#if defined(__GNUC__) && !defined(IMP_VM_SWITCH_DISPATCH)
+#define VM_THREADED 1
+#define VM_CASE(op) op_##op:
+#define VM_NEXT() do { ins = code[pc++]; goto *dispatch[ins.op]; } while (0)
+#else
+#define VM_THREADED 0
+#define VM_CASE(op) case IMP_OP_##op:
+#define VM_NEXT() break
+#endif
+
+/** Activation record of a procedure call. */
+typedef struct VMCall {
+  int ret_pc;      /**< Instruction to continue with in the caller. */
+  int call;        /**< Call site index. */
+  int *caller_fp;  /**< Frame of the caller. */
+} VMCall;
+
+int imp_vm_run(IMP_InterpreterContext *context, const IMP_BytecodeChunk *chunk) {
+#if VM_THREADED
+  static const void *const dispatch[] = {
+    [IMP_OP_PUSH] = &&op_PUSH, [IMP_OP_LOAD] = &&op_LOAD, [IMP_OP_STORE] = &&op_STORE,
+    [IMP_OP_ADD] = &&op_ADD, [IMP_OP_SUB] = &&op_SUB, [IMP_OP_MUL] = &&op_MUL,
+    [IMP_OP_EQ] = &&op_EQ, [IMP_OP_NE] = &&op_NE, [IMP_OP_LT] = &&op_LT,
+    [IMP_OP_LE] = &&op_LE, [IMP_OP_GT] = &&op_GT, [IMP_OP_GE] = &&op_GE,
+    [IMP_OP_AND] = &&op_AND, [IMP_OP_OR] = &&op_OR, [IMP_OP_NOT] = &&op_NOT,
+    [IMP_OP_JMP] = &&op_JMP, [IMP_OP_JZ] = &&op_JZ, [IMP_OP_DECL] = &&op_DECL,
+    [IMP_OP_CALL] = &&op_CALL, [IMP_OP_RET] = &&op_RET, [IMP_OP_HALT] = &&op_HALT,
+    [IMP_OP_INC] = &&op_INC, [IMP_OP_ADDVV] = &&op_ADDVV, [IMP_OP_SUBVV] = &&op_SUBVV,
+    [IMP_OP_MULVV] = &&op_MULVV, [IMP_OP_JZ_EQ] = &&op_JZ_EQ, [IMP_OP_JZ_NE] = &&op_JZ_NE,
+    [IMP_OP_JZ_LT] = &&op_JZ_LT, [IMP_OP_JZ_LE] = &&op_JZ_LE, [IMP_OP_JZ_GT] = &&op_JZ_GT,
+    [IMP_OP_JZ_GE] = &&op_JZ_GE,
+  };
+#endif
+  const IMP_Instruction *code = chunk->code;
+  int *stack = malloc(sizeof(int) * (chunk->max_stack + 1));
+  char *declared = calloc(chunk->procs_len + 1, sizeof(char));
+  assert(stack && declared && "Memory allocation failed");
+  for (int i = 0; i < chunk->procs_len; ++i) declared[i] = (char)chunk->procs[i].predeclared;
+  IMP_FrameStack *frame_stack = imp_interpreter_context_frame_stack(context);
+  VMCall *calls = NULL;
+  int *fp = imp_interpreter_context_frame(context);
+  int *sp = stack;
+  int pc = 0;
+  int ret = 0;
+  IMP_Instruction ins;
+
+#if VM_THREADED
+  VM_NEXT();
+  {
+#else
+  for (;;) {
+    ins = code[pc++];
+    switch (ins.op) {
+#endif
+      VM_CASE(PUSH) *sp++ = ins.arg; VM_NEXT();
+      VM_CASE(LOAD) *sp++ = fp[ins.arg]; VM_NEXT();
+      VM_CASE(STORE) fp[ins.arg] = *--sp; VM_NEXT();
+      VM_CASE(ADD) sp--; sp[-1] = sp[-1] + sp[0]; VM_NEXT();
+      VM_CASE(SUB) sp--; sp[-1] = sp[-1] - sp[0]; VM_NEXT();
+      VM_CASE(MUL) sp--; sp[-1] = sp[-1] * sp[0]; VM_NEXT();
+      VM_CASE(EQ) sp--; sp[-1] = sp[-1] == sp[0]; VM_NEXT();
+      VM_CASE(NE) sp--; sp[-1] = sp[-1] != sp[0]; VM_NEXT();
+      VM_CASE(LT) sp--; sp[-1] = sp[-1] < sp[0]; VM_NEXT();
+      VM_CASE(LE) sp--; sp[-1] = sp[-1] <= sp[0]; VM_NEXT();
+      VM_CASE(GT) sp--; sp[-1] = sp[-1] > sp[0]; VM_NEXT();
+      VM_CASE(GE) sp--; sp[-1] = sp[-1] >= sp[0]; VM_NEXT();
+      VM_CASE(AND) sp--; sp[-1] = sp[-1] && sp[0]; VM_NEXT();
+      VM_CASE(OR) sp--; sp[-1] = sp[-1] || sp[0]; VM_NEXT();
+      VM_CASE(NOT) sp[-1] = !sp[-1]; VM_NEXT();
+      VM_CASE(JMP) pc = ins.arg; VM_NEXT();
+      VM_CASE(JZ) if (!*--sp) pc = ins.arg; VM_NEXT();
+      VM_CASE(INC) fp[ins.arg] += ins.arg2; VM_NEXT();
+      VM_CASE(ADDVV) fp[ins.arg] = fp[ins.arg2] + fp[ins.arg3]; VM_NEXT();
+      VM_CASE(SUBVV) fp[ins.arg] = fp[ins.arg2] - fp[ins.arg3]; VM_NEXT();
+      VM_CASE(MULVV) fp[ins.arg] = fp[ins.arg2] * fp[ins.arg3]; VM_NEXT();
+      VM_CASE(JZ_EQ) if (!(fp[ins.arg] == ins.arg2)) pc = ins.arg3; VM_NEXT();
+      VM_CASE(JZ_NE) if (!(fp[ins.arg] != ins.arg2)) pc = ins.arg3; VM_NEXT();
+      VM_CASE(JZ_LT) if (!(fp[ins.arg] < ins.arg2)) pc = ins.arg3; VM_NEXT();
+      VM_CASE(JZ_LE) if (!(fp[ins.arg] <= ins.arg2)) pc = ins.arg3; VM_NEXT();
+      VM_CASE(JZ_GT) if (!(fp[ins.arg] > ins.arg2)) pc = ins.arg3; VM_NEXT();
+      VM_CASE(JZ_GE) if (!(fp[ins.arg] >= ins.arg2)) pc = ins.arg3; VM_NEXT();
+      VM_CASE(DECL)
+        if (imp_vm_runtime_decl(context, chunk, declared, ins.arg)) {
+          ret = -1;
+          goto done;
+        }
+        VM_NEXT();
+      VM_CASE(CALL) {
+        int *callee_fp = imp_vm_runtime_call(frame_stack, chunk, declared, ins.arg, sp);
+        if (!callee_fp) {
+          ret = -1;
+          goto done;
+        }
+        VMCall activation = { pc, ins.arg, fp };
+        arrput(calls, activation);
+        fp = callee_fp;
+        sp -= chunk->calls[ins.arg].val_argc;
+        pc = chunk->procs[chunk->calls[ins.arg].proc].entry;
+        VM_NEXT();
+      }
+      VM_CASE(RET) {
+        VMCall activation = arrpop(calls);
+        int failed = imp_vm_runtime_ret(frame_stack, chunk, activation.call, ins.arg, fp, activation.caller_fp);
+        fp = activation.caller_fp;
+        pc = activation.ret_pc;
+        if (failed) {
+          ret = -1;
+          goto done;
+        }
+        VM_NEXT();
+      }
+      VM_CASE(HALT) goto done;
+#if !VM_THREADED
+      default: assert(0);
+    }
+#endif
+  }
+
+done:
+  while (arrlen(calls) > 0) {
+    imp_frame_stack_pop(frame_stack, fp);
+    fp = arrpop(calls).caller_fp;
+  }
+  arrfree(calls);
+  free(declared);
+  free(stack);
+  return ret;
+}
+
+const char *imp_vm_dispatch(void) {
+  return VM_THREADED ? "threaded" : "switch";
+}
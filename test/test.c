@@ -3,8 +3,40 @@
 #include <assert.h>
 
 #include "ast.h"
+#include "symbol.h"
 #include "interpreter_context.h"
 #include "interpreter.h"
+#include "resolver.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "jit.h"
+#include "closure.h"
+#include "driver.h"
+#include "flat_ast.h"
+#include "optimizer.h"
+#include "ir.h"
+#include "ir_pass.h"
+#include "3rdparty/stb_ds/stb_ds.h"
+
+static void test_symbol(void) {
+  const IMP_Symbol *x = imp_symbol_intern("x");
+  char name[] = "xy";
+  assert(imp_symbol_intern_len(name, 1) == x);
+  assert(strcmp(x->name, "x") == 0 && x->len == 1);
+  const IMP_Symbol *xy = imp_symbol_intern(name);
+  assert(xy != x && xy->hash != x->hash);
+  name[1] = 'z';
+  assert(strcmp(xy->name, "xy") == 0);
+  size_t count = imp_symbol_count();
+  char buf[16];
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(buf, sizeof(buf), "s%d", i);
+    imp_symbol_intern(buf);
+  }
+  assert(imp_symbol_count() == count + 1000);
+  assert(imp_symbol_intern("xy") == xy);
+  assert(imp_symbol_intern("s999") == imp_symbol_intern("s999"));
+}
 
 static void test_interpreter_context(void) {
   IMP_InterpreterContext *context = imp_interpreter_context_create();
@@ -12,61 +44,61 @@ static void test_interpreter_context(void) {
 
   int value;
 
-  value = imp_interpreter_context_var_get(context, "a");
+  value = imp_interpreter_context_var_get(context, imp_symbol_intern("a"));
   assert(value == 0);
 
-  imp_interpreter_context_var_set(context, "a", 1);
-  value = imp_interpreter_context_var_get(context, "a");
+  imp_interpreter_context_var_set(context, imp_symbol_intern("a"), 1);
+  value = imp_interpreter_context_var_get(context, imp_symbol_intern("a"));
   assert(value == 1);
 
-  imp_interpreter_context_var_set(context, "b", 2);
-  value = imp_interpreter_context_var_get(context, "b");
+  imp_interpreter_context_var_set(context, imp_symbol_intern("b"), 2);
+  value = imp_interpreter_context_var_get(context, imp_symbol_intern("b"));
   assert(value == 2);
 
-  imp_interpreter_context_var_set(context, "c", 3);
-  value = imp_interpreter_context_var_get(context, "c");
+  imp_interpreter_context_var_set(context, imp_symbol_intern("c"), 3);
+  value = imp_interpreter_context_var_get(context, imp_symbol_intern("c"));
   assert(value == 3);
 
-  imp_interpreter_context_var_set(context, "a", 4);
-  value = imp_interpreter_context_var_get(context, "a");
+  imp_interpreter_context_var_set(context, imp_symbol_intern("a"), 4);
+  value = imp_interpreter_context_var_get(context, imp_symbol_intern("a"));
   assert(value == 4);
 
-  imp_interpreter_context_var_set(context, "b", 0);
-  value = imp_interpreter_context_var_get(context, "b");
+  imp_interpreter_context_var_set(context, imp_symbol_intern("b"), 0);
+  value = imp_interpreter_context_var_get(context, imp_symbol_intern("b"));
   assert(value == 0);
 
   IMP_InterpreterContextVarIter *var_iter = imp_interpreter_context_var_iter_create(context);
   IMP_InterpreterContextVarTableEntry *var_entry;
   while ((var_entry = imp_interpreter_context_var_iter_next(var_iter))) {
-    if (strcmp(var_entry->key, "a") == 0) assert(var_entry->value == 4);
-    else if (strcmp(var_entry->key, "c") == 0) assert(var_entry->value == 3);
+    if (var_entry->key == imp_symbol_intern("a")) assert(var_entry->value == 4);
+    else if (var_entry->key == imp_symbol_intern("c")) assert(var_entry->value == 3);
     else assert(0);
   }
   imp_interpreter_context_var_iter_destroy(var_iter);
 
-  IMP_ASTNode *proc_a = imp_ast_procdecl("a", NULL, NULL, imp_ast_skip());
-  IMP_ASTNode *proc_b = imp_ast_procdecl("b", NULL, NULL, imp_ast_skip());
+  IMP_ASTNode *proc_a = imp_ast_procdecl(NULL, imp_symbol_intern("a"), NULL, NULL, imp_ast_skip(NULL));
+  IMP_ASTNode *proc_b = imp_ast_procdecl(NULL, imp_symbol_intern("b"), NULL, NULL, imp_ast_skip(NULL));
   const IMP_ASTNode *proc;
 
-  proc = imp_interpreter_context_proc_get(context, "a");
+  proc = imp_interpreter_context_proc_get(context, imp_symbol_intern("a"));
   assert(proc == NULL);
 
-  imp_interpreter_context_proc_set(context, "a", proc_a);
-  proc = imp_interpreter_context_proc_get(context, "a");
+  imp_interpreter_context_proc_set(context, imp_symbol_intern("a"), proc_a);
+  proc = imp_interpreter_context_proc_get(context, imp_symbol_intern("a"));
   assert(proc != NULL);
 
-  imp_interpreter_context_proc_set(context, "b", proc_b);
-  proc = imp_interpreter_context_proc_get(context, "b");
+  imp_interpreter_context_proc_set(context, imp_symbol_intern("b"), proc_b);
+  proc = imp_interpreter_context_proc_get(context, imp_symbol_intern("b"));
   assert(proc != NULL);
 
-  imp_interpreter_context_proc_set(context, "b", NULL);
-  proc = imp_interpreter_context_proc_get(context, "b");
+  imp_interpreter_context_proc_set(context, imp_symbol_intern("b"), NULL);
+  proc = imp_interpreter_context_proc_get(context, imp_symbol_intern("b"));
   assert(proc == NULL);
 
   IMP_InterpreterContextProcIter *proc_iter = imp_interpreter_context_proc_iter_create(context);
   IMP_InterpreterContextProcTableEntry *proc_entry;
   while ((proc_entry = imp_interpreter_context_proc_iter_next(proc_iter))) {
-    if (strcmp(proc_entry->key, "a") == 0) assert(proc_entry->value != NULL);
+    if (proc_entry->key == imp_symbol_intern("a")) assert(proc_entry->value != NULL);
     else assert(0);
   }
   imp_interpreter_context_proc_iter_destroy(proc_iter);
@@ -77,55 +109,1174 @@ static void test_interpreter_context(void) {
   imp_interpreter_context_destroy(context);
 }
 
-static void test_interpreter(void) {
-  IMP_ASTNode *factorial_procdecl = imp_ast_procdecl(
-    "factorial",
-    imp_ast_list(imp_ast_var("n"), NULL),
-    imp_ast_list(imp_ast_var("r"), NULL),
-    imp_ast_if(
-      imp_ast_rop(IMP_AST_ROP_LE, imp_ast_var("n"), imp_ast_int(0)),
-      imp_ast_assign(imp_ast_var("r"), imp_ast_int(1)),
-      imp_ast_seq(
-        imp_ast_assign(imp_ast_var("m"), imp_ast_aop(IMP_AST_AOP_SUB, imp_ast_var("n"), imp_ast_int(1))),
-        imp_ast_seq(
-          imp_ast_proccall(
-            "factorial", 
-            imp_ast_list(imp_ast_var("m"), NULL),
-            imp_ast_list(imp_ast_var("r"), NULL)
+static IMP_ASTNode *factorial_program(void) {
+  IMP_ASTNode *factorial_procdecl = imp_ast_procdecl(NULL, 
+    imp_symbol_intern("factorial"),
+    imp_ast_list(NULL, imp_ast_var(NULL, imp_symbol_intern("n")), NULL),
+    imp_ast_list(NULL, imp_ast_var(NULL, imp_symbol_intern("r")), NULL),
+    imp_ast_if(NULL, 
+      imp_ast_rop(NULL, IMP_AST_ROP_LE, imp_ast_var(NULL, imp_symbol_intern("n")), imp_ast_int(NULL, 0)),
+      imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("r")), imp_ast_int(NULL, 1)),
+      imp_ast_seq(NULL, 
+        imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("m")), imp_ast_aop(NULL, IMP_AST_AOP_SUB, imp_ast_var(NULL, imp_symbol_intern("n")), imp_ast_int(NULL, 1))),
+        imp_ast_seq(NULL, 
+          imp_ast_proccall(NULL, 
+            imp_symbol_intern("factorial"), 
+            imp_ast_list(NULL, imp_ast_var(NULL, imp_symbol_intern("m")), NULL),
+            imp_ast_list(NULL, imp_ast_var(NULL, imp_symbol_intern("r")), NULL)
           ),
-          imp_ast_assign(imp_ast_var("r"), imp_ast_aop(IMP_AST_AOP_MUL, imp_ast_var("r"), imp_ast_var("n")))
+          imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("r")), imp_ast_aop(NULL, IMP_AST_AOP_MUL, imp_ast_var(NULL, imp_symbol_intern("r")), imp_ast_var(NULL, imp_symbol_intern("n"))))
         )
       )
     )
   );
 
-  IMP_ASTNode *main = imp_ast_seq(
+  return imp_ast_seq(NULL, 
     factorial_procdecl,
-    imp_ast_seq(
-      imp_ast_assign(imp_ast_var("n"), imp_ast_int(5)),
-      imp_ast_proccall(
-        "factorial",
-        imp_ast_list(imp_ast_var("n"), NULL),
-        imp_ast_list(imp_ast_var("r"), NULL)
+    imp_ast_seq(NULL, 
+      imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("n")), imp_ast_int(NULL, 5)),
+      imp_ast_proccall(NULL, 
+        imp_symbol_intern("factorial"),
+        imp_ast_list(NULL, imp_ast_var(NULL, imp_symbol_intern("n")), NULL),
+        imp_ast_list(NULL, imp_ast_var(NULL, imp_symbol_intern("r")), NULL)
       )
     )
   );
+}
+
+static void test_dense_vars(void) {
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  const IMP_Symbol *n = imp_symbol_intern("n");
+  imp_interpreter_context_var_set(context, imp_symbol_intern("m"), 7);
+  imp_interpreter_context_var_set(context, n, 1);
+  int *frame = imp_interpreter_context_frame(context);
+  int frame_size = imp_interpreter_context_frame_size(context);
+  for (int i = 0; i < 1000; ++i) {
+    imp_interpreter_context_var_set(context, n, i % 2);
+    assert(imp_interpreter_context_var_get(context, n) == i % 2);
+  }
+  imp_interpreter_context_var_set(context, n, 0);
+  assert(imp_interpreter_context_frame(context) == frame);
+  assert(imp_interpreter_context_frame_size(context) == frame_size);
+
+  IMP_InterpreterContextVarIter *iter = imp_interpreter_context_var_iter_create(context);
+  const IMP_InterpreterContextVarTableEntry *var_entry;
+  int count = 0;
+  while ((var_entry = imp_interpreter_context_var_iter_next(iter))) {
+    assert(var_entry->key != n);
+    count++;
+  }
+  imp_interpreter_context_var_iter_destroy(iter);
+  assert(count == 1);
+  imp_interpreter_context_destroy(context);
+}
+
+static void test_interpreter(void) {
+  IMP_ASTNode *main = factorial_program();
 
   IMP_InterpreterContext *context = imp_interpreter_context_create();
-  int result = imp_interpreter_interpret_ast(context, main);
+  int result = imp_resolver_resolve(context, main);
   assert(result == 0);
-  int factorial_result = imp_interpreter_context_var_get(context, "r");
+  result = imp_interpreter_interpret_ast(context, main);
+  assert(result == 0);
+  int factorial_result = imp_interpreter_context_var_get(context, imp_symbol_intern("r"));
   assert(factorial_result == 120);
-  const IMP_ASTNode *proc = imp_interpreter_context_proc_get(context, "factorial");
+  const IMP_ASTNode *proc = imp_interpreter_context_proc_get(context, imp_symbol_intern("factorial"));
   assert(proc != NULL);
 
   imp_ast_destroy(main);
   imp_interpreter_context_destroy(context);
 }
 
+static void test_proc_table_shared(void) {
+  /* Many procedures declared by an earlier program, then a call p0(5; x) that calls p1 through the table. */
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  char source[16384];
+  int len = snprintf(source, sizeof(source), "procedure p0(a;r) begin p1(a;r) end");
+  for (int i = 1; i < 200; ++i) len += snprintf(source + len, sizeof(source) - len, "; procedure p%d(a;r) begin r := a + %d end", i, i);
+  assert(len < (int)sizeof(source));
+  int result = imp_driver_interpret_str(context, source, NULL);
+  assert(result == 0);
+
+  const IMP_Symbol *p0 = imp_symbol_intern("p0"), *x = imp_symbol_intern("x");
+  IMP_ASTArena *arena = imp_ast_arena_create();
+  IMP_ASTNode *call = imp_ast_proccall(arena, p0, imp_ast_list(arena, imp_ast_int(arena, 5), NULL), imp_ast_list(arena, imp_ast_var(arena, x), NULL));
+  result = imp_resolver_resolve(context, call);
+  assert(result == 0);
+  size_t bytes = imp_ast_arena_bytes(arena);
+  unsigned long epoch = imp_interpreter_context_proc_epoch(context);
+  /* Epochs are drawn from a counter shared by all contexts, which creating a context advances as well. */
+  IMP_InterpreterContext *before = imp_interpreter_context_create();
+  unsigned long counter = imp_interpreter_context_proc_epoch(before);
+  imp_interpreter_context_destroy(before);
+
+  result = imp_interpreter_interpret_ast(context, call);
+  assert(result == 0);
+  assert(imp_interpreter_context_var_get(context, x) == 6);
+  /* The call neither cloned procedures nor created a context, nor declared into the table. */
+  assert(imp_ast_arena_bytes(arena) == bytes);
+  assert(imp_interpreter_context_proc_epoch(context) == epoch);
+  IMP_InterpreterContext *after = imp_interpreter_context_create();
+  assert(imp_interpreter_context_proc_epoch(after) == counter + 1);
+  imp_interpreter_context_destroy(after);
+
+  imp_ast_arena_destroy(arena);
+  imp_interpreter_context_destroy(context);
+}
+
+static void test_quickening(void) {
+  IMP_ASTNode *inc = imp_ast_aop(NULL, IMP_AST_AOP_ADD, imp_ast_var(NULL, imp_symbol_intern("x")), imp_ast_int(NULL, 1));
+  IMP_ASTNode *sum = imp_ast_aop(NULL, IMP_AST_AOP_ADD, imp_ast_var(NULL, imp_symbol_intern("x")), imp_ast_var(NULL, imp_symbol_intern("x")));
+  IMP_ASTNode *dbl = imp_ast_aop(NULL, IMP_AST_AOP_MUL, imp_ast_int(NULL, 2), sum);
+  IMP_ASTNode *cond = imp_ast_rop(NULL, IMP_AST_ROP_LT, imp_ast_int(NULL, 0), imp_ast_var(NULL, imp_symbol_intern("x")));
+  IMP_ASTNode *main = imp_ast_seq(NULL,
+    imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("x")), inc),
+    imp_ast_if(NULL, cond,
+      imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("y")), dbl),
+      imp_ast_skip(NULL)));
+  assert(inc->data.arith_op.quick == IMP_AST_QUICK_NONE);
+
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  int result = imp_resolver_resolve(context, main);
+  assert(result == 0);
+  result = imp_interpreter_interpret_ast(context, main);
+  assert(result == 0);
+  assert(inc->data.arith_op.quick == IMP_AST_QUICK_VAR_INT);
+  assert(sum->data.arith_op.quick == IMP_AST_QUICK_VAR_VAR);
+  assert(dbl->data.arith_op.quick == IMP_AST_QUICK_GENERIC);
+  assert(cond->data.rel_op.quick == IMP_AST_QUICK_INT_VAR);
+  result = imp_interpreter_interpret_ast(context, main);
+  assert(result == 0);
+  assert(imp_interpreter_context_var_get(context, imp_symbol_intern("x")) == 2);
+  assert(imp_interpreter_context_var_get(context, imp_symbol_intern("y")) == 8);
+  imp_ast_destroy(main);
+  imp_interpreter_context_destroy(context);
+
+  /* Procedure calls cache their declaration until the procedure table changes. */
+  main = factorial_program();
+  IMP_ASTNode *call = main->data.seq.snd_stmt->data.seq.snd_stmt;
+  const IMP_Symbol *name = imp_symbol_intern("factorial");
+  IMP_InterpreterContext *contexts[2] = { imp_interpreter_context_create(), imp_interpreter_context_create() };
+  for (int i = 0; i < 2; ++i) {
+    result = imp_resolver_resolve(contexts[i], main);
+    assert(result == 0);
+    result = imp_interpreter_interpret_ast(contexts[i], main);
+    assert(result == 0);
+    assert(imp_interpreter_context_var_get(contexts[i], imp_symbol_intern("r")) == 120);
+    assert(call->data.proc_call.procdecl == imp_interpreter_context_proc_get(contexts[i], name));
+  }
+  imp_interpreter_context_proc_set(contexts[1], name, imp_interpreter_context_proc_get(contexts[1], name));
+  assert(call->data.proc_call.procdecl != imp_interpreter_context_proc_get(contexts[1], name));
+  result = imp_interpreter_interpret_ast(contexts[1], call);
+  assert(result == 0);
+  assert(call->data.proc_call.procdecl == imp_interpreter_context_proc_get(contexts[1], name));
+  imp_ast_destroy(main);
+  imp_interpreter_context_destroy(contexts[0]);
+  imp_interpreter_context_destroy(contexts[1]);
+}
+
+static void test_vm(void) {
+  IMP_ASTNode *main = factorial_program();
+
+  IMP_InterpreterContext *ast_context = imp_interpreter_context_create();
+  int result = imp_resolver_resolve(ast_context, main);
+  assert(result == 0);
+  result = imp_interpreter_interpret_ast(ast_context, main);
+  assert(result == 0);
+
+  IMP_InterpreterContext *vm_context = imp_interpreter_context_create();
+  result = imp_resolver_resolve(vm_context, main);
+  assert(result == 0);
+  IMP_BytecodeChunk *chunk = imp_bytecode_compile(vm_context, main);
+  assert(chunk != NULL);
+  result = imp_vm_run(vm_context, chunk);
+  assert(result == 0);
+  imp_bytecode_destroy(chunk);
+
+  assert(imp_interpreter_context_var_get(vm_context, imp_symbol_intern("r")) == 120);
+  IMP_InterpreterContextVarIter *var_iter = imp_interpreter_context_var_iter_create(ast_context);
+  IMP_InterpreterContextVarTableEntry *var_entry;
+  while ((var_entry = imp_interpreter_context_var_iter_next(var_iter))) {
+    assert(imp_interpreter_context_var_get(vm_context, var_entry->key) == var_entry->value);
+  }
+  imp_interpreter_context_var_iter_destroy(var_iter);
+  assert(imp_interpreter_context_proc_get(vm_context, imp_symbol_intern("factorial")) != NULL);
+
+  imp_ast_destroy(main);
+  imp_interpreter_context_destroy(ast_context);
+  imp_interpreter_context_destroy(vm_context);
+}
+
+/* i := 0; s := 0; p := 1; while 10 > i do i := i + 1; s := s + i; p := p * i; d := s - p end;
+ * while s != 0 do s := s - 5 end; if i = 10 then t := 1 + t else t := 0 end */
+static IMP_ASTNode *idiom_program(void) {
+  IMP_ASTNode *loop_body = imp_ast_seq(NULL,
+    imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("i")), imp_ast_aop(NULL, IMP_AST_AOP_ADD, imp_ast_var(NULL, imp_symbol_intern("i")), imp_ast_int(NULL, 1))),
+    imp_ast_seq(NULL,
+      imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("s")), imp_ast_aop(NULL, IMP_AST_AOP_ADD, imp_ast_var(NULL, imp_symbol_intern("s")), imp_ast_var(NULL, imp_symbol_intern("i")))),
+      imp_ast_seq(NULL,
+        imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("p")), imp_ast_aop(NULL, IMP_AST_AOP_MUL, imp_ast_var(NULL, imp_symbol_intern("p")), imp_ast_var(NULL, imp_symbol_intern("i")))),
+        imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("d")), imp_ast_aop(NULL, IMP_AST_AOP_SUB, imp_ast_var(NULL, imp_symbol_intern("s")), imp_ast_var(NULL, imp_symbol_intern("p"))))
+      )
+    )
+  );
+  return imp_ast_seq(NULL,
+    imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("i")), imp_ast_int(NULL, 0)),
+    imp_ast_seq(NULL,
+      imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("s")), imp_ast_int(NULL, 0)),
+      imp_ast_seq(NULL,
+        imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("p")), imp_ast_int(NULL, 1)),
+        imp_ast_seq(NULL,
+          imp_ast_while(NULL, imp_ast_rop(NULL, IMP_AST_ROP_GT, imp_ast_int(NULL, 10), imp_ast_var(NULL, imp_symbol_intern("i"))), loop_body),
+          imp_ast_seq(NULL,
+            imp_ast_while(NULL,
+              imp_ast_rop(NULL, IMP_AST_ROP_NE, imp_ast_var(NULL, imp_symbol_intern("s")), imp_ast_int(NULL, 0)),
+              imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("s")), imp_ast_aop(NULL, IMP_AST_AOP_SUB, imp_ast_var(NULL, imp_symbol_intern("s")), imp_ast_int(NULL, 5)))
+            ),
+            imp_ast_if(NULL,
+              imp_ast_rop(NULL, IMP_AST_ROP_EQ, imp_ast_var(NULL, imp_symbol_intern("i")), imp_ast_int(NULL, 10)),
+              imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("t")), imp_ast_aop(NULL, IMP_AST_AOP_ADD, imp_ast_int(NULL, 1), imp_ast_var(NULL, imp_symbol_intern("t")))),
+              imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("t")), imp_ast_int(NULL, 0))
+            )
+          )
+        )
+      )
+    )
+  );
+}
+
+static void test_superinstructions(void) {
+  IMP_ASTNode *main = idiom_program();
+
+  IMP_InterpreterContext *ast_context = imp_interpreter_context_create();
+  int result = imp_resolver_resolve(ast_context, main);
+  assert(result == 0);
+  result = imp_interpreter_interpret_ast(ast_context, main);
+  assert(result == 0);
+
+  IMP_InterpreterContext *vm_context = imp_interpreter_context_create();
+  result = imp_resolver_resolve(vm_context, main);
+  assert(result == 0);
+  IMP_BytecodeChunk *chunk = imp_bytecode_compile(vm_context, main);
+  assert(imp_bytecode_count(chunk, IMP_OP_INC) == 3);
+  assert(imp_bytecode_count(chunk, IMP_OP_ADDVV) == 1);
+  assert(imp_bytecode_count(chunk, IMP_OP_SUBVV) == 1);
+  assert(imp_bytecode_count(chunk, IMP_OP_MULVV) == 1);
+  assert(imp_bytecode_count(chunk, IMP_OP_JZ_LT) == 1);
+  assert(imp_bytecode_count(chunk, IMP_OP_JZ_NE) == 1);
+  assert(imp_bytecode_count(chunk, IMP_OP_JZ_EQ) == 1);
+  assert(imp_bytecode_count(chunk, IMP_OP_JZ) == 0);
+  assert(strcmp(imp_bytecode_opcode_name(IMP_OP_JZ_LT), "jz_lt") == 0);
+  result = imp_vm_run(vm_context, chunk);
+  assert(result == 0);
+  imp_bytecode_destroy(chunk);
+
+  assert(imp_interpreter_context_var_get(vm_context, imp_symbol_intern("p")) == 3628800);
+  assert(imp_interpreter_context_var_get(vm_context, imp_symbol_intern("t")) == 1);
+  IMP_InterpreterContextVarIter *var_iter = imp_interpreter_context_var_iter_create(ast_context);
+  IMP_InterpreterContextVarTableEntry *var_entry;
+  while ((var_entry = imp_interpreter_context_var_iter_next(var_iter))) {
+    assert(imp_interpreter_context_var_get(vm_context, var_entry->key) == var_entry->value);
+  }
+  imp_interpreter_context_var_iter_destroy(var_iter);
+
+  imp_ast_destroy(main);
+  imp_interpreter_context_destroy(ast_context);
+  imp_interpreter_context_destroy(vm_context);
+}
+
+/* procedure down(n; r) begin if n <= 0 then r := 0 else down(n - 1; r); r := r + 1 end end; down(<n>; r) */
+static IMP_ASTNode *countdown_program(int n) {
+  return imp_ast_seq(NULL, 
+    imp_ast_procdecl(NULL, 
+      imp_symbol_intern("down"),
+      imp_ast_list(NULL, imp_ast_var(NULL, imp_symbol_intern("n")), NULL),
+      imp_ast_list(NULL, imp_ast_var(NULL, imp_symbol_intern("r")), NULL),
+      imp_ast_if(NULL, 
+        imp_ast_rop(NULL, IMP_AST_ROP_LE, imp_ast_var(NULL, imp_symbol_intern("n")), imp_ast_int(NULL, 0)),
+        imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("r")), imp_ast_int(NULL, 0)),
+        imp_ast_seq(NULL, 
+          imp_ast_proccall(NULL, 
+            imp_symbol_intern("down"),
+            imp_ast_list(NULL, imp_ast_aop(NULL, IMP_AST_AOP_SUB, imp_ast_var(NULL, imp_symbol_intern("n")), imp_ast_int(NULL, 1)), NULL),
+            imp_ast_list(NULL, imp_ast_var(NULL, imp_symbol_intern("r")), NULL)
+          ),
+          imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("r")), imp_ast_aop(NULL, IMP_AST_AOP_ADD, imp_ast_var(NULL, imp_symbol_intern("r")), imp_ast_int(NULL, 1)))
+        )
+      )
+    ),
+    imp_ast_proccall(NULL, imp_symbol_intern("down"), imp_ast_list(NULL, imp_ast_int(NULL, n), NULL), imp_ast_list(NULL, imp_ast_var(NULL, imp_symbol_intern("r")), NULL))
+  );
+}
+
+static void run_jit(IMP_InterpreterContext *context, const IMP_ASTNode *node) {
+  IMP_BytecodeChunk *chunk = imp_bytecode_compile(context, node);
+  IMP_JitCode *code = imp_jit_compile(chunk);
+  assert(code != NULL || !imp_jit_supported());
+  int result = code ? imp_jit_run(context, chunk, code) : imp_vm_run(context, chunk);
+  assert(result == 0);
+  imp_jit_destroy(code);
+  imp_bytecode_destroy(chunk);
+}
+
+static void assert_same_vars(IMP_InterpreterContext *expected, IMP_InterpreterContext *actual) {
+  IMP_InterpreterContextVarIter *var_iter = imp_interpreter_context_var_iter_create(expected);
+  IMP_InterpreterContextVarTableEntry *var_entry;
+  while ((var_entry = imp_interpreter_context_var_iter_next(var_iter))) {
+    assert(imp_interpreter_context_var_get(actual, var_entry->key) == var_entry->value);
+  }
+  imp_interpreter_context_var_iter_destroy(var_iter);
+}
+
+/* Runs a program by the tree walker and by another engine, each in a fresh context, and compares the variables. */
+static void assert_engine_matches_walker(IMP_ASTNode *program, void (*run)(IMP_InterpreterContext *, const IMP_ASTNode *)) {
+  IMP_InterpreterContext *ast_context = imp_interpreter_context_create();
+  int result = imp_resolver_resolve(ast_context, program);
+  assert(result == 0);
+  result = imp_interpreter_interpret_ast(ast_context, program);
+  assert(result == 0);
+
+  IMP_InterpreterContext *engine_context = imp_interpreter_context_create();
+  result = imp_resolver_resolve(engine_context, program);
+  assert(result == 0);
+  run(engine_context, program);
+  assert_same_vars(ast_context, engine_context);
+
+  imp_interpreter_context_destroy(ast_context);
+  imp_interpreter_context_destroy(engine_context);
+}
+
+static void test_jit(void) {
+  IMP_ASTNode *programs[] = { factorial_program(), idiom_program() };
+  for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); ++i) {
+    assert_engine_matches_walker(programs[i], run_jit);
+    imp_ast_destroy(programs[i]);
+  }
+
+  const char *corpus[] = { "examples/example.imp", "examples/factorial.imp", "examples/gcd.imp" };
+  IMP_DriverOptions ast_options = imp_driver_default_options;
+  IMP_DriverOptions jit_options = imp_driver_default_options;
+  jit_options.engine = IMP_DRIVER_ENGINE_JIT;
+  for (size_t i = 0; i < sizeof(corpus) / sizeof(corpus[0]); ++i) {
+    IMP_InterpreterContext *ast_context = imp_interpreter_context_create();
+    IMP_InterpreterContext *jit_context = imp_interpreter_context_create();
+    int result = imp_driver_interpret_file(ast_context, corpus[i], &ast_options);
+    assert(result == 0);
+    result = imp_driver_interpret_file(jit_context, corpus[i], &jit_options);
+    assert(result == 0);
+    assert_same_vars(ast_context, jit_context);
+    imp_interpreter_context_destroy(ast_context);
+    imp_interpreter_context_destroy(jit_context);
+  }
+
+  /* Procedure calls run on the frame stack, not the machine stack, and errors unwind it. */
+  IMP_ASTNode *main = countdown_program(100000);
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  int result = imp_resolver_resolve(context, main);
+  assert(result == 0);
+  run_jit(context, main);
+  assert(imp_interpreter_context_var_get(context, imp_symbol_intern("r")) == 100000);
+  imp_interpreter_context_destroy(context);
+
+  context = imp_interpreter_context_create();
+  result = imp_resolver_resolve(context, main);
+  assert(result == 0);
+  imp_interpreter_context_set_stack_limit(context, 1024);
+  IMP_BytecodeChunk *chunk = imp_bytecode_compile(context, main);
+  IMP_JitCode *code = imp_jit_compile(chunk);
+  if (code) {
+    result = imp_jit_run(context, chunk, code);
+    assert(result != 0);
+  }
+  imp_jit_destroy(code);
+  imp_bytecode_destroy(chunk);
+  imp_ast_destroy(main);
+  imp_interpreter_context_destroy(context);
+}
+
+static void test_trace(void) {
+  const char *program =
+    "i := 0; s := 0; m := 0;"
+    "while i < 1000 do"
+    "  i := i + 1;"
+    "  if i < 500 then s := s + i * 2 else (var t := i in s := s - t end; m := m + 1) end;"
+    "  (if s > 100000 then m := m * 1 end; s := s + 0 - 1)"
+    "end;"
+    "n := 0;"
+    "while n < 200 do n := n + 1; gcd(n, 12; r) end";
+  const char *procedure = "procedure gcd(a, b; r) begin while b # 0 do if a > b then a := a - b else b := b - a end; if a = b then b := 0 end end; r := a end";
+
+  IMP_DriverOptions walker_options = imp_driver_default_options;
+  walker_options.trace_threshold = 0;
+  IMP_DriverOptions trace_options = imp_driver_default_options;
+  trace_options.trace_threshold = 10;
+
+  IMP_InterpreterContext *walker_context = imp_interpreter_context_create();
+  int result = imp_driver_interpret_str(walker_context, procedure, &walker_options);
+  assert(result == 0);
+  result = imp_driver_interpret_str(walker_context, program, &walker_options);
+  assert(result == 0);
+  const IMP_TraceStats *stats = imp_tracer_stats(imp_interpreter_context_tracer(walker_context));
+  assert(stats->recorded == 0 && stats->entries == 0);
+
+  IMP_InterpreterContext *trace_context = imp_interpreter_context_create();
+  result = imp_driver_interpret_str(trace_context, procedure, &trace_options);
+  assert(result == 0);
+  result = imp_driver_interpret_str(trace_context, program, &trace_options);
+  assert(result == 0);
+  stats = imp_tracer_stats(imp_interpreter_context_tracer(trace_context));
+  assert(stats->recorded >= 2);
+  assert(stats->aborted == 1);
+  assert(stats->guard_exits > 0);
+  assert(stats->iterations > 0);
+
+  assert(imp_interpreter_context_var_get(trace_context, imp_symbol_intern("m")) == 501);
+  assert(imp_interpreter_context_var_get(trace_context, imp_symbol_intern("r")) == 4);
+  assert_same_vars(walker_context, trace_context);
+  assert_same_vars(trace_context, walker_context);
+
+  imp_interpreter_context_destroy(walker_context);
+  imp_interpreter_context_destroy(trace_context);
+}
+
+static void run_closure(IMP_InterpreterContext *context, const IMP_ASTNode *node) {
+  IMP_ClosureProgram *program = imp_closure_compile(node);
+  int result = imp_closure_run(context, program);
+  assert(result == 0);
+  imp_closure_destroy(program);
+}
+
+static void test_closure(void) {
+  IMP_ASTNode *programs[] = { factorial_program(), idiom_program() };
+  for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); ++i) {
+    assert_engine_matches_walker(programs[i], run_closure);
+    imp_ast_destroy(programs[i]);
+  }
+
+  /* Procedures declared by an earlier program are compiled on their first call. */
+  IMP_DriverOptions options = imp_driver_default_options;
+  options.engine = IMP_DRIVER_ENGINE_CLOSURE;
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  int result = imp_driver_interpret_file(context, "examples/factorial.imp", &options);
+  assert(result == 0);
+  result = imp_driver_interpret_str(context, "n := 2 * 3 - 1; factorial(n + 0 * n; r)", &options);
+  assert(result == 0);
+  assert(imp_interpreter_context_var_get(context, imp_symbol_intern("r")) == 120);
+  result = imp_driver_interpret_str(context, "factorial(1, 2; r)", &options);
+  assert(result != 0);
+  imp_interpreter_context_destroy(context);
+}
+
+static void test_optimizer(void) {
+  /* x := 3; y := -x * 2 + 1; while false do z := 1 end */
+  IMP_ASTArena *arena = imp_ast_arena_create();
+  IMP_ASTNode *y_assign = imp_ast_assign(arena, imp_ast_var(arena, imp_symbol_intern("y")),
+    imp_ast_aop(arena, IMP_AST_AOP_ADD,
+      imp_ast_aop(arena, IMP_AST_AOP_MUL,
+        imp_ast_aop(arena, IMP_AST_AOP_SUB, imp_ast_int(arena, 0), imp_ast_var(arena, imp_symbol_intern("x"))),
+        imp_ast_int(arena, 2)),
+      imp_ast_int(arena, 1)));
+  IMP_ASTNode *loop = imp_ast_while(arena,
+    imp_ast_rop(arena, IMP_AST_ROP_EQ, imp_ast_int(arena, 0), imp_ast_int(arena, 1)),
+    imp_ast_assign(arena, imp_ast_var(arena, imp_symbol_intern("z")), imp_ast_int(arena, 1)));
+  IMP_ASTNode *main = imp_ast_seq(arena,
+    imp_ast_assign(arena, imp_ast_var(arena, imp_symbol_intern("x")), imp_ast_int(arena, 3)),
+    imp_ast_seq(arena, y_assign, loop));
+  IMP_ASTNode *optimized = imp_optimizer_optimize(NULL, main, arena, NULL, NULL);
+  assert(optimized == main);
+  assert(y_assign->data.assign.aexpr->type == IMP_AST_NT_INT);
+  assert(y_assign->data.assign.aexpr->data.integer.val == -5);
+  assert(main->data.seq.snd_stmt == y_assign);
+  imp_ast_arena_destroy(arena);
+
+  /* Optimized programs end in the same state, with the same variables declared. */
+  const char *programs[] = {
+    "examples/example.imp", "examples/factorial.imp", "examples/gcd.imp",
+  };
+  const char *statements =
+    "x := 3; if false then z := 1 end; big := 2147483640 + x; var x := 7 in y := x end; w := x;"
+    "i := 0; while i < 10 do s := s + x; i := i + 1 end; if s > 5 then a := 1 else a := 1 end; c := a + 1";
+  IMP_DriverOptions options = imp_driver_default_options;
+  IMP_DriverOptions optimize_options = imp_driver_default_options;
+  optimize_options.optimize = 1;
+  for (size_t i = 0; i <= sizeof(programs) / sizeof(programs[0]); ++i) {
+    IMP_InterpreterContext *context = imp_interpreter_context_create();
+    IMP_InterpreterContext *optimized_context = imp_interpreter_context_create();
+    int result, optimized_result;
+    if (i < sizeof(programs) / sizeof(programs[0])) {
+      result = imp_driver_interpret_file(context, programs[i], &options);
+      optimized_result = imp_driver_interpret_file(optimized_context, programs[i], &optimize_options);
+    } else {
+      result = imp_driver_interpret_str(context, statements, &options);
+      optimized_result = imp_driver_interpret_str(optimized_context, statements, &optimize_options);
+    }
+    assert(result == 0 && optimized_result == 0);
+    assert_same_vars(context, optimized_context);
+    assert_same_vars(optimized_context, context);
+    imp_interpreter_context_destroy(context);
+    imp_interpreter_context_destroy(optimized_context);
+  }
+}
+
+static void test_dead_code(void) {
+  /* procedure used(; r) r := 1; procedure unused(; r) r := 2; x := 1; x := 2; used(; y) */
+  IMP_ASTArena *arena = imp_ast_arena_create();
+  const IMP_Symbol *used = imp_symbol_intern("used"), *unused = imp_symbol_intern("unused");
+  IMP_ASTNode *stmts[] = {
+    imp_ast_procdecl(arena, used, NULL, imp_ast_list(arena, imp_ast_var(arena, imp_symbol_intern("r")), NULL),
+      imp_ast_assign(arena, imp_ast_var(arena, imp_symbol_intern("r")), imp_ast_int(arena, 1))),
+    imp_ast_procdecl(arena, unused, NULL, imp_ast_list(arena, imp_ast_var(arena, imp_symbol_intern("r")), NULL),
+      imp_ast_assign(arena, imp_ast_var(arena, imp_symbol_intern("r")), imp_ast_int(arena, 2))),
+    imp_ast_assign(arena, imp_ast_var(arena, imp_symbol_intern("x")), imp_ast_int(arena, 1)),
+    imp_ast_assign(arena, imp_ast_var(arena, imp_symbol_intern("x")), imp_ast_int(arena, 2)),
+    imp_ast_proccall(arena, used, NULL, imp_ast_list(arena, imp_ast_var(arena, imp_symbol_intern("y")), NULL)),
+  };
+  IMP_ASTNode *main = imp_ast_block(arena, stmts, 5);
+  IMP_OptimizerOptions optimizer = imp_optimizer_default_options;
+  optimizer.whole_program = 1;
+  optimizer.inline_size = 0;
+  IMP_OptimizerStats stats;
+  main = imp_optimizer_optimize(NULL, main, arena, &optimizer, &stats);
+  assert(main->type == IMP_AST_NT_BLOCK && main->data.block.len == 3);
+  assert(stats.nodes_removed == 8);
+
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  int result = imp_resolver_resolve(context, main);
+  assert(result == 0);
+  result = imp_interpreter_interpret_ast(context, main);
+  assert(result == 0);
+  assert(imp_interpreter_context_var_get(context, imp_symbol_intern("x")) == 2);
+  assert(imp_interpreter_context_var_get(context, imp_symbol_intern("y")) == 1);
+  assert(imp_interpreter_context_proc_get(context, used) != NULL);
+  assert(imp_interpreter_context_proc_get(context, unused) == NULL);
+  imp_interpreter_context_destroy(context);
+  imp_ast_arena_destroy(arena);
+
+  /* Procedures declared for later programs, and redeclarations, are kept. */
+  IMP_DriverOptions options = imp_driver_default_options;
+  options.optimize = 1;
+  context = imp_interpreter_context_create();
+  result = imp_driver_interpret_str(context, "procedure p(a;r) begin r := a end; procedure p(a;r) begin r := a end", &options);
+  assert(result != 0);
+  result = imp_driver_interpret_str(context, "procedure q(a;r) begin r := a end", &options);
+  assert(result == 0);
+  result = imp_driver_interpret_str(context, "procedure q(a;r) begin r := a end", &options);
+  assert(result != 0);
+  imp_interpreter_context_destroy(context);
+}
+
+static void test_licm(void) {
+  /* procedure p(v; r) r := v + 1;
+   * i := 0; while i < n do s := s + a * b; i := i + 1 end; while i > 0 do p(a * b; a); i := i - 1 end */
+  IMP_ASTArena *arena = imp_ast_arena_create();
+  const IMP_Symbol *a = imp_symbol_intern("a"), *b = imp_symbol_intern("b"), *i = imp_symbol_intern("i");
+  const IMP_Symbol *n = imp_symbol_intern("n"), *s = imp_symbol_intern("s"), *p = imp_symbol_intern("p");
+  const IMP_Symbol *v = imp_symbol_intern("v"), *r = imp_symbol_intern("r");
+  IMP_ASTNode *first_loop = imp_ast_while(arena,
+    imp_ast_rop(arena, IMP_AST_ROP_LT, imp_ast_var(arena, i), imp_ast_var(arena, n)),
+    imp_ast_seq(arena,
+      imp_ast_assign(arena, imp_ast_var(arena, s), imp_ast_aop(arena, IMP_AST_AOP_ADD, imp_ast_var(arena, s),
+        imp_ast_aop(arena, IMP_AST_AOP_MUL, imp_ast_var(arena, a), imp_ast_var(arena, b)))),
+      imp_ast_assign(arena, imp_ast_var(arena, i), imp_ast_aop(arena, IMP_AST_AOP_ADD, imp_ast_var(arena, i), imp_ast_int(arena, 1)))));
+  IMP_ASTNode *second_loop = imp_ast_while(arena,
+    imp_ast_rop(arena, IMP_AST_ROP_GT, imp_ast_var(arena, i), imp_ast_int(arena, 0)),
+    imp_ast_seq(arena,
+      imp_ast_proccall(arena, p,
+        imp_ast_list(arena, imp_ast_aop(arena, IMP_AST_AOP_MUL, imp_ast_var(arena, a), imp_ast_var(arena, b)), NULL),
+        imp_ast_list(arena, imp_ast_var(arena, a), NULL)),
+      imp_ast_assign(arena, imp_ast_var(arena, i), imp_ast_aop(arena, IMP_AST_AOP_SUB, imp_ast_var(arena, i), imp_ast_int(arena, 1)))));
+  IMP_ASTNode *stmts[] = {
+    imp_ast_procdecl(arena, p, imp_ast_list(arena, imp_ast_var(arena, v), NULL), imp_ast_list(arena, imp_ast_var(arena, r), NULL),
+      imp_ast_assign(arena, imp_ast_var(arena, r), imp_ast_aop(arena, IMP_AST_AOP_ADD, imp_ast_var(arena, v), imp_ast_int(arena, 1)))),
+    imp_ast_assign(arena, imp_ast_var(arena, i), imp_ast_int(arena, 0)),
+    first_loop,
+    second_loop,
+  };
+  IMP_ASTNode *main = imp_ast_block(arena, stmts, 4);
+  IMP_OptimizerStats stats;
+  main = imp_optimizer_optimize(NULL, main, arena, NULL, &stats);
+  /* a * b is invariant in the first loop, but not in the second, which writes a through p. */
+  assert(stats.hoisted == 1);
+  assert(main->data.block.stmts[2]->type == IMP_AST_NT_LET);
+  assert(main->data.block.stmts[2]->data.let_stmt.body_stmt == first_loop);
+  assert(main->data.block.stmts[3] == second_loop);
+
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  imp_interpreter_context_var_set(context, a, 3);
+  imp_interpreter_context_var_set(context, b, 4);
+  imp_interpreter_context_var_set(context, n, 5);
+  int result = imp_resolver_resolve(context, main);
+  assert(result == 0);
+  result = imp_interpreter_interpret_ast(context, main);
+  assert(result == 0);
+  assert(imp_interpreter_context_var_get(context, s) == 60);
+  assert(imp_interpreter_context_var_get(context, a) == 3413);
+  imp_interpreter_context_destroy(context);
+  imp_ast_arena_destroy(arena);
+
+  IMP_OptimizerOptions optimizer = imp_optimizer_default_options;
+  optimizer.licm = 0;
+  arena = imp_ast_arena_create();
+  main = imp_ast_while(arena,
+    imp_ast_rop(arena, IMP_AST_ROP_LT, imp_ast_var(arena, i), imp_ast_aop(arena, IMP_AST_AOP_MUL, imp_ast_var(arena, a), imp_ast_var(arena, b))),
+    imp_ast_assign(arena, imp_ast_var(arena, i), imp_ast_aop(arena, IMP_AST_AOP_ADD, imp_ast_var(arena, i), imp_ast_int(arena, 1))));
+  assert(imp_optimizer_optimize(NULL, main, arena, &optimizer, &stats) == main);
+  assert(stats.hoisted == 0);
+  imp_ast_arena_destroy(arena);
+}
+
+static void test_cse(void) {
+  /* x := (a * b) + (a * b) - c; y := a * b; a := a + 1; z := a * b */
+  IMP_ASTArena *arena = imp_ast_arena_create();
+  const IMP_Symbol *a = imp_symbol_intern("a"), *b = imp_symbol_intern("b"), *c = imp_symbol_intern("c");
+  const IMP_Symbol *x = imp_symbol_intern("x"), *y = imp_symbol_intern("y"), *z = imp_symbol_intern("z");
+  IMP_ASTNode *stmts[] = {
+    imp_ast_assign(arena, imp_ast_var(arena, x), imp_ast_aop(arena, IMP_AST_AOP_SUB,
+      imp_ast_aop(arena, IMP_AST_AOP_ADD,
+        imp_ast_aop(arena, IMP_AST_AOP_MUL, imp_ast_var(arena, a), imp_ast_var(arena, b)),
+        imp_ast_aop(arena, IMP_AST_AOP_MUL, imp_ast_var(arena, a), imp_ast_var(arena, b))),
+      imp_ast_var(arena, c))),
+    imp_ast_assign(arena, imp_ast_var(arena, y), imp_ast_aop(arena, IMP_AST_AOP_MUL, imp_ast_var(arena, a), imp_ast_var(arena, b))),
+    imp_ast_assign(arena, imp_ast_var(arena, a), imp_ast_aop(arena, IMP_AST_AOP_ADD, imp_ast_var(arena, a), imp_ast_int(arena, 1))),
+    imp_ast_assign(arena, imp_ast_var(arena, z), imp_ast_aop(arena, IMP_AST_AOP_MUL, imp_ast_var(arena, a), imp_ast_var(arena, b))),
+  };
+  IMP_ASTNode *main = imp_ast_block(arena, stmts, 4);
+  IMP_OptimizerStats stats;
+  main = imp_optimizer_optimize(NULL, main, arena, NULL, &stats);
+  /* a * b is computed once for x and y, but again for z after a is assigned. */
+  assert(stats.cse_eliminated == 2);
+  assert(main->type == IMP_AST_NT_LET);
+  assert(stmts[1]->data.assign.aexpr->type == IMP_AST_NT_VAR);
+  assert(stmts[3]->data.assign.aexpr->type == IMP_AST_NT_AOP);
+
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  imp_interpreter_context_var_set(context, a, 3);
+  imp_interpreter_context_var_set(context, b, 4);
+  imp_interpreter_context_var_set(context, c, 5);
+  int result = imp_resolver_resolve(context, main);
+  assert(result == 0);
+  result = imp_interpreter_interpret_ast(context, main);
+  assert(result == 0);
+  assert(imp_interpreter_context_var_get(context, x) == 19);
+  assert(imp_interpreter_context_var_get(context, y) == 12);
+  assert(imp_interpreter_context_var_get(context, z) == 16);
+  imp_interpreter_context_destroy(context);
+  imp_ast_arena_destroy(arena);
+}
+
+static void test_inline(void) {
+  /* procedure sq(a; r) r := a * a; procedure rec(n; r) if n > 0 then rec(n - 1; r) else r := 5 end;
+   * sq(x + 1; y); sq(y; z); rec(3; w) */
+  const IMP_Symbol *sq = imp_symbol_intern("sq"), *rec = imp_symbol_intern("rec");
+  const IMP_Symbol *a = imp_symbol_intern("a"), *n = imp_symbol_intern("n"), *r = imp_symbol_intern("r");
+  const IMP_Symbol *x = imp_symbol_intern("x"), *y = imp_symbol_intern("y");
+  const IMP_Symbol *z = imp_symbol_intern("z"), *w = imp_symbol_intern("w");
+  for (int inline_size = 1; inline_size <= 40; inline_size += 39) {
+    IMP_ASTArena *arena = imp_ast_arena_create();
+    IMP_ASTNode *stmts[] = {
+      imp_ast_procdecl(arena, sq, imp_ast_list(arena, imp_ast_var(arena, a), NULL), imp_ast_list(arena, imp_ast_var(arena, r), NULL),
+        imp_ast_assign(arena, imp_ast_var(arena, r), imp_ast_aop(arena, IMP_AST_AOP_MUL, imp_ast_var(arena, a), imp_ast_var(arena, a)))),
+      imp_ast_procdecl(arena, rec, imp_ast_list(arena, imp_ast_var(arena, n), NULL), imp_ast_list(arena, imp_ast_var(arena, r), NULL),
+        imp_ast_if(arena, imp_ast_rop(arena, IMP_AST_ROP_GT, imp_ast_var(arena, n), imp_ast_int(arena, 0)),
+          imp_ast_proccall(arena, rec,
+            imp_ast_list(arena, imp_ast_aop(arena, IMP_AST_AOP_SUB, imp_ast_var(arena, n), imp_ast_int(arena, 1)), NULL),
+            imp_ast_list(arena, imp_ast_var(arena, r), NULL)),
+          imp_ast_assign(arena, imp_ast_var(arena, r), imp_ast_int(arena, 5)))),
+      imp_ast_proccall(arena, sq,
+        imp_ast_list(arena, imp_ast_aop(arena, IMP_AST_AOP_ADD, imp_ast_var(arena, x), imp_ast_int(arena, 1)), NULL),
+        imp_ast_list(arena, imp_ast_var(arena, y), NULL)),
+      imp_ast_proccall(arena, sq, imp_ast_list(arena, imp_ast_var(arena, y), NULL), imp_ast_list(arena, imp_ast_var(arena, z), NULL)),
+      imp_ast_proccall(arena, rec, imp_ast_list(arena, imp_ast_int(arena, 3), NULL), imp_ast_list(arena, imp_ast_var(arena, w), NULL)),
+    };
+    IMP_ASTNode *main = imp_ast_block(arena, stmts, 5);
+    IMP_OptimizerOptions optimizer = imp_optimizer_default_options;
+    optimizer.inline_size = inline_size;
+    optimizer.accumulate = 0;
+    IMP_OptimizerStats stats;
+    main = imp_optimizer_optimize(NULL, main, arena, &optimizer, &stats);
+    /* rec calls itself (not rewritten into a loop here), and sq exceeds an inline size of 1. */
+    assert(stats.inlined == (inline_size == 1 ? 0 : 2));
+    assert((main->data.block.stmts[2]->type == IMP_AST_NT_PROCCALL) == (inline_size == 1));
+    assert(main->data.block.stmts[4]->type == IMP_AST_NT_PROCCALL);
+
+    IMP_InterpreterContext *context = imp_interpreter_context_create();
+    imp_interpreter_context_var_set(context, x, 2);
+    int result = imp_resolver_resolve(context, main);
+    assert(result == 0);
+    result = imp_interpreter_interpret_ast(context, main);
+    assert(result == 0);
+    assert(imp_interpreter_context_var_get(context, y) == 9);
+    assert(imp_interpreter_context_var_get(context, z) == 81);
+    assert(imp_interpreter_context_var_get(context, w) == 5);
+    imp_interpreter_context_destroy(context);
+    imp_ast_arena_destroy(arena);
+  }
+
+  /* Procedures declared by earlier programs are inlined as well. */
+  IMP_DriverOptions options = imp_driver_default_options;
+  options.optimize = 1;
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  int result = imp_driver_interpret_str(context, "procedure inc(a;r) begin r := a + 1 end", &options);
+  assert(result == 0);
+  result = imp_driver_interpret_str(context, "x := 1; inc(x; x); inc(x; x)", &options);
+  assert(result == 0);
+  assert(imp_interpreter_context_var_get(context, x) == 3);
+  imp_interpreter_context_destroy(context);
+}
+
+static void test_ir(void) {
+  /* x := 2 * 3; while x < 100 do x := x + y end */
+  const IMP_Symbol *x = imp_symbol_intern("x"), *y = imp_symbol_intern("y");
+  IMP_ASTArena *arena = imp_ast_arena_create();
+  IMP_ASTNode *stmts[] = {
+    imp_ast_assign(arena, imp_ast_var(arena, x), imp_ast_aop(arena, IMP_AST_AOP_MUL, imp_ast_int(arena, 2), imp_ast_int(arena, 3))),
+    imp_ast_while(arena, imp_ast_rop(arena, IMP_AST_ROP_LT, imp_ast_var(arena, x), imp_ast_int(arena, 100)),
+      imp_ast_assign(arena, imp_ast_var(arena, x), imp_ast_aop(arena, IMP_AST_AOP_ADD, imp_ast_var(arena, x), imp_ast_var(arena, y)))),
+  };
+  IMP_ASTNode *main = imp_ast_block(arena, stmts, 2);
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  imp_interpreter_context_var_set(context, y, 7);
+  int result = imp_resolver_resolve(context, main);
+  assert(result == 0);
+
+  IMP_IRPassManager *passes = imp_ir_pass_manager_create_default();
+  IMP_IRProgram *program = imp_ir_build(main, passes);
+  IMP_IRFunction *function = imp_ir_program_main(program);
+  int phis = 0, consts = 0, muls = 0, stores = 0;
+  for (ptrdiff_t i = 0; i < arrlen(function->blocks); ++i) {
+    IMP_IRBlock *block = &function->blocks[i];
+    phis += (int)arrlen(block->phis);
+    for (ptrdiff_t j = 0; j < arrlen(block->instrs); ++j) {
+      consts += block->instrs[j].op == IMP_IR_CONST && block->instrs[j].imm == 6;
+      muls += block->instrs[j].op == IMP_IR_MUL;
+      stores += block->instrs[j].op == IMP_IR_STORE;
+    }
+  }
+  /* x flows around the loop through a phi, 2 * 3 is folded, and y is never stored as it never changes. */
+  assert(phis == 1 && consts == 1 && muls == 0 && stores == 1);
+  result = imp_interpreter_interpret_ir(context, program);
+  assert(result == 0);
+  assert(imp_interpreter_context_var_get(context, x) == 104);
+  assert(imp_interpreter_context_var_get(context, y) == 7);
+  imp_ir_destroy(program);
+  imp_ir_pass_manager_destroy(passes);
+  imp_interpreter_context_destroy(context);
+  imp_ast_arena_destroy(arena);
+
+  /* Procedures declared by earlier programs, and errors leaving the variables as they are. */
+  IMP_DriverOptions options = imp_driver_default_options;
+  options.engine = IMP_DRIVER_ENGINE_IR;
+  context = imp_interpreter_context_create();
+  result = imp_driver_interpret_str(context, "procedure inc(a;r) begin r := a + 1 end", &options);
+  assert(result == 0);
+  result = imp_driver_interpret_str(context, "x := 1; inc(x; x); inc(x; x); z := 5; undefined(x; x); z := 6", &options);
+  assert(result != 0);
+  assert(imp_interpreter_context_var_get(context, x) == 3);
+  assert(imp_interpreter_context_var_get(context, imp_symbol_intern("z")) == 5);
+  imp_interpreter_context_destroy(context);
+}
+
+static void test_specialize(void) {
+  /* procedure scale(a, b; r) r := a * b; scale(2, 3; x); scale(2, 3; y); scale(2, z; w) */
+  const IMP_Symbol *scale = imp_symbol_intern("scale");
+  const IMP_Symbol *a = imp_symbol_intern("a"), *b = imp_symbol_intern("b"), *r = imp_symbol_intern("r");
+  const IMP_Symbol *x = imp_symbol_intern("x"), *y = imp_symbol_intern("y");
+  const IMP_Symbol *z = imp_symbol_intern("z"), *w = imp_symbol_intern("w");
+  for (int budget = 1; budget <= 400; budget += 399) {
+    IMP_ASTArena *arena = imp_ast_arena_create();
+    IMP_ASTNode *stmts[] = {
+      imp_ast_procdecl(arena, scale, imp_ast_list(arena, imp_ast_var(arena, a), imp_ast_list(arena, imp_ast_var(arena, b), NULL)),
+        imp_ast_list(arena, imp_ast_var(arena, r), NULL),
+        imp_ast_assign(arena, imp_ast_var(arena, r), imp_ast_aop(arena, IMP_AST_AOP_MUL, imp_ast_var(arena, a), imp_ast_var(arena, b)))),
+      imp_ast_proccall(arena, scale, imp_ast_list(arena, imp_ast_int(arena, 2), imp_ast_list(arena, imp_ast_int(arena, 3), NULL)),
+        imp_ast_list(arena, imp_ast_var(arena, x), NULL)),
+      imp_ast_proccall(arena, scale, imp_ast_list(arena, imp_ast_int(arena, 2), imp_ast_list(arena, imp_ast_int(arena, 3), NULL)),
+        imp_ast_list(arena, imp_ast_var(arena, y), NULL)),
+      imp_ast_proccall(arena, scale, imp_ast_list(arena, imp_ast_int(arena, 2), imp_ast_list(arena, imp_ast_var(arena, z), NULL)),
+        imp_ast_list(arena, imp_ast_var(arena, w), NULL)),
+    };
+    IMP_ASTNode *main = imp_ast_block(arena, stmts, 4);
+    IMP_OptimizerOptions optimizer = imp_optimizer_default_options;
+    optimizer.inline_size = 0;
+    optimizer.specialize_budget = budget;
+    IMP_OptimizerStats stats;
+    main = imp_optimizer_optimize(NULL, main, arena, &optimizer, &stats);
+    /* The first two calls share a clone; the third gets one without b. */
+    assert(stats.specialized == (budget == 1 ? 0 : 3));
+    IMP_ASTNode *decls = main->data.block.stmts[0];
+    assert(budget == 1 ? decls->type == IMP_AST_NT_PROCDECL : decls->type == IMP_AST_NT_BLOCK && decls->data.block.len == 3);
+    assert(main->data.block.stmts[1]->data.proc_call.symbol == main->data.block.stmts[2]->data.proc_call.symbol);
+    assert((main->data.block.stmts[3]->data.proc_call.val_args->next == NULL) == (budget != 1));
+
+    IMP_InterpreterContext *context = imp_interpreter_context_create();
+    imp_interpreter_context_var_set(context, z, 5);
+    int result = imp_resolver_resolve(context, main);
+    assert(result == 0);
+    result = imp_interpreter_interpret_ast(context, main);
+    assert(result == 0);
+    assert(imp_interpreter_context_var_get(context, x) == 6);
+    assert(imp_interpreter_context_var_get(context, y) == 6);
+    assert(imp_interpreter_context_var_get(context, w) == 10);
+    imp_interpreter_context_destroy(context);
+    imp_ast_arena_destroy(arena);
+  }
+
+  /* Procedures declared by earlier programs are specialized as well, by every program. */
+  IMP_DriverOptions options = imp_driver_default_options;
+  options.optimize = 1;
+  options.optimizer.inline_size = 0;
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  int result = imp_driver_interpret_str(context, "procedure scale(a, b; r) begin r := a * b end", &options);
+  assert(result == 0);
+  result = imp_driver_interpret_str(context, "scale(2, 3; x)", &options);
+  assert(result == 0);
+  result = imp_driver_interpret_str(context, "scale(2, 3; y); scale(x, 3; z)", &options);
+  assert(result == 0);
+  assert(imp_interpreter_context_var_get(context, x) == 6);
+  assert(imp_interpreter_context_var_get(context, y) == 6);
+  assert(imp_interpreter_context_var_get(context, z) == 18);
+  imp_interpreter_context_destroy(context);
+}
+
+static void test_frame_stack(void) {
+  IMP_FrameStack *stack = imp_frame_stack_create();
+  size_t allocations = imp_frame_stack_allocations(stack);
+  int *a = imp_frame_stack_push(stack, 3);
+  a[2] = 7;
+  int *b = imp_frame_stack_push(stack, 100000);
+  assert(b[99999] == 0);
+  assert(a[2] == 7);
+  imp_frame_stack_pop(stack, b);
+  imp_frame_stack_pop(stack, a);
+  assert(imp_frame_stack_allocations(stack) == allocations + 1);
+  a = imp_frame_stack_push(stack, 3);
+  b = imp_frame_stack_push(stack, 100000);
+  assert(a[2] == 0);
+  imp_frame_stack_pop(stack, b);
+  imp_frame_stack_pop(stack, a);
+  assert(imp_frame_stack_allocations(stack) == allocations + 1);
+  imp_frame_stack_destroy(stack);
+
+  IMP_ASTNode *main = countdown_program(5000);
+  IMP_ASTNode *call = imp_ast_proccall(NULL, imp_symbol_intern("down"), imp_ast_list(NULL, imp_ast_int(NULL, 5000), NULL), imp_ast_list(NULL, imp_ast_var(NULL, imp_symbol_intern("s")), NULL));
+
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  IMP_FrameStack *frame_stack = imp_interpreter_context_frame_stack(context);
+  int result = imp_resolver_resolve(context, main);
+  assert(result == 0);
+  result = imp_resolver_resolve(context, call);
+  assert(result == 0);
+  result = imp_interpreter_interpret_ast(context, main);
+  assert(result == 0);
+  assert(imp_interpreter_context_var_get(context, imp_symbol_intern("r")) == 5000);
+  allocations = imp_frame_stack_allocations(frame_stack);
+  assert(allocations <= 4);
+  result = imp_interpreter_interpret_ast(context, call);
+  assert(result == 0);
+  assert(imp_interpreter_context_var_get(context, imp_symbol_intern("s")) == 5000);
+  assert(imp_frame_stack_allocations(frame_stack) == allocations);
+
+  IMP_BytecodeChunk *chunk = imp_bytecode_compile(context, call);
+  result = imp_vm_run(context, chunk);
+  assert(result == 0);
+  assert(imp_frame_stack_allocations(frame_stack) == allocations);
+  imp_bytecode_destroy(chunk);
+
+  imp_ast_destroy(main);
+  imp_ast_destroy(call);
+  imp_interpreter_context_destroy(context);
+}
+
+static void test_interpreter_iterative(void) {
+  IMP_ASTNode *main = countdown_program(1000000);
+
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  int result = imp_resolver_resolve(context, main);
+  assert(result == 0);
+  result = imp_interpreter_interpret_ast_iterative(context, main);
+  assert(result == 0);
+  assert(imp_interpreter_context_var_get(context, imp_symbol_intern("r")) == 1000000);
+  imp_interpreter_context_destroy(context);
+
+  context = imp_interpreter_context_create();
+  imp_interpreter_context_set_stack_limit(context, 64 * 1024);
+  result = imp_resolver_resolve(context, main);
+  assert(result == 0);
+  result = imp_interpreter_interpret_ast_iterative(context, main);
+  assert(result != 0);
+  assert(imp_interpreter_context_var_get(context, imp_symbol_intern("r")) == 0);
+  imp_interpreter_context_destroy(context);
+
+  imp_ast_destroy(main);
+}
+
+static void test_ast_arena(void) {
+  IMP_ASTArena *arena = imp_ast_arena_create();
+  assert(imp_ast_arena_bytes(arena) == 0);
+  IMP_ASTNode *main = imp_ast_seq(arena,
+    imp_ast_procdecl(arena, imp_symbol_intern("p"), imp_ast_list(arena, imp_ast_var(arena, imp_symbol_intern("a")), NULL), imp_ast_list(arena, imp_ast_var(arena, imp_symbol_intern("b")), NULL),
+      imp_ast_assign(arena, imp_ast_var(arena, imp_symbol_intern("b")), imp_ast_aop(arena, IMP_AST_AOP_MUL, imp_ast_var(arena, imp_symbol_intern("a")), imp_ast_int(arena, 7)))),
+    imp_ast_proccall(arena, imp_symbol_intern("p"), imp_ast_list(arena, imp_ast_int(arena, 6), NULL), imp_ast_list(arena, imp_ast_var(arena, imp_symbol_intern("x")), NULL))
+  );
+  assert(imp_ast_arena_bytes(arena) > 0);
+
+  IMP_ASTArena *clone_arena = imp_ast_arena_create();
+  IMP_ASTNode *clone = imp_ast_clone(main, clone_arena);
+  assert(imp_ast_arena_bytes(clone_arena) == imp_ast_arena_bytes(arena));
+  imp_ast_arena_destroy(arena);
+
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  int result = imp_resolver_resolve(context, clone);
+  assert(result == 0);
+  result = imp_interpreter_interpret_ast(context, clone);
+  assert(result == 0);
+  imp_ast_arena_destroy(clone_arena);
+  assert(imp_interpreter_context_var_get(context, imp_symbol_intern("x")) == 42);
+  assert(imp_interpreter_context_proc_get(context, imp_symbol_intern("p")) != NULL);
+  imp_interpreter_context_destroy(context);
+}
+
+static void test_flat_ast(void) {
+  IMP_ASTNode *main = factorial_program();
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  int result = imp_resolver_resolve(context, main);
+  assert(result == 0);
+  IMP_FlatAST *flat = imp_flat_ast_from_ast(main, context);
+  assert(flat->nodes[flat->root].type == IMP_AST_NT_SEQ);
+  assert(flat->decls_len == 1 && flat->predeclared == 1);
+
+  IMP_ASTArena *arena = imp_ast_arena_create();
+  IMP_ASTNode *round_trip = imp_flat_ast_to_ast(flat, flat->root, arena);
+  IMP_ASTArena *clone_arena = imp_ast_arena_create();
+  imp_ast_clone(main, clone_arena);
+  assert(imp_ast_arena_bytes(arena) == imp_ast_arena_bytes(clone_arena));
+  imp_ast_arena_destroy(clone_arena);
+
+  result = imp_flat_ast_interpret(context, flat);
+  assert(result == 0);
+  assert(imp_interpreter_context_var_get(context, imp_symbol_intern("r")) == 120);
+  imp_flat_ast_destroy(flat);
+  imp_interpreter_context_destroy(context);
+
+  context = imp_interpreter_context_create();
+  result = imp_resolver_resolve(context, round_trip);
+  assert(result == 0);
+  result = imp_interpreter_interpret_ast(context, round_trip);
+  assert(result == 0);
+  assert(imp_interpreter_context_var_get(context, imp_symbol_intern("r")) == 120);
+  imp_interpreter_context_destroy(context);
+  imp_ast_arena_destroy(arena);
+  imp_ast_destroy(main);
+}
+
+static void test_block(void) {
+  enum { LEN = 200000 };
+  static IMP_ASTNode *stmts[LEN];
+  for (int i = 0; i < LEN; ++i) {
+    stmts[i] = imp_ast_assign(NULL, imp_ast_var(NULL, imp_symbol_intern("x")),
+      imp_ast_aop(NULL, IMP_AST_AOP_ADD, imp_ast_var(NULL, imp_symbol_intern("x")), imp_ast_int(NULL, 1)));
+  }
+  IMP_ASTNode *main = imp_ast_block(NULL, stmts, LEN);
+  IMP_ASTNode *clone = imp_ast_clone(main, NULL);
+  imp_ast_destroy(main);
+  assert(clone->type == IMP_AST_NT_BLOCK && clone->data.block.len == LEN);
+
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  int result = imp_resolver_resolve(context, clone);
+  assert(result == 0);
+  result = imp_interpreter_interpret_ast(context, clone);
+  assert(result == 0);
+  result = imp_interpreter_interpret_ast_iterative(context, clone);
+  assert(result == 0);
+  IMP_BytecodeChunk *chunk = imp_bytecode_compile(context, clone);
+  result = imp_vm_run(context, chunk);
+  assert(result == 0);
+  imp_bytecode_destroy(chunk);
+  assert(imp_interpreter_context_var_get(context, imp_symbol_intern("x")) == 3 * LEN);
+
+  imp_ast_destroy(clone);
+  imp_interpreter_context_destroy(context);
+}
+
+static void test_resolver(void) {
+  IMP_ASTNode *x_outer = imp_ast_var(NULL, imp_symbol_intern("x"));
+  IMP_ASTNode *x_let = imp_ast_var(NULL, imp_symbol_intern("x"));
+  IMP_ASTNode *x_inner = imp_ast_var(NULL, imp_symbol_intern("x"));
+  IMP_ASTNode *y = imp_ast_var(NULL, imp_symbol_intern("y"));
+  IMP_ASTNode *main = imp_ast_seq(NULL, 
+    imp_ast_assign(NULL, x_outer, imp_ast_int(NULL, 1)),
+    imp_ast_let(NULL, 
+      x_let, imp_ast_int(NULL, 2),
+      imp_ast_assign(NULL, y, imp_ast_aop(NULL, IMP_AST_AOP_ADD, x_inner, imp_ast_int(NULL, 40)))
+    )
+  );
+
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  int result = imp_resolver_resolve(context, main);
+  assert(result == 0);
+  assert(x_outer->data.variable.slot == imp_interpreter_context_var_slot(context, imp_symbol_intern("x")));
+  assert(y->data.variable.slot == imp_interpreter_context_var_slot(context, imp_symbol_intern("y")));
+  assert(x_let->data.variable.slot == x_inner->data.variable.slot);
+  assert(x_let->data.variable.slot != x_outer->data.variable.slot);
+  assert(imp_interpreter_context_frame_size(context) == 3);
+
+  result = imp_interpreter_interpret_ast(context, main);
+  assert(result == 0);
+  assert(imp_interpreter_context_var_get(context, imp_symbol_intern("x")) == 1);
+  assert(imp_interpreter_context_var_get(context, imp_symbol_intern("y")) == 42);
+
+  imp_ast_destroy(main);
+  imp_interpreter_context_destroy(context);
+}
+
+static void test_scalar_evolution(void) {
+  /* i := 0; s := 0; while i < n do i := i + 1; s := s + i end */
+  const IMP_Symbol *i = imp_symbol_intern("i"), *s = imp_symbol_intern("s"), *n = imp_symbol_intern("n");
+  IMP_ASTArena *arena = imp_ast_arena_create();
+  IMP_ASTNode *body[] = {
+    imp_ast_assign(arena, imp_ast_var(arena, i), imp_ast_aop(arena, IMP_AST_AOP_ADD, imp_ast_var(arena, i), imp_ast_int(arena, 1))),
+    imp_ast_assign(arena, imp_ast_var(arena, s), imp_ast_aop(arena, IMP_AST_AOP_ADD, imp_ast_var(arena, s), imp_ast_var(arena, i))),
+  };
+  IMP_ASTNode *stmts[] = {
+    imp_ast_assign(arena, imp_ast_var(arena, i), imp_ast_int(arena, 0)),
+    imp_ast_assign(arena, imp_ast_var(arena, s), imp_ast_int(arena, 0)),
+    imp_ast_while(arena, imp_ast_rop(arena, IMP_AST_ROP_LT, imp_ast_var(arena, i), imp_ast_var(arena, n)), imp_ast_block(arena, body, 2)),
+  };
+  IMP_ASTNode *main = imp_ast_block(arena, stmts, 3);
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  int result = imp_resolver_resolve(context, main);
+  assert(result == 0);
+
+  IMP_IRPassManager *passes = imp_ir_pass_manager_create_default();
+  IMP_IRProgram *program = imp_ir_build(main, passes);
+  IMP_IRFunction *function = imp_ir_program_main(program);
+  int divus = 0;
+  for (ptrdiff_t j = 0; j < arrlen(function->blocks); ++j) {
+    for (ptrdiff_t k = 0; k < arrlen(function->blocks[j].instrs); ++k) divus += function->blocks[j].instrs[k].op == IMP_IR_DIVU;
+  }
+  /* The sum is computed in closed form, halving the product of the trip count and its successor. */
+  assert(divus == 1);
+  int inputs[] = { -5, 0, 1, 10, 100000 }, expected[] = { 0, 0, 1, 55, 705082704 };
+  for (int j = 0; j < 5; ++j) {
+    imp_interpreter_context_var_set(context, n, inputs[j]);
+    result = imp_interpreter_interpret_ir(context, program);
+    assert(result == 0);
+    assert(imp_interpreter_context_var_get(context, i) == (inputs[j] > 0 ? inputs[j] : 0));
+    /* The sum up to 100000 wraps around, exactly as the loop would. */
+    assert(imp_interpreter_context_var_get(context, s) == expected[j]);
+  }
+  imp_ir_destroy(program);
+  imp_ir_pass_manager_destroy(passes);
+  imp_interpreter_context_destroy(context);
+  imp_ast_arena_destroy(arena);
+
+  /* Remainders, counted decrements, and loops left alone, agree with the ast engine. */
+  const char *programs[] = {
+    "q := 100; b := 7; while q >= b do q := q - b end",
+    "q := 100; b := 0 - 7; c := 0; while q >= b and c < 5 do q := q - b; c := c + 1 end",
+    "k := 10; x := 1; while k # 0 do k := k - 1; x := x + 3; y := x * 2 end",
+    "k := 2147483640; t := 0; while k <= 2147483647 - 3 do k := k + 2; t := t - 1 end",
+    "k := 0 - 2147483647; while k > 0 - 2147483647 - 1 do k := k - 1 end",
+  };
+  const IMP_Symbol *vars[] = { imp_symbol_intern("q"), imp_symbol_intern("c"), imp_symbol_intern("k"),
+                               imp_symbol_intern("x"), imp_symbol_intern("y"), imp_symbol_intern("t") };
+  for (int j = 0; j < 5; ++j) {
+    IMP_InterpreterContext *contexts[2];
+    for (int engine = 0; engine < 2; ++engine) {
+      IMP_DriverOptions options = imp_driver_default_options;
+      options.engine = engine ? IMP_DRIVER_ENGINE_IR : IMP_DRIVER_ENGINE_AST;
+      contexts[engine] = imp_interpreter_context_create();
+      result = imp_driver_interpret_str(contexts[engine], programs[j], &options);
+      assert(result == 0);
+    }
+    for (int k = 0; k < 6; ++k) {
+      assert(imp_interpreter_context_var_get(contexts[0], vars[k]) == imp_interpreter_context_var_get(contexts[1], vars[k]));
+    }
+    imp_interpreter_context_destroy(contexts[0]);
+    imp_interpreter_context_destroy(contexts[1]);
+  }
+}
+
+static void test_accumulate(void) {
+  /* procedure factorial(n; r) if n <= 0 then r := 1 else m := n - 1; factorial(m; r); r := r * n end; factorial(10; x) */
+  const IMP_Symbol *factorial = imp_symbol_intern("factorial");
+  const IMP_Symbol *n = imp_symbol_intern("n"), *m = imp_symbol_intern("m"), *r = imp_symbol_intern("r");
+  const IMP_Symbol *x = imp_symbol_intern("x"), *y = imp_symbol_intern("y");
+  IMP_ASTArena *arena = imp_ast_arena_create();
+  IMP_ASTNode *recurse[] = {
+    imp_ast_assign(arena, imp_ast_var(arena, m), imp_ast_aop(arena, IMP_AST_AOP_SUB, imp_ast_var(arena, n), imp_ast_int(arena, 1))),
+    imp_ast_proccall(arena, factorial, imp_ast_list(arena, imp_ast_var(arena, m), NULL), imp_ast_list(arena, imp_ast_var(arena, r), NULL)),
+    imp_ast_assign(arena, imp_ast_var(arena, r), imp_ast_aop(arena, IMP_AST_AOP_MUL, imp_ast_var(arena, r), imp_ast_var(arena, n))),
+  };
+  IMP_ASTNode *stmts[] = {
+    imp_ast_procdecl(arena, factorial, imp_ast_list(arena, imp_ast_var(arena, n), NULL), imp_ast_list(arena, imp_ast_var(arena, r), NULL),
+      imp_ast_if(arena, imp_ast_rop(arena, IMP_AST_ROP_LE, imp_ast_var(arena, n), imp_ast_int(arena, 0)),
+        imp_ast_assign(arena, imp_ast_var(arena, r), imp_ast_int(arena, 1)),
+        imp_ast_block(arena, recurse, 3))),
+    imp_ast_proccall(arena, factorial, imp_ast_list(arena, imp_ast_int(arena, 10), NULL), imp_ast_list(arena, imp_ast_var(arena, x), NULL)),
+  };
+  IMP_ASTNode *main = imp_ast_block(arena, stmts, 2);
+  IMP_OptimizerOptions optimizer = imp_optimizer_default_options;
+  optimizer.inline_size = 0;
+  optimizer.specialize_budget = 0;
+  IMP_OptimizerStats stats;
+  main = imp_optimizer_optimize(NULL, main, arena, &optimizer, &stats);
+  assert(stats.accumulated == 1 && stats.accumulated_procs[0] == factorial);
+  imp_optimizer_stats_free(&stats);
+  /* The product is accumulated in a let-bound temporary around the loop. */
+  const IMP_ASTNode *body = main->data.block.stmts[0]->data.proc_decl.body_stmt;
+  assert(body->type == IMP_AST_NT_LET && body->data.let_stmt.body_stmt->data.block.stmts[0]->type == IMP_AST_NT_WHILE);
+
+  IMP_InterpreterContext *context = imp_interpreter_context_create();
+  int result = imp_resolver_resolve(context, main);
+  assert(result == 0);
+  result = imp_interpreter_interpret_ast(context, main);
+  assert(result == 0);
+  assert(imp_interpreter_context_var_get(context, x) == 3628800);
+  imp_interpreter_context_destroy(context);
+  imp_ast_arena_destroy(arena);
+
+  /* Recursion deeper than the stack allows runs as a loop, adding the terms in any order. */
+  const char *program = "procedure sum(n; r) begin if n = 0 then r := 0 else sum(n - 1; r); r := n + r end end; sum(100000; y)";
+  for (int optimize = 0; optimize <= 1; ++optimize) {
+    IMP_DriverOptions options = imp_driver_default_options;
+    options.stack_limit = 64 * 1024;
+    options.optimize = optimize;
+    context = imp_interpreter_context_create();
+    result = imp_driver_interpret_str(context, program, &options);
+    assert((result == 0) == optimize);
+    if (optimize) assert(imp_interpreter_context_var_get(context, y) == 705082704);
+    imp_interpreter_context_destroy(context);
+  }
+}
+
 int main(void) {
   printf("Starting tests...\n");
+  test_symbol();
   test_interpreter_context();
+  test_dense_vars();
   test_interpreter();
+  test_proc_table_shared();
+  test_resolver();
+  test_quickening();
+  test_vm();
+  test_superinstructions();
+  test_frame_stack();
+  test_jit();
+  test_trace();
+  test_closure();
+  test_optimizer();
+  test_dead_code();
+  test_licm();
+  test_cse();
+  test_inline();
+  test_ir();
+  test_specialize();
+  test_scalar_evolution();
+  test_accumulate();
+  test_interpreter_iterative();
+  test_ast_arena();
+  test_flat_ast();
+  test_block();
   printf("All tests passed\n");
 }
\ No newline at end of file